@@ -8,13 +8,82 @@
 
 #import <Foundation/Foundation.h>
 
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Highest "schema_version" of the config dictionary this SDK understands.
+ *
+ *  Fields are only ever added within a version, readers ignore keys they don't know and keep the
+ *  default for missing ones. The version is bumped for incompatible changes only, configs with a
+ *  newer version are rejected so an old SDK never misreads them.
+ */
+FOUNDATION_EXPORT NSInteger const PRESConfigSchemaVersion;
+
 @interface PRESConfig : NSObject
 
 @property(nonatomic, strong, class, readonly) PRESConfig *defaultConfig;
+
+/**
+ *  Schema version of the dictionary the config was created from, 1 for configs without "schema_version"
+ */
+@property(nonatomic, assign) NSInteger schemaVersion;
+
 @property(nonatomic, assign) BOOL httpMonitorEnabled;
 @property(nonatomic, assign) BOOL crashReportEnabled;
 @property(nonatomic, assign) BOOL telemetryEnabled;
 
-+ (instancetype)configWithDic:(NSDictionary *)dic;
+/**
+ *  Bounds for the adaptive telemetry batching, see PRESBatchingPolicy
+ */
+@property(nonatomic, assign) NSUInteger telemetryMinBatchSize;
+@property(nonatomic, assign) NSUInteger telemetryMaxBatchSize;
+@property(nonatomic, assign) NSTimeInterval telemetryMinBatchInterval;
+@property(nonatomic, assign) NSTimeInterval telemetryMaxBatchInterval;
+@property(nonatomic, assign) NSUInteger telemetryTargetBundleBytes;
+
+/**
+ *  Size limit of the compressed file for telemetry arriving while the channel is blocked, 0 disables spilling
+ */
+@property(nonatomic, assign) NSUInteger telemetryOverflowSpillBytes;
+
+/**
+ *  Max number of concurrent telemetry uploads and of bundles kept on disk
+ */
+@property(nonatomic, assign) NSUInteger telemetryRequestLimit;
+@property(nonatomic, assign) NSUInteger telemetryMaxFileCount;
+
+/**
+ *  Fraction of sessions which send normal priority telemetry, decided once per session
+ */
+@property(nonatomic, assign) double telemetrySampleRate;
+
+/**
+ *  Whether the SDK reports its own counters and latencies (PRESStats) as an hourly event
+ */
+@property(nonatomic, assign) BOOL telemetrySelfStatsEnabled;
+
+/**
+ *  Whether telemetry, HTTP monitor logs and crash reports are sent multiplexed through PRESBatchUploader,
+ *  only for servers which understand the batch envelope
+ */
+@property(nonatomic, assign) BOOL batchUploadEnabled;
+
+/**
+ *  Size of one HTTP monitor log file, number of log files in the ring and the upload interval
+ */
+@property(nonatomic, assign) NSUInteger httpMonitorMaxLogLength;
+@property(nonatomic, assign) NSUInteger httpMonitorMaxLogIndex;
+@property(nonatomic, assign) NSTimeInterval httpMonitorSendInterval;
+
+/**
+ *  Creates a config from the dictionary sent by the server. Values of the wrong type fall back to
+ *  the default, values out of range are clamped.
+ *
+ *  @return nil if the dictionary has a schema version newer than PRESConfigSchemaVersion
+ */
++ (nullable instancetype)configWithDic:(NSDictionary *)dic;
 
 @end
+
+NS_ASSUME_NONNULL_END
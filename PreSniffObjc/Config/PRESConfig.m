@@ -7,9 +7,79 @@
 //
 
 #import "PRESConfig.h"
+#import "PRESPrivate.h"
+
+NSInteger const PRESConfigSchemaVersion = 2;
+
+static NSUInteger const PRESDefaultTelemetryMinBatchSize = 5;
+static NSUInteger const PRESDefaultTelemetryMaxBatchSize = 100;
+static NSTimeInterval const PRESDefaultTelemetryMinBatchInterval = 3;
+static NSTimeInterval const PRESDefaultTelemetryMaxBatchInterval = 30;
+static NSUInteger const PRESDefaultTelemetryTargetBundleBytes = 64 * 1024;
+static NSUInteger const PRESDefaultTelemetryRequestLimit = 10;
+static NSUInteger const PRESDefaultTelemetryMaxFileCount = 50;
+static double const PRESDefaultTelemetrySampleRate = 1;
+static NSUInteger const PRESDefaultHTTPMonitorMaxLogLength = 64 * 1024;
+static NSUInteger const PRESDefaultHTTPMonitorMaxLogIndex = 100;
+static NSTimeInterval const PRESDefaultHTTPMonitorSendInterval = 10;
+
+typedef NS_ENUM(NSInteger, PRESConfigFieldType) {
+    PRESConfigFieldTypeBool,
+    PRESConfigFieldTypeUnsignedInteger,
+    PRESConfigFieldTypeDouble
+};
+
+typedef struct {
+    __unsafe_unretained NSString *key;
+    __unsafe_unretained NSString *property;
+    PRESConfigFieldType type;
+    double minValue;
+    double maxValue;
+} PRESConfigField;
+
+/**
+ *  The schema, every dictionary key with the property it sets, its type and the accepted range.
+ */
+static const PRESConfigField PRESConfigFields[] = {
+    {@"http_monitor_enabled", @"httpMonitorEnabled", PRESConfigFieldTypeBool, 0, 1},
+    {@"crash_report_enabled", @"crashReportEnabled", PRESConfigFieldTypeBool, 0, 1},
+    {@"telemetry_enabled", @"telemetryEnabled", PRESConfigFieldTypeBool, 0, 1},
+    {@"telemetry_min_batch_size", @"telemetryMinBatchSize", PRESConfigFieldTypeUnsignedInteger, 1, 1000},
+    {@"telemetry_max_batch_size", @"telemetryMaxBatchSize", PRESConfigFieldTypeUnsignedInteger, 1, 1000},
+    {@"telemetry_min_batch_interval", @"telemetryMinBatchInterval", PRESConfigFieldTypeDouble, 0.1, 3600},
+    {@"telemetry_max_batch_interval", @"telemetryMaxBatchInterval", PRESConfigFieldTypeDouble, 0.1, 3600},
+    {@"telemetry_target_bundle_bytes", @"telemetryTargetBundleBytes", PRESConfigFieldTypeUnsignedInteger, 1024, 4 * 1024 * 1024},
+    {@"telemetry_overflow_spill_bytes", @"telemetryOverflowSpillBytes", PRESConfigFieldTypeUnsignedInteger, 0, 64 * 1024 * 1024},
+    {@"telemetry_request_limit", @"telemetryRequestLimit", PRESConfigFieldTypeUnsignedInteger, 1, 50},
+    {@"telemetry_max_file_count", @"telemetryMaxFileCount", PRESConfigFieldTypeUnsignedInteger, 1, 1000},
+    {@"telemetry_sample_rate", @"telemetrySampleRate", PRESConfigFieldTypeDouble, 0, 1},
+    {@"telemetry_self_stats_enabled", @"telemetrySelfStatsEnabled", PRESConfigFieldTypeBool, 0, 1},
+    {@"batch_upload_enabled", @"batchUploadEnabled", PRESConfigFieldTypeBool, 0, 1},
+    {@"http_monitor_max_log_length", @"httpMonitorMaxLogLength", PRESConfigFieldTypeUnsignedInteger, 1024, 1024 * 1024},
+    {@"http_monitor_max_log_index", @"httpMonitorMaxLogIndex", PRESConfigFieldTypeUnsignedInteger, 2, 1000},
+    {@"http_monitor_send_interval", @"httpMonitorSendInterval", PRESConfigFieldTypeDouble, 1, 3600},
+};
 
 @implementation PRESConfig
 
+- (instancetype)init {
+    if (self = [super init]) {
+        _schemaVersion = 1;
+        _telemetryMinBatchSize = PRESDefaultTelemetryMinBatchSize;
+        _telemetryMaxBatchSize = PRESDefaultTelemetryMaxBatchSize;
+        _telemetryMinBatchInterval = PRESDefaultTelemetryMinBatchInterval;
+        _telemetryMaxBatchInterval = PRESDefaultTelemetryMaxBatchInterval;
+        _telemetryTargetBundleBytes = PRESDefaultTelemetryTargetBundleBytes;
+        _telemetryRequestLimit = PRESDefaultTelemetryRequestLimit;
+        _telemetryMaxFileCount = PRESDefaultTelemetryMaxFileCount;
+        _telemetrySampleRate = PRESDefaultTelemetrySampleRate;
+        _httpMonitorMaxLogLength = PRESDefaultHTTPMonitorMaxLogLength;
+        _httpMonitorMaxLogIndex = PRESDefaultHTTPMonitorMaxLogIndex;
+        _httpMonitorSendInterval = PRESDefaultHTTPMonitorSendInterval;
+    }
+    return self;
+}
+
 + (PRESConfig *)defaultConfig {
     PRESConfig *config = [PRESConfig new];
     config.httpMonitorEnabled = YES;
@@ -19,11 +89,74 @@
 }
 
 + (instancetype)configWithDic:(NSDictionary *)dic {
+    NSInteger schemaVersion = 1;
+    id version = [dic objectForKey:@"schema_version"];
+    if ([version isKindOfClass:[NSNumber class]] || [version isKindOfClass:[NSString class]]) {
+        schemaVersion = MAX([version integerValue], 1);
+    }
+    if (schemaVersion > PRESConfigSchemaVersion) {
+        PRESLogWarning(@"WARNING: Ignoring config with schema version %ld, supported up to %ld", (long)schemaVersion, (long)PRESConfigSchemaVersion);
+        return nil;
+    }
+
     PRESConfig *config = [PRESConfig new];
-    config.httpMonitorEnabled = [[dic objectForKey:@"http_monitor_enabled"] boolValue];
-    config.crashReportEnabled = [[dic objectForKey:@"crash_report_enabled"] boolValue];
-    config.telemetryEnabled = [[dic objectForKey:@"telemetry_enabled"] boolValue];
+    config.schemaVersion = schemaVersion;
+    for (size_t i = 0; i < sizeof(PRESConfigFields) / sizeof(PRESConfigFields[0]); i++) {
+        [config applyField:PRESConfigFields[i] value:[dic objectForKey:PRESConfigFields[i].key]];
+    }
+
+    // the bounds are only usable as pairs
+    PRESConfig *defaults = [PRESConfig new];
+    if (config.telemetryMinBatchSize > config.telemetryMaxBatchSize) {
+        config.telemetryMinBatchSize = defaults.telemetryMinBatchSize;
+        config.telemetryMaxBatchSize = defaults.telemetryMaxBatchSize;
+    }
+    if (config.telemetryMinBatchInterval > config.telemetryMaxBatchInterval) {
+        config.telemetryMinBatchInterval = defaults.telemetryMinBatchInterval;
+        config.telemetryMaxBatchInterval = defaults.telemetryMaxBatchInterval;
+    }
     return config;
 }
 
+- (void)applyField:(PRESConfigField)field value:(id)value {
+    if (!value) return;
+
+    BOOL isNumber = [value isKindOfClass:[NSNumber class]];
+    if (!isNumber && ![value isKindOfClass:[NSString class]]) {
+        PRESLogWarning(@"WARNING: Config value for %@ has the wrong type", field.key);
+        return;
+    }
+    if (!isNumber) {
+        // numbers sent as strings are accepted, anything else keeps the default
+        NSScanner *scanner = [NSScanner scannerWithString:value];
+        double scanned;
+        BOOL isBoolString = [value isEqualToString:@"true"] || [value isEqualToString:@"false"];
+        if (!isBoolString && !([scanner scanDouble:&scanned] && scanner.isAtEnd)) {
+            PRESLogWarning(@"WARNING: Config value for %@ is not a number", field.key);
+            return;
+        }
+    }
+
+    double number = [value doubleValue];
+    if ([value isKindOfClass:[NSString class]] && [value isEqualToString:@"true"]) {
+        number = 1;
+    }
+    if (number < field.minValue || number > field.maxValue) {
+        PRESLogWarning(@"WARNING: Config value %@ for %@ is out of range, clamping it", value, field.key);
+        number = MIN(MAX(number, field.minValue), field.maxValue);
+    }
+
+    switch (field.type) {
+        case PRESConfigFieldTypeBool:
+            [self setValue:@(number != 0) forKey:field.property];
+            break;
+        case PRESConfigFieldTypeUnsignedInteger:
+            [self setValue:@((NSUInteger)number) forKey:field.property];
+            break;
+        case PRESConfigFieldTypeDouble:
+            [self setValue:@(number) forKey:field.property];
+            break;
+    }
+}
+
 @end
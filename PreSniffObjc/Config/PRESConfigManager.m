@@ -7,13 +7,60 @@
 //
 
 #import "PRESConfigManager.h"
+#import "PRESBackoffPolicy.h"
+#import "PRESBinaryRecord.h"
+#import "PRESHelper.h"
+#import "PRESTransport.h"
+#import "PRESPrivate.h"
+#import "PreSniffObjc.h"
 
 #define PRESConfigServerDomain  @"http://localhost:8080"
 
+static char const *kPRESConfigQueueString = "com.presniff.config";
+
+static NSString *const kPRESLegacyConfigDefaultsKey = @"presniff_app_config";
+static NSString *const kPRESConfigDirectoryName = @"Config";
+static NSString *const kPRESConfigFileName = @"app_config.record";
+static NSString *const kPRESConfigBackoffFileName = @"config.backoff";
+static uint8_t const PRESConfigRecordVersion = 1;
+
+// Record fields, the config itself is kept as the raw JSON body of the response
+static NSString *const kPRESConfigRecordAppKey = @"app_key";
+static NSString *const kPRESConfigRecordBody = @"body";
+static NSString *const kPRESConfigRecordETag = @"etag";
+static NSString *const kPRESConfigRecordLastModified = @"last_modified";
+static NSString *const kPRESConfigRecordExpiresAt = @"expires_at";
+
+// Used when the server does not send Cache-Control max-age
+static NSTimeInterval const PRESConfigDefaultTTL = 60 * 60;
+static NSTimeInterval const PRESConfigMinTTL = 60;
+static NSTimeInterval const PRESConfigMaxTTL = 7 * 24 * 60 * 60;
+
+/**
+ *  @returns the max-age of a Cache-Control header value, -1 if there is none
+ */
+static NSTimeInterval pres_maxAgeFromCacheControl(NSString *cacheControl) {
+    for (NSString *directive in [cacheControl componentsSeparatedByString:@","]) {
+        NSString *trimmed = [directive stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if ([trimmed.lowercaseString hasPrefix:@"max-age="]) {
+            NSInteger maxAge = [[trimmed substringFromIndex:8] integerValue];
+            return maxAge >= 0 ? maxAge : -1;
+        }
+    }
+    return -1;
+}
+
 @interface PRESConfigManager ()
-<
-NSURLSessionDelegate
->
+
+@property (nonatomic, strong) dispatch_queue_t configQueue;
+@property (nonatomic, strong) PRESBackoffPolicy *backoffPolicy;
+@property (nonatomic, strong) id<NSObject> networkDidBecomeReachableObserver;
+
+// Only accessed on configQueue
+@property (nonatomic, copy) NSString *appKey;
+@property (nonatomic, copy) NSDictionary<NSString *, NSString *> *record;
+@property (nonatomic, assign) BOOL fetchInFlight;
+@property (nonatomic, assign) BOOL fetchScheduled;
 
 @end
 
@@ -28,45 +75,219 @@ NSURLSessionDelegate
     return config;
 }
 
+- (instancetype)init {
+    if ((self = [super init])) {
+        _configQueue = dispatch_queue_create(kPRESConfigQueueString, DISPATCH_QUEUE_SERIAL);
+        _backoffPolicy = [[PRESBackoffPolicy alloc] initWithFilePath:[pres_settingsSubdir(kPRESConfigDirectoryName) stringByAppendingPathComponent:kPRESConfigBackoffFileName]];
+
+        __weak typeof(self) weakSelf = self;
+        _networkDidBecomeReachableObserver = [[NSNotificationCenter defaultCenter] addObserverForName:PRESNetworkDidBecomeReachableNotification
+                                                                                               object:nil
+                                                                                                queue:nil
+                                                                                           usingBlock:^(NSNotification *note) {
+                                                                                               typeof(self) strongSelf = weakSelf;
+                                                                                               if (!strongSelf) return;
+                                                                                               dispatch_async(strongSelf.configQueue, ^{
+                                                                                                   [strongSelf fetchIfNeeded];
+                                                                                               });
+                                                                                           }];
+    }
+    return self;
+}
+
 - (PRESConfig *)getConfigWithAppKey:(NSString *)appKey {
-    PRESConfig *defaultConfig;
-    NSDictionary *dic = [NSUserDefaults.standardUserDefaults objectForKey:@"presniff_app_config"];
-    if (dic && [dic respondsToSelector:@selector(objectForKey:)]) {
-        defaultConfig = [PRESConfig configWithDic:dic];
-    } else {
-        defaultConfig = PRESConfig.defaultConfig;
+    __block PRESConfig *config;
+    dispatch_sync(self.configQueue, ^{
+        if (![self.appKey isEqualToString:appKey]) {
+            self.appKey = appKey;
+            self.record = [self loadRecordForAppKey:appKey];
+        }
+
+        NSDictionary *dic = [self configDictionaryFromRecord:self.record];
+        config = (dic ? [PRESConfig configWithDic:dic] : nil) ?: PRESConfig.defaultConfig;
+        [self fetchIfNeeded];
+    });
+    return config;
+}
+
+#pragma mark - Fetching
+
+/**
+ *  Starts a conditional request unless the cached config is still fresh or the endpoint is backed off.
+ */
+- (void)fetchIfNeeded {
+    if (!self.appKey || self.fetchInFlight) return;
+
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    NSTimeInterval expiresAt = [self.record[kPRESConfigRecordExpiresAt] doubleValue];
+    if (self.record && now < expiresAt) {
+        [self scheduleFetchAfter:expiresAt - now];
+        return;
+    }
+
+    NSTimeInterval backoffDelay = [self.backoffPolicy acquireAttemptForEndpoint:PRESConfigServerDomain];
+    if (backoffDelay > 0) {
+        [self scheduleFetchAfter:backoffDelay];
+        return;
     }
+
+    self.fetchInFlight = YES;
+    NSString *appKey = self.appKey;
     NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"%@/app_config?appkey=%@", PRESConfigServerDomain, appKey]]];
-    [NSURLProtocol setProperty:@YES
-                        forKey:@"PRESInternalRequest"
-                     inRequest:request];
-    
-    __weak typeof(self) wSelf = self;
-    [[[NSURLSession sessionWithConfiguration:NSURLSessionConfiguration.defaultSessionConfiguration
-                                    delegate:self
-                               delegateQueue:[NSOperationQueue new]]
-      dataTaskWithRequest:request
-      completionHandler:^(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error) {
-          NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *)response;
-          if (error || httpResponse.statusCode != 200) {
-              NSLog(@"%@", error.localizedDescription);
-              dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(30 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
-                  [self getConfigWithAppKey:appKey];
-              });
-          } else {
-              __strong typeof(wSelf) strongSelf = wSelf;
-              NSDictionary *dic = [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:nil];
-              if ([dic respondsToSelector:@selector(objectForKey:)]) {
-                  [NSUserDefaults.standardUserDefaults setObject:dic forKey:@"presniff_app_config"];
-                  PRESConfig *config = [PRESConfig configWithDic:dic];
-                  [strongSelf.delegate configManager:strongSelf didReceivedConfig:config];
-              } else {
-                  NSLog(@"config received from server has a wrong type");
-              }
-          }
-      }]
-     resume];
-    return defaultConfig;
+    request.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    NSString *etag = self.record[kPRESConfigRecordETag];
+    if (etag) {
+        [request setValue:etag forHTTPHeaderField:@"If-None-Match"];
+    }
+    NSString *lastModified = self.record[kPRESConfigRecordLastModified];
+    if (lastModified) {
+        [request setValue:lastModified forHTTPHeaderField:@"If-Modified-Since"];
+    }
+
+    __weak typeof(self) weakSelf = self;
+    // the backoff policy above already spaces out the retries
+    [[PRESTransport sharedTransport] sendRequest:request
+                                         options:PRESTransportOptionNone
+                                      completion:^(NSData * _Nullable data, NSHTTPURLResponse * _Nullable response, NSError * _Nullable error) {
+                                          typeof(self) strongSelf = weakSelf;
+                                          if (!strongSelf) return;
+                                          dispatch_async(strongSelf.configQueue, ^{
+                                              strongSelf.fetchInFlight = NO;
+                                              if (![strongSelf.appKey isEqualToString:appKey]) {
+                                                  // the app key changed while the request was running
+                                                  [strongSelf fetchIfNeeded];
+                                                  return;
+                                              }
+                                              [strongSelf handleResponse:response data:data error:error];
+                                          });
+                                      }];
+}
+
+- (void)handleResponse:(NSHTTPURLResponse *)response data:(NSData *)data error:(NSError *)error {
+    NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? response.statusCode : 0;
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+
+    if (statusCode == 304 && self.record) {
+        PRESLogDebug(@"INFO: Config is unchanged");
+        [self.backoffPolicy recordSuccessForEndpoint:PRESConfigServerDomain];
+        NSMutableDictionary<NSString *, NSString *> *record = [self.record mutableCopy];
+        record[kPRESConfigRecordExpiresAt] = [self expiresAtStringForResponse:response now:now];
+        [self saveRecord:record];
+        [self fetchIfNeeded];
+        return;
+    }
+
+    if (error || statusCode != 200) {
+        PRESLogWarning(@"WARNING: Fetching config failed with status code %ld: %@", (long)statusCode, error.localizedDescription);
+        NSTimeInterval retryAfter = [PRESBackoffPolicy retryAfterIntervalFromHeaderValue:response.allHeaderFields[@"Retry-After"] now:now];
+        [self.backoffPolicy recordFailureForEndpoint:PRESConfigServerDomain retryAfter:retryAfter];
+        [self fetchIfNeeded];
+        return;
+    }
+
+    NSDictionary *dic = data ? [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:nil] : nil;
+    if (![dic isKindOfClass:[NSDictionary class]]) {
+        PRESLogError(@"ERROR: Config received from server has a wrong type");
+        // a broken body is a server fault, retry it like a failed request
+        [self.backoffPolicy recordFailureForEndpoint:PRESConfigServerDomain retryAfter:-1];
+        [self fetchIfNeeded];
+        return;
+    }
+    [self.backoffPolicy recordSuccessForEndpoint:PRESConfigServerDomain];
+    PRESConfig *config = [PRESConfig configWithDic:dic];
+    if (!config) {
+        // keep the cached config, it is still one this version understands, and ask again after
+        // the normal refresh interval
+        NSMutableDictionary<NSString *, NSString *> *record = self.record ? [self.record mutableCopy] : [NSMutableDictionary dictionary];
+        record[kPRESConfigRecordAppKey] = self.appKey;
+        record[kPRESConfigRecordExpiresAt] = [self expiresAtStringForResponse:response now:now];
+        [self saveRecord:record];
+        [self fetchIfNeeded];
+        return;
+    }
+
+    NSMutableDictionary<NSString *, NSString *> *record = [NSMutableDictionary dictionary];
+    record[kPRESConfigRecordAppKey] = self.appKey;
+    record[kPRESConfigRecordBody] = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+    record[kPRESConfigRecordETag] = response.allHeaderFields[@"ETag"];
+    record[kPRESConfigRecordLastModified] = response.allHeaderFields[@"Last-Modified"];
+    record[kPRESConfigRecordExpiresAt] = [self expiresAtStringForResponse:response now:now];
+    [self saveRecord:record];
+    [self fetchIfNeeded];
+
+    id<PRESConfigManagerDelegate> delegate = self.delegate;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [delegate configManager:self didReceivedConfig:config];
+    });
+}
+
+- (NSString *)expiresAtStringForResponse:(NSHTTPURLResponse *)response now:(NSTimeInterval)now {
+    NSTimeInterval ttl = pres_maxAgeFromCacheControl(response.allHeaderFields[@"Cache-Control"]);
+    if (ttl < 0) {
+        ttl = PRESConfigDefaultTTL;
+    }
+    ttl = MIN(MAX(ttl, PRESConfigMinTTL), PRESConfigMaxTTL);
+    return [NSString stringWithFormat:@"%.0f", now + ttl];
+}
+
+- (void)scheduleFetchAfter:(NSTimeInterval)delay {
+    if (self.fetchScheduled) return;
+    self.fetchScheduled = YES;
+
+    __weak typeof(self) weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.configQueue, ^{
+        typeof(self) strongSelf = weakSelf;
+        strongSelf.fetchScheduled = NO;
+        [strongSelf fetchIfNeeded];
+    });
+}
+
+#pragma mark - Persistence
+
+- (NSString *)recordFilePath {
+    return [pres_settingsSubdir(kPRESConfigDirectoryName) stringByAppendingPathComponent:kPRESConfigFileName];
+}
+
+- (NSDictionary *)configDictionaryFromRecord:(NSDictionary<NSString *, NSString *> *)record {
+    NSData *body = [record[kPRESConfigRecordBody] dataUsingEncoding:NSUTF8StringEncoding];
+    if (!body) return nil;
+    NSDictionary *dic = [NSJSONSerialization JSONObjectWithData:body options:kNilOptions error:nil];
+    return [dic isKindOfClass:[NSDictionary class]] ? dic : nil;
+}
+
+- (NSDictionary<NSString *, NSString *> *)loadRecordForAppKey:(NSString *)appKey {
+    NSData *data = [NSData dataWithContentsOfFile:[self recordFilePath]];
+    if (data) {
+        uint8_t version = 0;
+        NSDictionary<NSString *, NSString *> *record = pres_decodeBinaryRecord(data, &version);
+        if (record && version == PRESConfigRecordVersion && [record[kPRESConfigRecordAppKey] isEqualToString:appKey]) {
+            return record;
+        }
+        return nil;
+    }
+
+    // migrate the config cached by older versions, it has no validator so it is refreshed right away
+    NSDictionary *legacyConfig = [NSUserDefaults.standardUserDefaults objectForKey:kPRESLegacyConfigDefaultsKey];
+    if (![legacyConfig isKindOfClass:[NSDictionary class]]) return nil;
+    [NSUserDefaults.standardUserDefaults removeObjectForKey:kPRESLegacyConfigDefaultsKey];
+
+    NSData *body = [NSJSONSerialization isValidJSONObject:legacyConfig] ? [NSJSONSerialization dataWithJSONObject:legacyConfig options:0 error:nil] : nil;
+    if (!body) return nil;
+    NSDictionary<NSString *, NSString *> *record = @{kPRESConfigRecordAppKey: appKey,
+                                                     kPRESConfigRecordBody: [[NSString alloc] initWithData:body encoding:NSUTF8StringEncoding],
+                                                     kPRESConfigRecordExpiresAt: @"0"};
+    [self saveRecord:record];
+    return record;
+}
+
+/**
+ *  Config and validators live in one record written atomically, so they can never disagree.
+ */
+- (void)saveRecord:(NSDictionary<NSString *, NSString *> *)record {
+    self.record = record;
+    if (![pres_encodeBinaryRecord(record, PRESConfigRecordVersion) writeToFile:[self recordFilePath] atomically:YES]) {
+        PRESLogWarning(@"WARNING: Unable to persist the config");
+    }
 }
 
 @end
@@ -32,14 +32,22 @@
 #import "PRESBaseManagerPrivate.h"
 #import "PRESHelper.h"
 #import "PRESNetworkClient.h"
-#import "PRESKeychainUtils.h"
+#import "PRESKeychainStore.h"
 #import "PRESVersion.h"
 #import "PRESConfigManager.h"
 #import "PRESNetDiag.h"
+#import "PRESStats.h"
+#import "PRESLaunchSequence.h"
 #import "PRESCrashManagerPrivate.h"
 #import "PRESMetricsManagerPrivate.h"
+#import "PRESSender.h"
+#import "PRESHTTPMonitorSender.h"
+#import "PRESBatchUploader.h"
+#import "PRESTransport.h"
 #import "PRESURLProtocol.h"
 
+static char *const kPRESLaunchQueue = "com.presniff.launchQueue";
+
 @interface PRESManager ()
 <
 PRESConfigManagerDelegate
@@ -61,6 +69,10 @@ PRESConfigManagerDelegate
     PRESNetworkClient *_hockeyAppClient;
     
     PRESConfigManager *_configManager;
+    
+    PRESLaunchSequence *_launchSequence;
+    
+    BOOL _httpMonitorStarted;
 }
 
 
@@ -97,6 +109,8 @@ PRESConfigManagerDelegate
         _configManager = [PRESConfigManager sharedInstance];
         _configManager.delegate = self;
         
+        _launchSequence = [[PRESLaunchSequence alloc] initWithQueue:dispatch_queue_create(kPRESLaunchQueue, DISPATCH_QUEUE_SERIAL)];
+        
         [self performSelector:@selector(validateStartManagerIsInvoked) withObject:nil afterDelay:0.0f];
     }
     return self;
@@ -150,37 +164,68 @@ PRESConfigManagerDelegate
         return;
     }
     
-    // Fix bug where Application Support directory was encluded from backup
-    NSFileManager *fileManager = [NSFileManager defaultManager];
-    NSURL *appSupportURL = [[fileManager URLsForDirectory:NSApplicationSupportDirectory inDomains:NSUserDomainMask] lastObject];
-    pres_fixBackupAttributeForURL(appSupportURL);
-    
     if (![self isSetUpOnMainThread]) return;
     
     PRESLogDebug(@"INFO: Starting PRESManager");
     _startManagerIsInvoked = YES;
     
-    // start CrashManager
+    __weak typeof(self) weakSelf = self;
+    
+    // Only the crash manager stays on the critical path, a crash during the rest of the launch has
+    // to be caught. It also converts a pending report before its handlers overwrite it.
     if (![self isCrashManagerDisabled]) {
-        PRESLogDebug(@"INFO: Start CrashManager");
-        
-        [_crashManager startManager];
+        [_launchSequence addStage:@"crash_manager" target:PRESLaunchStageTargetCritical block:^{
+            typeof(self) strongSelf = weakSelf;
+            PRESLogDebug(@"INFO: Start CrashManager");
+            [strongSelf.crashManager startManager];
+        }];
     }
     
+    [_launchSequence addStage:@"backup_attribute" target:PRESLaunchStageTargetBackground block:^{
+        // Fix bug where Application Support directory was encluded from backup
+        NSFileManager *fileManager = [NSFileManager defaultManager];
+        NSURL *appSupportURL = [[fileManager URLsForDirectory:NSApplicationSupportDirectory inDomains:NSUserDomainMask] lastObject];
+        pres_fixBackupAttributeForURL(appSupportURL);
+    }];
+    
     // App Extensions can only use PRESCrashManager, so ignore all others automatically
-    if (pres_isRunningInAppExtension()) {
-        return;
+    if (!pres_isRunningInAppExtension()) {
+        if (!self.isMetricsManagerDisabled) {
+            [_launchSequence addStage:@"metrics_manager" target:PRESLaunchStageTargetBackground block:^{
+                typeof(self) strongSelf = weakSelf;
+                PRESLogDebug(@"INFO: Start MetricsManager");
+                [strongSelf.metricsManager startManager];
+            }];
+        }
+        
+        // requests of the launch itself are not sniffed, the app should get to its first frame first
+        [_launchSequence addStage:@"http_monitor" target:PRESLaunchStageTargetMainIdle block:^{
+            typeof(self) strongSelf = weakSelf;
+            if (!strongSelf) return;
+            strongSelf->_httpMonitorStarted = YES;
+            if (!strongSelf.isHttpMonitorDisabled) {
+                [PRESURLProtocol enableHTTPSniff];
+            }
+        }];
     }
     
-    // start MetricsManager
-    if (!self.isMetricsManagerDisabled) {
-        PRESLogDebug(@"INFO: Start MetricsManager");
-        [_metricsManager startManager];
-    }
+    [_launchSequence start];
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)launchStageDurations {
+    return [_launchSequence stageDurations];
+}
+
+- (BOOL)handleEventsForBackgroundURLSession:(NSString *)identifier completionHandler:(void (^)(void))completionHandler {
+    if (![PRESSender isBackgroundSessionIdentifier:identifier]) return NO;
     
-    if (!self.isHttpMonitorDisabled) {
-        [PRESURLProtocol enableHTTPSniff];
+    if (self.isMetricsManagerDisabled || pres_isRunningInAppExtension()) {
+        // no sender recreates the session, the events are never delivered
+        if (completionHandler) completionHandler();
+        return YES;
     }
+    [PRESSender setBackgroundSessionCompletionHandler:completionHandler];
+    return YES;
 }
 
 - (void)setDisableMetricsManager:(BOOL)disableMetricsManager {
@@ -193,6 +238,8 @@ PRESConfigManagerDelegate
 
 - (void)setDisableHttpMonitor:(BOOL)disableHttpMonitor {
     _disableHttpMonitor = disableHttpMonitor;
+    // before its launch stage the flag is only remembered
+    if (!_httpMonitorStarted) return;
     if (disableHttpMonitor) {
         [PRESURLProtocol disableHTTPSniff];
     } else {
@@ -244,33 +291,13 @@ PRESConfigManagerDelegate
     [PRESLogger setLogHandler:logHandler];
 }
 
+- (NSDictionary<NSString *, NSNumber *> *)statsSnapshot {
+    return pres_stats_snapshot();
+}
+
 - (void)modifyKeychainUserValue:(NSString *)value forKey:(NSString *)key {
-    NSError *error = nil;
-    BOOL success = YES;
-    NSString *updateType = @"update";
-    
-    if (value) {
-        success = [PRESKeychainUtils storeUsername:key
-                                       andPassword:value
-                                    forServiceName:pres_keychainPreSniffObjcServiceName()
-                                    updateExisting:YES
-                                     accessibility:kSecAttrAccessibleAlwaysThisDeviceOnly
-                                             error:&error];
-    } else {
-        updateType = @"delete";
-        if ([PRESKeychainUtils getPasswordForUsername:key
-                                       andServiceName:pres_keychainPreSniffObjcServiceName()
-                                                error:&error]) {
-            success = [PRESKeychainUtils deleteItemForUsername:key
-                                                andServiceName:pres_keychainPreSniffObjcServiceName()
-                                                         error:&error];
-        }
-    }
-    
-    if (!success) {
-        NSString *errorDescription = [error description] ?: @"";
-        PRESLogError(@"ERROR: Couldn't %@ key %@ in the keychain. %@", updateType, key, errorDescription);
-    }
+    // unchanged values are skipped, failures are logged once the write ran
+    [[PRESKeychainStore sharedStore] setString:value forKey:key accessibility:kSecAttrAccessibleAlwaysThisDeviceOnly];
 }
 
 - (void)setUserID:(NSString *)userID {
@@ -396,6 +423,17 @@ PRESConfigManagerDelegate
     self.disableCrashManager = !config.crashReportEnabled;
     self.disableMetricsManager = !config.telemetryEnabled;
     self.disableHttpMonitor = !config.httpMonitorEnabled;
+    [[PRESHTTPMonitorSender sharedSender] updateWithConfig:config];
+    [[PRESTransport sharedTransport] updateWithConfig:config];
+    [PRESBatchUploader sharedUploader].enabled = config.batchUploadEnabled;
+    
+    // Serialized with the metrics manager's launch stage on the launch queue. A config applied
+    // before startManager reaches the metrics manager before it started, its startManager
+    // picks up the stored config then.
+    PRESMetricsManager *metricsManager = _metricsManager;
+    dispatch_async(_launchSequence.queue, ^{
+        [metricsManager updateWithConfig:config];
+    });
 }
 
 - (void)diagnose:(NSString *)host
@@ -403,6 +441,14 @@ PRESConfigManagerDelegate
     [PRESNetDiag diagnose:host appKey:_appIdentifier complete:complete];
 }
 
+- (void)diagnoseHosts:(NSArray<NSString *> *)hosts
+               probes:(PRESNetDiagProbe)probes
+              timeout:(NSTimeInterval)timeout
+             progress:(PRESNetDiagProgressHandler)progress
+             complete:(PRESNetDiagMultiCompleteHandler)complete {
+    [PRESNetDiag diagnoseHosts:hosts appKey:_appIdentifier probes:probes timeout:timeout progress:progress complete:complete];
+}
+
 - (void)configManager:(PRESConfigManager *)manager didReceivedConfig:(PRESConfig *)config {
     [self applyConfig:config];
 }
@@ -8,18 +8,23 @@
 
 #import "PRESNetDiagResult.h"
 #import "PRESUtilities.h"
+#import "PRESNetDiagResultPrivate.h"
+#import "PRESPrivate.h"
+#import "PRESTransport.h"
 
-#define PRESTotalResultNeeded   5
-#define PRESSendRetryInterval   10
-#define PRESSendMaxRetryTimes   5
 #define PRESNetDiagDomain       @"http://localhost:8080"
 #define PRESNetDiagPath         @"/v1/net_diag"
 
 @interface PRESNetDiagResult ()
 
-@property (nonatomic, assign) NSInteger completedCount;
-@property (nonatomic, assign) NSInteger retryTimes;
+@property (nonatomic, copy, readwrite) NSString *host;
+@property (atomic, assign, readwrite) PRESNetDiagProbe completed_probes;
+@property (atomic, assign, readwrite) PRESNetDiagProbe timed_out_probes;
+
+@property (nonatomic, assign) PRESNetDiagProbe requestedProbes;
+@property (nonatomic, assign) PRESNetDiagProbe claimedProbes;
 @property (nonatomic, strong) NSLock *lock;
+@property (nonatomic, copy) PRESNetDiagProgressHandler progress;
 @property (nonatomic, copy) PRESNetDiagCompleteHandler complete;
 @property (nonatomic, strong) NSString *appKey;
 
@@ -27,18 +32,47 @@
 
 @implementation PRESNetDiagResult
 
-- (instancetype)initWithAppKey:(NSString *)appKey complete:(PRESNetDiagCompleteHandler)complete {
+- (instancetype)initWithHost:(NSString *)host
+                      appKey:(NSString *)appKey
+                      probes:(PRESNetDiagProbe)probes
+                    progress:(PRESNetDiagProgressHandler)progress
+                    complete:(PRESNetDiagCompleteHandler)complete {
     if (self = [super init]) {
-        self.completedCount = 0;
-        self.retryTimes = 0;
+        self.host = host;
+        self.requestedProbes = probes & PRESNetDiagProbeAll;
         self.lock = [NSLock new];
+        self.progress = progress;
         self.complete = complete;
         self.appKey = appKey;
     }
     return self;
 }
 
+- (BOOL)isFinished {
+    return (self.completed_probes & self.requestedProbes) == self.requestedProbes;
+}
+
+- (BOOL)claimProbe:(PRESNetDiagProbe)probe {
+    [self.lock lock];
+    BOOL claimed = (self.requestedProbes & probe) && !(self.claimedProbes & probe);
+    if (claimed) {
+        self.claimedProbes |= probe;
+    }
+    [self.lock unlock];
+    return claimed;
+}
+
+- (void)probeTimedOut:(PRESNetDiagProbe)probe {
+    if (![self claimProbe:probe]) return;
+    PRESLogDebug(@"INFO: Net diag probe %lu for %@ timed out", (unsigned long)probe, self.host);
+    [self.lock lock];
+    self.timed_out_probes |= probe;
+    [self.lock unlock];
+    [self finishProbe:probe];
+}
+
 - (void)gotTcpResult:(QNNTcpPingResult *)r {
+    if (![self claimProbe:PRESNetDiagProbeTcpPing]) return;
     self.tcp_code = r.code;
     self.tcp_ip = r.ip;
     self.tcp_max_time = r.maxTime;
@@ -48,10 +82,11 @@
     self.tcp_count = r.count;
     self.tcp_total_time = r.totalTime;
     self.tcp_stddev = r.stddev;
-    [self checkAndSend];
+    [self finishProbe:PRESNetDiagProbeTcpPing];
 }
 
 - (void)gotPingResult:(QNNPingResult *)r {
+    if (![self claimProbe:PRESNetDiagProbePing]) return;
     self.ping_code = r.code;
     self.ping_ip = r.ip;
     self.ping_size = r.size;
@@ -62,25 +97,28 @@
     self.ping_count = r.count;
     self.ping_total_time = r.totalTime;
     self.ping_stddev = r.stddev;
-    [self checkAndSend];
+    [self finishProbe:PRESNetDiagProbePing];
 }
 
 - (void)gotHttpResult:(QNNHttpResult *)r {
+    if (![self claimProbe:PRESNetDiagProbeHttp]) return;
     self.http_code = r.code;
     self.http_ip = r.ip;
     self.http_duration = r.duration;
     self.http_body_size = r.body.length;
-    [self checkAndSend];
+    [self finishProbe:PRESNetDiagProbeHttp];
 }
 
 - (void)gotTrResult:(QNNTraceRouteResult *)r {
+    if (![self claimProbe:PRESNetDiagProbeTraceRoute]) return;
     self.tr_code = r.code;
     self.tr_ip = r.ip;
     self.tr_content = r.content;
-    [self checkAndSend];
+    [self finishProbe:PRESNetDiagProbeTraceRoute];
 }
 
 - (void)gotNsLookupResult:(NSArray<QNNRecord *> *) r {
+    if (![self claimProbe:PRESNetDiagProbeNslookup]) return;
     NSMutableString *recordString = [[NSMutableString alloc] initWithCapacity:30];
     for (QNNRecord *record in r) {
         [recordString appendFormat:@"%@\t", record.value];
@@ -88,23 +126,28 @@
         [recordString appendFormat:@"%d\n", record.type];
     }
     self.dns_records = recordString;
-    [self checkAndSend];
+    [self finishProbe:PRESNetDiagProbeNslookup];
 }
 
 - (NSDictionary *)toDic {
     return [PRESUtilities getObjectData:self];
 }
 
-- (void)checkAndSend {
+- (void)finishProbe:(PRESNetDiagProbe)probe {
     [self.lock lock];
-    self.completedCount++;
-    if (self.completedCount == PRESTotalResultNeeded) {
-        [self.lock unlock];
+    self.completed_probes |= probe;
+    BOOL finished = [self isFinished];
+    [self.lock unlock];
+
+    if (self.progress) {
+        self.progress(self, probe);
+    }
+    if (finished) {
         [self generateResultID];
-        self.complete(self);
+        if (self.complete) {
+            self.complete(self);
+        }
         [self sendReport:self.appKey];
-    } else {
-        [self.lock unlock];
     }
 }
 
@@ -121,18 +164,13 @@
         return;
     }
     [request addValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
-    [NSURLProtocol setProperty:@YES
-                        forKey:@"PRESInternalRequest"
-                     inRequest:request];
-    [[[NSURLSession sharedSession] dataTaskWithRequest:request completionHandler:^(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error) {
-        NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *)response;
-        if ((error || httpResponse.statusCode != 200) && self.retryTimes < PRESSendMaxRetryTimes) {
-            self.retryTimes ++;
-            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(PRESSendRetryInterval * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
-                [self sendReport:appKey];
-            });
-        }
-    }] resume];
+    [[PRESTransport sharedTransport] sendRequest:request
+                                         options:PRESTransportOptionRetryTransientErrors
+                                      completion:^(NSData * _Nullable data, NSHTTPURLResponse * _Nullable response, NSError * _Nullable error) {
+                                          if (error || response.statusCode != 200) {
+                                              PRESLogWarning(@"WARNING: Sending the net diag report failed, status: %ld, error: %@", (long)response.statusCode, error);
+                                          }
+                                      }];
 }
 
 @end
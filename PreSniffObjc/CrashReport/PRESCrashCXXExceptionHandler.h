@@ -41,9 +41,48 @@ typedef void (*PRESCrashUncaughtCXXExceptionHandler)(
 const PRESCrashUncaughtCXXExceptionInfo * __nonnull info
 );
 
+/**
+ *  How the stack of a C++ throw is recorded, every throw pays for this even if it is caught later
+ */
+typedef NS_ENUM(NSUInteger, PRESCrashCXXThrowCaptureMode) {
+    /**
+     *  Don't record throws, uncaught exceptions are reported with the stack of the terminate handler
+     */
+    PRESCrashCXXThrowCaptureModeNone = 0,
+    /**
+     *  Walk the frame pointer chain into a fixed per thread slot, this is the default
+     */
+    PRESCrashCXXThrowCaptureModeFramePointer = 1,
+    /**
+     *  Use backtrace(3), slower but does not rely on frame pointers
+     */
+    PRESCrashCXXThrowCaptureModeBacktrace = 2,
+};
+
 @interface PRESCrashUncaughtCXXExceptionHandlerManager : NSObject
 
 + (void)addCXXExceptionHandler:(nonnull PRESCrashUncaughtCXXExceptionHandler)handler;
 + (void)removeCXXExceptionHandler:(nonnull PRESCrashUncaughtCXXExceptionHandler)handler;
 
+/**
+ *  The following settings can be changed at any time and are picked up by the next throw
+ */
++ (void)setThrowCaptureMode:(PRESCrashCXXThrowCaptureMode)mode;
+
+/**
+ *  Maximum number of frames recorded per throw, capped at 128. Default: 128
+ */
++ (void)setThrowCaptureMaxFrames:(uint32_t)maxFrames;
+
+/**
+ *  Only record every n-th throw per thread, 1 records all throws. Default: 1
+ */
++ (void)setThrowCaptureSampleInterval:(uint32_t)interval;
+
+/**
+ *  Only record throws of the given mangled type names (as returned by `std::type_info::name()`),
+ *  at most 16 entries. Pass nil to record throws of all types.
+ */
++ (void)setThrowCaptureTypeAllowlist:(nullable NSArray<NSString *> *)mangledTypeNames;
+
 @end
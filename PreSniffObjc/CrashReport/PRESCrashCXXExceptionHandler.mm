@@ -27,8 +27,9 @@
  */
 
 #import "PreSniffObjc.h"
+#import "PRESPrivate.h"
 #import "PRESCrashCXXExceptionHandler.h"
-#import <vector>
+#import "PRESCrashCXXExceptionHandlerRegistry.h"
 #import <cxxabi.h>
 #import <exception>
 #import <stdexcept>
@@ -37,22 +38,77 @@
 #import <pthread.h>
 #import <dlfcn.h>
 #import <execinfo.h>
-#import <libkern/OSAtomic.h>
+#import <atomic>
+#import <algorithm>
 
-typedef std::vector<PRESCrashUncaughtCXXExceptionHandler> PRESCrashUncaughtCXXExceptionHandlerList;
+#define PRESCrashCXXMaxCapturedFrames 128
+#define PRESCrashCXXMaxAllowedTypes 16
+#define PRESCrashCXXMaxExceptionHandlers 8
+
+typedef PRESCrashCXXExceptionHandlerRegistry<PRESCrashUncaughtCXXExceptionHandler, PRESCrashCXXMaxExceptionHandlers> PRESCrashUncaughtCXXExceptionHandlerList;
 typedef struct
 {
     void *exception_object;
-    uintptr_t call_stack[128];
+    uintptr_t call_stack[PRESCrashCXXMaxCapturedFrames];
     uint32_t num_frames;
+    uint32_t skipped_frames; // leading frames belonging to __cxa_throw itself
+    uint32_t throw_count;
 } PRESCrashCXXExceptionTSInfo;
 
-static bool _PRESCrashIsOurTerminateHandlerInstalled = false;
+static std::atomic<bool> _PRESCrashIsOurTerminateHandlerInstalled(false);
 static std::terminate_handler _PRESCrashOriginalTerminateHandler = nullptr;
 static PRESCrashUncaughtCXXExceptionHandlerList _PRESCrashUncaughtExceptionHandlerList;
-static OSSpinLock _PRESCrashCXXExceptionHandlingLock = OS_SPINLOCK_INIT;
+// Only serializes installing and removing our terminate handler, the terminate path never takes it
+static pthread_mutex_t _PRESCrashCXXExceptionHandlerInstallLock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_key_t _PRESCrashCXXExceptionInfoTSDKey = 0;
 
+// Capture settings, read with relaxed ordering on every throw
+static std::atomic<uint32_t> _PRESCrashThrowCaptureMode(PRESCrashCXXThrowCaptureModeFramePointer);
+static std::atomic<uint32_t> _PRESCrashThrowCaptureMaxFrames(PRESCrashCXXMaxCapturedFrames);
+static std::atomic<uint32_t> _PRESCrashThrowCaptureSampleInterval(1);
+// Replaced lists are intentionally leaked, a concurrent throw may still be reading them
+static std::atomic<const char * const *> _PRESCrashThrowCaptureAllowedTypes(nullptr);
+
+__attribute__((always_inline))
+static inline bool PRESCrashIsThrowTypeAllowed(std::type_info *tinfo)
+{
+    const char * const *allowed_types = _PRESCrashThrowCaptureAllowedTypes.load(std::memory_order_acquire);
+    if (!allowed_types) return true;
+    if (!tinfo) return false;
+    
+    const char *name = tinfo->name();
+    for (const char * const *type = allowed_types; *type; type++) {
+        if (strcmp(*type, name) == 0) return true;
+    }
+    return false;
+}
+
+// Walks the frame pointer chain of the calling function, bounded by the thread's stack.
+// This is what backtrace(3) does as well, minus its locking and image bookkeeping.
+__attribute__((always_inline))
+static inline uint32_t PRESCrashWalkFramePointers(uintptr_t *frames, uint32_t max_frames)
+{
+    pthread_t thread = pthread_self();
+    uintptr_t stack_top = reinterpret_cast<uintptr_t>(pthread_get_stackaddr_np(thread));
+    uintptr_t stack_bottom = stack_top - pthread_get_stacksize_np(thread);
+    uintptr_t fp = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    uint32_t count = 0;
+    
+    while (count < max_frames && fp >= stack_bottom && fp + 2 * sizeof(uintptr_t) <= stack_top && (fp % sizeof(uintptr_t)) == 0) {
+        const uintptr_t *frame = reinterpret_cast<const uintptr_t *>(fp);
+        uintptr_t next_fp = frame[0];
+        uintptr_t return_address = frame[1];
+        if (return_address == 0) break;
+        
+        frames[count++] = return_address;
+        
+        // the stack grows down, so every caller frame has to live above the current one
+        if (next_fp <= fp) break;
+        fp = next_fp;
+    }
+    return count;
+}
+
 @implementation PRESCrashUncaughtCXXExceptionHandlerManager
 
 extern "C" void LIBCXXABI_NORETURN __cxa_throw(void *exception_object, std::type_info *tinfo, void (*dest)(void *))
@@ -93,13 +149,41 @@ extern "C" void LIBCXXABI_NORETURN __cxa_throw(void *exception_object, std::type
     if (_PRESCrashIsOurTerminateHandlerInstalled) {
         PRESCrashCXXExceptionTSInfo *info = static_cast<PRESCrashCXXExceptionTSInfo *>(pthread_getspecific(_PRESCrashCXXExceptionInfoTSDKey));
         
+        // A stack recorded for an earlier throw must never be reported for this one,
+        // so the slot is reset even if this throw is not captured.
+        if (info) {
+            info->exception_object = exception_object;
+            info->num_frames = 0;
+            info->skipped_frames = 0;
+        }
+        
+        uint32_t mode = _PRESCrashThrowCaptureMode.load(std::memory_order_relaxed);
+        if (mode == PRESCrashCXXThrowCaptureModeNone) {
+            goto callthrough;
+        }
+        
         if (!info) {
             info = reinterpret_cast<PRESCrashCXXExceptionTSInfo *>(calloc(1, sizeof(PRESCrashCXXExceptionTSInfo)));
+            if (!info) {
+                goto callthrough;
+            }
+            info->exception_object = exception_object;
             pthread_setspecific(_PRESCrashCXXExceptionInfoTSDKey, info);
         }
-        info->exception_object = exception_object;
-        // XXX: All significant time in this call is spent right here.
-        info->num_frames = backtrace(reinterpret_cast<void **>(&info->call_stack[0]), sizeof(info->call_stack) / sizeof(info->call_stack[0]));
+        
+        uint32_t sample_interval = _PRESCrashThrowCaptureSampleInterval.load(std::memory_order_relaxed);
+        if ((info->throw_count++ % sample_interval) != 0 || !PRESCrashIsThrowTypeAllowed(tinfo)) {
+            goto callthrough;
+        }
+        
+        uint32_t max_frames = _PRESCrashThrowCaptureMaxFrames.load(std::memory_order_relaxed);
+        if (mode == PRESCrashCXXThrowCaptureModeBacktrace) {
+            // XXX: All significant time in this call is spent right here.
+            info->num_frames = backtrace(reinterpret_cast<void **>(&info->call_stack[0]), static_cast<int>(max_frames));
+            info->skipped_frames = 1;
+        } else {
+            info->num_frames = PRESCrashWalkFramePointers(&info->call_stack[0], max_frames);
+        }
     }
     
 callthrough:
@@ -117,9 +201,9 @@ callthrough:
 __attribute__((always_inline))
 static inline void PRESCrashIterateExceptionHandlers_unlocked(const PRESCrashUncaughtCXXExceptionInfo &info)
 {
-    for (const auto &handler : _PRESCrashUncaughtExceptionHandlerList) {
+    _PRESCrashUncaughtExceptionHandlerList.forEach([&info](PRESCrashUncaughtCXXExceptionHandler handler) {
         handler(&info);
-    }
+    });
 }
 
 static void PRESCrashUncaughtCXXTerminateHandler(void)
@@ -131,55 +215,53 @@ static void PRESCrashUncaughtCXXTerminateHandler(void)
         .exception_frames_count = 0,
         .exception_frames = nullptr,
     };
+    // Storage for the fallback trace, has to outlive the handler calls below
+    void *frames[128] = { nullptr };
     auto p = std::current_exception();
     
-    OSSpinLockLock(&_PRESCrashCXXExceptionHandlingLock); {
-        if (p) { // explicit operator bool
-            info.exception = reinterpret_cast<const void *>(&p);
-            info.exception_type_name = __cxxabiv1::__cxa_current_exception_type()->name();
-            
-            PRESCrashCXXExceptionTSInfo *recorded_info = reinterpret_cast<PRESCrashCXXExceptionTSInfo *>(pthread_getspecific(_PRESCrashCXXExceptionInfoTSDKey));
-            
-            if (recorded_info) {
-                info.exception_frames_count = recorded_info->num_frames - 1;
-                info.exception_frames = &recorded_info->call_stack[1];
-            } else {
-                // There's no backtrace, grab this function's trace instead. Probably
-                // means the exception came from a dynamically loaded library.
-                void *frames[128] = { nullptr };
-                
-                info.exception_frames_count = backtrace(&frames[0], sizeof(frames) / sizeof(frames[0])) - 1;
-                info.exception_frames = reinterpret_cast<uintptr_t *>(&frames[1]);
-            }
-            
-            try {
-                std::rethrow_exception(p);
-            } catch (const std::exception &e) { // C++ exception.
-                info.exception_message = e.what();
-                PRESCrashIterateExceptionHandlers_unlocked(info);
-            } catch (const std::exception *e) { // C++ exception by pointer.
-                info.exception_message = e->what();
-                PRESCrashIterateExceptionHandlers_unlocked(info);
-            } catch (const std::string &e) { // C++ string as exception.
-                info.exception_message = e.c_str();
-                PRESCrashIterateExceptionHandlers_unlocked(info);
-            } catch (const std::string *e) { // C++ string pointer as exception.
-                info.exception_message = e->c_str();
-                PRESCrashIterateExceptionHandlers_unlocked(info);
-            } catch (const char *e) { // Plain string as exception.
-                info.exception_message = e;
-                PRESCrashIterateExceptionHandlers_unlocked(info);
-            } catch (id e) { // Objective-C exception. Pass it on to Foundation.
-                OSSpinLockUnlock(&_PRESCrashCXXExceptionHandlingLock);
-                if (_PRESCrashOriginalTerminateHandler != nullptr) {
-                    _PRESCrashOriginalTerminateHandler();
-                }
-                return;
-            } catch (...) { // Any other kind of exception. No message.
-                PRESCrashIterateExceptionHandlers_unlocked(info);
+    if (p) { // explicit operator bool
+        info.exception = reinterpret_cast<const void *>(&p);
+        info.exception_type_name = __cxxabiv1::__cxa_current_exception_type()->name();
+        
+        PRESCrashCXXExceptionTSInfo *recorded_info = reinterpret_cast<PRESCrashCXXExceptionTSInfo *>(pthread_getspecific(_PRESCrashCXXExceptionInfoTSDKey));
+        
+        if (recorded_info && recorded_info->num_frames > recorded_info->skipped_frames) {
+            info.exception_frames_count = recorded_info->num_frames - recorded_info->skipped_frames;
+            info.exception_frames = &recorded_info->call_stack[recorded_info->skipped_frames];
+        } else {
+            // There's no backtrace, grab this function's trace instead. Probably
+            // means the exception came from a dynamically loaded library, or the
+            // throw was skipped by the capture settings.
+            info.exception_frames_count = backtrace(&frames[0], sizeof(frames) / sizeof(frames[0])) - 1;
+            info.exception_frames = reinterpret_cast<uintptr_t *>(&frames[1]);
+        }
+        
+        try {
+            std::rethrow_exception(p);
+        } catch (const std::exception &e) { // C++ exception.
+            info.exception_message = e.what();
+            PRESCrashIterateExceptionHandlers_unlocked(info);
+        } catch (const std::exception *e) { // C++ exception by pointer.
+            info.exception_message = e->what();
+            PRESCrashIterateExceptionHandlers_unlocked(info);
+        } catch (const std::string &e) { // C++ string as exception.
+            info.exception_message = e.c_str();
+            PRESCrashIterateExceptionHandlers_unlocked(info);
+        } catch (const std::string *e) { // C++ string pointer as exception.
+            info.exception_message = e->c_str();
+            PRESCrashIterateExceptionHandlers_unlocked(info);
+        } catch (const char *e) { // Plain string as exception.
+            info.exception_message = e;
+            PRESCrashIterateExceptionHandlers_unlocked(info);
+        } catch (id e) { // Objective-C exception. Pass it on to Foundation.
+            if (_PRESCrashOriginalTerminateHandler != nullptr) {
+                _PRESCrashOriginalTerminateHandler();
             }
+            return;
+        } catch (...) { // Any other kind of exception. No message.
+            PRESCrashIterateExceptionHandlers_unlocked(info);
         }
-    } OSSpinLockUnlock(&_PRESCrashCXXExceptionHandlingLock); // In case terminate is called reentrantly by pasing it on
+    }
     
     if (_PRESCrashOriginalTerminateHandler != nullptr) {
         _PRESCrashOriginalTerminateHandler();
@@ -198,23 +280,20 @@ static void PRESCrashUncaughtCXXTerminateHandler(void)
         pthread_key_create(&_PRESCrashCXXExceptionInfoTSDKey, free);
     });
     
-    OSSpinLockLock(&_PRESCrashCXXExceptionHandlingLock); {
-        if (!_PRESCrashIsOurTerminateHandlerInstalled) {
+    pthread_mutex_lock(&_PRESCrashCXXExceptionHandlerInstallLock); {
+        if (!_PRESCrashUncaughtExceptionHandlerList.add(handler)) {
+            PRESLogError(@"ERROR: Too many C++ exception handlers, at most %d are supported", PRESCrashCXXMaxExceptionHandlers);
+        } else if (!_PRESCrashIsOurTerminateHandlerInstalled) {
             _PRESCrashOriginalTerminateHandler = std::set_terminate(PRESCrashUncaughtCXXTerminateHandler);
             _PRESCrashIsOurTerminateHandlerInstalled = true;
         }
-        _PRESCrashUncaughtExceptionHandlerList.push_back(handler);
-    } OSSpinLockUnlock(&_PRESCrashCXXExceptionHandlingLock);
+    } pthread_mutex_unlock(&_PRESCrashCXXExceptionHandlerInstallLock);
 }
 
 + (void)removeCXXExceptionHandler:(PRESCrashUncaughtCXXExceptionHandler)handler
 {
-    OSSpinLockLock(&_PRESCrashCXXExceptionHandlingLock); {
-        auto i = std::find(_PRESCrashUncaughtExceptionHandlerList.begin(), _PRESCrashUncaughtExceptionHandlerList.end(), handler);
-        
-        if (i != _PRESCrashUncaughtExceptionHandlerList.end()) {
-            _PRESCrashUncaughtExceptionHandlerList.erase(i);
-        }
+    pthread_mutex_lock(&_PRESCrashCXXExceptionHandlerInstallLock); {
+        _PRESCrashUncaughtExceptionHandlerList.remove(handler);
         
         if (_PRESCrashIsOurTerminateHandlerInstalled) {
             if (_PRESCrashUncaughtExceptionHandlerList.empty()) {
@@ -228,7 +307,39 @@ static void PRESCrashUncaughtCXXTerminateHandler(void)
                 }
             }
         }
-    } OSSpinLockUnlock(&_PRESCrashCXXExceptionHandlingLock);
+    } pthread_mutex_unlock(&_PRESCrashCXXExceptionHandlerInstallLock);
+}
+
++ (void)setThrowCaptureMode:(PRESCrashCXXThrowCaptureMode)mode
+{
+    _PRESCrashThrowCaptureMode.store(static_cast<uint32_t>(mode), std::memory_order_relaxed);
+}
+
++ (void)setThrowCaptureMaxFrames:(uint32_t)maxFrames
+{
+    _PRESCrashThrowCaptureMaxFrames.store(std::min<uint32_t>(maxFrames, PRESCrashCXXMaxCapturedFrames), std::memory_order_relaxed);
+}
+
++ (void)setThrowCaptureSampleInterval:(uint32_t)interval
+{
+    _PRESCrashThrowCaptureSampleInterval.store(std::max<uint32_t>(interval, 1), std::memory_order_relaxed);
+}
+
++ (void)setThrowCaptureTypeAllowlist:(NSArray<NSString *> *)mangledTypeNames
+{
+    if (!mangledTypeNames) {
+        _PRESCrashThrowCaptureAllowedTypes.store(nullptr, std::memory_order_release);
+        return;
+    }
+    
+    NSUInteger count = MIN(mangledTypeNames.count, (NSUInteger)PRESCrashCXXMaxAllowedTypes);
+    const char **allowed_types = reinterpret_cast<const char **>(calloc(count + 1, sizeof(const char *)));
+    if (!allowed_types) return;
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        allowed_types[i] = strdup(mangledTypeNames[i].UTF8String ?: "");
+    }
+    _PRESCrashThrowCaptureAllowedTypes.store(allowed_types, std::memory_order_release);
 }
 
 @end
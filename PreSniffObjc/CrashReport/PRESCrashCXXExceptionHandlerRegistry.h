@@ -0,0 +1,93 @@
+//
+//  PRESCrashCXXExceptionHandlerRegistry.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 09/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#ifndef PRESCrashCXXExceptionHandlerRegistry_h
+#define PRESCrashCXXExceptionHandlerRegistry_h
+
+#ifdef __cplusplus
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ *  Fixed capacity set of handler function pointers
+ *
+ *  Every slot is an atomic pointer, so handlers can be added and removed from any thread
+ *  while the terminate path iterates the slots without taking a lock. Nothing allocates,
+ *  which keeps `forEach` async-signal-safe. Only depends on the C++ standard library, so
+ *  it builds and can be exercised on any libc++/libstdc++ platform.
+ */
+template <typename Handler, std::size_t Capacity>
+class PRESCrashCXXExceptionHandlerRegistry {
+public:
+    PRESCrashCXXExceptionHandlerRegistry() {
+        for (auto &slot : _slots) {
+            slot.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    PRESCrashCXXExceptionHandlerRegistry(const PRESCrashCXXExceptionHandlerRegistry &) = delete;
+    PRESCrashCXXExceptionHandlerRegistry &operator=(const PRESCrashCXXExceptionHandlerRegistry &) = delete;
+
+    /**
+     *  @return false if the registry is full
+     */
+    bool add(Handler handler) {
+        if (!handler) return false;
+
+        for (auto &slot : _slots) {
+            Handler expected = nullptr;
+            if (slot.compare_exchange_strong(expected, handler, std::memory_order_acq_rel)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     *  Removes one registration of the handler
+     *
+     *  @return false if the handler was not registered
+     */
+    bool remove(Handler handler) {
+        if (!handler) return false;
+
+        for (auto &slot : _slots) {
+            Handler expected = handler;
+            if (slot.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool empty() const {
+        for (const auto &slot : _slots) {
+            if (slot.load(std::memory_order_acquire)) return false;
+        }
+        return true;
+    }
+
+    /**
+     *  Invokes the block for every handler registered at the time its slot is visited
+     */
+    template <typename Function>
+    void forEach(Function function) const {
+        for (const auto &slot : _slots) {
+            Handler handler = slot.load(std::memory_order_acquire);
+            if (handler) function(handler);
+        }
+    }
+
+private:
+    std::atomic<Handler> _slots[Capacity];
+};
+
+#endif /* __cplusplus */
+
+#endif /* PRESCrashCXXExceptionHandlerRegistry_h */
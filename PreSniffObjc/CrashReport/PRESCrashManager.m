@@ -34,17 +34,24 @@
 #import "PRESPrivate.h"
 #import "PRESHelper.h"
 #import "PRESNetworkClient.h"
+#import "PRESTransport.h"
+#import "PRESBatchUploader.h"
+#import "PRESGZIP.h"
 
 #import "PRESCrashManager.h"
 #import "PRESCrashManagerPrivate.h"
 #import "PRESBaseManagerPrivate.h"
 #import "PRESCrashReportTextFormatter.h"
+#import "PRESCrashReportCompactFormatter.h"
 #import "PRESCrashDetailsPrivate.h"
 #import "PRESCrashCXXExceptionHandler.h"
+#import "PRESCrashMetaDataStore.h"
 #import "PRESVersion.h"
 #import "PRESMetricsManagerPrivate.h"
 #import "PRESChannel.h"
 #import "PRESPersistencePrivate.h"
+#import "PRESStats.h"
+#import "PRESTime.h"
 #include <sys/sysctl.h>
 
 // stores the set of crashreports that have been approved but aren't sent yet
@@ -57,6 +64,9 @@
 #define kPRESCrashMetaApplicationLog @"PRESCrashMetaApplicationLog"
 #define kPRESCrashMetaAttachment @"PRESCrashMetaAttachment"
 
+// bytes of the SDK log attached to a crash report
+#define PRESCrashSDKLogMaxLength (16 * 1024)
+
 // internal keys
 static NSString *const KPRESAttachmentDictIndex = @"index";
 static NSString *const KPRESAttachmentDictAttachment = @"attachment";
@@ -175,6 +185,7 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
     NSString       *_settingsFile;
     NSString       *_analyzerInProgressFile;
     NSFileManager  *_fileManager;
+    PRESCrashMetaDataStore *_metaDataStore;
     
     BOOL _crashIdenticalCurrentVersion;
     
@@ -231,6 +242,7 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
         _crashesDir = pres_settingsDir();
         _settingsFile = [_crashesDir stringByAppendingPathComponent:PRES_CRASH_SETTINGS];
         _analyzerInProgressFile = [_crashesDir stringByAppendingPathComponent:PRES_CRASH_ANALYZER];
+        _metaDataStore = [[PRESCrashMetaDataStore alloc] initWithCrashesDir:_crashesDir];
         
         
         if (!PRESBundle() && !pres_isRunningInAppExtension()) {
@@ -323,13 +335,20 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
     
     [_fileManager removeItemAtPath:filename error:&error];
     [_fileManager removeItemAtPath:[filename stringByAppendingString:@".data"] error:&error];
-    [_fileManager removeItemAtPath:[filename stringByAppendingString:@".meta"] error:&error];
-    [_fileManager removeItemAtPath:[filename stringByAppendingString:@".desc"] error:&error];
-    
-    NSString *cacheFilename = [filename lastPathComponent];
-    [self removeKeyFromKeychain:[NSString stringWithFormat:@"%@.%@", cacheFilename, kPRESCrashMetaUserName]];
-    [self removeKeyFromKeychain:[NSString stringWithFormat:@"%@.%@", cacheFilename, kPRESCrashMetaUserEmail]];
-    [self removeKeyFromKeychain:[NSString stringWithFormat:@"%@.%@", cacheFilename, kPRESCrashMetaUserID]];
+    [_fileManager removeItemAtPath:[filename stringByAppendingString:@".attachment"] error:&error];
+    [_metaDataStore removeEntryForCrashReport:filename];
+    
+    // reports written by previous SDK versions still have a .meta plist and per field keychain items
+    NSString *legacyMetaFilename = [filename stringByAppendingString:@".meta"];
+    if ([_fileManager fileExistsAtPath:legacyMetaFilename]) {
+        [_fileManager removeItemAtPath:legacyMetaFilename error:&error];
+        [_fileManager removeItemAtPath:[filename stringByAppendingString:@".desc"] error:&error];
+        
+        NSString *cacheFilename = [filename lastPathComponent];
+        [self removeKeyFromKeychain:[NSString stringWithFormat:@"%@.%@", cacheFilename, kPRESCrashMetaUserName]];
+        [self removeKeyFromKeychain:[NSString stringWithFormat:@"%@.%@", cacheFilename, kPRESCrashMetaUserEmail]];
+        [self removeKeyFromKeychain:[NSString stringWithFormat:@"%@.%@", cacheFilename, kPRESCrashMetaUserID]];
+    }
     
     [_crashFiles removeObject:filename];
     [_approvedCrashReports removeObjectForKey:filename];
@@ -349,11 +368,23 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
 }
 
 - (BOOL)persistAttachment:(PRESAttachment *)attachment withFilename:(NSString *)filename {
+    // an attachment without content has nothing to persist, that is not a failure
+    if (!attachment.hockeyAttachmentData) return YES;
+    
     NSString *attachmentFilename = [filename stringByAppendingString:@".data"];
+    
+    // the attachment content is kept in its own file, so it can be streamed into the upload body later
+    if (![attachment.hockeyAttachmentData writeToFile:[filename stringByAppendingString:@".attachment"] atomically:YES]) {
+        return NO;
+    }
+    
+    PRESAttachment *attachmentInfo = [[PRESAttachment alloc] initWithFilename:attachment.filename
+                                                         hockeyAttachmentData:nil
+                                                                  contentType:attachment.contentType];
     NSMutableData *data = [[NSMutableData alloc] init];
     NSKeyedArchiver *archiver = [[NSKeyedArchiver alloc] initForWritingWithMutableData:data];
     
-    [archiver encodeObject:attachment forKey:kPRESCrashMetaAttachment];
+    [archiver encodeObject:attachmentInfo forKey:kPRESCrashMetaAttachment];
     
     [archiver finishEncoding];
     
@@ -361,31 +392,35 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
 }
 
 - (void)persistUserProvidedMetaData:(PRESCrashMetaData *)userProvidedMetaData {
-    if (!userProvidedMetaData) return;
+    if (!userProvidedMetaData || !_lastCrashFilename) return;
+    
+    PRESCrashMetaDataEntry *entry = [_metaDataStore entryForCrashReport:_lastCrashFilename] ?: [PRESCrashMetaDataEntry new];
     
     if (userProvidedMetaData.userProvidedDescription && [userProvidedMetaData.userProvidedDescription length] > 0) {
-        NSError *error;
-        [userProvidedMetaData.userProvidedDescription writeToFile:[NSString stringWithFormat:@"%@.desc", [_crashesDir stringByAppendingPathComponent: _lastCrashFilename]] atomically:YES encoding:NSUTF8StringEncoding error:&error];
+        entry.userProvidedDescription = userProvidedMetaData.userProvidedDescription;
     }
     
     if (userProvidedMetaData.userName && [userProvidedMetaData.userName length] > 0) {
-        [self addStringValueToKeychain:userProvidedMetaData.userName forKey:[NSString stringWithFormat:@"%@.%@", _lastCrashFilename, kPRESCrashMetaUserName]];
-        
+        entry.userName = userProvidedMetaData.userName;
     }
     
     if (userProvidedMetaData.userEmail && [userProvidedMetaData.userEmail length] > 0) {
-        [self addStringValueToKeychain:userProvidedMetaData.userEmail forKey:[NSString stringWithFormat:@"%@.%@", _lastCrashFilename, kPRESCrashMetaUserEmail]];
+        entry.userEmail = userProvidedMetaData.userEmail;
     }
     
     if (userProvidedMetaData.userID && [userProvidedMetaData.userID length] > 0) {
-        [self addStringValueToKeychain:userProvidedMetaData.userID forKey:[NSString stringWithFormat:@"%@.%@", _lastCrashFilename, kPRESCrashMetaUserID]];
-        
+        entry.userID = userProvidedMetaData.userID;
     }
+    
+    [_metaDataStore setEntry:entry forCrashReport:_lastCrashFilename];
 }
 
 /**
  *  Read the attachment data from the stored file
  *
+ *  Attachments persisted by this SDK version only carry filename and content type,
+ *  their content is read from `attachmentFileURLForCrashReport:` while uploading.
+ *
  *  @param filename The crash report file path
  *
  *  @return an PRESAttachment instance or nil
@@ -418,6 +453,15 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
     return nil;
 }
 
+- (NSURL *)attachmentFileURLForCrashReport:(NSString *)filename {
+    NSString *contentFilename = [filename stringByAppendingString:@".attachment"];
+    
+    if (![_fileManager fileExistsAtPath:contentFilename])
+        return nil;
+    
+    return [NSURL fileURLWithPath:contentFilename];
+}
+
 /**
  *	 Extract all app specific UUIDs from the crash reports
  *
@@ -719,24 +763,28 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
 }
 
 /**
- *  Write a meta file for a new crash report
+ *  Store the meta data for a new crash report in the meta data index
  *
  *  @param filename the crash reports temp filename
  */
 - (void)storeMetaDataForCrashReportFilename:(NSString *)filename {
     PRESLogVerbose(@"VERBOSE: Storing meta data for crash report with filename %@", filename);
-    NSError *error = NULL;
-    NSMutableDictionary *metaDict = [NSMutableDictionary dictionaryWithCapacity:4];
-    NSString *applicationLog = @"";
+    PRESCrashMetaDataEntry *entry = [PRESCrashMetaDataEntry new];
     
-    [self addStringValueToKeychain:[self userNameForCrashReport] forKey:[NSString stringWithFormat:@"%@.%@", filename, kPRESCrashMetaUserName]];
-    [self addStringValueToKeychain:[self userEmailForCrashReport] forKey:[NSString stringWithFormat:@"%@.%@", filename, kPRESCrashMetaUserEmail]];
-    [self addStringValueToKeychain:[self userIDForCrashReport] forKey:[NSString stringWithFormat:@"%@.%@", filename, kPRESCrashMetaUserID]];
+    entry.userName = [self userNameForCrashReport];
+    entry.userEmail = [self userEmailForCrashReport];
+    entry.userID = [self userIDForCrashReport];
+    entry.applicationLog = @"";
     
     if ([self.delegate respondsToSelector:@selector(applicationLogForCrashManager:)]) {
-        applicationLog = [self.delegate applicationLogForCrashManager:self] ?: @"";
+        entry.applicationLog = [self.delegate applicationLogForCrashManager:self] ?: @"";
+    }
+    
+    // the SDK's own log of the crashed launch, at the log level that was configured then
+    NSString *sdkLog = [PRESLogger previousSessionLogWithMaxLength:PRESCrashSDKLogMaxLength];
+    if (sdkLog.length > 0) {
+        entry.applicationLog = entry.applicationLog.length > 0 ? [NSString stringWithFormat:@"%@\n\nPreSniffObjc:\n%@", entry.applicationLog, sdkLog] : sdkLog;
     }
-    [metaDict setObject:applicationLog forKey:kPRESCrashMetaApplicationLog];
     
     if ([self.delegate respondsToSelector:@selector(attachmentForCrashManager:)]) {
         PRESLogVerbose(@"VERBOSE: Processing attachment for crash report with filename %@", filename);
@@ -754,18 +802,7 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
         }
     }
     
-    NSData *plist = [NSPropertyListSerialization dataWithPropertyList:(id)metaDict
-                                                               format:NSPropertyListBinaryFormat_v1_0
-                                                              options:0
-                                                                error:&error];
-    if (plist) {
-        BOOL success = [plist writeToFile:[_crashesDir stringByAppendingPathComponent: [filename stringByAppendingPathExtension:@"meta"]] atomically:YES];
-        if (!success) {
-            PRESLogError(@"ERROR: Writing crash meta data failed.");
-        }
-    } else {
-        PRESLogError(@"ERROR: Writing crash meta data failed. %@", error);
-    }
+    [_metaDataStore setEntry:entry forCrashReport:filename];
     PRESLogVerbose(@"VERBOSE: Storing crash meta data finished.");
 }
 
@@ -928,21 +965,34 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
     if ([self.fileManager fileExistsAtPath:_crashesDir]) {
         NSError *error = NULL;
         
-        NSArray *dirArray = [self.fileManager contentsOfDirectoryAtPath:_crashesDir error:&error];
+        // prefetch type and size with the directory listing instead of stat-ing every file separately
+        NSArray *dirArray = [self.fileManager contentsOfDirectoryAtURL:[NSURL fileURLWithPath:_crashesDir]
+                                            includingPropertiesForKeys:@[NSURLIsRegularFileKey, NSURLFileSizeKey]
+                                                               options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                                 error:&error];
         
-        for (NSString *file in dirArray) {
-            NSString *filePath = [_crashesDir stringByAppendingPathComponent:file];
+        for (NSURL *fileURL in dirArray) {
+            NSString *file = fileURL.lastPathComponent;
+            NSNumber *isRegularFile = nil;
+            NSNumber *fileSize = nil;
+            [fileURL getResourceValue:&isRegularFile forKey:NSURLIsRegularFileKey error:nil];
+            [fileURL getResourceValue:&fileSize forKey:NSURLFileSizeKey error:nil];
             
-            NSDictionary *fileAttributes = [self.fileManager attributesOfItemAtPath:filePath error:&error];
-            if ([[fileAttributes objectForKey:NSFileType] isEqualToString:NSFileTypeRegular] &&
-                [[fileAttributes objectForKey:NSFileSize] intValue] > 0 &&
+            if ([isRegularFile boolValue] &&
+                [fileSize unsignedLongLongValue] > 0 &&
                 ![file hasSuffix:@".DS_Store"] &&
                 ![file hasSuffix:@".analyzer"] &&
                 ![file hasSuffix:@".plist"] &&
+                ![file hasSuffix:@".index"] &&
                 ![file hasSuffix:@".data"] &&
+                ![file hasSuffix:@".attachment"] &&
+                ![file hasSuffix:@".multipart"] &&
                 ![file hasSuffix:@".meta"] &&
                 ![file hasSuffix:@".desc"]) {
-                [_crashFiles addObject:filePath];
+                NSString *filePath = [_crashesDir stringByAppendingPathComponent:file];
+                if (![_crashFiles containsObject:filePath]) {
+                    [_crashFiles addObject:filePath];
+                }
             }
         }
     }
@@ -1140,7 +1190,9 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
             // Check if we previously crashed
             if ([self.plCrashReporter hasPendingCrashReport]) {
                 _didCrashInLastSession = YES;
+                uint64_t processingStart = pres_monotonic_ns();
                 [self handleCrashReport];
+                pres_stats_record(PRESStatsHistogramCrashProcessingMs, (pres_monotonic_ns() - processingStart) / NSEC_PER_MSEC);
             }
             
             // The actual signal and mach handlers are only registered when invoking `enableCrashReporterAndReturnError`
@@ -1283,12 +1335,7 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
     [fakeReportString appendString:@"Code Type:       ARM\n"];
     [fakeReportString appendString:@"\n"];
     
-    NSLocale *enUSPOSIXLocale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
-    NSDateFormatter *rfc3339Formatter = [[NSDateFormatter alloc] init];
-    [rfc3339Formatter setLocale:enUSPOSIXLocale];
-    [rfc3339Formatter setDateFormat:@"yyyy'-'MM'-'dd'T'HH':'mm':'ss'Z'"];
-    [rfc3339Formatter setTimeZone:[NSTimeZone timeZoneForSecondsFromGMT:0]];
-    NSString *fakeCrashTimestamp = [rfc3339Formatter stringFromDate:[NSDate date]];
+    NSString *fakeCrashTimestamp = pres_rfc3339DateString([NSDate date]);
     
     // we use the current date, since we don't know when the kill actually happened
     [fakeReportString appendFormat:@"Date/Time:       %@\n", fakeCrashTimestamp];
@@ -1380,7 +1427,7 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
         NSString *osVersion = nil;
         NSString *deviceModel = nil;
         NSString *appBinaryUUIDs = nil;
-        NSString *metaFilename = nil;
+        NSData *compactReport = nil;
         
         NSPropertyListFormat format;
         
@@ -1400,7 +1447,6 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
             deviceModel = [fakeReportDict objectForKey:kPRESFakeCrashDeviceModel];
             osVersion = [fakeReportDict objectForKey:kPRESFakeCrashOSVersion];
             
-            metaFilename = [cacheFilename stringByReplacingOccurrencesOfString:@".fake" withString:@".meta"];
             attachmentFilename = [attachmentFilename stringByReplacingOccurrencesOfString:@".fake" withString:@""];
             
             if ([appBundleVersion compare:[[NSBundle mainBundle] objectForInfoDictionaryKey:@"CFBundleVersion"]] == NSOrderedSame) {
@@ -1426,8 +1472,11 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
             if (report.uuidRef != NULL) {
                 crashUUID = (NSString *) CFBridgingRelease(CFUUIDCreateString(NULL, report.uuidRef));
             }
-            metaFilename = [cacheFilename stringByAppendingPathExtension:@"meta"];
-            crashLogString = [PRESCrashReportTextFormatter stringValueForCrashReport:report crashReporterKey:installString];
+            if (self.isCompactCrashReportFormatEnabled) {
+                // the server renders the text report, only an empty log is sent along the XML meta data
+                compactReport = [PRESCrashReportCompactFormatter dataValueForCrashReport:report crashReporterKey:installString];
+            }
+            crashLogString = compactReport ? @"" : [PRESCrashReportTextFormatter stringValueForCrashReport:report crashReporterKey:installString];
             appBundleIdentifier = report.applicationInfo.applicationIdentifier;
             appBundleMarketingVersion = report.applicationInfo.applicationMarketingVersion ?: @"";
             appBundleVersion = report.applicationInfo.applicationVersion;
@@ -1449,22 +1498,34 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
         NSString *applicationLog = @"";
         NSString *description = @"";
         
-        NSData *plist = [NSData dataWithContentsOfFile:[_crashesDir stringByAppendingPathComponent:metaFilename]];
-        if (plist) {
-            NSDictionary *metaDict = (NSDictionary *)[NSPropertyListSerialization
-                                                      propertyListWithData:plist
-                                                      options:NSPropertyListMutableContainersAndLeaves
-                                                      format:&format
-                                                      error:&error];
-            
-            username = [self stringValueFromKeychainForKey:[NSString stringWithFormat:@"%@.%@", attachmentFilename.lastPathComponent, kPRESCrashMetaUserName]] ?: @"";
-            useremail = [self stringValueFromKeychainForKey:[NSString stringWithFormat:@"%@.%@", attachmentFilename.lastPathComponent, kPRESCrashMetaUserEmail]] ?: @"";
-            userid = [self stringValueFromKeychainForKey:[NSString stringWithFormat:@"%@.%@", attachmentFilename.lastPathComponent, kPRESCrashMetaUserID]] ?: @"";
-            applicationLog = [metaDict objectForKey:kPRESCrashMetaApplicationLog] ?: @"";
-            description = [NSString stringWithContentsOfFile:[NSString stringWithFormat:@"%@.desc", [_crashesDir stringByAppendingPathComponent: cacheFilename]] encoding:NSUTF8StringEncoding error:&error];
+        PRESCrashMetaDataEntry *metaData = [_metaDataStore entryForCrashReport:cacheFilename];
+        if (metaData) {
+            username = metaData.userName ?: @"";
+            useremail = metaData.userEmail ?: @"";
+            userid = metaData.userID ?: @"";
+            applicationLog = metaData.applicationLog ?: @"";
+            description = metaData.userProvidedDescription ?: @"";
             attachment = [self attachmentForCrashReport:attachmentFilename];
         } else {
-            PRESLogError(@"ERROR: Reading crash meta data. %@", error);
+            // fall back to the meta data layout of previous SDK versions
+            NSString *legacyMetaFilename = [[cacheFilename stringByDeletingPathExtension] stringByAppendingPathExtension:@"meta"];
+            NSData *plist = [NSData dataWithContentsOfFile:[_crashesDir stringByAppendingPathComponent:legacyMetaFilename]];
+            if (plist) {
+                NSDictionary *metaDict = (NSDictionary *)[NSPropertyListSerialization
+                                                          propertyListWithData:plist
+                                                          options:NSPropertyListMutableContainersAndLeaves
+                                                          format:&format
+                                                          error:&error];
+                
+                username = [self stringValueFromKeychainForKey:[NSString stringWithFormat:@"%@.%@", attachmentFilename.lastPathComponent, kPRESCrashMetaUserName]] ?: @"";
+                useremail = [self stringValueFromKeychainForKey:[NSString stringWithFormat:@"%@.%@", attachmentFilename.lastPathComponent, kPRESCrashMetaUserEmail]] ?: @"";
+                userid = [self stringValueFromKeychainForKey:[NSString stringWithFormat:@"%@.%@", attachmentFilename.lastPathComponent, kPRESCrashMetaUserID]] ?: @"";
+                applicationLog = [metaDict objectForKey:kPRESCrashMetaApplicationLog] ?: @"";
+                description = [NSString stringWithContentsOfFile:[NSString stringWithFormat:@"%@.desc", [_crashesDir stringByAppendingPathComponent: cacheFilename]] encoding:NSUTF8StringEncoding error:&error] ?: @"";
+                attachment = [self attachmentForCrashReport:attachmentFilename];
+            } else {
+                PRESLogError(@"ERROR: Reading crash meta data. %@", error);
+            }
         }
         
         if ([applicationLog length] > 0) {
@@ -1493,7 +1554,7 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
                     [description stringByReplacingOccurrencesOfString:@"]]>" withString:@"]]" @"]]><![CDATA[" @">" options:NSLiteralSearch range:NSMakeRange(0,description.length)]];
         
         PRESLogDebug(@"INFO: Sending crash reports:\n%@", crashXML);
-        [self sendCrashReportWithFilename:filename xml:crashXML attachment:attachment];
+        [self sendCrashReportWithFilename:filename xml:crashXML compactReport:compactReport attachment:attachment attachmentFileURL:[self attachmentFileURLForCrashReport:attachmentFilename]];
     } else {
         // we cannot do anything with this report, so delete it
         [self cleanCrashReportWithFilename:filename];
@@ -1521,59 +1582,59 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
 
 #pragma mark - Networking
 
-- (NSData *)postBodyWithXML:(NSString *)xml attachment:(PRESAttachment *)attachment boundary:(NSString *)boundary {
-    NSMutableData *postBody =  [NSMutableData data];
-    
-    //  [postBody appendData:[[NSString stringWithFormat:@"\r\n"] dataUsingEncoding:NSUTF8StringEncoding]];
-    [postBody appendData:[PRESNetworkClient dataWithPostValue:PRES_NAME
-                                                       forKey:@"sdk"
-                                                     boundary:boundary]];
+- (PRESMultipartFormData *)multipartFormDataWithXML:(NSString *)xml compactReport:(NSData *)compactReport attachment:(PRESAttachment *)attachment attachmentFileURL:(NSURL *)attachmentFileURL boundary:(NSString *)boundary {
+    PRESMultipartFormData *formData = [[PRESMultipartFormData alloc] initWithBoundary:boundary];
     
-    [postBody appendData:[PRESNetworkClient dataWithPostValue:[PRESVersion getSDKVersion]
-                                                       forKey:@"sdk_version"
-                                                     boundary:boundary]];
+    [formData appendPartWithValue:PRES_NAME forKey:@"sdk"];
+    [formData appendPartWithValue:[PRESVersion getSDKVersion] forKey:@"sdk_version"];
+    [formData appendPartWithValue:@"no" forKey:@"feedbackEnabled"];
     
-    [postBody appendData:[PRESNetworkClient dataWithPostValue:@"no"
-                                                       forKey:@"feedbackEnabled"
-                                                     boundary:boundary]];
+    NSData *xmlData = [xml dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *gzippedXMLData = self.compressCrashXMLEnabled ? [xmlData pres_gzippedData] : nil;
+    if (gzippedXMLData) {
+        [formData appendPartWithData:gzippedXMLData forKey:@"xml" contentType:@"application/x-gzip" filename:@"crash.xml.gz"];
+    } else {
+        [formData appendPartWithData:xmlData forKey:@"xml" contentType:@"text/xml" filename:@"crash.xml"];
+    }
     
-    [postBody appendData:[PRESNetworkClient dataWithPostValue:[xml dataUsingEncoding:NSUTF8StringEncoding]
-                                                       forKey:@"xml"
-                                                  contentType:@"text/xml"
-                                                     boundary:boundary
-                                                     filename:@"crash.xml"]];
+    if (compactReport) {
+        [formData appendPartWithData:compactReport
+                              forKey:@"compact_report"
+                         contentType:[NSString stringWithFormat:@"application/x-pres-crash; version=%u", PRESCrashReportCompactFormatVersion]
+                            filename:@"crash.bin"];
+    }
     
-    if (attachment && attachment.hockeyAttachmentData) {
+    if (attachment && (attachment.hockeyAttachmentData || attachmentFileURL)) {
         NSString *attachmentFilename = attachment.filename;
         if (!attachmentFilename) {
             attachmentFilename = @"Attachment_0";
         }
-        [postBody appendData:[PRESNetworkClient dataWithPostValue:attachment.hockeyAttachmentData
-                                                           forKey:@"attachment0"
-                                                      contentType:attachment.contentType
-                                                         boundary:boundary
-                                                         filename:attachmentFilename]];
+        if (attachment.hockeyAttachmentData) {
+            [formData appendPartWithData:attachment.hockeyAttachmentData
+                                  forKey:@"attachment0"
+                             contentType:attachment.contentType
+                                filename:attachmentFilename];
+        } else if (![formData appendPartWithFileURL:attachmentFileURL
+                                             forKey:@"attachment0"
+                                        contentType:attachment.contentType
+                                           filename:attachmentFilename]) {
+            PRESLogWarning(@"WARNING: Could not read crash attachment at %@", attachmentFileURL);
+        }
     }
     
-    [postBody appendData:[[NSString stringWithFormat:@"\r\n--%@--\r\n", boundary] dataUsingEncoding:NSUTF8StringEncoding]];
-    
-    return postBody;
+    return formData;
 }
 
-- (NSMutableURLRequest *)requestWithBoundary:(NSString *)boundary {
+- (NSMutableURLRequest *)requestWithMultipartFormData:(PRESMultipartFormData *)formData {
     NSString *postCrashPath = [NSString stringWithFormat:@"api/2/apps/%@/crashes", self.encodedAppIdentifier];
     
-    NSMutableURLRequest *request = [self.hockeyAppClient requestWithMethod:@"POST"
-                                                                      path:postCrashPath
-                                                                parameters:nil];
+    NSMutableURLRequest *request = [self.hockeyAppClient requestWithPath:postCrashPath
+                                                       multipartFormData:formData];
     
     [request setCachePolicy: NSURLRequestReloadIgnoringLocalCacheData];
     [request setValue:@"PreSniffObjc/iOS" forHTTPHeaderField:@"User-Agent"];
     [request setValue:@"gzip" forHTTPHeaderField:@"Accept-Encoding"];
     
-    NSString *contentType = [NSString stringWithFormat:@"multipart/form-data; boundary=%@", boundary];
-    [request setValue:contentType forHTTPHeaderField:@"Content-type"];
-    
     return request;
 }
 
@@ -1637,59 +1698,79 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
     });
 }
 
+/**
+ *  Like processUploadResultWithFilename:responseData:statusCode:error: for reports sent as chunk of a
+ *  batch upload, those only tell whether the server took the report.
+ */
+- (void)processBatchUploadResultWithFilename:(NSString *)filename acknowledged:(BOOL)acknowledged {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        _sendingInProgress = NO;
+        
+        if (acknowledged) {
+            [self cleanCrashReportWithFilename:filename];
+            
+            if ([self.delegate respondsToSelector:@selector(crashManagerDidFinishSendingCrashReport:)]) {
+                [self.delegate crashManagerDidFinishSendingCrashReport:self];
+            }
+            
+            [self sendNextCrashReport];
+            return;
+        }
+        
+        NSError *theError = [NSError errorWithDomain:kPRESCrashErrorDomain
+                                                code:PRESCrashAPIErrorWithStatusCode
+                                            userInfo:@{
+                                                       NSLocalizedDescriptionKey: @"Sending failed, the batch upload was not acknowledged"
+                                                       }
+                             ];
+        if ([self.delegate respondsToSelector:@selector(crashManager:didFailWithError:)]) {
+            [self.delegate crashManager:self didFailWithError:theError];
+        }
+        
+        PRESLogError(@"ERROR: %@", [theError localizedDescription]);
+    });
+}
+
 /**
  *	 Send the XML data to the server
  *
- * Wraps the XML structure into a POST body and starts sending the data asynchronously
+ * Wraps the XML structure into a multipart body which is written to a temporary file part by part
+ * and uploaded from there, so large attachments are never copied into one big buffer.
  *
  *	@param	xml	The XML data that needs to be send to the server
+ *	@param	compactReport	The binary crash report if the compact format is enabled, otherwise nil
  */
-- (void)sendCrashReportWithFilename:(NSString *)filename xml:(NSString*)xml attachment:(PRESAttachment *)attachment {
-    BOOL sendingWithURLSession = NO;
+- (void)sendCrashReportWithFilename:(NSString *)filename xml:(NSString*)xml compactReport:(NSData *)compactReport attachment:(PRESAttachment *)attachment attachmentFileURL:(NSURL *)attachmentFileURL {
+    PRESMultipartFormData *formData = [self multipartFormDataWithXML:xml compactReport:compactReport attachment:attachment attachmentFileURL:attachmentFileURL boundary:kPRESNetworkClientBoundary];
+    NSMutableURLRequest *request = [self requestWithMultipartFormData:formData];
+    NSURL *bodyFileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:
+                                                 [[filename lastPathComponent] stringByAppendingPathExtension:@"multipart"]]];
     
-    if ([PRESHelper isURLSessionSupported]) {
-        NSURLSessionConfiguration *sessionConfiguration = [NSURLSessionConfiguration defaultSessionConfiguration];
-        __block NSURLSession *session = [NSURLSession sessionWithConfiguration:sessionConfiguration];
-        
-        NSURLRequest *request = [self requestWithBoundary:kPRESNetworkClientBoundary];
-        NSData *data = [self postBodyWithXML:xml attachment:attachment boundary:kPRESNetworkClientBoundary];
-        
-        if (request && data) {
-            __weak typeof (self) weakSelf = self;
-            NSURLSessionUploadTask *uploadTask = [session uploadTaskWithRequest:request
-                                                                       fromData:data
-                                                              completionHandler:^(NSData *responseData, NSURLResponse *response, NSError *error) {
-                                                                  typeof (self) strongSelf = weakSelf;
-                                                                  
-                                                                  [session finishTasksAndInvalidate];
-                                                                  
-                                                                  NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse*) response;
-                                                                  NSInteger statusCode = [httpResponse statusCode];
-                                                                  [strongSelf processUploadResultWithFilename:filename responseData:responseData statusCode:statusCode error:error];
-                                                              }];
-            
-            [uploadTask resume];
-            sendingWithURLSession = YES;
-        }
+    NSError *error = nil;
+    if (![formData writeToFileURL:bodyFileURL error:&error]) {
+        PRESLogError(@"ERROR: Writing crash report upload body failed. %@", error);
+        _sendingInProgress = NO;
+        return;
     }
     
-    if (!sendingWithURLSession) {
-        NSMutableURLRequest *request = [self requestWithBoundary:kPRESNetworkClientBoundary];
-        
-        NSData *postBody = [self postBodyWithXML:xml attachment:attachment boundary:kPRESNetworkClientBoundary];
-        [request setHTTPBody:postBody];
-        
-        __weak typeof (self) weakSelf = self;
-        PRESHTTPOperation *operation = [self.hockeyAppClient
-                                        operationWithURLRequest:request
-                                        completion:^(PRESHTTPOperation *operation, NSData* responseData, NSError *error) {
-                                            typeof (self) strongSelf = weakSelf;
-                                            
-                                            NSInteger statusCode = [operation.response statusCode];
-                                            [strongSelf processUploadResultWithFilename:filename responseData:responseData statusCode:statusCode error:error];
-                                        }];
-        
-        [self.hockeyAppClient enqeueHTTPOperation:operation];
+    __weak typeof (self) weakSelf = self;
+    if ([PRESBatchUploader sharedUploader].enabled) {
+        // the body stays in its file, the uploader streams it into the envelope
+        PRESBatchChunk *chunk = [PRESBatchChunk chunkWithType:PRESBatchChunkTypeCrashReport payloadFileURL:bodyFileURL completion:^(PRESBatchChunk *chunk, BOOL acknowledged) {
+            typeof (self) strongSelf = weakSelf;
+            
+            [[NSFileManager defaultManager] removeItemAtURL:bodyFileURL error:nil];
+            [strongSelf processBatchUploadResultWithFilename:filename acknowledged:acknowledged];
+        }];
+        if (!chunk) {
+            PRESLogError(@"ERROR: Reading crash report upload body failed.");
+            [[NSFileManager defaultManager] removeItemAtURL:bodyFileURL error:nil];
+            _sendingInProgress = NO;
+            return;
+        }
+        [[PRESBatchUploader sharedUploader] enqueueChunk:chunk];
+    } else {
+        [self uploadRequest:request bodyFileURL:bodyFileURL filename:filename];
     }
     
     if ([self.delegate respondsToSelector:@selector(crashManagerWillSendCrashReport:)]) {
@@ -1699,6 +1780,19 @@ static void uncaught_cxx_exception_handler(const PRESCrashUncaughtCXXExceptionIn
     PRESLogDebug(@"INFO: Sending crash reports started.");
 }
 
+- (void)uploadRequest:(NSURLRequest *)request bodyFileURL:(NSURL *)bodyFileURL filename:(NSString *)filename {
+    __weak typeof (self) weakSelf = self;
+    [[PRESTransport sharedTransport] uploadRequest:request
+                                          fromFile:bodyFileURL
+                                           options:PRESTransportOptionNone
+                                        completion:^(NSData *responseData, NSHTTPURLResponse *response, NSError *error) {
+                                            typeof (self) strongSelf = weakSelf;
+                                            
+                                            [[NSFileManager defaultManager] removeItemAtURL:bodyFileURL error:nil];
+                                            [strongSelf processUploadResultWithFilename:filename responseData:responseData statusCode:response.statusCode error:error];
+                                        }];
+}
+
 - (NSTimeInterval)timeintervalCrashInLastSessionOccured {
     return self.timeIntervalCrashInLastSessionOccurred;
 }
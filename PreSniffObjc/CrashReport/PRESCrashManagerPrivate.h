@@ -67,6 +67,13 @@
 
 @property (nonatomic, strong) NSString *crashesDir;
 
+/**
+ *  Send the crash XML part gzip compressed, the server has to accept `crash.xml.gz` parts
+ *
+ *  Default: _NO_
+ */
+@property (nonatomic, assign, getter=isCompressCrashXMLEnabled) BOOL compressCrashXMLEnabled;
+
 - (instancetype)initWithAppIdentifier:(NSString *)appIdentifier appEnvironment:(PRESEnvironment)environment hockeyAppClient:(PRESNetworkClient *)hockeyAppClient NS_DESIGNATED_INITIALIZER;
 
 - (void)cleanCrashReports;
@@ -83,6 +90,7 @@
 - (BOOL)persistAttachment:(PRESAttachment *)attachment withFilename:(NSString *)filename;
 
 - (PRESAttachment *)attachmentForCrashReport:(NSString *)filename;
+- (NSURL *)attachmentFileURLForCrashReport:(NSString *)filename;
 
 - (void)invokeDelayedProcessing;
 - (void)sendNextCrashReport;
@@ -0,0 +1,51 @@
+//
+//  PRESCrashMetaDataStore.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 02/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  Meta data gathered for a single crash report
+ */
+@interface PRESCrashMetaDataEntry : NSObject
+
+@property (nonatomic, copy) NSString *applicationLog;
+@property (nonatomic, copy) NSString *userProvidedDescription;
+
+// secure fields, these are never written to disk but kept in the keychain
+@property (nonatomic, copy) NSString *userName;
+@property (nonatomic, copy) NSString *userEmail;
+@property (nonatomic, copy) NSString *userID;
+
+@end
+
+/**
+ *  Compact meta data index for all crash reports in the crashes directory
+ *
+ *  The small public fields of all reports live in one PRESBinaryRecord index, the secure fields of
+ *  all reports are batched into a single keychain item. Both are loaded once on first access. The
+ *  application logs are the only big field, every report keeps its log in its own file, which is
+ *  only read with the entry and only rewritten when it changed.
+ */
+@interface PRESCrashMetaDataStore : NSObject
+
+- (instancetype)initWithCrashesDir:(NSString *)crashesDir;
+
+/**
+ *  Returns the meta data for the given crash report or nil if nothing was stored
+ *
+ *  @param filename the crash report filename, extensions like `.fake` are ignored
+ */
+- (PRESCrashMetaDataEntry *)entryForCrashReport:(NSString *)filename;
+
+- (void)setEntry:(PRESCrashMetaDataEntry *)entry forCrashReport:(NSString *)filename;
+
+- (void)removeEntryForCrashReport:(NSString *)filename;
+
+- (void)removeAllEntries;
+
+@end
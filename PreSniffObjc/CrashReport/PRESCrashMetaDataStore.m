@@ -0,0 +1,209 @@
+//
+//  PRESCrashMetaDataStore.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 02/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESCrashMetaDataStore.h"
+#import "PRESPrivate.h"
+#import "PRESHelper.h"
+#import "PRESBinaryRecord.h"
+#import "PRESKeychainStore.h"
+
+static uint8_t const PRESCrashMetaRecordVersion = 1;
+
+static NSString *const kPRESCrashMetaIndexFileName = @"index";
+static NSString *const kPRESCrashMetaLogFileExtension = @"log";
+static NSString *const kPRESCrashMetaSecureIndex = @"PRESCrashMetaSecureIndex";
+
+// Record keys are "<crash report> <field>"
+static NSString *const kPRESCrashMetaDescriptionField = @"description";
+static NSString *const kPRESCrashMetaUserNameField = @"user_name";
+static NSString *const kPRESCrashMetaUserEmailField = @"user_email";
+static NSString *const kPRESCrashMetaUserIDField = @"user_id";
+
+#pragma mark - PRESCrashMetaDataEntry
+
+@implementation PRESCrashMetaDataEntry
+@end
+
+#pragma mark - PRESCrashMetaDataStore
+
+@implementation PRESCrashMetaDataStore {
+    NSString *_metaDir;
+    NSMutableDictionary<NSString *, PRESCrashMetaDataEntry *> *_entries;
+    
+    // application logs as they are on disk, keyed like _entries, read on first access of the entry
+    NSMutableDictionary<NSString *, NSString *> *_persistedLogs;
+}
+
+- (instancetype)initWithCrashesDir:(NSString *)crashesDir {
+    if ((self = [super init])) {
+        _metaDir = [crashesDir stringByAppendingPathComponent:PRES_CRASH_META_DIR];
+        _persistedLogs = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (PRESCrashMetaDataEntry *)entryForCrashReport:(NSString *)filename {
+    if (!filename) return nil;
+
+    @synchronized (self) {
+        [self loadIfNeeded];
+        NSString *key = [self keyForCrashReport:filename];
+        PRESCrashMetaDataEntry *entry = _entries[key];
+        if (entry && !_persistedLogs[key]) {
+            NSString *log = [NSString stringWithContentsOfFile:[self logFileForKey:key] encoding:NSUTF8StringEncoding error:nil] ?: @"";
+            _persistedLogs[key] = log;
+            entry.applicationLog = log;
+        }
+        return entry;
+    }
+}
+
+- (void)setEntry:(PRESCrashMetaDataEntry *)entry forCrashReport:(NSString *)filename {
+    if (!entry || !filename) return;
+
+    @synchronized (self) {
+        [self loadIfNeeded];
+        NSString *key = [self keyForCrashReport:filename];
+        _entries[key] = entry;
+        
+        // the logs are the only big field, they are only rewritten when they changed
+        NSString *log = entry.applicationLog ?: @"";
+        if (![_persistedLogs[key] isEqualToString:log]) {
+            [self writeLog:log forKey:key];
+        }
+        [self save];
+    }
+}
+
+- (void)removeEntryForCrashReport:(NSString *)filename {
+    if (!filename) return;
+
+    @synchronized (self) {
+        [self loadIfNeeded];
+        NSString *key = [self keyForCrashReport:filename];
+        if (!_entries[key]) return;
+        [_entries removeObjectForKey:key];
+        [self writeLog:@"" forKey:key];
+        [_persistedLogs removeObjectForKey:key];
+        [self save];
+    }
+}
+
+- (void)removeAllEntries {
+    @synchronized (self) {
+        _entries = [NSMutableDictionary dictionary];
+        [_persistedLogs removeAllObjects];
+        [[NSFileManager defaultManager] removeItemAtPath:_metaDir error:nil];
+        [[PRESKeychainStore sharedStore] removeStringForKey:kPRESCrashMetaSecureIndex];
+    }
+}
+
+#pragma mark - Private
+
+- (NSString *)keyForCrashReport:(NSString *)filename {
+    // crash report filenames are timestamps, fake reports only differ by their extension
+    return [[filename lastPathComponent] stringByDeletingPathExtension];
+}
+
+- (NSString *)indexFile {
+    return [_metaDir stringByAppendingPathComponent:kPRESCrashMetaIndexFileName];
+}
+
+- (NSString *)logFileForKey:(NSString *)key {
+    return [[_metaDir stringByAppendingPathComponent:key] stringByAppendingPathExtension:kPRESCrashMetaLogFileExtension];
+}
+
+/**
+ *  Splits "<crash report> <field>" record keys
+ */
+static void pres_enumerateRecordFields(NSDictionary<NSString *, NSString *> *record, void (^block)(NSString *key, NSString *field, NSString *value)) {
+    [record enumerateKeysAndObjectsUsingBlock:^(NSString *recordKey, NSString *value, BOOL *stop) {
+        NSRange separator = [recordKey rangeOfString:@" " options:NSBackwardsSearch];
+        if (separator.location == NSNotFound) return;
+        block([recordKey substringToIndex:separator.location], [recordKey substringFromIndex:NSMaxRange(separator)], value);
+    }];
+}
+
+- (void)loadIfNeeded {
+    if (_entries) return;
+
+    // every report with meta data has an entry afterwards, lookups of other reports never touch the disk
+    _entries = [NSMutableDictionary dictionary];
+
+    NSData *data = [NSData dataWithContentsOfFile:[self indexFile]];
+    uint8_t version = 0;
+    NSDictionary<NSString *, NSString *> *record = data ? pres_decodeBinaryRecord(data, &version) : nil;
+    if (!record || version != PRESCrashMetaRecordVersion) {
+        if (data) PRESLogWarning(@"WARNING: Ignoring invalid crash meta data index");
+        return;
+    }
+    pres_enumerateRecordFields(record, ^(NSString *key, NSString *field, NSString *value) {
+        if (![field isEqualToString:kPRESCrashMetaDescriptionField]) return;
+        PRESCrashMetaDataEntry *entry = [PRESCrashMetaDataEntry new];
+        entry.userProvidedDescription = value;
+        _entries[key] = entry;
+    });
+    if (_entries.count == 0) return;
+
+    NSString *secureIndex = [[PRESKeychainStore sharedStore] stringForKey:kPRESCrashMetaSecureIndex];
+    NSData *secureData = secureIndex ? [[NSData alloc] initWithBase64EncodedString:secureIndex options:0] : nil;
+    NSDictionary<NSString *, NSString *> *secureRecord = secureData ? pres_decodeBinaryRecord(secureData, NULL) : nil;
+    pres_enumerateRecordFields(secureRecord, ^(NSString *key, NSString *field, NSString *value) {
+        PRESCrashMetaDataEntry *entry = _entries[key];
+        if ([field isEqualToString:kPRESCrashMetaUserNameField]) {
+            entry.userName = value;
+        } else if ([field isEqualToString:kPRESCrashMetaUserEmailField]) {
+            entry.userEmail = value;
+        } else if ([field isEqualToString:kPRESCrashMetaUserIDField]) {
+            entry.userID = value;
+        }
+    });
+}
+
+- (void)writeLog:(NSString *)log forKey:(NSString *)key {
+    NSString *logFile = [self logFileForKey:key];
+    if (log.length == 0) {
+        [[NSFileManager defaultManager] removeItemAtPath:logFile error:nil];
+    } else if (![log writeToFile:logFile atomically:YES encoding:NSUTF8StringEncoding error:nil]) {
+        PRESLogError(@"ERROR: Writing the application log of crash report %@ failed.", key);
+        return;
+    }
+    _persistedLogs[key] = log;
+}
+
+/**
+ *  Writes the index and the keychain item, both only hold the small fields of all reports
+ */
+- (void)save {
+    NSMutableDictionary<NSString *, NSString *> *record = [NSMutableDictionary dictionaryWithCapacity:_entries.count];
+    NSMutableDictionary<NSString *, NSString *> *secureRecord = [NSMutableDictionary dictionary];
+    [_entries enumerateKeysAndObjectsUsingBlock:^(NSString *key, PRESCrashMetaDataEntry *entry, BOOL *stop) {
+        record[[NSString stringWithFormat:@"%@ %@", key, kPRESCrashMetaDescriptionField]] = entry.userProvidedDescription ?: @"";
+        if (entry.userName.length > 0) secureRecord[[NSString stringWithFormat:@"%@ %@", key, kPRESCrashMetaUserNameField]] = entry.userName;
+        if (entry.userEmail.length > 0) secureRecord[[NSString stringWithFormat:@"%@ %@", key, kPRESCrashMetaUserEmailField]] = entry.userEmail;
+        if (entry.userID.length > 0) secureRecord[[NSString stringWithFormat:@"%@ %@", key, kPRESCrashMetaUserIDField]] = entry.userID;
+    }];
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    if (![fileManager fileExistsAtPath:_metaDir]) {
+        [fileManager createDirectoryAtPath:_metaDir withIntermediateDirectories:YES attributes:nil error:nil];
+    }
+    if (![pres_encodeBinaryRecord(record, PRESCrashMetaRecordVersion) writeToFile:[self indexFile] atomically:YES]) {
+        PRESLogError(@"ERROR: Writing crash meta data index failed.");
+    }
+
+    // unchanged values are skipped by the keychain store
+    if (secureRecord.count > 0) {
+        NSString *secureIndex = [pres_encodeBinaryRecord(secureRecord, PRESCrashMetaRecordVersion) base64EncodedStringWithOptions:0];
+        [[PRESKeychainStore sharedStore] setString:secureIndex forKey:kPRESCrashMetaSecureIndex accessibility:kSecAttrAccessibleAlways];
+    } else {
+        [[PRESKeychainStore sharedStore] removeStringForKey:kPRESCrashMetaSecureIndex];
+    }
+}
+
+@end
@@ -0,0 +1,42 @@
+//
+//  PRESCrashReportCompactFormatter.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 07/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class PLCrashReport;
+
+/**
+ *  Version of the compact crash report layout, bumped on every incompatible change
+ */
+extern const uint8_t PRESCrashReportCompactFormatVersion;
+
+/**
+ *  Converts a PLCrashReport into a compact binary representation
+ *
+ *  All integers are unsigned LEB128 varints, strings are a varint byte length followed by UTF-8.
+ *
+ *  - magic `PRCC`, format version (1 byte)
+ *  - incident identifier, crash reporter key, hardware model
+ *  - app identifier, marketing version, version
+ *  - os, os version, os build, architecture, crash timestamp
+ *  - process name, id, path, parent name, parent id, start timestamp
+ *  - signal name, code, address
+ *  - binary image table (deduplicated by base address): base address, size, cpu type, cpu subtype, uuid, path
+ *  - exception: present flag, name, reason, frames
+ *  - threads: number, crashed flag, frames
+ *  - registers of the crashed thread: count, names, then raw little endian 64 bit values
+ *
+ *  A frame is `image index + 1` (0 if no image contains the address) followed by the offset
+ *  into that image, or the absolute address for unknown images. Symbolication and rendering
+ *  of the Apple text format happen on the server.
+ */
+@interface PRESCrashReportCompactFormatter : NSObject
+
++ (NSData *)dataValueForCrashReport:(PLCrashReport *)report crashReporterKey:(NSString *)crashReporterKey;
+
+@end
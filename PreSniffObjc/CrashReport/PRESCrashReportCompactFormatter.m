@@ -0,0 +1,177 @@
+//
+//  PRESCrashReportCompactFormatter.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 07/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESCrashReportCompactFormatter.h"
+#import "PRESBinaryRecord.h"
+#import <CrashReporter/CrashReporter.h>
+
+const uint8_t PRESCrashReportCompactFormatVersion = 1;
+
+static const uint8_t PRESCrashReportCompactMagic[4] = {'P', 'R', 'C', 'C'};
+
+static void pres_appendString(NSMutableData *data, NSString *string) {
+    const char *utf8 = string.UTF8String ?: "";
+    size_t length = strlen(utf8);
+    pres_appendVarint(data, length);
+    [data appendBytes:utf8 length:length];
+}
+
+static void pres_appendTimestamp(NSMutableData *data, NSDate *date) {
+    NSTimeInterval interval = [date timeIntervalSince1970];
+    pres_appendVarint(data, interval > 0 ? (uint64_t)interval : 0);
+}
+
+@implementation PRESCrashReportCompactFormatter
+
++ (NSData *)dataValueForCrashReport:(BITPLCrashReport *)report crashReporterKey:(NSString *)crashReporterKey {
+    NSMutableData *data = [NSMutableData dataWithCapacity:16 * 1024];
+
+    [data appendBytes:PRESCrashReportCompactMagic length:sizeof(PRESCrashReportCompactMagic)];
+    [data appendBytes:&PRESCrashReportCompactFormatVersion length:sizeof(PRESCrashReportCompactFormatVersion)];
+
+    /* Header */
+    NSString *incidentIdentifier = @"???";
+    if (report.uuidRef != NULL) {
+        incidentIdentifier = (NSString *) CFBridgingRelease(CFUUIDCreateString(NULL, report.uuidRef));
+    }
+    pres_appendString(data, incidentIdentifier);
+    pres_appendString(data, crashReporterKey);
+    pres_appendString(data, report.hasMachineInfo ? report.machineInfo.modelName : nil);
+
+    pres_appendString(data, report.applicationInfo.applicationIdentifier);
+    pres_appendString(data, report.applicationInfo.applicationMarketingVersion);
+    pres_appendString(data, report.applicationInfo.applicationVersion);
+
+    pres_appendVarint(data, report.systemInfo.operatingSystem);
+    pres_appendString(data, report.systemInfo.operatingSystemVersion);
+    pres_appendString(data, report.systemInfo.operatingSystemBuild);
+    pres_appendVarint(data, report.systemInfo.processorInfo.type);
+    pres_appendVarint(data, report.systemInfo.processorInfo.subtype);
+    pres_appendTimestamp(data, report.systemInfo.timestamp);
+
+    if (report.hasProcessInfo) {
+        pres_appendString(data, report.processInfo.processName);
+        pres_appendVarint(data, report.processInfo.processID);
+        pres_appendString(data, report.processInfo.processPath);
+        pres_appendString(data, report.processInfo.parentProcessName);
+        pres_appendVarint(data, report.processInfo.parentProcessID);
+        pres_appendTimestamp(data, [report.processInfo respondsToSelector:@selector(processStartTime)] ? report.processInfo.processStartTime : nil);
+    } else {
+        pres_appendString(data, nil);
+        pres_appendVarint(data, 0);
+        pres_appendString(data, nil);
+        pres_appendString(data, nil);
+        pres_appendVarint(data, 0);
+        pres_appendVarint(data, 0);
+    }
+
+    pres_appendString(data, report.signalInfo.name);
+    pres_appendString(data, report.signalInfo.code);
+    pres_appendVarint(data, report.signalInfo.address);
+
+    /* Binary images, deduplicated and sorted by base address for the frame lookup */
+    NSMutableArray<BITPLCrashReportBinaryImageInfo *> *images = [NSMutableArray arrayWithCapacity:report.images.count];
+    NSMutableSet<NSNumber *> *seenBaseAddresses = [NSMutableSet setWithCapacity:report.images.count];
+    for (BITPLCrashReportBinaryImageInfo *imageInfo in report.images) {
+        if ([seenBaseAddresses containsObject:@(imageInfo.imageBaseAddress)]) continue;
+        [seenBaseAddresses addObject:@(imageInfo.imageBaseAddress)];
+        [images addObject:imageInfo];
+    }
+    [images sortUsingComparator:^NSComparisonResult(BITPLCrashReportBinaryImageInfo *a, BITPLCrashReportBinaryImageInfo *b) {
+        if (a.imageBaseAddress < b.imageBaseAddress) return NSOrderedAscending;
+        if (a.imageBaseAddress > b.imageBaseAddress) return NSOrderedDescending;
+        return NSOrderedSame;
+    }];
+
+    NSUInteger imageCount = images.count;
+    uint64_t *imageStarts = calloc(MAX(imageCount, 1U), sizeof(uint64_t));
+    uint64_t *imageEnds = calloc(MAX(imageCount, 1U), sizeof(uint64_t));
+    if (!imageStarts || !imageEnds) {
+        free(imageStarts);
+        free(imageEnds);
+        return nil;
+    }
+
+    pres_appendVarint(data, imageCount);
+    for (NSUInteger i = 0; i < imageCount; i++) {
+        BITPLCrashReportBinaryImageInfo *imageInfo = images[i];
+        imageStarts[i] = imageInfo.imageBaseAddress;
+        imageEnds[i] = imageInfo.imageBaseAddress + MAX(1U, imageInfo.imageSize);
+
+        pres_appendVarint(data, imageInfo.imageBaseAddress);
+        pres_appendVarint(data, imageInfo.imageSize);
+        BOOL hasMachCodeType = imageInfo.codeType != nil && imageInfo.codeType.typeEncoding == PLCrashReportProcessorTypeEncodingMach;
+        pres_appendVarint(data, hasMachCodeType ? imageInfo.codeType.type : 0);
+        pres_appendVarint(data, hasMachCodeType ? imageInfo.codeType.subtype : 0);
+        pres_appendString(data, imageInfo.hasImageUUID ? imageInfo.imageUUID : nil);
+        pres_appendString(data, imageInfo.imageName);
+    }
+
+    void (^appendFrames)(NSArray<BITPLCrashReportStackFrameInfo *> *) = ^(NSArray<BITPLCrashReportStackFrameInfo *> *frames) {
+        pres_appendVarint(data, frames.count);
+        for (BITPLCrashReportStackFrameInfo *frameInfo in frames) {
+            uint64_t address = frameInfo.instructionPointer;
+
+            // binary search for the last image starting at or before the address
+            NSUInteger low = 0, high = imageCount;
+            while (low < high) {
+                NSUInteger mid = low + (high - low) / 2;
+                if (imageStarts[mid] <= address) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+
+            if (low > 0 && address < imageEnds[low - 1]) {
+                pres_appendVarint(data, low);
+                pres_appendVarint(data, address - imageStarts[low - 1]);
+            } else {
+                pres_appendVarint(data, 0);
+                pres_appendVarint(data, address);
+            }
+        }
+    };
+
+    /* Exception */
+    BOOL hasException = report.hasExceptionInfo && report.exceptionInfo != nil;
+    pres_appendVarint(data, hasException ? 1 : 0);
+    if (hasException) {
+        pres_appendString(data, report.exceptionInfo.exceptionName);
+        pres_appendString(data, report.exceptionInfo.exceptionReason);
+        appendFrames(report.exceptionInfo.stackFrames);
+    }
+
+    /* Threads */
+    BITPLCrashReportThreadInfo *crashedThread = nil;
+    pres_appendVarint(data, report.threads.count);
+    for (BITPLCrashReportThreadInfo *thread in report.threads) {
+        if (thread.crashed) crashedThread = thread;
+        pres_appendVarint(data, (uint64_t)thread.threadNumber);
+        pres_appendVarint(data, thread.crashed ? 1 : 0);
+        appendFrames(thread.stackFrames);
+    }
+
+    /* Registers */
+    NSArray<BITPLCrashReportRegisterInfo *> *registers = crashedThread.registers ?: @[];
+    pres_appendVarint(data, registers.count);
+    for (BITPLCrashReportRegisterInfo *reg in registers) {
+        pres_appendString(data, reg.registerName);
+    }
+    for (BITPLCrashReportRegisterInfo *reg in registers) {
+        uint64_t value = CFSwapInt64HostToLittle(reg.registerValue);
+        [data appendBytes:&value length:sizeof(value)];
+    }
+
+    free(imageStarts);
+    free(imageEnds);
+
+    return data;
+}
+
+@end
@@ -33,6 +33,7 @@
 
 #import "PreSniffObjc.h"
 #import "PRESPrivate.h"
+#import "PRESHelper.h"
 #import <CrashReporter/CrashReporter.h>
 
 #import <mach-o/dyld.h>
@@ -385,16 +386,10 @@ NSString *const PRESXamarinStackTraceDelimiter = @"Xamarin Exception Stack:";
         if (report.systemInfo.operatingSystemBuild != nil)
             osBuild = report.systemInfo.operatingSystemBuild;
         
-        NSLocale *enUSPOSIXLocale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
-        NSDateFormatter *rfc3339Formatter = [[NSDateFormatter alloc] init];
-        [rfc3339Formatter setLocale:enUSPOSIXLocale];
-        [rfc3339Formatter setDateFormat:@"yyyy'-'MM'-'dd'T'HH':'mm':'ss'Z'"];
-        [rfc3339Formatter setTimeZone:[NSTimeZone timeZoneForSecondsFromGMT:0]];
-        
-        [text appendFormat: @"Date/Time:       %@\n", [rfc3339Formatter stringFromDate:report.systemInfo.timestamp]];
+        [text appendFormat: @"Date/Time:       %@\n", pres_rfc3339DateString(report.systemInfo.timestamp)];
         if ([report.processInfo respondsToSelector:@selector(processStartTime)]) {
             if (report.systemInfo.timestamp && report.processInfo.processStartTime) {
-                [text appendFormat: @"Launch Time:     %@\n", [rfc3339Formatter stringFromDate:report.processInfo.processStartTime]];
+                [text appendFormat: @"Launch Time:     %@\n", pres_rfc3339DateString(report.processInfo.processStartTime)];
             }
         }
         [text appendFormat: @"OS Version:      %@ %@ (%@)\n", osName, report.systemInfo.operatingSystemVersion, osBuild];
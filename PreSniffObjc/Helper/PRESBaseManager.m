@@ -34,7 +34,7 @@
 #import "PRESBaseManager.h"
 #import "PRESBaseManagerPrivate.h"
 
-#import "PRESKeychainUtils.h"
+#import "PRESKeychainStore.h"
 
 #import <sys/sysctl.h>
 #import <mach-o/dyld.h>
@@ -131,42 +131,29 @@
     if (!key || !stringValue)
         return NO;
     
-    NSError *error = nil;
-    return [PRESKeychainUtils storeUsername:key
-                                andPassword:stringValue
-                             forServiceName:pres_keychainPreSniffObjcServiceName()
-                             updateExisting:YES
-                                      error:&error];
+    return [[PRESKeychainStore sharedStore] writeString:stringValue forKey:key accessibility:kSecAttrAccessibleAlways];
 }
 
 - (BOOL)addStringValueToKeychainForThisDeviceOnly:(NSString *)stringValue forKey:(NSString *)key {
     if (!key || !stringValue)
         return NO;
     
-    NSError *error = nil;
-    return [PRESKeychainUtils storeUsername:key
-                                andPassword:stringValue
-                             forServiceName:pres_keychainPreSniffObjcServiceName()
-                             updateExisting:YES
-                              accessibility:kSecAttrAccessibleAfterFirstUnlockThisDeviceOnly
-                                      error:&error];
+    return [[PRESKeychainStore sharedStore] writeString:stringValue forKey:key accessibility:kSecAttrAccessibleAfterFirstUnlockThisDeviceOnly];
 }
 
 - (NSString *)stringValueFromKeychainForKey:(NSString *)key {
     if (!key)
         return nil;
     
-    NSError *error = nil;
-    return [PRESKeychainUtils getPasswordForUsername:key
-                                      andServiceName:pres_keychainPreSniffObjcServiceName()
-                                               error:&error];
+    return [[PRESKeychainStore sharedStore] stringForKey:key];
 }
 
 - (BOOL)removeKeyFromKeychain:(NSString *)key {
-    NSError *error = nil;
-    return [PRESKeychainUtils deleteItemForUsername:key
-                                     andServiceName:pres_keychainPreSniffObjcServiceName()
-                                              error:&error];
+    if (!key)
+        return NO;
+    
+    [[PRESKeychainStore sharedStore] removeStringForKey:key];
+    return YES;
 }
 
 
@@ -0,0 +1,51 @@
+//
+//  PRESBinaryRecord.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 13/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Encodes a flat string record into a compact binary representation
+ *
+ *  Layout: magic `PRBR`, schema version (1 byte), field count, then for every field the key
+ *  and the value. Counts and string lengths are unsigned LEB128 varints, strings are UTF-8.
+ *  Fields are self describing, so readers skip keys they don't know and newer writers can add
+ *  fields without bumping the version. The version is only bumped for incompatible changes.
+ *
+ *  @param record  keys and values, both have to be strings
+ *  @param version schema version of the record
+ *
+ *  @return the encoded record
+ */
+NSData *pres_encodeBinaryRecord(NSDictionary<NSString *, NSString *> *record, uint8_t version);
+
+/**
+ *  Decodes a record created by pres_encodeBinaryRecord
+ *
+ *  @param data    the encoded record
+ *  @param version set to the schema version of the record, may be NULL
+ *
+ *  @return the record or nil if data is not a valid record
+ */
+NSDictionary<NSString *, NSString *> *_Nullable pres_decodeBinaryRecord(NSData *data, uint8_t *_Nullable version);
+
+/**
+ *  Appends value as unsigned LEB128 varint, shared with other binary formats of the SDK
+ */
+void pres_appendVarint(NSMutableData *data, uint64_t value);
+
+/**
+ *  Reads an unsigned LEB128 varint at cursor and advances it
+ *
+ *  @return NO if the varint is truncated or longer than 64 bits
+ */
+BOOL pres_readVarint(const uint8_t *_Nonnull *_Nonnull cursor, const uint8_t *end, uint64_t *value);
+
+NS_ASSUME_NONNULL_END
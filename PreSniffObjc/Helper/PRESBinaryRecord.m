@@ -0,0 +1,93 @@
+//
+//  PRESBinaryRecord.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 13/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESBinaryRecord.h"
+
+static const uint8_t PRESBinaryRecordMagic[4] = {'P', 'R', 'B', 'R'};
+
+void pres_appendVarint(NSMutableData *data, uint64_t value) {
+    uint8_t buffer[10];
+    size_t length = 0;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value) byte |= 0x80;
+        buffer[length++] = byte;
+    } while (value);
+    [data appendBytes:buffer length:length];
+}
+
+static void pres_appendString(NSMutableData *data, NSString *string) {
+    const char *utf8 = string.UTF8String ?: "";
+    size_t length = strlen(utf8);
+    pres_appendVarint(data, length);
+    [data appendBytes:utf8 length:length];
+}
+
+BOOL pres_readVarint(const uint8_t **cursor, const uint8_t *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64 && *cursor < end; shift += 7) {
+        uint8_t byte = *(*cursor)++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return YES;
+        }
+    }
+    return NO;
+}
+
+static NSString *pres_readString(const uint8_t **cursor, const uint8_t *end) {
+    uint64_t length = 0;
+    if (!pres_readVarint(cursor, end, &length) || length > (uint64_t)(end - *cursor)) {
+        return nil;
+    }
+    NSString *string = [[NSString alloc] initWithBytes:*cursor length:(NSUInteger)length encoding:NSUTF8StringEncoding];
+    *cursor += length;
+    return string;
+}
+
+NSData *pres_encodeBinaryRecord(NSDictionary<NSString *, NSString *> *record, uint8_t version) {
+    NSMutableData *data = [NSMutableData dataWithCapacity:256];
+    [data appendBytes:PRESBinaryRecordMagic length:sizeof(PRESBinaryRecordMagic)];
+    [data appendBytes:&version length:sizeof(version)];
+    
+    pres_appendVarint(data, record.count);
+    [record enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSString *value, BOOL *stop) {
+        pres_appendString(data, key);
+        pres_appendString(data, value);
+    }];
+    return data;
+}
+
+NSDictionary<NSString *, NSString *> *pres_decodeBinaryRecord(NSData *data, uint8_t *version) {
+    if (data.length < sizeof(PRESBinaryRecordMagic) + 1 || memcmp(data.bytes, PRESBinaryRecordMagic, sizeof(PRESBinaryRecordMagic)) != 0) {
+        return nil;
+    }
+    
+    const uint8_t *cursor = (const uint8_t *)data.bytes + sizeof(PRESBinaryRecordMagic);
+    const uint8_t *end = (const uint8_t *)data.bytes + data.length;
+    if (version) *version = *cursor;
+    cursor++;
+    
+    uint64_t count = 0;
+    if (!pres_readVarint(&cursor, end, &count) || count > (uint64_t)(end - cursor)) {
+        return nil;
+    }
+    
+    NSMutableDictionary<NSString *, NSString *> *record = [NSMutableDictionary dictionaryWithCapacity:(NSUInteger)count];
+    for (uint64_t i = 0; i < count; i++) {
+        NSString *key = pres_readString(&cursor, end);
+        NSString *value = key ? pres_readString(&cursor, end) : nil;
+        if (!key || !value) {
+            return nil;
+        }
+        record[key] = value;
+    }
+    return record;
+}
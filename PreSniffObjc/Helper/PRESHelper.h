@@ -46,6 +46,12 @@ FOUNDATION_EXPORT NSString *const kPRESExcludeApplicationSupportFromBackup;
 
 NSString *pres_settingsDir(void);
 
+/**
+ *  Subdirectory of pres_settingsDir() for SDK files, created if needed. Files directly in
+ *  pres_settingsDir() are taken for crash reports, everything else has to live in a subdirectory.
+ */
+NSString *pres_settingsSubdir(NSString *name);
+
 BOOL pres_validateEmail(NSString *email);
 NSString *pres_keychainPreSniffObjcServiceName(void);
 
@@ -82,6 +88,12 @@ NSString *pres_base64String(NSData * data, unsigned long length);
 
 /* Context helpers */
 NSString *pres_utcDateString(NSDate *date);
+NSString *pres_utcDateStringNow(void);
+
+/**
+ * @return "yyyy-MM-ddTHH:mm:ssZ" as used in the Apple crash report format
+ */
+NSString *pres_rfc3339DateString(NSDate *date);
 NSString *pres_devicePlatform(void);
 NSString *pres_devicePlatform(void);
 NSString *pres_deviceType(void);
@@ -28,14 +28,14 @@
 
 
 #import "PRESHelper.h"
-#import "PRESKeychainUtils.h"
+#import "PRESKeychainStore.h"
 #import "PreSniffObjc.h"
 #import "PRESPrivate.h"
 #import "PRESVersion.h"
+#import "PRESTime.h"
 #import <QuartzCore/QuartzCore.h>
 #import <sys/sysctl.h>
 
-static NSString *const kPRESUtcDateFormatter = @"utcDateFormatter";
 NSString *const kPRESExcludeApplicationSupportFromBackup = @"kPRESExcludeApplicationSupportFromBackup";
 
 @implementation PRESHelper
@@ -96,6 +96,20 @@ NSString *pres_settingsDir(void) {
     return settingsDir;
 }
 
+NSString *pres_settingsSubdir(NSString *name) {
+    NSString *subdir = [pres_settingsDir() stringByAppendingPathComponent:name];
+    NSFileManager *fileManager = [[NSFileManager alloc] init];
+    
+    if (![fileManager fileExistsAtPath:subdir]) {
+        NSDictionary *attributes = [NSDictionary dictionaryWithObject: [NSNumber numberWithUnsignedLong: 0755] forKey: NSFilePosixPermissions];
+        NSError *theError = NULL;
+        
+        [fileManager createDirectoryAtPath:subdir withIntermediateDirectories: YES attributes: attributes error: &theError];
+    }
+    
+    return subdir;
+}
+
 BOOL pres_validateEmail(NSString *email) {
     NSString *emailRegex =
     @"(?:[a-z0-9!#$%\\&'*+/=?\\^_`{|}~-]+(?:\\.[a-z0-9!#$%\\&'*+/=?\\^_`{|}"
@@ -213,43 +227,25 @@ NSString *pres_UUID(void) {
 NSString *pres_appAnonID(BOOL forceNewAnonID) {
     static NSString *appAnonID = nil;
     static dispatch_once_t predAppAnonID;
-    __block NSError *error = nil;
     NSString *appAnonIDKey = @"appAnonID";
     
     if (forceNewAnonID) {
         appAnonID = pres_UUID();
         // store this UUID in the keychain (on this device only) so we can be sure to always have the same ID upon app startups
         if (appAnonID) {
-            // add to keychain in a background thread, since we got reports that storing to the keychain may take several seconds sometimes and cause the app to be killed
-            // and we don't care about the result anyway
-            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
-                [PRESKeychainUtils storeUsername:appAnonIDKey
-                                     andPassword:appAnonID
-                                  forServiceName:pres_keychainPreSniffObjcServiceName()
-                                  updateExisting:YES
-                                   accessibility:kSecAttrAccessibleAlwaysThisDeviceOnly
-                                           error:&error];
-            });
+            // the store writes in the background, since we got reports that storing to the keychain may take several seconds sometimes and cause the app to be killed
+            [[PRESKeychainStore sharedStore] setString:appAnonID forKey:appAnonIDKey accessibility:kSecAttrAccessibleAlwaysThisDeviceOnly];
         }
     } else {
         dispatch_once(&predAppAnonID, ^{
             // first check if we already have an install string in the keychain
-            appAnonID = [PRESKeychainUtils getPasswordForUsername:appAnonIDKey andServiceName:pres_keychainPreSniffObjcServiceName() error:&error];
+            appAnonID = [[PRESKeychainStore sharedStore] stringForKey:appAnonIDKey];
             
             if (!appAnonID) {
                 appAnonID = pres_UUID();
                 // store this UUID in the keychain (on this device only) so we can be sure to always have the same ID upon app startups
                 if (appAnonID) {
-                    // add to keychain in a background thread, since we got reports that storing to the keychain may take several seconds sometimes and cause the app to be killed
-                    // and we don't care about the result anyway
-                    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
-                        [PRESKeychainUtils storeUsername:appAnonIDKey
-                                             andPassword:appAnonID
-                                          forServiceName:pres_keychainPreSniffObjcServiceName()
-                                          updateExisting:YES
-                                           accessibility:kSecAttrAccessibleAlwaysThisDeviceOnly
-                                                   error:&error];
-                    });
+                    [[PRESKeychainStore sharedStore] setString:appAnonID forKey:appAnonIDKey accessibility:kSecAttrAccessibleAlwaysThisDeviceOnly];
                 }
             }
         });
@@ -436,41 +432,25 @@ NSString *pres_base64String(NSData * data, unsigned long length) {
 
 #pragma mark Context helpers
 
+static NSString *pres_iso8601String(pres_timestamp_t timestamp, int withMilliseconds) {
+    char buffer[PRES_ISO8601_MILLISECONDS_LENGTH + 1];
+    size_t length = pres_format_iso8601(timestamp, withMilliseconds, buffer, sizeof(buffer));
+    return [[NSString alloc] initWithBytes:buffer length:length encoding:NSASCIIStringEncoding];
+}
+
 // Return ISO 8601 string representation of the date
 NSString *pres_utcDateString(NSDate *date){
-    static NSDateFormatter *dateFormatter;
-    
-    // NSDateFormatter is not thread-safe prior to iOS 7
-    if (pres_isPreiOS7Environment()) {
-        NSMutableDictionary *threadDictionary = [NSThread currentThread].threadDictionary;
-        dateFormatter = threadDictionary[kPRESUtcDateFormatter];
-        
-        if (!dateFormatter) {
-            dateFormatter = [NSDateFormatter new];
-            NSLocale *enUSPOSIXLocale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
-            dateFormatter.locale = enUSPOSIXLocale;
-            dateFormatter.dateFormat = @"yyyy-MM-dd'T'HH:mm:ss.SSS'Z'";
-            dateFormatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
-            threadDictionary[kPRESUtcDateFormatter] = dateFormatter;
-        }
-        
-        NSString *dateString = [dateFormatter stringFromDate:date];
-        
-        return dateString;
-    }
-    
-    static dispatch_once_t dateFormatterToken;
-    dispatch_once(&dateFormatterToken, ^{
-        NSLocale *enUSPOSIXLocale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
-        dateFormatter = [NSDateFormatter new];
-        dateFormatter.locale = enUSPOSIXLocale;
-        dateFormatter.dateFormat = @"yyyy-MM-dd'T'HH:mm:ss.SSS'Z'";
-        dateFormatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
-    });
-    
-    NSString *dateString = [dateFormatter stringFromDate:date];
-    
-    return dateString;
+    if (!date) return nil;
+    return pres_iso8601String(pres_timestamp_from_interval(date.timeIntervalSince1970), 1);
+}
+
+NSString *pres_utcDateStringNow(void) {
+    return pres_iso8601String(pres_timestamp_now(), 1);
+}
+
+NSString *pres_rfc3339DateString(NSDate *date) {
+    if (!date) return nil;
+    return pres_iso8601String(pres_timestamp_from_interval(date.timeIntervalSince1970), 0);
 }
 
 NSString *pres_devicePlatform(void) {
@@ -0,0 +1,60 @@
+//
+//  PRESKeychainStore.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 23/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Cached access to the SDK's keychain items
+ *
+ *  All items of the service are loaded with a single keychain query on first use and reads are
+ *  served from memory afterwards. Writes update the cache right away and are written to the
+ *  keychain in the background, several writes to a key before the write runs only cost one
+ *  keychain call. If the keychain can't be read yet, e.g. before the first unlock, reads fall back
+ *  to querying the key and loading is tried again on the next read. Thread safe.
+ */
+@interface PRESKeychainStore : NSObject
+
+/**
+ *  The store for pres_keychainPreSniffObjcServiceName()
+ */
++ (instancetype)sharedStore;
+
+- (instancetype)initWithServiceName:(NSString *)serviceName;
+
+@property (nonatomic, copy, readonly) NSString *serviceName;
+
+- (nullable NSString *)stringForKey:(NSString *)key;
+
+/**
+ *  Writing the value an item already has is skipped unless its accessibility differs.
+ *
+ *  @param value         nil removes the item
+ *  @param accessibility a kSecAttrAccessible value, used when the item is written
+ */
+- (void)setString:(nullable NSString *)value forKey:(NSString *)key accessibility:(CFTypeRef)accessibility;
+
+/**
+ *  Like setString:forKey:accessibility: but blocks until the value reached the keychain
+ *
+ *  @return NO if the keychain write failed
+ */
+- (BOOL)writeString:(nullable NSString *)value forKey:(NSString *)key accessibility:(CFTypeRef)accessibility;
+
+- (void)removeStringForKey:(NSString *)key;
+
+/**
+ *  Blocks until all pending writes reached the keychain
+ */
+- (void)synchronize;
+
+@end
+
+NS_ASSUME_NONNULL_END
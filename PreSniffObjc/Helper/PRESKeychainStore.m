@@ -0,0 +1,254 @@
+//
+//  PRESKeychainStore.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 23/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESKeychainStore.h"
+#import "PRESKeychainUtils.h"
+#import "PRESHelper.h"
+#import "PRESPrivate.h"
+#import <Security/Security.h>
+
+static char *const kPRESKeychainStoreQueue = "com.presniff.keychainStoreQueue";
+
+@interface PRESKeychainWrite : NSObject
+
+/**
+ *  nil deletes the item
+ */
+@property (nonatomic, copy) NSString *value;
+@property (nonatomic, strong) id accessibility;
+
+@end
+
+@implementation PRESKeychainWrite
+@end
+
+@interface PRESKeychainStore ()
+
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, assign) BOOL loaded;
+
+/**
+ *  Values by key, NSNull for keys known to have no item. Guarded by self.
+ */
+@property (nonatomic, strong) NSMutableDictionary<NSString *, id> *cache;
+
+/**
+ *  Writes not yet handed to the keychain, the last one per key wins. Guarded by self.
+ */
+@property (nonatomic, strong) NSMutableDictionary<NSString *, PRESKeychainWrite *> *pendingWrites;
+@property (nonatomic, assign) BOOL flushScheduled;
+
+/**
+ *  kSecAttrAccessible of the items as loaded or last written. Guarded by self.
+ */
+@property (nonatomic, strong) NSMutableDictionary<NSString *, id> *accessibilities;
+
+/**
+ *  Keys whose last write failed, the cache is ahead of the keychain for them. Guarded by self.
+ */
+@property (nonatomic, strong) NSMutableSet<NSString *> *failedKeys;
+
+@end
+
+@implementation PRESKeychainStore
+
++ (instancetype)sharedStore {
+    static PRESKeychainStore *sharedInstance;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedInstance = [[PRESKeychainStore alloc] initWithServiceName:pres_keychainPreSniffObjcServiceName()];
+    });
+    return sharedInstance;
+}
+
+- (instancetype)initWithServiceName:(NSString *)serviceName {
+    if ((self = [super init])) {
+        _serviceName = [serviceName copy];
+        // keychain calls may take seconds, they never run on the caller's thread except for loading
+        _queue = dispatch_queue_create(kPRESKeychainStoreQueue, DISPATCH_QUEUE_SERIAL);
+        _cache = [NSMutableDictionary new];
+        _pendingWrites = [NSMutableDictionary new];
+        _accessibilities = [NSMutableDictionary new];
+        _failedKeys = [NSMutableSet new];
+    }
+    return self;
+}
+
+#pragma mark - Reading
+
+- (NSString *)stringForKey:(NSString *)key {
+    if (!key) return nil;
+    
+    @synchronized (self) {
+        id value = self.cache[key];
+        if (value || self.loaded) {
+            return value == [NSNull null] ? nil : value;
+        }
+    }
+    
+    // on the queue, so loading never races a write that is running
+    __block id value;
+    dispatch_sync(self.queue, ^{
+        [self loadIfNeeded];
+        @synchronized (self) {
+            value = self.cache[key];
+        }
+        if (value) return;
+        
+        NSError *error = nil;
+        value = [PRESKeychainUtils getPasswordForUsername:key andServiceName:self.serviceName error:&error];
+        if (error && error.code != -1999) return;
+        @synchronized (self) {
+            // a write may have come in meanwhile
+            if (!self.cache[key]) {
+                self.cache[key] = value ?: [NSNull null];
+            }
+            value = self.cache[key];
+        }
+    });
+    return value == [NSNull null] ? nil : value;
+}
+
+/**
+ *  Reads all items of the service at once, only called on queue
+ */
+- (void)loadIfNeeded {
+    @synchronized (self) {
+        if (self.loaded) return;
+    }
+    
+    NSDictionary *query = @{(__bridge id)kSecClass: (__bridge id)kSecClassGenericPassword,
+                            (__bridge id)kSecAttrService: self.serviceName,
+                            (__bridge id)kSecMatchLimit: (__bridge id)kSecMatchLimitAll,
+                            (__bridge id)kSecReturnAttributes: @YES,
+                            (__bridge id)kSecReturnData: @YES};
+    CFTypeRef result = NULL;
+    OSStatus status = SecItemCopyMatching((__bridge CFDictionaryRef)query, &result);
+    NSArray<NSDictionary *> *items = (__bridge_transfer NSArray *)result;
+    if (status != errSecSuccess && status != errSecItemNotFound) {
+        PRESLogWarning(@"WARNING: Loading the keychain items failed with status %d, reading them one by one", (int)status);
+        return;
+    }
+    
+    @synchronized (self) {
+        for (NSDictionary *item in items) {
+            NSString *account = item[(__bridge id)kSecAttrAccount];
+            NSData *data = item[(__bridge id)kSecValueData];
+            // keys written since are newer than what the keychain has
+            if (![account isKindOfClass:[NSString class]] || ![data isKindOfClass:[NSData class]] || self.pendingWrites[account]) continue;
+            
+            NSString *value = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+            if (value) {
+                self.cache[account] = value;
+                self.accessibilities[account] = item[(__bridge id)kSecAttrAccessible];
+            }
+        }
+        // everything not in the keychain has no item
+        self.loaded = YES;
+    }
+    PRESLogDebug(@"INFO: Loaded %lu keychain items", (unsigned long)items.count);
+}
+
+#pragma mark - Writing
+
+- (void)setString:(NSString *)value forKey:(NSString *)key accessibility:(CFTypeRef)accessibility {
+    if (!key) return;
+    
+    PRESKeychainWrite *write = [PRESKeychainWrite new];
+    write.value = value;
+    write.accessibility = (__bridge id)accessibility;
+    
+    @synchronized (self) {
+        id cached = self.cache[key];
+        BOOL unchanged = value ? [cached isEqual:value] && [self.accessibilities[key] isEqual:write.accessibility] : (!cached || cached == [NSNull null]);
+        if (self.loaded && unchanged && !self.pendingWrites[key] && ![self.failedKeys containsObject:key]) {
+            return;
+        }
+        self.cache[key] = value ?: [NSNull null];
+        self.pendingWrites[key] = write;
+        if (self.flushScheduled) return;
+        self.flushScheduled = YES;
+    }
+    
+    dispatch_async(self.queue, ^{
+        [self flushPendingWrites];
+    });
+}
+
+- (BOOL)writeString:(NSString *)value forKey:(NSString *)key accessibility:(CFTypeRef)accessibility {
+    if (!key) return NO;
+    
+    [self setString:value forKey:key accessibility:accessibility];
+    __block BOOL success;
+    dispatch_sync(self.queue, ^{
+        // writes the value unless the scheduled flush already did
+        [self flushPendingWrites];
+        @synchronized (self) {
+            success = ![self.failedKeys containsObject:key];
+        }
+    });
+    return success;
+}
+
+- (void)removeStringForKey:(NSString *)key {
+    [self setString:nil forKey:key accessibility:kSecAttrAccessibleAlways];
+}
+
+- (void)synchronize {
+    dispatch_sync(self.queue, ^{});
+}
+
+/**
+ *  Only called on queue
+ */
+- (void)flushPendingWrites {
+    NSDictionary<NSString *, PRESKeychainWrite *> *writes;
+    @synchronized (self) {
+        writes = self.pendingWrites;
+        self.pendingWrites = [NSMutableDictionary new];
+        self.flushScheduled = NO;
+    }
+    
+    [writes enumerateKeysAndObjectsUsingBlock:^(NSString *key, PRESKeychainWrite *write, BOOL *stop) {
+        NSError *error = nil;
+        if (write.value) {
+            id accessibility;
+            @synchronized (self) {
+                accessibility = self.accessibilities[key];
+            }
+            if (accessibility && ![accessibility isEqual:write.accessibility]) {
+                // an update keeps the accessibility of the item, only a new item gets the new one
+                [PRESKeychainUtils deleteItemForUsername:key andServiceName:self.serviceName error:nil];
+            }
+            [PRESKeychainUtils storeUsername:key
+                                 andPassword:write.value
+                              forServiceName:self.serviceName
+                              updateExisting:YES
+                               accessibility:(__bridge CFTypeRef)write.accessibility
+                                       error:&error];
+        } else {
+            [PRESKeychainUtils deleteItemForUsername:key andServiceName:self.serviceName error:&error];
+            if (error.code == errSecItemNotFound) {
+                error = nil;
+            }
+        }
+        @synchronized (self) {
+            if (error) {
+                [self.failedKeys addObject:key];
+            } else {
+                [self.failedKeys removeObject:key];
+                self.accessibilities[key] = write.value ? write.accessibility : nil;
+            }
+        }
+        if (error) {
+            PRESLogError(@"ERROR: Couldn't %@ key %@ in the keychain. %@", write.value ? @"update" : @"delete", key, error);
+        }
+    }];
+}
+
+@end
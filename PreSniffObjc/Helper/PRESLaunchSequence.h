@@ -0,0 +1,65 @@
+//
+//  PRESLaunchSequence.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 20/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, PRESLaunchStageTarget) {
+    /**
+     *  Runs synchronously on the thread calling start, i.e. on the launch critical path. Only add
+     *  these before the first deferred stage, later ones run wherever the previous stage ended.
+     */
+    PRESLaunchStageTargetCritical = 0,
+    /**
+     *  Runs on the serial background queue of the sequence
+     */
+    PRESLaunchStageTargetBackground = 1,
+    /**
+     *  Runs on the main thread once its run loop is about to wait for events in the default mode
+     */
+    PRESLaunchStageTargetMainIdle = 2
+};
+
+/**
+ *  Runs the startup work of the SDK in stages and measures each of them
+ *
+ *  Stages run strictly in the order they were added, a stage starts only after the previous one
+ *  finished, whatever their targets. Work dispatched to the queue after start runs after all
+ *  background stages added before it.
+ */
+@interface PRESLaunchSequence : NSObject
+
+/**
+ *  Serial queue the background stages run on, free for work that has to run after them
+ */
+@property (nonatomic, strong, readonly) dispatch_queue_t queue;
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue;
+
+- (void)addStage:(NSString *)name target:(PRESLaunchStageTarget)target block:(dispatch_block_t)block;
+
+/**
+ *  Runs the critical stages right away and schedules the rest. Call once.
+ */
+- (void)start;
+
+/**
+ *  Microseconds of each finished stage by name, plus "critical_path" for the time start blocked the caller
+ */
+- (NSDictionary<NSString *, NSNumber *> *)stageDurations;
+
+/**
+ *  Called on the queue once the last stage finished
+ */
+@property (nonatomic, copy, nullable) void (^completion)(NSDictionary<NSString *, NSNumber *> *stageDurations);
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,153 @@
+//
+//  PRESLaunchSequence.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 20/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESLaunchSequence.h"
+#import "PRESTime.h"
+#import "PRESPrivate.h"
+
+static NSString *const kPRESLaunchCriticalPathKey = @"critical_path";
+
+@interface PRESLaunchStage : NSObject
+
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic, assign) PRESLaunchStageTarget target;
+@property (nonatomic, copy) dispatch_block_t block;
+
+@end
+
+@implementation PRESLaunchStage
+@end
+
+@interface PRESLaunchSequence ()
+
+@property (nonatomic, strong) NSMutableArray<PRESLaunchStage *> *stages;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *durations;
+@property (nonatomic, assign) BOOL started;
+
+@end
+
+@implementation PRESLaunchSequence
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue {
+    if ((self = [super init])) {
+        _queue = queue;
+        _stages = [NSMutableArray new];
+        _durations = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (void)addStage:(NSString *)name target:(PRESLaunchStageTarget)target block:(dispatch_block_t)block {
+    PRESLaunchStage *stage = [PRESLaunchStage new];
+    stage.name = name;
+    stage.target = target;
+    stage.block = block;
+    @synchronized (self) {
+        if (self.started) {
+            PRESLogWarning(@"WARNING: Launch stage %@ added after the start is ignored", name);
+            return;
+        }
+        [self.stages addObject:stage];
+    }
+}
+
+- (void)start {
+    @synchronized (self) {
+        if (self.started) return;
+        self.started = YES;
+    }
+
+    uint64_t start = pres_monotonic_ns();
+    // holds the background stages back until the critical path is done
+    dispatch_suspend(self.queue);
+    [self runStageAtIndex:0];
+    [self recordDuration:pres_monotonic_ns() - start forStage:kPRESLaunchCriticalPathKey];
+    dispatch_resume(self.queue);
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)stageDurations {
+    @synchronized (self) {
+        return [self.durations copy];
+    }
+}
+
+#pragma mark - Stages
+
+- (void)runStageAtIndex:(NSUInteger)index {
+    PRESLaunchStage *stage;
+    @synchronized (self) {
+        stage = index < self.stages.count ? self.stages[index] : nil;
+    }
+    if (!stage) {
+        [self finish];
+        return;
+    }
+
+    switch (stage.target) {
+        case PRESLaunchStageTargetCritical:
+            [self runStage:stage];
+            [self runStageAtIndex:index + 1];
+            break;
+        case PRESLaunchStageTargetBackground:
+            dispatch_async(self.queue, ^{
+                [self runStage:stage];
+                [self runStageAtIndex:index + 1];
+            });
+            break;
+        case PRESLaunchStageTargetMainIdle: {
+            // blocks the queue as well, so work dispatched to it keeps running after this stage
+            dispatch_suspend(self.queue);
+            [self runOnMainIdle:^{
+                [self runStage:stage];
+                dispatch_async(self.queue, ^{
+                    [self runStageAtIndex:index + 1];
+                });
+                dispatch_resume(self.queue);
+            }];
+            break;
+        }
+    }
+}
+
+- (void)runStage:(PRESLaunchStage *)stage {
+    uint64_t start = pres_monotonic_ns();
+    if (stage.block) {
+        stage.block();
+    }
+    [self recordDuration:pres_monotonic_ns() - start forStage:stage.name];
+}
+
+- (void)runOnMainIdle:(dispatch_block_t)block {
+    CFRunLoopRef mainRunLoop = CFRunLoopGetMain();
+    CFRunLoopObserverRef observer = CFRunLoopObserverCreateWithHandler(kCFAllocatorDefault, kCFRunLoopBeforeWaiting, false, 0, ^(CFRunLoopObserverRef observer, CFRunLoopActivity activity) {
+        block();
+    });
+    CFRunLoopAddObserver(mainRunLoop, observer, kCFRunLoopDefaultMode);
+    CFRelease(observer);
+    // a sleeping run loop would only notice the observer with the next event
+    CFRunLoopWakeUp(mainRunLoop);
+}
+
+- (void)recordDuration:(uint64_t)nanoseconds forStage:(NSString *)name {
+    @synchronized (self) {
+        self.durations[name] = @(nanoseconds / NSEC_PER_USEC);
+    }
+}
+
+- (void)finish {
+    NSDictionary<NSString *, NSNumber *> *durations = [self stageDurations];
+    PRESLogDebug(@"INFO: Launch stages finished in microseconds: %@", durations);
+
+    void (^completion)(NSDictionary<NSString *, NSNumber *> *) = self.completion;
+    if (!completion) return;
+    dispatch_async(self.queue, ^{
+        completion(durations);
+    });
+}
+
+@end
@@ -3,13 +3,35 @@
 #import <Foundation/Foundation.h>
 #import "PRESEnums.h"
 
-#define PRESLog(_level, _message) [PRESLogger logMessage:_message level:_level file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__]
+/**
+ *  Most verbose level compiled into the SDK, e.g. PRES_LOG_LEVEL_MIN=2 (PRESLogLevelWarning) in
+ *  GCC_PREPROCESSOR_DEFINITIONS removes all debug and verbose logging including its arguments.
+ */
+#ifndef PRES_LOG_LEVEL_MIN
+#define PRES_LOG_LEVEL_MIN PRESLogLevelVerbose
+#endif
+
+/**
+ *  Most verbose level any handler currently wants, checked before the message block is even created
+ */
+FOUNDATION_EXPORT PRESLogLevel pres_logLevelThreshold;
+
+#define PRESLog(_level, _message) do { \
+    if ((_level) <= PRES_LOG_LEVEL_MIN && (_level) <= pres_logLevelThreshold) { \
+        [PRESLogger logMessage:_message level:_level file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__]; \
+    } \
+} while (0)
 
 #define PRESLogError(format, ...)   PRESLog(PRESLogLevelError,   (^{ return [NSString stringWithFormat:(format), ##__VA_ARGS__]; }))
 #define PRESLogWarning(format, ...) PRESLog(PRESLogLevelWarning, (^{ return [NSString stringWithFormat:(format), ##__VA_ARGS__]; }))
 #define PRESLogDebug(format, ...)   PRESLog(PRESLogLevelDebug,   (^{ return [NSString stringWithFormat:(format), ##__VA_ARGS__]; }))
 #define PRESLogVerbose(format, ...) PRESLog(PRESLogLevelVerbose, (^{ return [NSString stringWithFormat:(format), ##__VA_ARGS__]; }))
 
+/**
+ *  Messages up to the current log level are put into a lock free ring and written to the console
+ *  and to a log file by a background queue, so logging never blocks the caller on I/O. A custom log
+ *  handler is still called synchronously with every message, as before.
+ */
 @interface PRESLogger : NSObject
 
 + (PRESLogLevel)currentLogLevel;
@@ -18,4 +40,18 @@
 
 + (void)logMessage:(PRESLogMessageProvider)messageProvider level:(PRESLogLevel)loglevel file:(const char *)file function:(const char *)function line:(uint)line;
 
+/**
+ *  The tail of the log file written by the previous launch, for attaching it to its crash report
+ *
+ *  @param maxLength the maximum number of bytes to return
+ *
+ *  @return nil if the previous launch did not log anything
+ */
++ (NSString *)previousSessionLogWithMaxLength:(NSUInteger)maxLength;
+
+/**
+ *  Blocks until every message logged so far is written, e.g. before the app terminates
+ */
++ (void)flush;
+
 @end
@@ -1,23 +1,79 @@
 #import "PRESLogger.h"
 #import "PreSniffObjc.h"
+#import "PRESHelper.h"
+#import "PRESTime.h"
+#import <stdatomic.h>
+
+// must be a power of two
+#define PRES_LOG_RING_CAPACITY 256
+
+static NSString *const PRESLogDirectoryName = @"Logs";
+static NSString *const PRESLogFileName = @"sdk.log";
+static NSString *const PRESLogRotatedFileSuffix = @".1";
+static NSString *const PRESPreviousLogFileName = @"sdk.previous.log";
+static unsigned long long const PRESLogFileMaxLength = 64 * 1024;
+
+/**
+ *  One slot of the multi producer, single consumer ring. sequence tells who owns the slot: it
+ *  equals the write position while the slot is free, write position + 1 once a producer filled it.
+ */
+typedef struct {
+    _Atomic uint64_t sequence;
+    CFTypeRef message;
+    PRESLogLevel level;
+    const char *function;
+    uint line;
+    BOOL console;
+    pres_timestamp_t timestamp;
+} PRESLogRingSlot;
+
+static PRESLogRingSlot pres_logRing[PRES_LOG_RING_CAPACITY];
+static _Atomic uint64_t pres_logRingWritePosition;
+static uint64_t pres_logRingReadPosition; // drain queue only
+static _Atomic uint64_t pres_logRingDroppedCount;
+
+static dispatch_queue_t pres_logQueue;
+static dispatch_source_t pres_logSource;
+static NSFileHandle *pres_logFileHandle; // drain queue only
+static BOOL pres_logFilesPrepared; // drain queue only
+
+PRESLogLevel pres_logLevelThreshold = PRESLogLevelWarning;
 
 @implementation PRESLogger
 
 static PRESLogLevel _currentLogLevel = PRESLogLevelWarning;
 static PRESLogHandler currentLogHandler;
 
+static void pres_logRecord(PRESLogLevel level, const char *function, uint line, NSString *message, BOOL console);
+static void pres_logDrain(void);
+static void pres_logPrepareFiles(void);
+static NSString *pres_logDirectory(void);
+static void pres_logWrite(NSData *data);
+
 PRESLogHandler defaultLogHandler = ^(PRESLogMessageProvider messageProvider, PRESLogLevel logLevel, const char *file, const char *function, uint line) {
     if (messageProvider) {
         if (_currentLogLevel < logLevel) {
             return;
         }
-        NSLog((@"[PreSniffObjc] %s/%d %@"), function, line, messageProvider());
+        pres_logRecord(logLevel, function, line, messageProvider(), YES);
     }
 };
 
 
 + (void)initialize {
+    if (self != [PRESLogger class]) return;
+
     currentLogHandler = defaultLogHandler;
+    for (NSUInteger i = 0; i < PRES_LOG_RING_CAPACITY; i++) {
+        atomic_init(&pres_logRing[i].sequence, i);
+    }
+    pres_logQueue = dispatch_queue_create("com.presniff.logger", DISPATCH_QUEUE_SERIAL);
+    dispatch_set_target_queue(pres_logQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+    pres_logSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_ADD, 0, 0, pres_logQueue);
+    dispatch_source_set_event_handler(pres_logSource, ^{
+        pres_logDrain();
+    });
+    dispatch_resume(pres_logSource);
 }
 
 + (PRESLogLevel)currentLogLevel {
@@ -25,16 +81,207 @@ PRESLogHandler defaultLogHandler = ^(PRESLogMessageProvider messageProvider, PRE
 }
 
 + (void)setCurrentLogLevel:(PRESLogLevel)currentLogLevel {
-    _currentLogLevel = currentLogLevel;
+    @synchronized (self) {
+        _currentLogLevel = currentLogLevel;
+        [self updateThreshold];
+    }
 }
 
 + (void)setLogHandler:(PRESLogHandler)logHandler {
-    currentLogHandler = logHandler;
+    @synchronized (self) {
+        currentLogHandler = logHandler;
+        [self updateThreshold];
+    }
+}
+
++ (void)updateThreshold {
+    // custom handlers filter by themselves and get every message
+    BOOL customHandler = currentLogHandler && currentLogHandler != defaultLogHandler;
+    pres_logLevelThreshold = customHandler ? PRESLogLevelVerbose : _currentLogLevel;
 }
 
 + (void)logMessage:(PRESLogMessageProvider)messageProvider level:(PRESLogLevel)loglevel file:(const char *)file function:(const char *)function line:(uint)line {
-    if (currentLogHandler) {
-        currentLogHandler(messageProvider, loglevel, file, function, line);
+    PRESLogHandler handler = currentLogHandler;
+    if (!handler || handler == defaultLogHandler) {
+        defaultLogHandler(messageProvider, loglevel, file, function, line);
+        return;
+    }
+    if (!messageProvider) return;
+
+    // the log file keeps recording at the current level, the message is formatted only once for both
+    __block NSString *message;
+    PRESLogMessageProvider cachingProvider = ^NSString *{
+        if (!message) {
+            message = messageProvider();
+        }
+        return message;
+    };
+    handler(cachingProvider, loglevel, file, function, line);
+    if (loglevel <= _currentLogLevel) {
+        pres_logRecord(loglevel, function, line, cachingProvider(), NO);
+    }
+}
+
++ (NSString *)previousSessionLogWithMaxLength:(NSUInteger)maxLength {
+    __block NSData *data;
+    dispatch_sync(pres_logQueue, ^{
+        pres_logPrepareFiles();
+        NSString *path = [pres_logDirectory() stringByAppendingPathComponent:PRESPreviousLogFileName];
+        NSMutableData *combined = [NSMutableData dataWithContentsOfFile:[path stringByAppendingString:PRESLogRotatedFileSuffix]] ?: [NSMutableData data];
+        NSData *current = [NSData dataWithContentsOfFile:path];
+        if (current) {
+            [combined appendData:current];
+        }
+        data = combined;
+    });
+    if (data.length == 0) return nil;
+
+    if (data.length > maxLength) {
+        data = [data subdataWithRange:NSMakeRange(data.length - maxLength, maxLength)];
+    }
+    // the cut may have split a character or a line, drop everything before the first full line
+    NSString *log = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+    if (!log) {
+        log = [[NSString alloc] initWithData:data encoding:NSASCIIStringEncoding];
+    }
+    NSRange firstNewline = [log rangeOfString:@"\n"];
+    if (data.length == maxLength && firstNewline.location != NSNotFound) {
+        log = [log substringFromIndex:NSMaxRange(firstNewline)];
+    }
+    return log;
+}
+
++ (void)flush {
+    dispatch_sync(pres_logQueue, ^{
+        pres_logDrain();
+        [pres_logFileHandle synchronizeFile];
+    });
+}
+
+#pragma mark - Ring
+
+static void pres_logRecord(PRESLogLevel level, const char *function, uint line, NSString *message, BOOL console) {
+    if (!message) return;
+
+    uint64_t position = atomic_load_explicit(&pres_logRingWritePosition, memory_order_relaxed);
+    PRESLogRingSlot *slot;
+    for (;;) {
+        slot = &pres_logRing[position & (PRES_LOG_RING_CAPACITY - 1)];
+        uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        int64_t difference = (int64_t)sequence - (int64_t)position;
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&pres_logRingWritePosition, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // the drain queue fell behind a full ring, losing a message beats blocking the caller
+            atomic_fetch_add_explicit(&pres_logRingDroppedCount, 1, memory_order_relaxed);
+            return;
+        } else {
+            position = atomic_load_explicit(&pres_logRingWritePosition, memory_order_relaxed);
+        }
+    }
+
+    slot->message = CFBridgingRetain(message);
+    slot->level = level;
+    slot->function = function;
+    slot->line = line;
+    slot->console = console;
+    slot->timestamp = pres_timestamp_now();
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+
+    dispatch_source_merge_data(pres_logSource, 1);
+}
+
+static void pres_logDrain(void) {
+    NSMutableData *buffer = [NSMutableData data];
+    char timestamp[PRES_ISO8601_MILLISECONDS_LENGTH + 1];
+
+    uint64_t dropped = atomic_exchange_explicit(&pres_logRingDroppedCount, 0, memory_order_relaxed);
+    if (dropped > 0) {
+        NSString *line = [NSString stringWithFormat:@"[PreSniffObjc] %llu log messages dropped\n", dropped];
+        [buffer appendData:[line dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+
+    for (;;) {
+        PRESLogRingSlot *slot = &pres_logRing[pres_logRingReadPosition & (PRES_LOG_RING_CAPACITY - 1)];
+        uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence != pres_logRingReadPosition + 1) break;
+
+        NSString *message = CFBridgingRelease(slot->message);
+        slot->message = NULL;
+        if (slot->console) {
+            NSLog((@"[PreSniffObjc] %s/%d %@"), slot->function, slot->line, message);
+        }
+        pres_format_iso8601(slot->timestamp, 1, timestamp, sizeof(timestamp));
+        NSString *line = [NSString stringWithFormat:@"%s %lu %s/%d %@\n", timestamp, (unsigned long)slot->level, slot->function, slot->line, message];
+        [buffer appendData:[line dataUsingEncoding:NSUTF8StringEncoding]];
+
+        atomic_store_explicit(&slot->sequence, pres_logRingReadPosition + PRES_LOG_RING_CAPACITY, memory_order_release);
+        pres_logRingReadPosition++;
+    }
+
+    if (buffer.length > 0) {
+        pres_logWrite(buffer);
+    }
+}
+
+#pragma mark - Log file
+
+/**
+ *  Moves the files of the previous launch aside once, before this launch writes anything
+ */
+static void pres_logPrepareFiles(void) {
+    if (pres_logFilesPrepared) return;
+    pres_logFilesPrepared = YES;
+
+    NSFileManager *fileManager = [NSFileManager new];
+    NSString *directory = pres_logDirectory();
+    for (NSString *suffix in @[@"", PRESLogRotatedFileSuffix]) {
+        NSString *current = [[directory stringByAppendingPathComponent:PRESLogFileName] stringByAppendingString:suffix];
+        NSString *previous = [[directory stringByAppendingPathComponent:PRESPreviousLogFileName] stringByAppendingString:suffix];
+        [fileManager removeItemAtPath:previous error:nil];
+        [fileManager moveItemAtPath:current toPath:previous error:nil];
+    }
+}
+
+/**
+ *  The crash manager takes every file directly in pres_settingsDir() for a crash report, so the logs live in a subdirectory
+ */
+static NSString *pres_logDirectory(void) {
+    static NSString *logDirectory;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        logDirectory = pres_settingsSubdir(PRESLogDirectoryName);
+    });
+    return logDirectory;
+}
+
+static void pres_logWrite(NSData *data) {
+    pres_logPrepareFiles();
+
+    NSString *path = [pres_logDirectory() stringByAppendingPathComponent:PRESLogFileName];
+    if (pres_logFileHandle && pres_logFileHandle.offsetInFile + data.length > PRESLogFileMaxLength) {
+        // keep the last two files only
+        [pres_logFileHandle closeFile];
+        pres_logFileHandle = nil;
+        NSString *rotated = [path stringByAppendingString:PRESLogRotatedFileSuffix];
+        [[NSFileManager defaultManager] removeItemAtPath:rotated error:nil];
+        [[NSFileManager defaultManager] moveItemAtPath:path toPath:rotated error:nil];
+    }
+    if (!pres_logFileHandle) {
+        if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+            [[NSFileManager defaultManager] createFileAtPath:path contents:nil attributes:nil];
+        }
+        pres_logFileHandle = [NSFileHandle fileHandleForWritingAtPath:path];
+        [pres_logFileHandle seekToEndOfFile];
+    }
+    @try {
+        [pres_logFileHandle writeData:data];
+    } @catch (NSException *exception) {
+        // e.g. the disk is full, logging about it would only add to the problem
+        [pres_logFileHandle closeFile];
+        pres_logFileHandle = nil;
     }
 }
 
@@ -15,4 +15,19 @@
           appKey:(NSString *)appKey
         complete:(PRESNetDiagCompleteHandler)complete;
 
+/**
+ *  Runs the probes against every host in parallel
+ *
+ *  Each probe is stopped once it exceeds its own timeout, which is capped by timeout if it is greater
+ *  than 0. progress is called as soon as a single probe finished, complete once all hosts finished,
+ *  with the results in the order of hosts. Finished results are kept for a minute per host and
+ *  network type, a host whose cached result covers the requested probes is not probed again.
+ */
++ (void)diagnoseHosts:(NSArray<NSString *> *)hosts
+               appKey:(NSString *)appKey
+               probes:(PRESNetDiagProbe)probes
+              timeout:(NSTimeInterval)timeout
+             progress:(PRESNetDiagProgressHandler)progress
+             complete:(PRESNetDiagMultiCompleteHandler)complete;
+
 @end
@@ -10,28 +10,226 @@
 #import "QNNetDiag.h"
 #import "PRESNetDiagResult.h"
 #import "PRESNetDiagResultPrivate.h"
+#import "PRESReachability.h"
+#import "PRESTime.h"
+#import "PRESPrivate.h"
+
+static NSTimeInterval const PRESNetDiagPingTimeout = 10;
+static NSTimeInterval const PRESNetDiagTcpPingTimeout = 10;
+static NSTimeInterval const PRESNetDiagTraceRouteTimeout = 30;
+static NSTimeInterval const PRESNetDiagNslookupTimeout = 5;
+static NSTimeInterval const PRESNetDiagHttpTimeout = 15;
+
+static NSTimeInterval const PRESNetDiagCacheTTL = 60;
+static NSUInteger const PRESNetDiagCacheMaxCount = 20;
+
+@interface PRESNetDiagCacheEntry : NSObject
+
+@property (nonatomic, strong) PRESNetDiagResult *result;
+@property (nonatomic, assign) uint64_t finishedAt;
+
+@end
+
+@implementation PRESNetDiagCacheEntry
+@end
 
 @implementation PRESNetDiag
 
 + (void)diagnose:(NSString *)host
           appKey:(NSString *)appKey
         complete:(PRESNetDiagCompleteHandler)complete {
-    PRESNetDiagResult *result = [[PRESNetDiagResult alloc] initWithAppKey:appKey complete:complete];
-    [QNNPing start:host size:64 output:nil complete:^(QNNPingResult *r) {
-        [result gotPingResult:r];
-    }];
-    [QNNTcpPing start:host output:nil complete:^(QNNTcpPingResult *r) {
-        [result gotTcpResult:r];
+    [self diagnoseHosts:@[host] appKey:appKey probes:PRESNetDiagProbeAll timeout:0 progress:nil complete:^(NSArray<PRESNetDiagResult *> *results) {
+        if (complete) {
+            complete(results.firstObject);
+        }
     }];
-    [QNNTraceRoute start:host output:nil complete:^(QNNTraceRouteResult *r) {
-        [result gotTrResult:r];
-    }];
-    [QNNNslookup start:host output:nil complete:^(NSArray *r) {
-        [result gotNsLookupResult:r];
-    }];
-    [QNNHttp start:host output:nil complete:^(QNNHttpResult *r) {
-        [result gotHttpResult:r];
+}
+
++ (void)diagnoseHosts:(NSArray<NSString *> *)hosts
+               appKey:(NSString *)appKey
+               probes:(PRESNetDiagProbe)probes
+              timeout:(NSTimeInterval)timeout
+             progress:(PRESNetDiagProgressHandler)progress
+             complete:(PRESNetDiagMultiCompleteHandler)complete {
+    probes &= PRESNetDiagProbeAll;
+    if (hosts.count == 0 || probes == 0) {
+        if (complete) {
+            complete(@[]);
+        }
+        return;
+    }
+
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:hosts.count];
+    for (NSUInteger i = 0; i < hosts.count; i++) {
+        [results addObject:[NSNull null]];
+    }
+    dispatch_group_t group = dispatch_group_create();
+
+    [hosts enumerateObjectsUsingBlock:^(NSString *host, NSUInteger index, BOOL *stop) {
+        dispatch_group_enter(group);
+        void (^finished)(PRESNetDiagResult *) = ^(PRESNetDiagResult *result) {
+            @synchronized (results) {
+                results[index] = result;
+            }
+            dispatch_group_leave(group);
+        };
+
+        PRESNetDiagResult *cached = [self cachedResultForHost:host probes:probes];
+        if (cached) {
+            PRESLogDebug(@"INFO: Reusing net diag result for %@", host);
+            if (progress) {
+                for (PRESNetDiagProbe probe = PRESNetDiagProbePing; probe & PRESNetDiagProbeAll; probe <<= 1) {
+                    if (probes & probe) {
+                        progress(cached, probe);
+                    }
+                }
+            }
+            finished(cached);
+            return;
+        }
+
+        [self runProbes:probes host:host appKey:appKey timeout:timeout progress:progress complete:^(PRESNetDiagResult *result) {
+            [self cacheResult:result];
+            finished(result);
+        }];
     }];
+
+    dispatch_group_notify(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        if (complete) {
+            complete([results copy]);
+        }
+    });
+}
+
++ (void)runProbes:(PRESNetDiagProbe)probes
+             host:(NSString *)host
+           appKey:(NSString *)appKey
+          timeout:(NSTimeInterval)timeout
+         progress:(PRESNetDiagProgressHandler)progress
+         complete:(PRESNetDiagCompleteHandler)complete {
+    // keeps the running probes alive until they finished, so the timeouts are able to stop them
+    NSMutableDictionary<NSNumber *, id<QNNStopDelegate>> *running = [NSMutableDictionary dictionaryWithCapacity:5];
+    PRESNetDiagResult *result = [[PRESNetDiagResult alloc] initWithHost:host appKey:appKey probes:probes progress:^(PRESNetDiagResult *partialResult, PRESNetDiagProbe probe) {
+        @synchronized (running) {
+            [running removeObjectForKey:@(probe)];
+        }
+        if (progress) {
+            progress(partialResult, probe);
+        }
+    } complete:complete];
+
+    void (^start)(PRESNetDiagProbe, NSTimeInterval, id<QNNStopDelegate> (^)(void)) = ^(PRESNetDiagProbe probe, NSTimeInterval defaultTimeout, id<QNNStopDelegate> (^startProbe)(void)) {
+        if (!(probes & probe)) return;
+
+        id<QNNStopDelegate> task = startProbe();
+        @synchronized (running) {
+            if (task && ![result isFinished] && !(result.completed_probes & probe)) {
+                running[@(probe)] = task;
+            }
+        }
+
+        NSTimeInterval probeTimeout = timeout > 0 ? MIN(timeout, defaultTimeout) : defaultTimeout;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(probeTimeout * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+            if (result.completed_probes & probe) return;
+
+            id<QNNStopDelegate> timedOutTask;
+            @synchronized (running) {
+                timedOutTask = running[@(probe)];
+            }
+            [result probeTimedOut:probe];
+            [timedOutTask stop];
+        });
+    };
+
+    start(PRESNetDiagProbePing, PRESNetDiagPingTimeout, ^id<QNNStopDelegate> {
+        return [QNNPing start:host size:64 output:nil complete:^(QNNPingResult *r) {
+            [result gotPingResult:r];
+        }];
+    });
+    start(PRESNetDiagProbeTcpPing, PRESNetDiagTcpPingTimeout, ^id<QNNStopDelegate> {
+        return [QNNTcpPing start:host output:nil complete:^(QNNTcpPingResult *r) {
+            [result gotTcpResult:r];
+        }];
+    });
+    start(PRESNetDiagProbeTraceRoute, PRESNetDiagTraceRouteTimeout, ^id<QNNStopDelegate> {
+        return [QNNTraceRoute start:host output:nil complete:^(QNNTraceRouteResult *r) {
+            [result gotTrResult:r];
+        }];
+    });
+    start(PRESNetDiagProbeNslookup, PRESNetDiagNslookupTimeout, ^id<QNNStopDelegate> {
+        return [QNNNslookup start:host output:nil complete:^(NSArray *r) {
+            [result gotNsLookupResult:r];
+        }];
+    });
+    start(PRESNetDiagProbeHttp, PRESNetDiagHttpTimeout, ^id<QNNStopDelegate> {
+        return [QNNHttp start:host output:nil complete:^(QNNHttpResult *r) {
+            [result gotHttpResult:r];
+        }];
+    });
+}
+
+#pragma mark - Cache
+
++ (NSMutableDictionary<NSString *, PRESNetDiagCacheEntry *> *)cache {
+    static NSMutableDictionary *cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [NSMutableDictionary new];
+    });
+    return cache;
+}
+
++ (NSString *)cacheKeyForHost:(NSString *)host {
+    // a result only says something about the network it was taken on
+    return [NSString stringWithFormat:@"%ld %@", (long)[PRESReachability sharedInstance].status, host];
+}
+
++ (PRESNetDiagResult *)cachedResultForHost:(NSString *)host probes:(PRESNetDiagProbe)probes {
+    NSMutableDictionary<NSString *, PRESNetDiagCacheEntry *> *cache = [self cache];
+    NSString *key = [self cacheKeyForHost:host];
+    @synchronized (cache) {
+        PRESNetDiagCacheEntry *entry = cache[key];
+        if (!entry) return nil;
+        if (pres_monotonic_ns() - entry.finishedAt > (uint64_t)(PRESNetDiagCacheTTL * NSEC_PER_SEC)) {
+            [cache removeObjectForKey:key];
+            return nil;
+        }
+        // timed out probes don't count, they are worth another try
+        PRESNetDiagProbe usable = entry.result.completed_probes & ~entry.result.timed_out_probes;
+        return (usable & probes) == probes ? entry.result : nil;
+    }
+}
+
++ (void)cacheResult:(PRESNetDiagResult *)result {
+    NSMutableDictionary<NSString *, PRESNetDiagCacheEntry *> *cache = [self cache];
+    NSString *key = [self cacheKeyForHost:result.host];
+    uint64_t now = pres_monotonic_ns();
+    @synchronized (cache) {
+        PRESNetDiagCacheEntry *existing = cache[key];
+        PRESNetDiagProbe existingProbes = existing.result.completed_probes & ~existing.result.timed_out_probes;
+        PRESNetDiagProbe newProbes = result.completed_probes & ~result.timed_out_probes;
+        // a narrower probe set must not evict a fresh result covering more
+        if (existing && (existingProbes & ~newProbes) && now - existing.finishedAt <= (uint64_t)(PRESNetDiagCacheTTL * NSEC_PER_SEC)) {
+            return;
+        }
+
+        PRESNetDiagCacheEntry *entry = [PRESNetDiagCacheEntry new];
+        entry.result = result;
+        entry.finishedAt = now;
+        cache[key] = entry;
+
+        if (cache.count > PRESNetDiagCacheMaxCount) {
+            NSString *oldestKey;
+            uint64_t oldest = UINT64_MAX;
+            for (NSString *candidate in cache) {
+                if (cache[candidate].finishedAt < oldest) {
+                    oldest = cache[candidate].finishedAt;
+                    oldestKey = candidate;
+                }
+            }
+            [cache removeObjectForKey:oldestKey];
+        }
+    }
 }
 
 @end
@@ -10,7 +10,22 @@
 
 @interface PRESNetDiagResult ()
 
-- (instancetype)initWithAppKey:(NSString *)appKey complete:(PRESNetDiagCompleteHandler)complete ;
+- (instancetype)initWithHost:(NSString *)host
+                      appKey:(NSString *)appKey
+                      probes:(PRESNetDiagProbe)probes
+                    progress:(PRESNetDiagProgressHandler)progress
+                    complete:(PRESNetDiagCompleteHandler)complete;
+
+/**
+ *  YES once every requested probe finished or timed out
+ */
+- (BOOL)isFinished;
+
+/**
+ *  Marks the probe as timed out, a result arriving later for it is ignored
+ */
+- (void)probeTimedOut:(PRESNetDiagProbe)probe;
+
 - (void)gotTcpResult:(QNNTcpPingResult *)r;
 - (void)gotPingResult:(QNNPingResult *)r;
 - (void)gotHttpResult:(QNNHttpResult *)r;
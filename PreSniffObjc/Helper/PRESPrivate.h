@@ -39,6 +39,7 @@
 #define PRES_IDENTIFIER @"net.hockeyapp.sdk.ios"
 #define PRES_CRASH_SETTINGS @"PRESCrashManager.plist"
 #define PRES_CRASH_ANALYZER @"PRESCrashManager.analyzer"
+#define PRES_CRASH_META_DIR @"PRESCrashMeta"
 
 #define kPRESMetaUserName  @"PRESMetaUserName"
 #define kPRESMetaUserEmail @"PRESMetaUserEmail"
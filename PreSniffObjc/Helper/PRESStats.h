@@ -0,0 +1,67 @@
+//
+//  PRESStats.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 19/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Counters of the SDK's own work, named "<module>.<metric>" in a snapshot
+ */
+typedef NS_ENUM(NSUInteger, PRESStatsCounter) {
+    PRESStatsCounterTelemetryEnqueued = 0,
+    PRESStatsCounterTelemetryDropped,
+    PRESStatsCounterUploadRetries,
+    PRESStatsCounterCount
+};
+
+/**
+ *  Distributions of the SDK's own work. A snapshot has "<name>.count", ".sum", ".max", ".p50",
+ *  ".p90" and ".p99" for each, the percentiles are the upper bound of their power of two bucket.
+ */
+typedef NS_ENUM(NSUInteger, PRESStatsHistogram) {
+    PRESStatsHistogramTelemetrySerializationNs = 0,
+    PRESStatsHistogramTelemetryBundleBytes,
+    PRESStatsHistogramGzipNs,
+    /**
+     *  Compressed size in percent of the uncompressed size
+     */
+    PRESStatsHistogramGzipRatioPercent,
+    PRESStatsHistogramUploadLatencyMs,
+    PRESStatsHistogramHTTPMonitorWriteNs,
+    PRESStatsHistogramCrashProcessingMs,
+    PRESStatsHistogramCount
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Adds to a counter. Lock free, every thread writes to its own shard which is only merged when a
+ *  snapshot is taken.
+ */
+void pres_stats_add(PRESStatsCounter counter, uint64_t value);
+
+/**
+ *  Records a value in a histogram. Lock free like pres_stats_add.
+ */
+void pres_stats_record(PRESStatsHistogram histogram, uint64_t value);
+
+/**
+ *  Merges the shards of all threads into cumulative values since the launch. Values of a thread
+ *  being updated at the same time may be off by its latest update.
+ */
+NSDictionary<NSString *, NSNumber *> *pres_stats_snapshot(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,171 @@
+//
+//  PRESStats.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 19/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESStats.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bucket 0 holds 0, bucket i holds [2^(i-1), 2^i)
+#define PRES_STATS_BUCKET_COUNT 65
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[PRES_STATS_BUCKET_COUNT];
+} pres_stats_histogram_t;
+
+/**
+ *  Only the owning thread writes a shard, so updates are plain relaxed loads and stores without
+ *  read-modify-write instructions. The atomics only keep the snapshot from reading torn values.
+ *  Shards are never freed: a shard of an exited thread keeps its values and goes to the next new
+ *  thread, so memory is bounded by the peak number of threads that used the stats.
+ */
+typedef struct pres_stats_shard {
+    _Atomic uint64_t counters[PRESStatsCounterCount];
+    pres_stats_histogram_t histograms[PRESStatsHistogramCount];
+    atomic_bool inUse;
+    struct pres_stats_shard *next;
+} pres_stats_shard_t;
+
+static _Atomic(pres_stats_shard_t *) pres_stats_shards;
+static pthread_key_t pres_stats_shard_key;
+static pthread_once_t pres_stats_key_once = PTHREAD_ONCE_INIT;
+
+static NSString *const pres_stats_counter_names[PRESStatsCounterCount] = {
+    [PRESStatsCounterTelemetryEnqueued] = @"telemetry.enqueued",
+    [PRESStatsCounterTelemetryDropped] = @"telemetry.dropped",
+    [PRESStatsCounterUploadRetries] = @"upload.retries",
+};
+
+static NSString *const pres_stats_histogram_names[PRESStatsHistogramCount] = {
+    [PRESStatsHistogramTelemetrySerializationNs] = @"telemetry.serialization_ns",
+    [PRESStatsHistogramTelemetryBundleBytes] = @"telemetry.bundle_bytes",
+    [PRESStatsHistogramGzipNs] = @"gzip.duration_ns",
+    [PRESStatsHistogramGzipRatioPercent] = @"gzip.ratio_percent",
+    [PRESStatsHistogramUploadLatencyMs] = @"upload.latency_ms",
+    [PRESStatsHistogramHTTPMonitorWriteNs] = @"http_monitor.write_ns",
+    [PRESStatsHistogramCrashProcessingMs] = @"crash.processing_ms",
+};
+
+static void pres_stats_release_shard(void *shard) {
+    atomic_store_explicit(&((pres_stats_shard_t *)shard)->inUse, false, memory_order_release);
+}
+
+static void pres_stats_create_key(void) {
+    pthread_key_create(&pres_stats_shard_key, pres_stats_release_shard);
+}
+
+static pres_stats_shard_t *pres_stats_current_shard(void) {
+    pthread_once(&pres_stats_key_once, pres_stats_create_key);
+    pres_stats_shard_t *shard = pthread_getspecific(pres_stats_shard_key);
+    if (shard) return shard;
+
+    // take over the shard of an exited thread if there is one
+    for (shard = atomic_load_explicit(&pres_stats_shards, memory_order_acquire); shard; shard = shard->next) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong_explicit(&shard->inUse, &expected, true, memory_order_acquire, memory_order_relaxed)) {
+            pthread_setspecific(pres_stats_shard_key, shard);
+            return shard;
+        }
+    }
+
+    shard = calloc(1, sizeof(pres_stats_shard_t));
+    if (!shard) return NULL;
+    atomic_init(&shard->inUse, true);
+    pres_stats_shard_t *head = atomic_load_explicit(&pres_stats_shards, memory_order_relaxed);
+    do {
+        shard->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&pres_stats_shards, &head, shard, memory_order_release, memory_order_relaxed));
+    pthread_setspecific(pres_stats_shard_key, shard);
+    return shard;
+}
+
+static inline void pres_stats_shard_add(_Atomic uint64_t *value, uint64_t delta) {
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+void pres_stats_add(PRESStatsCounter counter, uint64_t value) {
+    if (counter >= PRESStatsCounterCount) return;
+    pres_stats_shard_t *shard = pres_stats_current_shard();
+    if (!shard) return;
+    pres_stats_shard_add(&shard->counters[counter], value);
+}
+
+void pres_stats_record(PRESStatsHistogram histogram, uint64_t value) {
+    if (histogram >= PRESStatsHistogramCount) return;
+    pres_stats_shard_t *shard = pres_stats_current_shard();
+    if (!shard) return;
+
+    pres_stats_histogram_t *h = &shard->histograms[histogram];
+    unsigned int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    pres_stats_shard_add(&h->count, 1);
+    pres_stats_shard_add(&h->sum, value);
+    pres_stats_shard_add(&h->buckets[bucket], 1);
+    if (value > atomic_load_explicit(&h->max, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max, value, memory_order_relaxed);
+    }
+}
+
+static uint64_t pres_stats_percentile(const uint64_t *buckets, uint64_t count, uint64_t max, double quantile) {
+    if (count == 0) return 0;
+    uint64_t rank = (uint64_t)(quantile * count);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < PRES_STATS_BUCKET_COUNT; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t upperBound = i == 0 ? 0 : (i == 64 ? UINT64_MAX : (1ull << i) - 1);
+            return upperBound < max ? upperBound : max;
+        }
+    }
+    return max;
+}
+
+NSDictionary<NSString *, NSNumber *> *pres_stats_snapshot(void) {
+    uint64_t counters[PRESStatsCounterCount] = {0};
+    uint64_t counts[PRESStatsHistogramCount] = {0};
+    uint64_t sums[PRESStatsHistogramCount] = {0};
+    uint64_t maxima[PRESStatsHistogramCount] = {0};
+    uint64_t buckets[PRESStatsHistogramCount][PRES_STATS_BUCKET_COUNT];
+    memset(buckets, 0, sizeof(buckets));
+
+    for (pres_stats_shard_t *shard = atomic_load_explicit(&pres_stats_shards, memory_order_acquire); shard; shard = shard->next) {
+        for (NSUInteger i = 0; i < PRESStatsCounterCount; i++) {
+            counters[i] += atomic_load_explicit(&shard->counters[i], memory_order_relaxed);
+        }
+        for (NSUInteger i = 0; i < PRESStatsHistogramCount; i++) {
+            pres_stats_histogram_t *h = &shard->histograms[i];
+            counts[i] += atomic_load_explicit(&h->count, memory_order_relaxed);
+            sums[i] += atomic_load_explicit(&h->sum, memory_order_relaxed);
+            uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+            if (max > maxima[i]) maxima[i] = max;
+            for (NSUInteger b = 0; b < PRES_STATS_BUCKET_COUNT; b++) {
+                buckets[i][b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+            }
+        }
+    }
+
+    NSMutableDictionary<NSString *, NSNumber *> *snapshot = [NSMutableDictionary dictionaryWithCapacity:PRESStatsCounterCount + PRESStatsHistogramCount * 6];
+    for (NSUInteger i = 0; i < PRESStatsCounterCount; i++) {
+        snapshot[pres_stats_counter_names[i]] = @(counters[i]);
+    }
+    for (NSUInteger i = 0; i < PRESStatsHistogramCount; i++) {
+        NSString *name = pres_stats_histogram_names[i];
+        snapshot[[name stringByAppendingString:@".count"]] = @(counts[i]);
+        snapshot[[name stringByAppendingString:@".sum"]] = @(sums[i]);
+        snapshot[[name stringByAppendingString:@".max"]] = @(maxima[i]);
+        snapshot[[name stringByAppendingString:@".p50"]] = @(pres_stats_percentile(buckets[i], counts[i], maxima[i], 0.5));
+        snapshot[[name stringByAppendingString:@".p90"]] = @(pres_stats_percentile(buckets[i], counts[i], maxima[i], 0.9));
+        snapshot[[name stringByAppendingString:@".p99"]] = @(pres_stats_percentile(buckets[i], counts[i], maxima[i], 0.99));
+    }
+    return snapshot;
+}
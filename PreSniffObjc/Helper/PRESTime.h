@@ -0,0 +1,64 @@
+//
+//  PRESTime.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 12/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#ifndef PRESTime_h
+#define PRESTime_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Wall clock time in seconds and nanoseconds since 1970
+ */
+typedef struct {
+    int64_t seconds;
+    int32_t nanoseconds;
+} pres_timestamp_t;
+
+/**
+ *  Length of "yyyy-MM-ddTHH:mm:ss.SSSZ" without the terminating NUL
+ */
+#define PRES_ISO8601_MILLISECONDS_LENGTH 24
+
+/**
+ *  Length of "yyyy-MM-ddTHH:mm:ssZ" without the terminating NUL
+ */
+#define PRES_ISO8601_SECONDS_LENGTH 20
+
+pres_timestamp_t pres_timestamp_now(void);
+pres_timestamp_t pres_timestamp_from_interval(double secondsSince1970);
+
+/**
+ *  Monotonic nanoseconds for measuring durations, unrelated to the wall clock
+ */
+uint64_t pres_monotonic_ns(void);
+
+/**
+ *  Formats the timestamp as UTC ISO 8601 string
+ *
+ *  Thread-safe and allocation free. The date and time part is cached per second, the
+ *  fraction is written from a digit table.
+ *
+ *  @param timestamp       the time to format
+ *  @param withMilliseconds whether to add the ".SSS" fraction
+ *  @param buffer          output buffer, needs at least PRES_ISO8601_MILLISECONDS_LENGTH + 1 bytes
+ *  @param length          size of the buffer
+ *
+ *  @return the number of characters written excluding the terminating NUL, 0 if the buffer is too small
+ */
+size_t pres_format_iso8601(pres_timestamp_t timestamp, int withMilliseconds, char *buffer, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PRESTime_h */
@@ -0,0 +1,197 @@
+//
+//  PRESTime.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 12/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#include "PRESTime.h"
+
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#ifdef __APPLE__
+#include <Availability.h>
+#include <dispatch/dispatch.h>
+#include <mach/mach_time.h>
+#endif
+
+#define PRES_ISO8601_PREFIX_LENGTH 19 // "yyyy-MM-ddTHH:mm:ss"
+#define PRES_ISO8601_CACHE_WORDS 3
+
+static const char pres_digit_pairs[201] =
+"00010203040506070809"
+"10111213141516171819"
+"20212223242526272829"
+"30313233343536373839"
+"40414243444546474849"
+"50515253545556575859"
+"60616263646566676869"
+"70717273747576777879"
+"80818283848586878889"
+"90919293949596979899";
+
+// Seqlock protected cache of the date and time part of the last formatted second.
+// The prefix is kept in atomic words so readers never race with a writer on plain memory.
+static _Atomic uint32_t pres_iso8601_cache_sequence = 0;
+static _Atomic int64_t pres_iso8601_cache_second = INT64_MIN;
+static _Atomic uint64_t pres_iso8601_cache_prefix[PRES_ISO8601_CACHE_WORDS];
+
+#pragma mark - Capturing
+
+pres_timestamp_t pres_timestamp_now(void) {
+    pres_timestamp_t timestamp;
+#if !defined(__APPLE__) || (defined(__IPHONE_OS_VERSION_MIN_REQUIRED) && __IPHONE_OS_VERSION_MIN_REQUIRED >= 100000) || (defined(__MAC_OS_X_VERSION_MIN_REQUIRED) && __MAC_OS_X_VERSION_MIN_REQUIRED >= 101200)
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    timestamp.seconds = now.tv_sec;
+    timestamp.nanoseconds = (int32_t)now.tv_nsec;
+#else
+    // clock_gettime is only available starting with iOS 10 / macOS 10.12
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    timestamp.seconds = now.tv_sec;
+    timestamp.nanoseconds = (int32_t)now.tv_usec * 1000;
+#endif
+    return timestamp;
+}
+
+pres_timestamp_t pres_timestamp_from_interval(double secondsSince1970) {
+    pres_timestamp_t timestamp;
+    int64_t seconds = (int64_t)secondsSince1970;
+    if ((double)seconds > secondsSince1970) {
+        seconds -= 1;
+    }
+    timestamp.seconds = seconds;
+    timestamp.nanoseconds = (int32_t)((secondsSince1970 - (double)seconds) * 1e9);
+    if (timestamp.nanoseconds >= 1000000000) {
+        timestamp.seconds += 1;
+        timestamp.nanoseconds -= 1000000000;
+    }
+    return timestamp;
+}
+
+uint64_t pres_monotonic_ns(void) {
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+#pragma mark - Formatting
+
+static inline void pres_write_two_digits(char *buffer, unsigned value) {
+    memcpy(buffer, &pres_digit_pairs[value * 2], 2);
+}
+
+// Days since 1970-01-01 to proleptic Gregorian date, see http://howardhinnant.github.io/date_algorithms.html
+static void pres_civil_from_days(int64_t days, int64_t *year, unsigned *month, unsigned *day) {
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned dayOfEra = (unsigned)(days - era * 146097);
+    const unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const unsigned shiftedMonth = (5 * dayOfYear + 2) / 153;
+    *day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+    *month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+    *year = (int64_t)yearOfEra + era * 400 + (*month <= 2);
+}
+
+static void pres_format_prefix(int64_t seconds, char *buffer) {
+    int64_t days = seconds / 86400;
+    int64_t secondOfDay = seconds % 86400;
+    if (secondOfDay < 0) {
+        secondOfDay += 86400;
+        days -= 1;
+    }
+
+    int64_t year;
+    unsigned month, day;
+    pres_civil_from_days(days, &year, &month, &day);
+    if (year < 0) year = 0;
+    if (year > 9999) year = 9999;
+
+    pres_write_two_digits(buffer, (unsigned)(year / 100));
+    pres_write_two_digits(buffer + 2, (unsigned)(year % 100));
+    buffer[4] = '-';
+    pres_write_two_digits(buffer + 5, month);
+    buffer[7] = '-';
+    pres_write_two_digits(buffer + 8, day);
+    buffer[10] = 'T';
+    pres_write_two_digits(buffer + 11, (unsigned)(secondOfDay / 3600));
+    buffer[13] = ':';
+    pres_write_two_digits(buffer + 14, (unsigned)(secondOfDay / 60 % 60));
+    buffer[16] = ':';
+    pres_write_two_digits(buffer + 17, (unsigned)(secondOfDay % 60));
+}
+
+static int pres_load_cached_prefix(int64_t seconds, char *buffer) {
+    uint32_t sequence = atomic_load_explicit(&pres_iso8601_cache_sequence, memory_order_acquire);
+    if (sequence & 1) return 0;
+
+    int64_t cachedSecond = atomic_load_explicit(&pres_iso8601_cache_second, memory_order_relaxed);
+    uint64_t words[PRES_ISO8601_CACHE_WORDS];
+    for (int i = 0; i < PRES_ISO8601_CACHE_WORDS; i++) {
+        words[i] = atomic_load_explicit(&pres_iso8601_cache_prefix[i], memory_order_relaxed);
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&pres_iso8601_cache_sequence, memory_order_relaxed) != sequence) return 0;
+    if (cachedSecond != seconds) return 0;
+
+    memcpy(buffer, words, PRES_ISO8601_PREFIX_LENGTH);
+    return 1;
+}
+
+static void pres_store_cached_prefix(int64_t seconds, const char *buffer) {
+    uint32_t sequence = atomic_load_explicit(&pres_iso8601_cache_sequence, memory_order_relaxed);
+    // another thread is updating the cache, it is only an optimization so just skip it
+    if ((sequence & 1) || !atomic_compare_exchange_strong_explicit(&pres_iso8601_cache_sequence, &sequence, sequence + 1,
+                                                                     memory_order_relaxed, memory_order_relaxed)) {
+        return;
+    }
+    atomic_thread_fence(memory_order_release);
+
+    uint64_t words[PRES_ISO8601_CACHE_WORDS] = {0};
+    memcpy(words, buffer, PRES_ISO8601_PREFIX_LENGTH);
+    for (int i = 0; i < PRES_ISO8601_CACHE_WORDS; i++) {
+        atomic_store_explicit(&pres_iso8601_cache_prefix[i], words[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&pres_iso8601_cache_second, seconds, memory_order_relaxed);
+
+    atomic_store_explicit(&pres_iso8601_cache_sequence, sequence + 2, memory_order_release);
+}
+
+size_t pres_format_iso8601(pres_timestamp_t timestamp, int withMilliseconds, char *buffer, size_t length) {
+    size_t formattedLength = withMilliseconds ? PRES_ISO8601_MILLISECONDS_LENGTH : PRES_ISO8601_SECONDS_LENGTH;
+    if (!buffer || length < formattedLength + 1) return 0;
+
+    if (!pres_load_cached_prefix(timestamp.seconds, buffer)) {
+        pres_format_prefix(timestamp.seconds, buffer);
+        pres_store_cached_prefix(timestamp.seconds, buffer);
+    }
+
+    char *cursor = buffer + PRES_ISO8601_PREFIX_LENGTH;
+    if (withMilliseconds) {
+        unsigned milliseconds = (unsigned)(timestamp.nanoseconds / 1000000);
+        *cursor++ = '.';
+        *cursor++ = (char)('0' + milliseconds / 100);
+        pres_write_two_digits(cursor, milliseconds % 100);
+        cursor += 2;
+    }
+    *cursor++ = 'Z';
+    *cursor = '\0';
+
+    return formattedLength;
+}
@@ -12,6 +12,186 @@
 #import <objc/runtime.h>
 #import <CommonCrypto/CommonDigest.h>
 
+typedef NS_ENUM(uint8_t, PRESPropertyKind) {
+    PRESPropertyKindObject,
+    PRESPropertyKindBool,
+    PRESPropertyKindChar,
+    PRESPropertyKindUnsignedChar,
+    PRESPropertyKindShort,
+    PRESPropertyKindUnsignedShort,
+    PRESPropertyKindInt,
+    PRESPropertyKindUnsignedInt,
+    PRESPropertyKindLong,
+    PRESPropertyKindUnsignedLong,
+    PRESPropertyKindLongLong,
+    PRESPropertyKindUnsignedLongLong,
+    PRESPropertyKindFloat,
+    PRESPropertyKindDouble,
+    /**
+     *  No ivar to read directly (computed, custom or overridden getter, weak, atomic object or
+     *  struct), read through KVC
+     */
+    PRESPropertyKindGetter
+};
+
+typedef struct {
+    PRESPropertyKind kind;
+    ptrdiff_t offset;
+    Ivar ivar;
+} PRESPropertyAccessor;
+
+/**
+ *  The properties of one class with how to read them, built once per class from the runtime
+ *  instead of on every getObjectData: call.
+ */
+@interface PRESObjectSerializer : NSObject
+
+@property (nonatomic, assign, readonly) NSUInteger count;
+@property (nonatomic, copy, readonly) NSArray<NSString *> *names;
+@property (nonatomic, assign, readonly) PRESPropertyAccessor *accessors;
+
++ (instancetype)serializerForClass:(Class)cls;
+
+/**
+ *  @return the value of the property, scalars boxed as NSNumber
+ */
+- (id)valueAtIndex:(NSUInteger)index ofObject:(id)obj;
+
+@end
+
+@implementation PRESObjectSerializer
+
++ (instancetype)serializerForClass:(Class)cls {
+    static NSMapTable *serializers;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        serializers = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsOpaquePersonality
+                                            valueOptions:NSPointerFunctionsStrongMemory];
+    });
+    
+    @synchronized (serializers) {
+        PRESObjectSerializer *serializer = [serializers objectForKey:cls];
+        if (!serializer) {
+            serializer = [[PRESObjectSerializer alloc] initWithClass:cls];
+            [serializers setObject:serializer forKey:cls];
+        }
+        return serializer;
+    }
+}
+
+/**
+ *  YES if cls implements the getter exactly once itself. None means it is inherited or resolved
+ *  dynamically, more than one means a category replaced it.
+ */
+static BOOL pres_classOwnsGetter(Class cls, SEL getter) {
+    unsigned int methodsCount = 0;
+    Method *methods = class_copyMethodList(cls, &methodsCount);
+    unsigned int implementations = 0;
+    for (unsigned int i = 0; i < methodsCount; i++) {
+        if (method_getName(methods[i]) == getter) implementations++;
+    }
+    free(methods);
+    return implementations == 1;
+}
+
+static PRESPropertyKind pres_propertyKindForType(const char *type) {
+    switch (type[0]) {
+        case '@': return PRESPropertyKindObject;
+        case 'B': return PRESPropertyKindBool;
+        case 'c': return PRESPropertyKindChar;
+        case 'C': return PRESPropertyKindUnsignedChar;
+        case 's': return PRESPropertyKindShort;
+        case 'S': return PRESPropertyKindUnsignedShort;
+        case 'i': return PRESPropertyKindInt;
+        case 'I': return PRESPropertyKindUnsignedInt;
+        case 'l': return PRESPropertyKindLong;
+        case 'L': return PRESPropertyKindUnsignedLong;
+        case 'q': return PRESPropertyKindLongLong;
+        case 'Q': return PRESPropertyKindUnsignedLongLong;
+        case 'f': return PRESPropertyKindFloat;
+        case 'd': return PRESPropertyKindDouble;
+        default: return PRESPropertyKindGetter;
+    }
+}
+
+- (instancetype)initWithClass:(Class)cls {
+    if (self = [super init]) {
+        unsigned int propsCount = 0;
+        objc_property_t *props = class_copyPropertyList(cls, &propsCount);
+        
+        NSMutableArray<NSString *> *names = [NSMutableArray arrayWithCapacity:propsCount];
+        _accessors = calloc(MAX(propsCount, 1U), sizeof(PRESPropertyAccessor));
+        for (unsigned int i = 0; i < propsCount; i++) {
+            char *type = property_copyAttributeValue(props[i], "T");
+            char *ivarName = property_copyAttributeValue(props[i], "V");
+            char *weak = property_copyAttributeValue(props[i], "W");
+            char *nonatomic = property_copyAttributeValue(props[i], "N");
+            char *customGetter = property_copyAttributeValue(props[i], "G");
+            
+            // blocks have nothing to serialize
+            BOOL isBlock = type && strcmp(type, "@?") == 0;
+            if (type && !isBlock) {
+                PRESPropertyAccessor accessor = {pres_propertyKindForType(type), 0, NULL};
+                Ivar ivar = ivarName ? class_getInstanceVariable(cls, ivarName) : NULL;
+                BOOL plainGetter = !customGetter && pres_classOwnsGetter(cls, sel_registerName(property_getName(props[i])));
+                if (!ivar || weak || !plainGetter || (accessor.kind == PRESPropertyKindObject && !nonatomic)) {
+                    // the getter takes care of weak references, of locking atomic objects and of
+                    // whatever a custom or overridden getter computes
+                    accessor.kind = PRESPropertyKindGetter;
+                } else {
+                    accessor.offset = ivar_getOffset(ivar);
+                    accessor.ivar = ivar;
+                }
+                _accessors[_count++] = accessor;
+                [names addObject:@(property_getName(props[i]))];
+            }
+            
+            free(type);
+            free(ivarName);
+            free(weak);
+            free(nonatomic);
+            free(customGetter);
+        }
+        free(props);
+        _names = [names copy];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_accessors);
+}
+
+- (id)valueAtIndex:(NSUInteger)index ofObject:(id)obj {
+    PRESPropertyAccessor accessor = _accessors[index];
+    const uint8_t *field = (const uint8_t *)(__bridge void *)obj + accessor.offset;
+    
+    switch (accessor.kind) {
+        case PRESPropertyKindObject: {
+            // a getter may fill a nil ivar lazily
+            id value = object_getIvar(obj, accessor.ivar);
+            return value ?: [obj valueForKey:_names[index]];
+        }
+        case PRESPropertyKindBool: return @(*(const bool *)field);
+        case PRESPropertyKindChar: return @(*(const char *)field);
+        case PRESPropertyKindUnsignedChar: return @(*(const unsigned char *)field);
+        case PRESPropertyKindShort: return @(*(const short *)field);
+        case PRESPropertyKindUnsignedShort: return @(*(const unsigned short *)field);
+        case PRESPropertyKindInt: return @(*(const int *)field);
+        case PRESPropertyKindUnsignedInt: return @(*(const unsigned int *)field);
+        case PRESPropertyKindLong: return @(*(const long *)field);
+        case PRESPropertyKindUnsignedLong: return @(*(const unsigned long *)field);
+        case PRESPropertyKindLongLong: return @(*(const long long *)field);
+        case PRESPropertyKindUnsignedLongLong: return @(*(const unsigned long long *)field);
+        case PRESPropertyKindFloat: return @(*(const float *)field);
+        case PRESPropertyKindDouble: return @(*(const double *)field);
+        case PRESPropertyKindGetter: return [obj valueForKey:_names[index]];
+    }
+    return nil;
+}
+
+@end
+
 @implementation PRESUtilities
 
 + (NSString *)getAppName {
@@ -47,24 +227,17 @@
 }
 
 + (NSDictionary*)getObjectData:(id)obj {
+    PRESObjectSerializer *serializer = [PRESObjectSerializer serializerForClass:[obj class]];
+    NSMutableDictionary *dic = [NSMutableDictionary dictionaryWithCapacity:serializer.count];
     
-    NSMutableDictionary *dic = [NSMutableDictionary dictionary];
-    unsigned int propsCount;
-    
-    objc_property_t *props = class_copyPropertyList([obj class], &propsCount);
-    
-    for(int i = 0;i < propsCount; i++) {
-        
-        objc_property_t prop = props[i];
-        NSString *propName = [NSString stringWithUTF8String:property_getName(prop)];
-        id value = [obj valueForKey:propName];
-        if(value == nil) {
-            
+    for (NSUInteger i = 0; i < serializer.count; i++) {
+        id value = [serializer valueAtIndex:i ofObject:obj];
+        if (value == nil) {
             value = [NSNull null];
-        } else {
+        } else if (serializer.accessors[i].kind == PRESPropertyKindObject || serializer.accessors[i].kind == PRESPropertyKindGetter) {
             value = [self getObjectInternal:value];
         }
-        [dic setObject:value forKey:propName];
+        [dic setObject:value forKey:serializer.names[i]];
     }
     
     return dic;
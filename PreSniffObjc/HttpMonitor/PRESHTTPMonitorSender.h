@@ -9,6 +9,8 @@
 #import <Foundation/Foundation.h>
 #import "PRESHTTPMonitorModel.h"
 
+@class PRESConfig;
+
 @interface PRESHTTPMonitorSender : NSObject
 
 @property (nonatomic, assign, getter=isEnabled) BOOL enable;
@@ -17,4 +19,10 @@
 
 - (void)addModel:(PRESHTTPMonitorModel *)model;
 
+/**
+ *  Applies the log file size, the number of log files and the send interval of the config.
+ *  A smaller number of log files takes effect when the writer wraps around.
+ */
+- (void)updateWithConfig:(PRESConfig *)config;
+
 @end
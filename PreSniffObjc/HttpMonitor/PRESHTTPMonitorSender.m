@@ -7,11 +7,13 @@
 //
 
 #import "PRESHTTPMonitorSender.h"
-#import "PRESGZIP.h"
+#import "PRESTransport.h"
+#import "PRESBatchUploader.h"
+#import "PRESConfig.h"
+#import "PRESPrivate.h"
+#import "PRESStats.h"
+#import "PRESTime.h"
 
-#define PRESSendLogDefaultInterval  10
-#define PRESMaxLogLenth            (1024 * 64)
-#define PRESMaxLogIndex             100
 #define PRESSendTimeOut             10
 
 #define PRESErrorDomain             @"error.sdk.presniff"
@@ -21,16 +23,14 @@
 #define PRESReadFilePositionKey     @"read_file_position"
 #define PRESWriteFileIndexKey       @"write_file_index"
 #define PRESWriteFilePosition       @"write_file_position"
+#define PRESWrapFileIndexKey        @"wrap_file_index"
 
 static NSString * wrapString(NSString *st) {
     NSString *ret = st ? (st.length != 0 ? st : @"-") : @"-";
     return ret;
 }
 
-@interface PRESHTTPMonitorSender ()
-<
-NSURLSessionDelegate
->
+@interface PRESHTTPMonitorSender () <PRESBatchChunkSource>
 
 @property (nonatomic, strong) NSString          *logDirPath;
 @property (nonatomic, strong) NSString          *indexFilePath;
@@ -43,8 +43,12 @@ NSURLSessionDelegate
 @property (nonatomic, strong) NSRecursiveLock   *logFileIOLock;
 @property (nonatomic, strong) NSFileHandle      *indexFileHandle;
 @property (nonatomic, assign) BOOL              isSendingData;
-@property (nonatomic, strong) NSURLSession      *urlSession;
 @property (nonatomic, strong) NSString          *logPathToBeRemoved;
+@property (atomic, assign) NSUInteger           maxLogLength;
+@property (atomic, assign) NSUInteger           maxLogIndex;
+@property (nonatomic, assign) NSTimeInterval    sendInterval;
+// Index of the last file before the writer wrapped to 1, 0 once the reader wrapped as well
+@property (nonatomic, assign) unsigned int      mWrapFileIndex;
 
 @end
 
@@ -67,10 +71,14 @@ NSURLSessionDelegate
         _mReadFilePosition = 0;
         _mWriteFileIndex = 1;
         _mWriteFilePosition = 0;
+        _mWrapFileIndex = 0;
+        PRESConfig *defaultConfig = PRESConfig.defaultConfig;
+        _maxLogLength = defaultConfig.httpMonitorMaxLogLength;
+        _maxLogIndex = defaultConfig.httpMonitorMaxLogIndex;
+        _sendInterval = defaultConfig.httpMonitorSendInterval;
         _indexFileIOLock = [NSRecursiveLock new];
         _logFileIOLock = [NSRecursiveLock new];
-        NSURLSessionConfiguration *sessionConfig = NSURLSessionConfiguration.defaultSessionConfiguration;
-        _urlSession = [NSURLSession sessionWithConfiguration:sessionConfig delegate:self delegateQueue:[NSOperationQueue new]];
+        [[PRESBatchUploader sharedUploader] addSource:self];
     }
     return self;
 }
@@ -123,10 +131,44 @@ NSURLSessionDelegate
     [self writeArray:modelArray];
 }
 
+- (void)updateWithConfig:(PRESConfig *)config {
+    self.maxLogLength = MAX(config.httpMonitorMaxLogLength, 1024U);
+    self.maxLogIndex = MAX(config.httpMonitorMaxLogIndex, 2U);
+    
+    NSTimeInterval sendInterval = MAX(config.httpMonitorSendInterval, 1);
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (sendInterval == self.sendInterval) return;
+        self.sendInterval = sendInterval;
+        // restart the timer with the new interval
+        if (self.sendTimer) {
+            [self.sendTimer invalidate];
+            self.sendTimer = nil;
+            self.enable = self.enable;
+        }
+    });
+}
+
+/**
+ *  The file after the given one. The reader only wraps while it is still behind in the previous
+ *  cycle, at the file the writer wrapped at, so a maxLogIndex changed in between does not matter.
+ */
+- (unsigned int)readFileIndexAfter:(unsigned int)index {
+    if (index < _mWriteFileIndex) {
+        return index + 1;
+    }
+    unsigned int wrapIndex = _mWrapFileIndex ?: (unsigned int)self.maxLogIndex;
+    if (index < wrapIndex) {
+        return index + 1;
+    }
+    // the reader caught up with the wrap, the next one is recorded by the writer again
+    _mWrapFileIndex = 0;
+    return 1;
+}
+
 - (void)setEnable:(BOOL)enable {
     _enable = enable;
     if (enable && !_sendTimer) {
-        _sendTimer = [NSTimer timerWithTimeInterval:PRESSendLogDefaultInterval target:self selector:@selector(sendLog) userInfo:nil repeats:YES];
+        _sendTimer = [NSTimer timerWithTimeInterval:self.sendInterval target:self selector:@selector(sendLog) userInfo:nil repeats:YES];
         [[NSRunLoop mainRunLoop] addTimer: _sendTimer forMode:NSRunLoopCommonModes];
     } else if (!enable && _sendTimer) {
         [_sendTimer invalidate];
@@ -158,7 +200,7 @@ NSURLSessionDelegate
         [[NSFileManager defaultManager] createDirectoryAtPath:_logDirPath withIntermediateDirectories:NO attributes:nil error:&err];
     }
     if (err) {
-        NSLog(@"log file create error: %@", err);
+        PRESLogError(@"ERROR: Unable to create the HTTP monitor log directory: %@", err);
         return err;
     }
     exist = [[NSFileManager defaultManager] fileExistsAtPath:_indexFilePath isDirectory:&isDir];
@@ -173,7 +215,9 @@ NSURLSessionDelegate
     if (err) {
         return err;
     }
+    uint64_t writeStart = pres_monotonic_ns();
     err = [self writeData:dataToWrite];
+    pres_stats_record(PRESStatsHistogramHTTPMonitorWriteNs, pres_monotonic_ns() - writeStart);
     return err;
 }
 
@@ -182,10 +226,11 @@ NSURLSessionDelegate
     NSDictionary *dic = @{PRESReadFileIndexKey: @(_mReadFileIndex),
                           PRESReadFilePositionKey: @(_mReadFilePosition),
                           PRESWriteFileIndexKey: @(_mWriteFileIndex),
-                          PRESWriteFilePosition: @(_mWriteFilePosition)};
+                          PRESWriteFilePosition: @(_mWriteFilePosition),
+                          PRESWrapFileIndexKey: @(_mWrapFileIndex)};
     NSData *indexData = [NSJSONSerialization dataWithJSONObject:dic options:0 error:&err];
     if (err) {
-        NSLog(@"create json for update index file error: %@", err);
+        PRESLogError(@"ERROR: Unable to serialize the HTTP monitor index: %@", err);
         return err;
     }
     if (!_indexFileHandle) {
@@ -193,7 +238,7 @@ NSURLSessionDelegate
     }
     if (!_indexFileHandle) {
         err = [NSError errorWithDomain:PRESErrorDomain code:-1 userInfo:@{NSLocalizedDescriptionKey: [NSString stringWithFormat:@"create index file handle error for: %@", _indexFilePath]}];
-        NSLog(@"%@", err);
+        PRESLogError(@"ERROR: %@", err);
         return err;
     }
     
@@ -212,12 +257,12 @@ NSURLSessionDelegate
     if (indexData != nil) {
         NSDictionary *dic = [NSJSONSerialization JSONObjectWithData:indexData options:0 error:&err];
         if (err) {
-            NSLog(@"error:parse data failed %@", err);
+            PRESLogError(@"ERROR: Unable to parse the HTTP monitor index: %@", err);
             [_indexFileIOLock unlock];
             return err;
         }
         if (!dic || ![dic respondsToSelector:@selector(objectForKey:)]) {
-            NSLog(@"index file json is not valid dictionary object");
+            PRESLogError(@"ERROR: HTTP monitor index is not a dictionary");
             [_indexFileIOLock unlock];
             return err;
         }
@@ -225,6 +270,7 @@ NSURLSessionDelegate
         _mReadFilePosition = (unsigned int)[[dic objectForKey:PRESReadFilePositionKey] unsignedIntegerValue];
         _mWriteFileIndex = (unsigned int)[[dic objectForKey:PRESWriteFileIndexKey] unsignedIntegerValue];
         _mWriteFilePosition = (unsigned int)[[dic objectForKey:PRESWriteFilePosition] unsignedIntegerValue];
+        _mWrapFileIndex = (unsigned int)[[dic objectForKey:PRESWrapFileIndexKey] unsignedIntegerValue];
     }
     [_indexFileIOLock unlock];
     return nil;
@@ -234,8 +280,9 @@ NSURLSessionDelegate
     BOOL isDir = NO, exist = NO;
     NSError *err;
     
-    if (_mWriteFilePosition + dataToWrite.length > PRESMaxLogLenth) {
-        if (_mWriteFileIndex == PRESMaxLogIndex) {
+    if (_mWriteFilePosition + dataToWrite.length > self.maxLogLength) {
+        if (_mWriteFileIndex >= self.maxLogIndex) {
+            _mWrapFileIndex = _mWriteFileIndex;
             _mWriteFileIndex = 1;
         } else {
             _mWriteFileIndex ++;
@@ -250,14 +297,14 @@ NSURLSessionDelegate
         BOOL success = [[NSFileManager defaultManager] createFileAtPath:logPath contents:nil attributes:nil];
         if (!success) {
             err = [NSError errorWithDomain:PRESErrorDomain code:-1 userInfo:@{NSLocalizedDescriptionKey: [NSString stringWithFormat:@"create http monior log file error for: %@", logPath]}];
-            NSLog(@"%@", err);
+            PRESLogError(@"ERROR: %@", err);
             return err;
         }
     }
     NSFileHandle *logFileHandle = [NSFileHandle fileHandleForUpdatingAtPath:logPath];
     if (!logFileHandle) {
         err = [NSError errorWithDomain:PRESErrorDomain code:-1 userInfo:@{NSLocalizedDescriptionKey: [NSString stringWithFormat:@"create http monior log file handle error for: %@", logPath]}];
-        NSLog(@"%@", err);
+        PRESLogError(@"ERROR: %@", err);
         return err;
     }
     [logFileHandle seekToFileOffset:_mWriteFilePosition];
@@ -278,67 +325,18 @@ NSURLSessionDelegate
     if (!_enable) {
         return;
     }
+    if ([PRESBatchUploader sharedUploader].enabled) {
+        // the uploader pulls the log through takeBatchChunksWithMaxBytes:
+        [[PRESBatchUploader sharedUploader] flush];
+        return;
+    }
     if (_isSendingData) {
         return;
     }
     _isSendingData = YES;
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
-        BOOL isDir = NO, exist = NO;
-        NSError *err;
-        
-        err = [self parseIndexFile];
-        if (err) {
-            _isSendingData = NO;
-            return;
-        }
-        NSString *logFilePath = [NSString stringWithFormat:@"%@/log.%u", _logDirPath, _mReadFileIndex];
-        exist = [[NSFileManager defaultManager] fileExistsAtPath:logFilePath isDirectory:&isDir];
-        if (!exist || isDir) {
-            NSLog(@"log file path not exist");
-            _isSendingData = NO;
-            return;
-        }
-        NSFileHandle *handle = [NSFileHandle fileHandleForUpdatingAtPath:logFilePath];
-        if (!handle) {
-            NSLog(@"log file handle generate failed");
-            _isSendingData = NO;
-            return;
-        }
-        
-        NSData *dataUncompressed;
-        [handle seekToFileOffset:_mReadFilePosition];
-        if (_mReadFileIndex == _mWriteFileIndex) {
-            dataUncompressed = [handle readDataOfLength:(_mWriteFilePosition - _mReadFilePosition)];
-            _logPathToBeRemoved = nil;
-        } else {
-            dataUncompressed = [handle readDataToEndOfFile];
-            if (!dataUncompressed.length) {
-                [[NSFileManager defaultManager] removeItemAtPath:logFilePath error:&err];
-                if (err) {
-                    NSLog(@"remove log file failed: %@", err);
-                }
-                // 删除失败依然需要将读取的位置切换到下个文件，不管之前的文件了
-                if (_mReadFileIndex == PRESMaxLogIndex) {
-                    _mReadFileIndex = 1;
-                } else {
-                    _mReadFileIndex ++;
-                }
-                _mReadFilePosition = 0;
-                [self updateIndexFile];
-                _isSendingData = NO;
-                return;
-            }
-            _logPathToBeRemoved = logFilePath;
-        }
-        
-        if (!dataUncompressed || !dataUncompressed.length) {
-            _isSendingData = NO;
-            return;
-        }
-        
-        NSData *dataToSend = [dataUncompressed pres_gzippedData];
-        if (!dataToSend || !dataToSend.length) {
-            NSLog(@"compressed data is empty");
+        NSData *dataUncompressed = [self readPendingLog];
+        if (!dataUncompressed) {
             _isSendingData = NO;
             return;
         }
@@ -346,36 +344,109 @@ NSURLSessionDelegate
         NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:[NSURL URLWithString:[NSString stringWithFormat:@"%@%@", PRESHTTPMonitorDomain, PRESHTTPMonitorReportPath]]];
         request.HTTPMethod = @"POST";
         request.timeoutInterval = PRESSendTimeOut;
-        request.HTTPBody = dataToSend;
+        request.HTTPBody = dataUncompressed;
         [request addValue:@"application/x-gzip" forHTTPHeaderField:@"Content-Type"];
-        [request addValue:@"gzip" forHTTPHeaderField:@"Content-Encoding"];
-        [NSURLProtocol setProperty:@YES
-                            forKey:@"PRESInternalRequest"
-                         inRequest:request];
-        [[_urlSession dataTaskWithRequest:request] resume];
+        // a failed upload is read again from the log on the next timer tick
+        [[PRESTransport sharedTransport] sendRequest:request
+                                             options:PRESTransportOptionGzipBody
+                                          completion:^(NSData *data, NSHTTPURLResponse *response, NSError *error) {
+                                              [self handleSendResponse:response error:error];
+                                          }];
     });
 }
 
-- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error {
-    NSHTTPURLResponse *response = (NSHTTPURLResponse *)task.response;
+/**
+ *  Reads the log from the read position up to the write position or the end of the read file,
+ *  and remembers the file to delete once it was sent.
+ *
+ *  @return nil if there is nothing to send
+ */
+- (NSData *)readPendingLog {
+    BOOL isDir = NO, exist = NO;
+    NSError *err;
+    
+    err = [self parseIndexFile];
+    if (err) {
+        return nil;
+    }
+    NSString *logFilePath = [NSString stringWithFormat:@"%@/log.%u", _logDirPath, _mReadFileIndex];
+    exist = [[NSFileManager defaultManager] fileExistsAtPath:logFilePath isDirectory:&isDir];
+    if (!exist || isDir) {
+        PRESLogWarning(@"WARNING: HTTP monitor log file does not exist");
+        return nil;
+    }
+    NSFileHandle *handle = [NSFileHandle fileHandleForUpdatingAtPath:logFilePath];
+    if (!handle) {
+        PRESLogError(@"ERROR: Unable to open the HTTP monitor log file");
+        return nil;
+    }
+    
+    NSData *dataUncompressed;
+    [handle seekToFileOffset:_mReadFilePosition];
+    if (_mReadFileIndex == _mWriteFileIndex) {
+        dataUncompressed = [handle readDataOfLength:(_mWriteFilePosition - _mReadFilePosition)];
+        _logPathToBeRemoved = nil;
+    } else {
+        dataUncompressed = [handle readDataToEndOfFile];
+        if (!dataUncompressed.length) {
+            [[NSFileManager defaultManager] removeItemAtPath:logFilePath error:&err];
+            if (err) {
+                PRESLogError(@"ERROR: Unable to remove the HTTP monitor log file: %@", err);
+            }
+            // 删除失败依然需要将读取的位置切换到下个文件，不管之前的文件了
+            _mReadFileIndex = [self readFileIndexAfter:_mReadFileIndex];
+            _mReadFilePosition = 0;
+            [self updateIndexFile];
+            return nil;
+        }
+        _logPathToBeRemoved = logFilePath;
+    }
+    
+    return dataUncompressed.length ? dataUncompressed : nil;
+}
+
+#pragma mark - PRESBatchChunkSource
+
+- (NSArray<PRESBatchChunk *> *)takeBatchChunksWithMaxBytes:(NSUInteger)maxBytes {
+    if (!_enable || _isSendingData) {
+        return nil;
+    }
+    _isSendingData = YES;
+    // one segment at a time, the read position only moves once it is acknowledged
+    NSData *segment = [self readPendingLog];
+    if (!segment) {
+        _isSendingData = NO;
+        return nil;
+    }
+    
+    __weak typeof(self) weakSelf = self;
+    return @[[PRESBatchChunk chunkWithType:PRESBatchChunkTypeHTTPMonitor payload:segment completion:^(PRESBatchChunk *chunk, BOOL acknowledged) {
+        typeof(self) strongSelf = weakSelf;
+        [strongSelf finishSendingWithSuccess:acknowledged];
+    }]];
+}
+
+- (void)handleSendResponse:(NSHTTPURLResponse *)response error:(NSError *)error {
+    BOOL success = !error && response.statusCode == 201;
+    if (!success) {
+        PRESLogWarning(@"WARNING: Sending the HTTP monitor log failed, status: %@, error: %@", [NSHTTPURLResponse localizedStringForStatusCode:response.statusCode], error);
+    }
+    [self finishSendingWithSuccess:success];
+}
+
+- (void)finishSendingWithSuccess:(BOOL)success {
     NSError *err;
-    if (!error && response.statusCode == 201) {
+    if (success) {
         if (_logPathToBeRemoved) {
             [[NSFileManager defaultManager] removeItemAtPath:_logPathToBeRemoved error:&err];
             if (err) {
-                NSLog(@"delete log file failed: %@", err);
-            }
-            if (_mReadFileIndex == PRESMaxLogIndex) {
-                _mReadFileIndex = 1;
-            } else {
-                _mReadFileIndex ++;
+                PRESLogError(@"ERROR: Unable to delete the sent HTTP monitor log file: %@", err);
             }
+            _mReadFileIndex = [self readFileIndexAfter:_mReadFileIndex];
             _mReadFilePosition = 0;
         } else {
             _mReadFilePosition = _mWriteFilePosition;
         }
-    } else {
-        NSLog(@"log send failure, statusCode: %@, error: %@", [NSHTTPURLResponse localizedStringForStatusCode:((NSHTTPURLResponse *)response).statusCode], err);
     }
     [self updateIndexFile];
     _isSendingData = NO;
@@ -11,6 +11,7 @@
 #import "PRESURLSessionSwizzler.h"
 #import "PRESHTTPMonitorModel.h"
 #import "PRESHTTPMonitorSender.h"
+#import "PRESTransport.h"
 
 #define DNSPodsHost @"119.29.29.29"
 
@@ -92,9 +93,8 @@ NSURLSessionDataDelegate
 }
 
 - (void)startLoading {
-    NSURLSessionConfiguration *sessionConfig = NSURLSessionConfiguration.ephemeralSessionConfiguration;
-    NSURLSession *session = [NSURLSession sessionWithConfiguration:sessionConfig delegate:self delegateQueue:[NSOperationQueue new]];
-    self.task = [session dataTaskWithRequest:self.request];
+    // one shared session for all proxied requests instead of a session (and connection pool) per request
+    self.task = [[PRESTransport sharedTransport] passthroughDataTaskWithRequest:self.request delegate:self];
     [self.task resume];
     
     HTTPMonitorModel = [[PRESHTTPMonitorModel alloc] init];
@@ -141,8 +141,4 @@ NSURLSessionDataDelegate
     [[PRESHTTPMonitorSender sharedSender] addModel:HTTPMonitorModel];
 }
 
-- (void)URLSession:(NSURLSession *)session didBecomeInvalidWithError:(NSError *)error {
-    [self.client URLProtocol:self didFailWithError:error];
-}
-
 @end
@@ -0,0 +1,107 @@
+//
+//  PRESBatchEnvelope.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 22/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Kind of payload carried by a chunk, the server routes every chunk by it
+ */
+typedef NS_ENUM(uint8_t, PRESBatchChunkType) {
+    /**
+     *  A telemetry bundle, newline separated JSON as written by PRESPersistence
+     */
+    PRESBatchChunkTypeTelemetry = 1,
+    /**
+     *  A segment of the HTTP monitor log, tab separated lines
+     */
+    PRESBatchChunkTypeHTTPMonitor = 2,
+    /**
+     *  A crash report as multipart body, with boundary kPRESNetworkClientBoundary
+     */
+    PRESBatchChunkTypeCrashReport = 3
+};
+
+@class PRESBatchChunk;
+
+/**
+ *  @param acknowledged YES if the server acknowledged the chunk, it must not be sent again.
+ *                      NO if the request failed or the server skipped the chunk, it should be retried later.
+ */
+typedef void (^PRESBatchChunkCompletion)(PRESBatchChunk *chunk, BOOL acknowledged);
+
+@interface PRESBatchChunk : NSObject
+
+@property (nonatomic, assign, readonly) PRESBatchChunkType type;
+
+/**
+ *  nil if the payload stays in payloadFileURL
+ */
+@property (nonatomic, strong, readonly, nullable) NSData *payload;
+@property (nonatomic, strong, readonly, nullable) NSURL *payloadFileURL;
+@property (nonatomic, assign, readonly) NSUInteger payloadLength;
+
+/**
+ *  Assigned by the uploader, unique within the process
+ */
+@property (atomic, assign) uint32_t chunkID;
+
+@property (nonatomic, copy, nullable) PRESBatchChunkCompletion completion;
+
++ (instancetype)chunkWithType:(PRESBatchChunkType)type payload:(NSData *)payload completion:(nullable PRESBatchChunkCompletion)completion;
+
+/**
+ *  For large payloads already on disk, they are streamed into the envelope instead of being read
+ *  into memory. The file must not change until the completion was called.
+ *
+ *  @return nil if the file can not be read
+ */
++ (nullable instancetype)chunkWithType:(PRESBatchChunkType)type payloadFileURL:(NSURL *)fileURL completion:(nullable PRESBatchChunkCompletion)completion;
+
+@end
+
+/**
+ *  Encodes chunks into one upload envelope
+ *
+ *  Layout: magic `PRBE`, version (1 byte), chunk count, then for every chunk its type (1 byte),
+ *  its id, the payload length and the payload. Counts, ids and lengths are unsigned LEB128
+ *  varints like in PRESBinaryRecord. The envelope is sent gzipped as a whole.
+ */
+NSData *pres_encodeBatchEnvelope(NSArray<PRESBatchChunk *> *chunks);
+
+/**
+ *  Writes the envelope gzipped to fileURL, file payloads are copied over block by block.
+ *  Same layout as pres_encodeBatchEnvelope.
+ *
+ *  @return NO if a payload file could not be read completely or the file could not be written
+ */
+BOOL pres_writeGzippedBatchEnvelope(NSArray<PRESBatchChunk *> *chunks, NSURL *fileURL, NSError **error);
+
+/**
+ *  Decodes an envelope created by pres_encodeBatchEnvelope, the chunks get no completion
+ *
+ *  @return the chunks or nil if data is not a valid envelope
+ */
+NSArray<PRESBatchChunk *> *_Nullable pres_decodeBatchEnvelope(NSData *data);
+
+/**
+ *  Encodes the server's answer to an envelope
+ *
+ *  Layout: magic `PRBA`, version (1 byte), count, then the ids of the acknowledged chunks as varints.
+ *  Chunks the server rejected for good are acknowledged as well, so they are not retried.
+ */
+NSData *pres_encodeBatchAck(NSArray<NSNumber *> *chunkIDs);
+
+/**
+ *  @return the acknowledged chunk ids or nil if data is not a valid acknowledgement
+ */
+NSSet<NSNumber *> *_Nullable pres_decodeBatchAck(NSData *data);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,293 @@
+//
+//  PRESBatchEnvelope.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 22/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESBatchEnvelope.h"
+#import "PRESBinaryRecord.h"
+#import <zlib.h>
+
+static const uint8_t PRESBatchEnvelopeMagic[4] = {'P', 'R', 'B', 'E'};
+static const uint8_t PRESBatchAckMagic[4] = {'P', 'R', 'B', 'A'};
+static uint8_t const PRESBatchEnvelopeVersion = 1;
+
+// Block size for reading payload files and for the compressed output
+static NSUInteger const PRESBatchEnvelopeFileBlockSize = 64 * 1024;
+
+@interface PRESBatchChunk ()
+
+@property (nonatomic, assign, readwrite) PRESBatchChunkType type;
+@property (nonatomic, strong, readwrite) NSData *payload;
+@property (nonatomic, strong, readwrite) NSURL *payloadFileURL;
+@property (nonatomic, assign, readwrite) NSUInteger payloadLength;
+
+@end
+
+@implementation PRESBatchChunk
+
++ (instancetype)chunkWithType:(PRESBatchChunkType)type payload:(NSData *)payload completion:(PRESBatchChunkCompletion)completion {
+    PRESBatchChunk *chunk = [PRESBatchChunk new];
+    chunk.type = type;
+    chunk.payload = payload;
+    chunk.payloadLength = payload.length;
+    chunk.completion = completion;
+    return chunk;
+}
+
++ (instancetype)chunkWithType:(PRESBatchChunkType)type payloadFileURL:(NSURL *)fileURL completion:(PRESBatchChunkCompletion)completion {
+    NSNumber *fileSize = nil;
+    if (![fileURL getResourceValue:&fileSize forKey:NSURLFileSizeKey error:nil] || !fileSize) {
+        return nil;
+    }
+    PRESBatchChunk *chunk = [PRESBatchChunk new];
+    chunk.type = type;
+    chunk.payloadFileURL = fileURL;
+    chunk.payloadLength = fileSize.unsignedIntegerValue;
+    chunk.completion = completion;
+    return chunk;
+}
+
+@end
+
+/**
+ *  Deflates everything appended into a gzip file, holding only one block in memory
+ */
+@interface PRESBatchEnvelopeFileWriter : NSObject
+
+- (nullable instancetype)initWithFileURL:(NSURL *)fileURL;
+- (BOOL)appendBytes:(const void *)bytes length:(NSUInteger)length;
+- (BOOL)appendVarint:(uint64_t)value;
+- (BOOL)appendContentsOfFileURL:(NSURL *)fileURL length:(NSUInteger)length;
+- (BOOL)finish;
+
+@property (nonatomic, strong, readonly, nullable) NSError *streamError;
+
+@end
+
+@implementation PRESBatchEnvelopeFileWriter {
+    z_stream _stream;
+    BOOL _streamInitialized;
+    NSOutputStream *_outputStream;
+    NSMutableData *_buffer;
+}
+
+- (instancetype)initWithFileURL:(NSURL *)fileURL {
+    if ((self = [super init])) {
+        // 16 added to the window bits selects the gzip wrapper
+        if (deflateInit2(&_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return nil;
+        }
+        _streamInitialized = YES;
+        _buffer = [NSMutableData dataWithLength:PRESBatchEnvelopeFileBlockSize];
+        _outputStream = [NSOutputStream outputStreamWithURL:fileURL append:NO];
+        [_outputStream open];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_streamInitialized) {
+        deflateEnd(&_stream);
+    }
+    [_outputStream close];
+}
+
+- (NSError *)streamError {
+    return _outputStream.streamError;
+}
+
+- (BOOL)writeBytes:(const uint8_t *)bytes length:(NSUInteger)length {
+    while (length > 0) {
+        NSInteger written = [_outputStream write:bytes maxLength:length];
+        if (written <= 0) return NO;
+        bytes += written;
+        length -= (NSUInteger)written;
+    }
+    return YES;
+}
+
+- (BOOL)deflateBytes:(const void *)bytes length:(NSUInteger)length flush:(int)flush {
+    _stream.next_in = (Bytef *)bytes;
+    _stream.avail_in = (uInt)length;
+    int status;
+    do {
+        _stream.next_out = _buffer.mutableBytes;
+        _stream.avail_out = (uInt)_buffer.length;
+        status = deflate(&_stream, flush);
+        if (status == Z_STREAM_ERROR) return NO;
+        if (![self writeBytes:_buffer.bytes length:_buffer.length - _stream.avail_out]) return NO;
+    } while (_stream.avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+    return YES;
+}
+
+- (BOOL)appendBytes:(const void *)bytes length:(NSUInteger)length {
+    const uint8_t *cursor = bytes;
+    while (length > 0) {
+        NSUInteger blockLength = MIN(length, PRESBatchEnvelopeFileBlockSize);
+        if (![self deflateBytes:cursor length:blockLength flush:Z_NO_FLUSH]) return NO;
+        cursor += blockLength;
+        length -= blockLength;
+    }
+    return YES;
+}
+
+- (BOOL)appendVarint:(uint64_t)value {
+    NSMutableData *data = [NSMutableData dataWithCapacity:10];
+    pres_appendVarint(data, value);
+    return [self appendBytes:data.bytes length:data.length];
+}
+
+- (BOOL)appendContentsOfFileURL:(NSURL *)fileURL length:(NSUInteger)length {
+    NSInputStream *inputStream = [NSInputStream inputStreamWithURL:fileURL];
+    [inputStream open];
+    
+    NSMutableData *block = [NSMutableData dataWithLength:PRESBatchEnvelopeFileBlockSize];
+    NSUInteger remaining = length;
+    BOOL success = YES;
+    while (success && remaining > 0) {
+        NSInteger read = [inputStream read:block.mutableBytes maxLength:MIN(remaining, block.length)];
+        // the length is already written, a file that shrank would corrupt the envelope
+        success = read > 0 && [self appendBytes:block.bytes length:(NSUInteger)read];
+        if (success) remaining -= (NSUInteger)read;
+    }
+    [inputStream close];
+    return success;
+}
+
+- (BOOL)finish {
+    BOOL success = [self deflateBytes:NULL length:0 flush:Z_FINISH];
+    [_outputStream close];
+    return success;
+}
+
+@end
+
+/**
+ *  Checks magic and version and places the cursor behind them
+ */
+static BOOL pres_readHeader(NSData *data, const uint8_t magic[4], const uint8_t **cursor, const uint8_t **end) {
+    if (data.length < 5 || memcmp(data.bytes, magic, 4) != 0) {
+        return NO;
+    }
+    *cursor = (const uint8_t *)data.bytes + 4;
+    *end = (const uint8_t *)data.bytes + data.length;
+    // newer versions may change the layout, they are not guessed at
+    return *(*cursor)++ == PRESBatchEnvelopeVersion;
+}
+
+NSData *pres_encodeBatchEnvelope(NSArray<PRESBatchChunk *> *chunks) {
+    NSUInteger capacity = 16;
+    for (PRESBatchChunk *chunk in chunks) {
+        capacity += chunk.payloadLength + 16;
+    }
+    NSMutableData *data = [NSMutableData dataWithCapacity:capacity];
+    [data appendBytes:PRESBatchEnvelopeMagic length:sizeof(PRESBatchEnvelopeMagic)];
+    [data appendBytes:&PRESBatchEnvelopeVersion length:sizeof(PRESBatchEnvelopeVersion)];
+    
+    pres_appendVarint(data, chunks.count);
+    for (PRESBatchChunk *chunk in chunks) {
+        uint8_t type = chunk.type;
+        [data appendBytes:&type length:sizeof(type)];
+        pres_appendVarint(data, chunk.chunkID);
+        NSData *payload = chunk.payload ?: [NSData dataWithContentsOfURL:chunk.payloadFileURL options:NSDataReadingMappedIfSafe error:nil] ?: [NSData data];
+        pres_appendVarint(data, payload.length);
+        [data appendData:payload];
+    }
+    return data;
+}
+
+BOOL pres_writeGzippedBatchEnvelope(NSArray<PRESBatchChunk *> *chunks, NSURL *fileURL, NSError **error) {
+    PRESBatchEnvelopeFileWriter *writer = [[PRESBatchEnvelopeFileWriter alloc] initWithFileURL:fileURL];
+    BOOL success = writer &&
+                   [writer appendBytes:PRESBatchEnvelopeMagic length:sizeof(PRESBatchEnvelopeMagic)] &&
+                   [writer appendBytes:&PRESBatchEnvelopeVersion length:sizeof(PRESBatchEnvelopeVersion)] &&
+                   [writer appendVarint:chunks.count];
+    
+    for (PRESBatchChunk *chunk in chunks) {
+        if (!success) break;
+        uint8_t type = chunk.type;
+        success = [writer appendBytes:&type length:sizeof(type)] &&
+                  [writer appendVarint:chunk.chunkID] &&
+                  [writer appendVarint:chunk.payloadLength];
+        if (!success) break;
+        if (chunk.payloadFileURL) {
+            success = [writer appendContentsOfFileURL:chunk.payloadFileURL length:chunk.payloadLength];
+        } else {
+            success = [writer appendBytes:chunk.payload.bytes length:chunk.payload.length];
+        }
+    }
+    success = success && [writer finish];
+    
+    if (!success) {
+        if (error) {
+            *error = writer.streamError ?: [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:nil];
+        }
+        [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+    }
+    return success;
+}
+
+NSArray<PRESBatchChunk *> *pres_decodeBatchEnvelope(NSData *data) {
+    const uint8_t *cursor, *end;
+    if (!pres_readHeader(data, PRESBatchEnvelopeMagic, &cursor, &end)) {
+        return nil;
+    }
+    
+    uint64_t count = 0;
+    if (!pres_readVarint(&cursor, end, &count) || count > (uint64_t)(end - cursor)) {
+        return nil;
+    }
+    
+    NSMutableArray<PRESBatchChunk *> *chunks = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+    for (uint64_t i = 0; i < count; i++) {
+        if (cursor >= end) return nil;
+        uint8_t type = *cursor++;
+        uint64_t chunkID = 0, length = 0;
+        if (!pres_readVarint(&cursor, end, &chunkID) || chunkID > UINT32_MAX ||
+            !pres_readVarint(&cursor, end, &length) || length > (uint64_t)(end - cursor)) {
+            return nil;
+        }
+        PRESBatchChunk *chunk = [PRESBatchChunk chunkWithType:type payload:[NSData dataWithBytes:cursor length:(NSUInteger)length] completion:nil];
+        chunk.chunkID = (uint32_t)chunkID;
+        [chunks addObject:chunk];
+        cursor += length;
+    }
+    return chunks;
+}
+
+NSData *pres_encodeBatchAck(NSArray<NSNumber *> *chunkIDs) {
+    NSMutableData *data = [NSMutableData dataWithCapacity:8 + chunkIDs.count * 3];
+    [data appendBytes:PRESBatchAckMagic length:sizeof(PRESBatchAckMagic)];
+    [data appendBytes:&PRESBatchEnvelopeVersion length:sizeof(PRESBatchEnvelopeVersion)];
+    
+    pres_appendVarint(data, chunkIDs.count);
+    for (NSNumber *chunkID in chunkIDs) {
+        pres_appendVarint(data, chunkID.unsignedIntValue);
+    }
+    return data;
+}
+
+NSSet<NSNumber *> *pres_decodeBatchAck(NSData *data) {
+    const uint8_t *cursor, *end;
+    if (!pres_readHeader(data, PRESBatchAckMagic, &cursor, &end)) {
+        return nil;
+    }
+    
+    uint64_t count = 0;
+    if (!pres_readVarint(&cursor, end, &count) || count > (uint64_t)(end - cursor)) {
+        return nil;
+    }
+    
+    NSMutableSet<NSNumber *> *chunkIDs = [NSMutableSet setWithCapacity:(NSUInteger)count];
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t chunkID = 0;
+        if (!pres_readVarint(&cursor, end, &chunkID) || chunkID > UINT32_MAX) {
+            return nil;
+        }
+        [chunkIDs addObject:@((uint32_t)chunkID)];
+    }
+    return chunkIDs;
+}
@@ -0,0 +1,79 @@
+//
+//  PRESBatchUploader.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 22/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "PRESBatchEnvelope.h"
+
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  A module with pending payloads, asked for chunks whenever the uploader has room in a request
+ */
+@protocol PRESBatchChunkSource <NSObject>
+
+/**
+ *  Hands out pending payloads of at most maxBytes in total, a single payload may exceed it if
+ *  nothing smaller is pending. Handed out payloads must not be handed out again before the
+ *  completion of their chunk was called. Called on the uploader's queue.
+ *
+ *  @return the chunks with their completion set, nil or empty if nothing is pending
+ */
+- (nullable NSArray<PRESBatchChunk *> *)takeBatchChunksWithMaxBytes:(NSUInteger)maxBytes;
+
+@end
+
+/**
+ *  Sends the payloads of all modules multiplexed in PRESBatchEnvelope requests
+ *
+ *  Chunks from all sources are packed into envelopes of up to maxBatchBytes, which are gzipped
+ *  and sent through PRESTransport. Up to maxRequestsInFlight envelopes are sent without waiting
+ *  for the previous answer. The server acknowledges per chunk, so a partly failed request only
+ *  gives back the chunks that were not acknowledged. Failed requests back off per endpoint.
+ *
+ *  Only used while enabled, the modules send with their own requests otherwise.
+ */
+@interface PRESBatchUploader : NSObject
+
++ (instancetype)sharedUploader;
+
+/**
+ *  Set from the config, enabling it flushes right away. Defaults to NO
+ */
+@property (atomic, assign, getter=isEnabled) BOOL enabled;
+
+@property (atomic, strong) NSURL *serverURL;
+
+/**
+ *  Uncompressed size an envelope is filled up to, defaults to 512 KB
+ */
+@property (atomic, assign) NSUInteger maxBatchBytes;
+
+/**
+ *  Defaults to 2
+ */
+@property (atomic, assign) NSUInteger maxRequestsInFlight;
+
+/**
+ *  Sources are held weakly
+ */
+- (void)addSource:(id<PRESBatchChunkSource>)source;
+
+/**
+ *  Sends the chunk with the next envelope, for payloads which don't sit in a source
+ */
+- (void)enqueueChunk:(PRESBatchChunk *)chunk;
+
+/**
+ *  Sends envelopes until all sources are drained or the in-flight limit is reached. Does nothing while disabled.
+ */
+- (void)flush;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,277 @@
+//
+//  PRESBatchUploader.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 22/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESBatchUploader.h"
+#import "PRESBackoffPolicy.h"
+#import "PRESTransport.h"
+#import "PRESPrivate.h"
+
+#define PRESBatchUploadDomain       @"http://localhost:8080"
+#define PRESBatchUploadPath         @"/v1/batch"
+
+static char *const kPRESBatchUploaderQueue = "com.presniff.batchUploaderQueue";
+static NSString *const kPRESBatchContentType = @"application/x-presniff-batch";
+static NSString *const kPRESBatchEnvelopeFileExtension = @"envelope";
+
+static NSUInteger const PRESBatchDefaultMaxBytes = 512 * 1024;
+static NSUInteger const PRESBatchDefaultMaxRequestsInFlight = 2;
+
+@interface PRESBatchUploader ()
+
+@property (nonatomic, strong) dispatch_queue_t queue;
+
+/**
+ *  Only accessed on queue
+ */
+@property (nonatomic, strong) NSHashTable<id<PRESBatchChunkSource>> *sources;
+@property (nonatomic, strong) NSMutableArray<PRESBatchChunk *> *enqueuedChunks;
+@property (nonatomic, assign) NSUInteger requestsInFlight;
+@property (nonatomic, assign) NSUInteger nextSourceIndex;
+@property (nonatomic, assign) uint32_t nextChunkID;
+@property (nonatomic, assign) BOOL deferredFlushScheduled;
+
+@property (nonatomic, strong) PRESBackoffPolicy *backoffPolicy;
+
+@end
+
+@implementation PRESBatchUploader
+
+@synthesize enabled = _enabled;
+
++ (instancetype)sharedUploader {
+    static PRESBatchUploader *sharedInstance;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedInstance = [PRESBatchUploader new];
+    });
+    return sharedInstance;
+}
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _serverURL = [NSURL URLWithString:[NSString stringWithFormat:@"%@%@", PRESBatchUploadDomain, PRESBatchUploadPath]];
+        _maxBatchBytes = PRESBatchDefaultMaxBytes;
+        _maxRequestsInFlight = PRESBatchDefaultMaxRequestsInFlight;
+        _queue = dispatch_queue_create(kPRESBatchUploaderQueue, DISPATCH_QUEUE_SERIAL);
+        _sources = [NSHashTable weakObjectsHashTable];
+        _enqueuedChunks = [NSMutableArray new];
+        _backoffPolicy = [[PRESBackoffPolicy alloc] initWithFilePath:nil];
+    }
+    return self;
+}
+
+- (BOOL)isEnabled {
+    @synchronized (self) {
+        return _enabled;
+    }
+}
+
+- (void)setEnabled:(BOOL)enabled {
+    @synchronized (self) {
+        if (_enabled == enabled) return;
+        _enabled = enabled;
+    }
+    
+    if (enabled) {
+        [self flush];
+        return;
+    }
+    dispatch_async(self.queue, ^{
+        // the modules send with their own requests from now on
+        NSArray<PRESBatchChunk *> *chunks = [self.enqueuedChunks copy];
+        [self.enqueuedChunks removeAllObjects];
+        [self completeChunks:chunks acknowledgedIDs:nil];
+    });
+}
+
+- (void)addSource:(id<PRESBatchChunkSource>)source {
+    dispatch_async(self.queue, ^{
+        [self.sources addObject:source];
+    });
+}
+
+- (void)enqueueChunk:(PRESBatchChunk *)chunk {
+    dispatch_async(self.queue, ^{
+        [self.enqueuedChunks addObject:chunk];
+        [self sendPendingChunks];
+    });
+}
+
+- (void)flush {
+    dispatch_async(self.queue, ^{
+        [self sendPendingChunks];
+    });
+}
+
+#pragma mark - Sending
+
+/**
+ *  Only called on queue
+ */
+- (void)sendPendingChunks {
+    if (!self.enabled) return;
+    
+    NSString *endpoint = [self endpointKey];
+    NSTimeInterval delay = [self.backoffPolicy delayForEndpoint:endpoint];
+    if (delay > 0) {
+        [self scheduleDeferredFlushAfter:delay];
+        return;
+    }
+    
+    while (self.requestsInFlight < MAX(self.maxRequestsInFlight, 1U)) {
+        NSArray<PRESBatchChunk *> *chunks = [self takeChunksWithMaxBytes:MAX(self.maxBatchBytes, 1U)];
+        if (chunks.count == 0) return;
+        
+        delay = [self.backoffPolicy acquireAttemptForEndpoint:endpoint];
+        if (delay > 0) {
+            [self completeChunks:chunks acknowledgedIDs:nil];
+            [self scheduleDeferredFlushAfter:delay];
+            return;
+        }
+        if (![self sendChunks:chunks]) return;
+    }
+}
+
+/**
+ *  Fills one envelope, enqueued chunks first, then the sources in turns so no module starves the others
+ */
+- (NSArray<PRESBatchChunk *> *)takeChunksWithMaxBytes:(NSUInteger)maxBytes {
+    NSMutableArray<PRESBatchChunk *> *chunks = [NSMutableArray new];
+    NSUInteger bytes = 0;
+    
+    while (self.enqueuedChunks.count > 0 && (chunks.count == 0 || bytes + self.enqueuedChunks.firstObject.payloadLength <= maxBytes)) {
+        PRESBatchChunk *chunk = self.enqueuedChunks.firstObject;
+        [self.enqueuedChunks removeObjectAtIndex:0];
+        [chunks addObject:chunk];
+        bytes += chunk.payloadLength;
+    }
+    
+    NSArray<id<PRESBatchChunkSource>> *sources = self.sources.allObjects;
+    for (NSUInteger i = 0; i < sources.count && bytes < maxBytes; i++) {
+        id<PRESBatchChunkSource> source = sources[(self.nextSourceIndex + i) % sources.count];
+        // the limit is soft, a source may hand out one payload larger than what is left
+        NSArray<PRESBatchChunk *> *sourceChunks = [source takeBatchChunksWithMaxBytes:maxBytes - bytes];
+        for (PRESBatchChunk *chunk in sourceChunks) {
+            [chunks addObject:chunk];
+            bytes += chunk.payloadLength;
+        }
+    }
+    self.nextSourceIndex++;
+    
+    for (PRESBatchChunk *chunk in chunks) {
+        chunk.chunkID = self.nextChunkID++;
+    }
+    return chunks;
+}
+
+/**
+ *  @return NO if the envelope could not be written, the chunks are given back then
+ */
+- (BOOL)sendChunks:(NSArray<PRESBatchChunk *> *)chunks {
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:self.serverURL];
+    request.HTTPMethod = @"POST";
+    request.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    [request setValue:kPRESBatchContentType forHTTPHeaderField:@"Content-Type"];
+    
+    NSURL *envelopeFileURL = nil;
+    for (PRESBatchChunk *chunk in chunks) {
+        if (!chunk.payloadFileURL) continue;
+        
+        // file payloads like crash reports are streamed into a gzipped envelope file instead of memory
+        envelopeFileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:
+                                                  [[NSUUID UUID].UUIDString stringByAppendingPathExtension:kPRESBatchEnvelopeFileExtension]]];
+        NSError *error = nil;
+        if (!pres_writeGzippedBatchEnvelope(chunks, envelopeFileURL, &error)) {
+            PRESLogError(@"ERROR: Writing the batch envelope failed. %@", error);
+            [self completeChunks:chunks acknowledgedIDs:nil];
+            [self.backoffPolicy recordFailureForEndpoint:[self endpointKey] retryAfter:-1];
+            [self scheduleDeferredFlushAfter:MAX([self.backoffPolicy delayForEndpoint:[self endpointKey]], self.backoffPolicy.baseDelay)];
+            return NO;
+        }
+        [request setValue:@"gzip" forHTTPHeaderField:@"Content-Encoding"];
+        break;
+    }
+    
+    PRESLogDebug(@"INFO: Sending %lu chunks in a batch", (unsigned long)chunks.count);
+    self.requestsInFlight++;
+    
+    __weak typeof(self) weakSelf = self;
+    PRESTransportCompletion completion = ^(NSData *data, NSHTTPURLResponse *response, NSError *error) {
+        typeof(self) strongSelf = weakSelf;
+        if (envelopeFileURL) {
+            [[NSFileManager defaultManager] removeItemAtURL:envelopeFileURL error:nil];
+        }
+        dispatch_async(strongSelf.queue, ^{
+            strongSelf.requestsInFlight--;
+            [strongSelf handleResponse:response data:data error:error chunks:chunks];
+        });
+    };
+    
+    if (envelopeFileURL) {
+        [[PRESTransport sharedTransport] uploadRequest:request fromFile:envelopeFileURL options:PRESTransportOptionNone completion:completion];
+    } else {
+        request.HTTPBody = pres_encodeBatchEnvelope(chunks);
+        [[PRESTransport sharedTransport] sendRequest:request options:PRESTransportOptionGzipBody completion:completion];
+    }
+    return YES;
+}
+
+- (void)handleResponse:(NSHTTPURLResponse *)response data:(NSData *)data error:(NSError *)error chunks:(NSArray<PRESBatchChunk *> *)chunks {
+    NSInteger statusCode = response.statusCode;
+    BOOL answered = !error && statusCode >= 200 && statusCode < 300;
+    NSSet<NSNumber *> *acknowledgedIDs = nil;
+    
+    if (answered) {
+        acknowledgedIDs = pres_decodeBatchAck(data ?: [NSData data]);
+        if (acknowledgedIDs.count == 0) {
+            PRESLogWarning(@"WARNING: Batch upload answered without acknowledging any chunk");
+        }
+    } else {
+        PRESLogWarning(@"WARNING: Batch upload failed with status code %ld: %@", (long)statusCode, error.localizedDescription);
+    }
+    
+    [self completeChunks:chunks acknowledgedIDs:acknowledgedIDs];
+    if (acknowledgedIDs.count > 0) {
+        [self.backoffPolicy recordSuccessForEndpoint:[self endpointKey]];
+        // the sources may have more, sending stops once they are drained
+        [self sendPendingChunks];
+        return;
+    }
+    
+    // nothing got through, the chunks were given back and are retried after the backoff
+    NSTimeInterval retryAfter = answered ? -1 : [PRESBackoffPolicy retryAfterIntervalFromHeaderValue:response.allHeaderFields[@"Retry-After"] now:[[NSDate date] timeIntervalSince1970]];
+    [self.backoffPolicy recordFailureForEndpoint:[self endpointKey] retryAfter:retryAfter];
+    [self scheduleDeferredFlushAfter:MAX([self.backoffPolicy delayForEndpoint:[self endpointKey]], self.backoffPolicy.baseDelay)];
+}
+
+- (void)completeChunks:(NSArray<PRESBatchChunk *> *)chunks acknowledgedIDs:(NSSet<NSNumber *> *)acknowledgedIDs {
+    for (PRESBatchChunk *chunk in chunks) {
+        if (chunk.completion) {
+            chunk.completion(chunk, [acknowledgedIDs containsObject:@(chunk.chunkID)]);
+        }
+    }
+}
+
+- (void)scheduleDeferredFlushAfter:(NSTimeInterval)delay {
+    if (self.deferredFlushScheduled || delay <= 0) return;
+    self.deferredFlushScheduled = YES;
+    
+    __weak typeof(self) weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.queue, ^{
+        typeof(self) strongSelf = weakSelf;
+        strongSelf.deferredFlushScheduled = NO;
+        [strongSelf sendPendingChunks];
+    });
+}
+
+- (NSString *)endpointKey {
+    NSURL *serverURL = self.serverURL;
+    return [NSString stringWithFormat:@"%@%@", serverURL.host ?: @"", serverURL.path ?: @""];
+}
+
+@end
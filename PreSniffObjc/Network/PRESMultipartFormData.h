@@ -0,0 +1,51 @@
+//
+//  PRESMultipartFormData.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 05/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  Streaming multipart/form-data body builder
+ *
+ *  Parts are only referenced when appended and are written out one after the other when
+ *  the body is produced, file backed parts are copied in small chunks. Unlike concatenating
+ *  everything into one NSMutableData this never holds a second copy of large attachments.
+ */
+@interface PRESMultipartFormData : NSObject
+
+- (instancetype)initWithBoundary:(NSString *)boundary;
+
+@property (nonatomic, copy, readonly) NSString *boundary;
+
+/**
+ *  The value for the Content-Type header of the request carrying this body
+ */
+@property (nonatomic, copy, readonly) NSString *contentType;
+
+/**
+ *  Total number of bytes the body will have, including all part headers and the closing boundary
+ */
+@property (nonatomic, assign, readonly) unsigned long long contentLength;
+
+- (void)appendPartWithValue:(NSString *)value forKey:(NSString *)key;
+
+- (void)appendPartWithData:(NSData *)data forKey:(NSString *)key contentType:(NSString *)contentType filename:(NSString *)filename;
+
+/**
+ *  Append a part whose content is read lazily from the given file when the body is written
+ *
+ *  @return NO if the file can not be read
+ */
+- (BOOL)appendPartWithFileURL:(NSURL *)fileURL forKey:(NSString *)key contentType:(NSString *)contentType filename:(NSString *)filename;
+
+/**
+ *  Write the complete body to the given file, suitable for `uploadTaskWithRequest:fromFile:`,
+ *  which streams it from disk
+ */
+- (BOOL)writeToFileURL:(NSURL *)fileURL error:(NSError **)error;
+
+@end
@@ -0,0 +1,162 @@
+//
+//  PRESMultipartFormData.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 05/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESMultipartFormData.h"
+
+static const NSUInteger PRESMultipartFormDataChunkSize = 64 * 1024;
+
+@interface PRESMultipartFormPart : NSObject
+
+@property (nonatomic, strong) NSData *header;
+@property (nonatomic, strong) NSData *data;
+@property (nonatomic, strong) NSURL *fileURL;
+@property (nonatomic, assign) unsigned long long bodyLength;
+
+@end
+
+@implementation PRESMultipartFormPart
+@end
+
+@implementation PRESMultipartFormData {
+    NSMutableArray<PRESMultipartFormPart *> *_parts;
+}
+
+- (instancetype)initWithBoundary:(NSString *)boundary {
+    if ((self = [super init])) {
+        _boundary = [boundary copy];
+        _parts = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (NSString *)contentType {
+    return [NSString stringWithFormat:@"multipart/form-data; boundary=%@", _boundary];
+}
+
+- (unsigned long long)contentLength {
+    unsigned long long length = 0;
+    for (PRESMultipartFormPart *part in _parts) {
+        length += part.header.length + part.bodyLength + 2;
+    }
+    return length + [self closingBoundary].length;
+}
+
+#pragma mark - Appending parts
+
+- (NSData *)headerForKey:(NSString *)key contentType:(NSString *)contentType filename:(NSString *)filename {
+    NSMutableString *header = [NSMutableString stringWithFormat:@"--%@\r\n", _boundary];
+    if (filename) {
+        [header appendFormat:@"Content-Disposition: form-data; name=\"%@\"; filename=\"%@\"\r\n", key, filename];
+        [header appendFormat:@"Content-Type: %@\r\n", contentType];
+        [header appendString:@"Content-Transfer-Encoding: binary\r\n\r\n"];
+    } else {
+        [header appendFormat:@"Content-Disposition: form-data; name=\"%@\"\r\n", key];
+        [header appendFormat:@"Content-Type: %@\r\n\r\n", contentType];
+    }
+    return [header dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (NSData *)closingBoundary {
+    // same bytes as the body built in memory before, including the extra line break
+    return [[NSString stringWithFormat:@"\r\n--%@--\r\n", _boundary] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (void)appendPartWithValue:(NSString *)value forKey:(NSString *)key {
+    [self appendPartWithData:[value dataUsingEncoding:NSUTF8StringEncoding] forKey:key contentType:@"text" filename:nil];
+}
+
+- (void)appendPartWithData:(NSData *)data forKey:(NSString *)key contentType:(NSString *)contentType filename:(NSString *)filename {
+    PRESMultipartFormPart *part = [PRESMultipartFormPart new];
+    part.header = [self headerForKey:key contentType:contentType filename:filename];
+    part.data = data ?: [NSData data];
+    part.bodyLength = part.data.length;
+    [_parts addObject:part];
+}
+
+- (BOOL)appendPartWithFileURL:(NSURL *)fileURL forKey:(NSString *)key contentType:(NSString *)contentType filename:(NSString *)filename {
+    NSNumber *fileSize = nil;
+    if (![fileURL getResourceValue:&fileSize forKey:NSURLFileSizeKey error:nil] || !fileSize) {
+        return NO;
+    }
+
+    PRESMultipartFormPart *part = [PRESMultipartFormPart new];
+    part.header = [self headerForKey:key contentType:contentType filename:filename ?: fileURL.lastPathComponent];
+    part.fileURL = fileURL;
+    part.bodyLength = fileSize.unsignedLongLongValue;
+    [_parts addObject:part];
+    return YES;
+}
+
+#pragma mark - Producing the body
+
+static BOOL pres_writeData(NSOutputStream *outputStream, NSData *data) {
+    const uint8_t *bytes = data.bytes;
+    NSUInteger remaining = data.length;
+    while (remaining > 0) {
+        NSInteger written = [outputStream write:bytes maxLength:remaining];
+        if (written <= 0) return NO;
+        bytes += written;
+        remaining -= (NSUInteger)written;
+    }
+    return YES;
+}
+
+- (BOOL)writePart:(PRESMultipartFormPart *)part toStream:(NSOutputStream *)outputStream {
+    if (!pres_writeData(outputStream, part.header)) return NO;
+
+    if (part.fileURL) {
+        NSInputStream *inputStream = [NSInputStream inputStreamWithURL:part.fileURL];
+        [inputStream open];
+        uint8_t *buffer = malloc(PRESMultipartFormDataChunkSize);
+        BOOL success = buffer != NULL;
+        while (success) {
+            NSInteger read = [inputStream read:buffer maxLength:PRESMultipartFormDataChunkSize];
+            if (read == 0) break;
+            if (read < 0) {
+                success = NO;
+                break;
+            }
+            success = pres_writeData(outputStream, [NSData dataWithBytesNoCopy:buffer length:(NSUInteger)read freeWhenDone:NO]);
+        }
+        free(buffer);
+        [inputStream close];
+        if (!success) return NO;
+    } else if (!pres_writeData(outputStream, part.data)) {
+        return NO;
+    }
+
+    return pres_writeData(outputStream, [@"\r\n" dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+- (BOOL)writeToFileURL:(NSURL *)fileURL error:(NSError **)error {
+    NSOutputStream *outputStream = [NSOutputStream outputStreamWithURL:fileURL append:NO];
+    [outputStream open];
+
+    BOOL success = YES;
+    for (PRESMultipartFormPart *part in _parts) {
+        @autoreleasepool {
+            success = [self writePart:part toStream:outputStream];
+        }
+        if (!success) break;
+    }
+    if (success) {
+        success = pres_writeData(outputStream, [self closingBoundary]);
+    }
+
+    if (!success && error) {
+        *error = outputStream.streamError ?: [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:nil];
+    }
+    [outputStream close];
+
+    if (!success) {
+        [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+    }
+    return success;
+}
+
+@end
@@ -28,12 +28,12 @@
 
 #import <Foundation/Foundation.h>
 
-#import "PRESHTTPOperation.h" //needed for typedef
+#import "PRESMultipartFormData.h"
 
 extern NSString * const kPRESNetworkClientBoundary;
 
 /**
- *  Generic PreSniff API client
+ *  Generic PreSniff API client, builds the requests which are sent through PRESTransport
  */
 @interface PRESNetworkClient : NSObject
 
@@ -54,7 +54,7 @@ extern NSString * const kPRESNetworkClientBoundary;
  *  the internally stored baseURL.
  *
  *	@param	method	the HTTPMethod to check, must not be nil
- *	@param	params	parameters for the request (only supported for GET and POST for now)
+ *	@param	params	query parameters for the request, only supported for GET
  *	@param	path	path to append to baseURL. can be nil in which case "/" is appended
  *
  *	@return	an NSMutableURLRequest for further configuration
@@ -63,85 +63,15 @@ extern NSString * const kPRESNetworkClientBoundary;
                                        path:(NSString *) path
                                  parameters:(NSDictionary *) params;
 /**
- *	Creates an operation for the given NSURLRequest
+ *	creates a POST request carrying the given multipart body. The body itself is not attached,
+ *  write it to a file and upload it from there.
  *
- *	@param	request	the request that should be handled
- *	@param	completion	completionBlock that is called once the operation finished
+ *	@param	path	path to append to baseURL
+ *	@param	formData	the multipart body, used for the Content-Type and Content-Length headers
  *
- *	@return	operation, which can be queued via enqueueHTTPOperation:
- */
-- (PRESHTTPOperation*) operationWithURLRequest:(NSURLRequest*) request
-                                    completion:(PRESNetworkCompletionBlock) completion;
-
-/**
- *	Creates an operation for the given path, and enqueues it
- *
- *	@param	path	the request path to check
- *	@param	params parameters for the request
- *	@param	completion	completionBlock that is called once the operation finished
- *
- */
-- (void) getPath:(NSString*) path
-      parameters:(NSDictionary *) params
-      completion:(PRESNetworkCompletionBlock) completion;
-
-/**
- *	Creates an operation for the given path, and enqueues it
- *
- *	@param	path	the request path to check
- *	@param	params parameters for the request
- *	@param	completion	completionBlock that is called once the operation finished
- *
- */
-- (void) postPath:(NSString*) path
-       parameters:(NSDictionary *) params
-       completion:(PRESNetworkCompletionBlock) completion;
-/**
- *	adds the given operation to the internal queue
- *
- *	@param	operation	operation to add
- */
-- (void) enqeueHTTPOperation:(PRESHTTPOperation *) operation;
-
-/**
- *	cancels the specified operations
- *
- *	@param	path	the path which operation should be cancelled. Can be nil to match all
- *	@param	method	the method which operations to cancel. Can be nil to match all
- *  @return number of operations cancelled
- */
-- (NSUInteger) cancelOperationsWithPath:(NSString*) path
-                                 method:(NSString*) method;
-
-/**
- *	Access to the internal operation queue
- */
-@property (nonatomic, strong) NSOperationQueue *operationQueue;
-
-#pragma mark - Helpers
-/**
- *	create a post body from the given value, key and boundary. This is a convenience call to
- *  dataWithPostValue:forKey:contentType:boundary and aimed at NSString-content.
- *
- *	@param	value	-
- *	@param	key	-
- *	@param	boundary	-
- *
- *	@return	NSData instance configured to be attached on a (post) URLRequest
- */
-+ (NSData *)dataWithPostValue:(NSString *)value forKey:(NSString *)key boundary:(NSString *) boundary;
-
-/**
- *	create a post body from the given value, key and boundary and content type.
- *
- *	@param	value	-
- *	@param	key	-
- *@param contentType -
- *	@param	boundary	-
- *	@param	filename	-
- *
- *	@return	NSData instance configured to be attached on a (post) URLRequest
+ *	@return	an NSMutableURLRequest for further configuration
  */
-+ (NSData *)dataWithPostValue:(NSData *)value forKey:(NSString *)key contentType:(NSString *)contentType boundary:(NSString *) boundary filename:(NSString *)filename;
+- (NSMutableURLRequest *) requestWithPath:(NSString *) path
+                        multipartFormData:(PRESMultipartFormData *) formData;
 
 @end
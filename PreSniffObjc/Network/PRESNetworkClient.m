@@ -30,10 +30,6 @@
 NSString * const kPRESNetworkClientBoundary = @"----FOO";
 
 @implementation PRESNetworkClient
-- (void)dealloc {
-    [self cancelOperationsWithPath:nil method:nil];
-}
-
 - (instancetype)initWithBaseURL:(NSURL *)baseURL {
     self = [super init];
     if ( self ) {
@@ -49,7 +45,7 @@ NSString * const kPRESNetworkClientBoundary = @"----FOO";
                                  parameters:(NSDictionary *)params {
     NSParameterAssert(self.baseURL);
     NSParameterAssert(method);
-    NSParameterAssert(params == nil || [method isEqualToString:@"POST"] || [method isEqualToString:@"GET"]);
+    NSParameterAssert(params == nil || [method isEqualToString:@"GET"]);
     path = path ? : @"";
     
     NSURL *endpoint = [self.baseURL URLByAppendingPathComponent:path];
@@ -60,60 +56,26 @@ NSString * const kPRESNetworkClientBoundary = @"----FOO";
                      inRequest:request];
     
     if (params) {
-        if ([method isEqualToString:@"GET"]) {
-            NSString *absoluteURLString = [endpoint absoluteString];
-            //either path already has parameters, or not
-            NSString *appenderFormat = [path rangeOfString:@"?"].location == NSNotFound ? @"?%@" : @"&%@";
-            
-            endpoint = [NSURL URLWithString:[absoluteURLString stringByAppendingFormat:appenderFormat,
-                                             [self.class queryStringFromParameters:params withEncoding:NSUTF8StringEncoding]]];
-            [request setURL:endpoint];
-        } else {
-            //TODO: this is crap. Boundary must be the same as the one in appendData
-            //unify this!
-            NSString *contentType = [NSString stringWithFormat:@"multipart/form-data; boundary=%@", kPRESNetworkClientBoundary];
-            [request setValue:contentType forHTTPHeaderField:@"Content-type"];
-            
-            NSMutableData *postBody = [NSMutableData data];
-            [params enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSString *value, BOOL *stop) {
-                [postBody appendData:[[self class] dataWithPostValue:value forKey:key boundary:kPRESNetworkClientBoundary]];
-            }];
-            
-            [postBody appendData:[[NSString stringWithFormat:@"--%@--\r\n", kPRESNetworkClientBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
-            
-            [request setHTTPBody:postBody];
-        }
+        NSString *absoluteURLString = [endpoint absoluteString];
+        //either path already has parameters, or not
+        NSString *appenderFormat = [path rangeOfString:@"?"].location == NSNotFound ? @"?%@" : @"&%@";
+        
+        endpoint = [NSURL URLWithString:[absoluteURLString stringByAppendingFormat:appenderFormat,
+                                         [self.class queryStringFromParameters:params withEncoding:NSUTF8StringEncoding]]];
+        [request setURL:endpoint];
     }
     
     return request;
 }
 
-+ (NSData *)dataWithPostValue:(NSString *)value forKey:(NSString *)key boundary:(NSString *) boundary {
-    return [self dataWithPostValue:[value dataUsingEncoding:NSUTF8StringEncoding] forKey:key contentType:@"text" boundary:boundary filename:nil];
-}
-
-+ (NSData *)dataWithPostValue:(NSData *)value forKey:(NSString *)key contentType:(NSString *)contentType boundary:(NSString *) boundary filename:(NSString *)filename {
-    NSMutableData *postBody = [NSMutableData data];
-    
-    [postBody appendData:[[NSString stringWithFormat:@"--%@\r\n", boundary] dataUsingEncoding:NSUTF8StringEncoding]];
-    
-    // There's certainly a better way to check if we are supposed to send binary data here.
-    if (filename){
-        [postBody appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"%@\"; filename=\"%@\"\r\n", key, filename] dataUsingEncoding:NSUTF8StringEncoding]];
-        [postBody appendData:[[NSString stringWithFormat:@"Content-Type: %@\r\n", contentType] dataUsingEncoding:NSUTF8StringEncoding]];
-        [postBody appendData:[[NSString stringWithFormat:@"Content-Transfer-Encoding: binary\r\n\r\n"] dataUsingEncoding:NSUTF8StringEncoding]];
-    } else {
-        [postBody appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"%@\"\r\n", key] dataUsingEncoding:NSUTF8StringEncoding]];
-        [postBody appendData:[[NSString stringWithFormat:@"Content-Type: %@\r\n\r\n", contentType] dataUsingEncoding:NSUTF8StringEncoding]];
-    }
-    
-    [postBody appendData:value];
-    [postBody appendData:[@"\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
-    
-    return postBody;
+- (NSMutableURLRequest *) requestWithPath:(NSString *) path
+                        multipartFormData:(PRESMultipartFormData *) formData {
+    NSMutableURLRequest *request = [self requestWithMethod:@"POST" path:path parameters:nil];
+    [request setValue:formData.contentType forHTTPHeaderField:@"Content-type"];
+    [request setValue:[NSString stringWithFormat:@"%llu", formData.contentLength] forHTTPHeaderField:@"Content-Length"];
+    return request;
 }
 
-
 + (NSString *) queryStringFromParameters:(NSDictionary *) params withEncoding:(NSStringEncoding) encoding {
     NSMutableString *queryString = [NSMutableString new];
     [params enumerateKeysAndObjectsUsingBlock:^(NSString* key, NSString* value, BOOL *stop) {
@@ -125,65 +87,4 @@ NSString * const kPRESNetworkClientBoundary = @"----FOO";
     return queryString;
 }
 
-- (PRESHTTPOperation*) operationWithURLRequest:(NSURLRequest*) request
-                                    completion:(PRESNetworkCompletionBlock) completion {
-    PRESHTTPOperation *operation = [PRESHTTPOperation operationWithRequest:request
-                                    ];
-    [operation setCompletion:completion];
-    
-    return operation;
-}
-
-- (void)getPath:(NSString *)path parameters:(NSDictionary *)params completion:(PRESNetworkCompletionBlock)completion {
-    NSURLRequest *request = [self requestWithMethod:@"GET" path:path parameters:params];
-    PRESHTTPOperation *op = [self operationWithURLRequest:request
-                                               completion:completion];
-    [self enqeueHTTPOperation:op];
-}
-
-- (void)postPath:(NSString *)path parameters:(NSDictionary *)params completion:(PRESNetworkCompletionBlock)completion {
-    NSURLRequest *request = [self requestWithMethod:@"POST" path:path parameters:params];
-    PRESHTTPOperation *op = [self operationWithURLRequest:request
-                                               completion:completion];
-    [self enqeueHTTPOperation:op];
-}
-
-- (void) enqeueHTTPOperation:(PRESHTTPOperation *) operation {
-    [self.operationQueue addOperation:operation];
-}
-
-- (NSUInteger) cancelOperationsWithPath:(NSString*) path
-                                 method:(NSString*) method {
-    NSUInteger cancelledOperations = 0;
-    for(PRESHTTPOperation *operation in self.operationQueue.operations) {
-        NSURLRequest *request = operation.URLRequest;
-        
-        BOOL matchedMethod = YES;
-        if(method && ![request.HTTPMethod isEqualToString:method]) {
-            matchedMethod = NO;
-        }
-        
-        BOOL matchedPath = YES;
-        if(path) {
-            //method is not interesting here, we' just creating it to get the URL
-            NSURL *url = [self requestWithMethod:@"GET" path:path parameters:nil].URL;
-            matchedPath = [request.URL isEqual:url];
-        }
-        
-        if(matchedPath && matchedMethod) {
-            ++cancelledOperations;
-            [operation cancel];
-        }
-    }
-    return cancelledOperations;
-}
-
-- (NSOperationQueue *)operationQueue {
-    if(nil == _operationQueue) {
-        _operationQueue = [[NSOperationQueue alloc] init];
-        _operationQueue.maxConcurrentOperationCount = 1;
-    }
-    return _operationQueue;
-}
-
 @end
@@ -0,0 +1,45 @@
+//
+//  PRESReachability.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 14/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSInteger, PRESReachabilityStatus) {
+    PRESReachabilityStatusUnknown = 0,
+    PRESReachabilityStatusNotReachable = 1,
+    PRESReachabilityStatusViaWWAN = 2,
+    PRESReachabilityStatusViaWiFi = 3
+};
+
+/**
+ *  Posted on the main thread whenever the status changes, userInfo contains the new status for
+ *  kPRESReachabilityStatusKey. PRESNetworkDidBecomeReachableNotification is posted in addition
+ *  when the network becomes reachable.
+ */
+FOUNDATION_EXPORT NSString *const PRESReachabilityStatusDidChangeNotification;
+FOUNDATION_EXPORT NSString *const kPRESReachabilityStatusKey;
+
+/**
+ *  Thin wrapper around SCNetworkReachability for the default route
+ */
+@interface PRESReachability : NSObject
+
++ (instancetype)sharedInstance;
+
+/**
+ *  The last known status, PRESReachabilityStatusUnknown until monitoring has been started
+ */
+@property (atomic, assign, readonly) PRESReachabilityStatus status;
+
+@property (nonatomic, assign, readonly, getter=isReachable) BOOL reachable;
+
+/**
+ *  Starts observing the default route, calling it more than once has no effect
+ */
+- (void)startMonitoring;
+
+@end
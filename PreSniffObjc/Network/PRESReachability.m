@@ -0,0 +1,130 @@
+//
+//  PRESReachability.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 14/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESReachability.h"
+#import "PreSniffObjc.h"
+#import "PRESPrivate.h"
+#import <SystemConfiguration/SystemConfiguration.h>
+#import <netinet/in.h>
+
+NSString *const PRESReachabilityStatusDidChangeNotification = @"PRESReachabilityStatusDidChangeNotification";
+NSString *const kPRESReachabilityStatusKey = @"PRESReachabilityStatus";
+
+static PRESReachabilityStatus pres_reachabilityStatusForFlags(SCNetworkReachabilityFlags flags) {
+    if (!(flags & kSCNetworkReachabilityFlagsReachable)) {
+        return PRESReachabilityStatusNotReachable;
+    }
+    
+    BOOL needsConnection = (flags & kSCNetworkReachabilityFlagsConnectionRequired) != 0;
+    BOOL canConnectAutomatically = (flags & (kSCNetworkReachabilityFlagsConnectionOnDemand | kSCNetworkReachabilityFlagsConnectionOnTraffic)) != 0
+    && (flags & kSCNetworkReachabilityFlagsInterventionRequired) == 0;
+    if (needsConnection && !canConnectAutomatically) {
+        return PRESReachabilityStatusNotReachable;
+    }
+    
+    if (flags & kSCNetworkReachabilityFlagsIsWWAN) {
+        return PRESReachabilityStatusViaWWAN;
+    }
+    return PRESReachabilityStatusViaWiFi;
+}
+
+@interface PRESReachability ()
+
+@property (atomic, assign, readwrite) PRESReachabilityStatus status;
+
+- (void)updateWithFlags:(SCNetworkReachabilityFlags)flags;
+
+@end
+
+static void pres_reachabilityCallback(SCNetworkReachabilityRef target, SCNetworkReachabilityFlags flags, void *info) {
+    PRESReachability *reachability = (__bridge PRESReachability *)info;
+    [reachability updateWithFlags:flags];
+}
+
+@implementation PRESReachability {
+    SCNetworkReachabilityRef _reachabilityRef;
+    dispatch_queue_t _callbackQueue;
+    BOOL _monitoring;
+}
+
++ (instancetype)sharedInstance {
+    static PRESReachability *sharedInstance;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedInstance = [[PRESReachability alloc] init];
+    });
+    return sharedInstance;
+}
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        struct sockaddr_in zeroAddress;
+        bzero(&zeroAddress, sizeof(zeroAddress));
+        zeroAddress.sin_len = sizeof(zeroAddress);
+        zeroAddress.sin_family = AF_INET;
+        _reachabilityRef = SCNetworkReachabilityCreateWithAddress(kCFAllocatorDefault, (const struct sockaddr *)&zeroAddress);
+        _callbackQueue = dispatch_queue_create("com.presniff.reachabilityQueue", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_reachabilityRef) {
+        SCNetworkReachabilitySetCallback(_reachabilityRef, NULL, NULL);
+        SCNetworkReachabilitySetDispatchQueue(_reachabilityRef, NULL);
+        CFRelease(_reachabilityRef);
+    }
+}
+
+- (BOOL)isReachable {
+    PRESReachabilityStatus status = self.status;
+    return status == PRESReachabilityStatusViaWiFi || status == PRESReachabilityStatusViaWWAN;
+}
+
+- (void)startMonitoring {
+    @synchronized (self) {
+        if (_monitoring || !_reachabilityRef) return;
+        
+        SCNetworkReachabilityContext context = {0, (__bridge void *)self, NULL, NULL, NULL};
+        if (!SCNetworkReachabilitySetCallback(_reachabilityRef, pres_reachabilityCallback, &context) ||
+            !SCNetworkReachabilitySetDispatchQueue(_reachabilityRef, _callbackQueue)) {
+            PRESLogWarning(@"WARNING: Unable to monitor network reachability");
+            return;
+        }
+        _monitoring = YES;
+    }
+    
+    dispatch_async(_callbackQueue, ^{
+        SCNetworkReachabilityFlags flags = 0;
+        if (SCNetworkReachabilityGetFlags(_reachabilityRef, &flags)) {
+            [self updateWithFlags:flags];
+        }
+    });
+}
+
+- (void)updateWithFlags:(SCNetworkReachabilityFlags)flags {
+    PRESReachabilityStatus status = pres_reachabilityStatusForFlags(flags);
+    PRESReachabilityStatus previousStatus = self.status;
+    if (status == previousStatus) return;
+    
+    self.status = status;
+    PRESLogVerbose(@"VERBOSE: Network reachability changed to %ld", (long)status);
+    
+    BOOL becameReachable = self.isReachable && (previousStatus == PRESReachabilityStatusNotReachable);
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [[NSNotificationCenter defaultCenter] postNotificationName:PRESReachabilityStatusDidChangeNotification
+                                                            object:self
+                                                          userInfo:@{kPRESReachabilityStatusKey: @(status)}];
+        if (becameReachable) {
+            [[NSNotificationCenter defaultCenter] postNotificationName:PRESNetworkDidBecomeReachableNotification
+                                                                object:nil];
+        }
+    });
+}
+
+@end
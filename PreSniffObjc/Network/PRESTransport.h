@@ -0,0 +1,101 @@
+//
+//  PRESTransport.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 21/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class PRESConfig;
+
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_OPTIONS(NSUInteger, PRESTransportOptions) {
+    PRESTransportOptionNone = 0,
+    /**
+     *  Compresses HTTPBody with gzip and sets Content-Encoding
+     */
+    PRESTransportOptionGzipBody = 1 << 0,
+    /**
+     *  Retries network errors, 408, 429 and 5xx responses up to maxRetryAttempts times. The delays
+     *  come from a backoff per host shared by all retrying requests, honoring Retry-After.
+     *  Leave this off for callers with their own retry state, like PRESSender.
+     */
+    PRESTransportOptionRetryTransientErrors = 1 << 1
+};
+
+typedef void (^PRESTransportCompletion)(NSData *_Nullable data, NSHTTPURLResponse *_Nullable response, NSError *_Nullable error);
+typedef void (^PRESTransportStartHandler)(void);
+
+/**
+ *  The one place the SDK talks HTTP through
+ *
+ *  All requests of the SDK share one session and its connection pool, and at most
+ *  maxConcurrentRequests of them run at a time, the rest wait in order. Every request is marked
+ *  as internal so the HTTP monitor doesn't record it, and gets additionalHTTPHeaders.
+ *  Completions are called on an arbitrary queue.
+ */
+@interface PRESTransport : NSObject
+
++ (instancetype)sharedTransport;
+
+/**
+ *  One more than the telemetry request limit of the config, so a full sender never holds back
+ *  config fetches and crash reports
+ */
+@property (atomic, assign) NSUInteger maxConcurrentRequests;
+
+/**
+ *  Defaults to 3
+ */
+@property (atomic, assign) NSUInteger maxRetryAttempts;
+
+/**
+ *  Headers added to every request unless it sets them itself, e.g. for authentication
+ */
+@property (atomic, copy) NSDictionary<NSString *, NSString *> *additionalHTTPHeaders;
+
+/**
+ *  Applies the request limit of the config, waiting requests start right away if it grew.
+ */
+- (void)updateWithConfig:(PRESConfig *)config;
+
+- (void)sendRequest:(NSURLRequest *)request
+            options:(PRESTransportOptions)options
+         completion:(nullable PRESTransportCompletion)completion;
+
+/**
+ *  Like sendRequest:options:completion:, started is called on the transport's queue each time
+ *  the request leaves the line and its task is resumed. Keep it short.
+ */
+- (void)sendRequest:(NSURLRequest *)request
+            options:(PRESTransportOptions)options
+            started:(nullable PRESTransportStartHandler)started
+         completion:(nullable PRESTransportCompletion)completion;
+
+/**
+ *  Uploads the file as body of the request, PRESTransportOptionGzipBody is ignored
+ */
+- (void)uploadRequest:(NSURLRequest *)request
+             fromFile:(NSURL *)fileURL
+              options:(PRESTransportOptions)options
+           completion:(nullable PRESTransportCompletion)completion;
+
+/**
+ *  Creates a task on a shared session whose delegate callbacks are forwarded to delegate, for
+ *  proxying the app's own requests. These are not limited and not retried, the caller resumes them.
+ */
+- (NSURLSessionDataTask *)passthroughDataTaskWithRequest:(NSURLRequest *)request
+                                                delegate:(id<NSURLSessionDataDelegate>)delegate;
+
+/**
+ *  gzip with the compression stats recorded, for callers which have to compress ahead of the request
+ */
++ (nullable NSData *)gzippedData:(NSData *)data;
+
+@end
+
+NS_ASSUME_NONNULL_END
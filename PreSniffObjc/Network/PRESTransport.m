@@ -0,0 +1,313 @@
+//
+//  PRESTransport.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 21/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESTransport.h"
+#import "PRESConfig.h"
+#import "PRESBackoffPolicy.h"
+#import "PRESGZIP.h"
+#import "PRESStats.h"
+#import "PRESTime.h"
+#import "PRESPrivate.h"
+
+static char *const kPRESTransportQueue = "com.presniff.transportQueue";
+
+// the transport limits the requests itself, NSURLSession must not hold them back a second time
+static NSInteger const PRESTransportMaxConnectionsPerHost = 64;
+static NSUInteger const PRESTransportDefaultMaxRetryAttempts = 3;
+static NSTimeInterval const PRESTransportRequestTimeout = 30;
+
+// same marker the SDK always used, PRESURLProtocol ignores requests carrying it
+static NSString *const kPRESInternalRequestProperty = @"PRESInternalRequest";
+
+@interface PRESTransportRequest : NSObject
+
+@property (nonatomic, strong) NSURLRequest *request;
+@property (nonatomic, strong) NSURL *fileURL;
+@property (nonatomic, assign) PRESTransportOptions options;
+@property (nonatomic, copy) PRESTransportStartHandler started;
+@property (nonatomic, copy) PRESTransportCompletion completion;
+@property (nonatomic, assign) NSUInteger attempts;
+
+@end
+
+@implementation PRESTransportRequest
+@end
+
+@interface PRESTransport () <NSURLSessionDataDelegate>
+
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong) NSURLSession *session;
+@property (nonatomic, strong) NSURLSession *passthroughSession;
+
+/**
+ *  Requests waiting for a free slot, in order, only accessed on queue
+ */
+@property (nonatomic, strong) NSMutableArray<PRESTransportRequest *> *pendingRequests;
+@property (nonatomic, assign) NSUInteger runningRequestsCount;
+
+@property (nonatomic, strong) PRESBackoffPolicy *hostBackoff;
+@property (nonatomic, strong) NSMutableDictionary<NSNumber *, id<NSURLSessionDataDelegate>> *passthroughDelegates;
+
+@end
+
+@implementation PRESTransport
+
++ (instancetype)sharedTransport {
+    static PRESTransport *sharedInstance;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedInstance = [PRESTransport new];
+    });
+    return sharedInstance;
+}
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _maxConcurrentRequests = [self maxConcurrentRequestsForConfig:PRESConfig.defaultConfig];
+        _maxRetryAttempts = PRESTransportDefaultMaxRetryAttempts;
+        _additionalHTTPHeaders = @{};
+        _queue = dispatch_queue_create(kPRESTransportQueue, DISPATCH_QUEUE_SERIAL);
+        _pendingRequests = [NSMutableArray new];
+        // nothing to persist, callers with retry state of their own across launches keep it themselves
+        _hostBackoff = [[PRESBackoffPolicy alloc] initWithFilePath:nil];
+        _passthroughDelegates = [NSMutableDictionary new];
+
+        NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+        configuration.URLCache = nil;
+        configuration.requestCachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+        configuration.HTTPMaximumConnectionsPerHost = PRESTransportMaxConnectionsPerHost;
+        configuration.timeoutIntervalForRequest = PRESTransportRequestTimeout;
+        _session = [NSURLSession sessionWithConfiguration:configuration];
+
+        NSOperationQueue *delegateQueue = [NSOperationQueue new];
+        delegateQueue.maxConcurrentOperationCount = 1;
+        _passthroughSession = [NSURLSession sessionWithConfiguration:[NSURLSessionConfiguration ephemeralSessionConfiguration] delegate:self delegateQueue:delegateQueue];
+    }
+    return self;
+}
+
+#pragma mark - Config
+
+- (NSUInteger)maxConcurrentRequestsForConfig:(PRESConfig *)config {
+    return MAX(config.telemetryRequestLimit, 1U) + 1;
+}
+
+- (void)updateWithConfig:(PRESConfig *)config {
+    NSUInteger maxConcurrentRequests = [self maxConcurrentRequestsForConfig:config];
+    if (maxConcurrentRequests == self.maxConcurrentRequests) return;
+    
+    self.maxConcurrentRequests = maxConcurrentRequests;
+    // running requests finish normally, a higher limit can start more right away
+    dispatch_async(self.queue, ^{
+        [self startPendingRequests];
+    });
+}
+
+#pragma mark - Requests
+
+- (void)sendRequest:(NSURLRequest *)request options:(PRESTransportOptions)options completion:(PRESTransportCompletion)completion {
+    [self enqueueRequest:request fileURL:nil options:options started:nil completion:completion];
+}
+
+- (void)sendRequest:(NSURLRequest *)request options:(PRESTransportOptions)options started:(PRESTransportStartHandler)started completion:(PRESTransportCompletion)completion {
+    [self enqueueRequest:request fileURL:nil options:options started:started completion:completion];
+}
+
+- (void)uploadRequest:(NSURLRequest *)request fromFile:(NSURL *)fileURL options:(PRESTransportOptions)options completion:(PRESTransportCompletion)completion {
+    [self enqueueRequest:request fileURL:fileURL options:options & ~PRESTransportOptionGzipBody started:nil completion:completion];
+}
+
+- (void)enqueueRequest:(NSURLRequest *)request fileURL:(NSURL *)fileURL options:(PRESTransportOptions)options started:(PRESTransportStartHandler)started completion:(PRESTransportCompletion)completion {
+    PRESTransportRequest *transportRequest = [PRESTransportRequest new];
+    transportRequest.request = [self preparedRequest:request options:options];
+    transportRequest.fileURL = fileURL;
+    transportRequest.options = options;
+    transportRequest.started = started;
+    transportRequest.completion = completion;
+
+    dispatch_async(self.queue, ^{
+        [self.pendingRequests addObject:transportRequest];
+        [self startPendingRequests];
+    });
+}
+
+- (NSURLRequest *)preparedRequest:(NSURLRequest *)request options:(PRESTransportOptions)options {
+    NSMutableURLRequest *prepared = [request mutableCopy];
+    [NSURLProtocol setProperty:@YES forKey:kPRESInternalRequestProperty inRequest:prepared];
+
+    [self.additionalHTTPHeaders enumerateKeysAndObjectsUsingBlock:^(NSString *field, NSString *value, BOOL *stop) {
+        if (![prepared valueForHTTPHeaderField:field]) {
+            [prepared setValue:value forHTTPHeaderField:field];
+        }
+    }];
+
+    if ((options & PRESTransportOptionGzipBody) && prepared.HTTPBody.length > 0) {
+        NSData *compressed = [[self class] gzippedData:prepared.HTTPBody];
+        if (compressed) {
+            prepared.HTTPBody = compressed;
+            [prepared setValue:@"gzip" forHTTPHeaderField:@"Content-Encoding"];
+        }
+    }
+    return prepared;
+}
+
+/**
+ *  Starts waiting requests while there are free slots, only called on queue
+ */
+- (void)startPendingRequests {
+    while (self.runningRequestsCount < MAX(self.maxConcurrentRequests, 1U) && self.pendingRequests.count > 0) {
+        PRESTransportRequest *request = self.pendingRequests.firstObject;
+        [self.pendingRequests removeObjectAtIndex:0];
+
+        if (request.options & PRESTransportOptionRetryTransientErrors) {
+            NSTimeInterval delay = [self.hostBackoff acquireAttemptForEndpoint:[self hostKeyForRequest:request.request]];
+            if (delay > 0) {
+                // the host is backed off, the request gets back in line once the delay passed
+                dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.queue, ^{
+                    [self.pendingRequests addObject:request];
+                    [self startPendingRequests];
+                });
+                continue;
+            }
+        }
+        [self startRequest:request];
+    }
+}
+
+- (void)startRequest:(PRESTransportRequest *)request {
+    self.runningRequestsCount++;
+    request.attempts++;
+
+    __weak typeof(self) weakSelf = self;
+    void (^completionHandler)(NSData *, NSURLResponse *, NSError *) = ^(NSData *data, NSURLResponse *response, NSError *error) {
+        typeof(self) strongSelf = weakSelf;
+        dispatch_async(strongSelf.queue, ^{
+            strongSelf.runningRequestsCount--;
+            [strongSelf finishRequest:request data:data response:response error:error];
+            [strongSelf startPendingRequests];
+        });
+    };
+
+    NSURLSessionTask *task;
+    if (request.fileURL) {
+        task = [self.session uploadTaskWithRequest:request.request fromFile:request.fileURL completionHandler:completionHandler];
+    } else {
+        task = [self.session dataTaskWithRequest:request.request completionHandler:completionHandler];
+    }
+    if (request.started) {
+        request.started();
+    }
+    [task resume];
+}
+
+- (void)finishRequest:(PRESTransportRequest *)request data:(NSData *)data response:(NSURLResponse *)response error:(NSError *)error {
+    NSHTTPURLResponse *httpResponse = [response isKindOfClass:[NSHTTPURLResponse class]] ? (NSHTTPURLResponse *)response : nil;
+
+    if (request.options & PRESTransportOptionRetryTransientErrors) {
+        NSString *hostKey = [self hostKeyForRequest:request.request];
+        if ([self isTransientFailureWithResponse:httpResponse error:error]) {
+            NSTimeInterval retryAfter = [PRESBackoffPolicy retryAfterIntervalFromHeaderValue:httpResponse.allHeaderFields[@"Retry-After"] now:[[NSDate date] timeIntervalSince1970]];
+            [self.hostBackoff recordFailureForEndpoint:hostKey retryAfter:retryAfter];
+            if (request.attempts < MAX(self.maxRetryAttempts, 1U)) {
+                PRESLogDebug(@"INFO: Retrying %@ after attempt %lu", request.request.URL.path, (unsigned long)request.attempts);
+                pres_stats_add(PRESStatsCounterUploadRetries, 1);
+                [self.pendingRequests addObject:request];
+                return;
+            }
+        } else {
+            [self.hostBackoff recordSuccessForEndpoint:hostKey];
+        }
+    }
+
+    PRESTransportCompletion completion = request.completion;
+    if (completion) {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            completion(data, httpResponse, error);
+        });
+    }
+}
+
+- (BOOL)isTransientFailureWithResponse:(NSHTTPURLResponse *)response error:(NSError *)error {
+    if (error) {
+        return !([error.domain isEqualToString:NSURLErrorDomain] && error.code == NSURLErrorCancelled);
+    }
+    NSInteger statusCode = response.statusCode;
+    return statusCode == 408 || statusCode == 429 || statusCode >= 500;
+}
+
+- (NSString *)hostKeyForRequest:(NSURLRequest *)request {
+    return request.URL.host ?: @"";
+}
+
+#pragma mark - Compression
+
++ (NSData *)gzippedData:(NSData *)data {
+    if (data.length == 0) return data;
+
+    uint64_t start = pres_monotonic_ns();
+    NSData *compressed = [data pres_gzippedData];
+    pres_stats_record(PRESStatsHistogramGzipNs, pres_monotonic_ns() - start);
+    if (compressed) {
+        pres_stats_record(PRESStatsHistogramGzipRatioPercent, compressed.length * 100 / data.length);
+    }
+    return compressed;
+}
+
+#pragma mark - Passthrough
+
+- (NSURLSessionDataTask *)passthroughDataTaskWithRequest:(NSURLRequest *)request delegate:(id<NSURLSessionDataDelegate>)delegate {
+    NSURLSessionDataTask *task = [self.passthroughSession dataTaskWithRequest:request];
+    @synchronized (self.passthroughDelegates) {
+        self.passthroughDelegates[@(task.taskIdentifier)] = delegate;
+    }
+    return task;
+}
+
+- (id<NSURLSessionDataDelegate>)passthroughDelegateForTask:(NSURLSessionTask *)task {
+    @synchronized (self.passthroughDelegates) {
+        return self.passthroughDelegates[@(task.taskIdentifier)];
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask willCacheResponse:(NSCachedURLResponse *)proposedResponse completionHandler:(void (^)(NSCachedURLResponse *))completionHandler {
+    id<NSURLSessionDataDelegate> delegate = [self passthroughDelegateForTask:dataTask];
+    if ([delegate respondsToSelector:@selector(URLSession:dataTask:willCacheResponse:completionHandler:)]) {
+        [delegate URLSession:session dataTask:dataTask willCacheResponse:proposedResponse completionHandler:completionHandler];
+    } else {
+        completionHandler(proposedResponse);
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveResponse:(NSURLResponse *)response completionHandler:(void (^)(NSURLSessionResponseDisposition))completionHandler {
+    id<NSURLSessionDataDelegate> delegate = [self passthroughDelegateForTask:dataTask];
+    if ([delegate respondsToSelector:@selector(URLSession:dataTask:didReceiveResponse:completionHandler:)]) {
+        [delegate URLSession:session dataTask:dataTask didReceiveResponse:response completionHandler:completionHandler];
+    } else {
+        completionHandler(NSURLSessionResponseAllow);
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data {
+    id<NSURLSessionDataDelegate> delegate = [self passthroughDelegateForTask:dataTask];
+    if ([delegate respondsToSelector:@selector(URLSession:dataTask:didReceiveData:)]) {
+        [delegate URLSession:session dataTask:dataTask didReceiveData:data];
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error {
+    id<NSURLSessionDataDelegate> delegate;
+    @synchronized (self.passthroughDelegates) {
+        delegate = self.passthroughDelegates[@(task.taskIdentifier)];
+        [self.passthroughDelegates removeObjectForKey:@(task.taskIdentifier)];
+    }
+    if ([delegate respondsToSelector:@selector(URLSession:task:didCompleteWithError:)]) {
+        [delegate URLSession:session task:task didCompleteWithError:error];
+    }
+}
+
+@end
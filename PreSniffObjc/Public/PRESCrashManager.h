@@ -221,6 +221,19 @@ typedef NS_ENUM(NSUInteger, PRESCrashManagerUserInput) {
 @property (nonatomic, assign, getter=isOnDeviceSymbolicationEnabled) BOOL enableOnDeviceSymbolication;
 
 
+/**
+ *  Send crash reports in the compact binary format instead of the Apple text format
+ *
+ *  The compact format contains a deduplicated binary image table and stack frames as
+ *  image index and offset pairs. It is considerably smaller and skips formatting the
+ *  text report on the device, the server takes care of symbolication and rendering.
+ *  Reports created for app kills are always sent as text.
+ *
+ *  Default: _NO_
+ */
+@property (nonatomic, assign, getter=isCompactCrashReportFormatEnabled) BOOL enableCompactCrashReportFormat;
+
+
 /**
  *  EXPERIMENTAL: Enable heuristics to detect the app not terminating cleanly
  *
@@ -56,6 +56,20 @@ typedef NS_ENUM(NSInteger, PRESEnvironment) {
     PRESEnvironmentOther = 99
 };
 
+/**
+ *  Priority of a tracked telemetry item
+ */
+typedef NS_ENUM(NSInteger, PRESTelemetryPriority) {
+    /**
+     *  Bulk data, batched and dropped first when the SDK runs out of space
+     */
+    PRESTelemetryPriorityNormal = 0,
+    /**
+     *  Persisted right away in a reserved lane with its own quota and sent before normal data
+     */
+    PRESTelemetryPriorityHigh = 1
+};
+
 /**
  *  PreSniffObjc Crash Reporter error domain
  */
@@ -78,8 +92,27 @@ typedef NS_ENUM (NSInteger, PRESCrashErrorReason) {
     PRESCrashAPIErrorWithStatusCode
 };
 
+/**
+ *  Probes a network diagnosis can run
+ */
+typedef NS_OPTIONS(NSUInteger, PRESNetDiagProbe) {
+    PRESNetDiagProbePing = 1 << 0,
+    PRESNetDiagProbeTcpPing = 1 << 1,
+    PRESNetDiagProbeTraceRoute = 1 << 2,
+    PRESNetDiagProbeNslookup = 1 << 3,
+    PRESNetDiagProbeHttp = 1 << 4,
+    PRESNetDiagProbeAll = PRESNetDiagProbePing | PRESNetDiagProbeTcpPing | PRESNetDiagProbeTraceRoute | PRESNetDiagProbeNslookup | PRESNetDiagProbeHttp
+};
+
 typedef void (^PRESNetDiagCompleteHandler)(PRESNetDiagResult* result);
 
+/**
+ *  Called whenever a single probe finished or timed out, the result contains all probes of its host finished so far
+ */
+typedef void (^PRESNetDiagProgressHandler)(PRESNetDiagResult* partialResult, PRESNetDiagProbe probe);
+
+typedef void (^PRESNetDiagMultiCompleteHandler)(NSArray<PRESNetDiagResult *> *results);
+
 typedef NSString *(^PRESLogMessageProvider)(void);
 
 typedef void (^PRESLogHandler)(PRESLogMessageProvider messageProvider, PRESLogLevel logLevel, const char *file, const char *function, uint line);
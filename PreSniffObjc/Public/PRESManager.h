@@ -133,11 +133,44 @@ NS_ASSUME_NONNULL_BEGIN
  
  Call this after configuring the manager and setting up all modules.
  
+ Only the crash reporter is set up before this returns. The metrics manager starts on a
+ background queue and the HTTP monitor once the main run loop is idle for the first time.
+ 
+ @see launchStageDurations
+ 
  @see configureWithIdentifier:delegate:
  @see configureWithBetaIdentifier:liveIdentifier:delegate:
  */
 - (void)startManager;
 
+/**
+ Microseconds spent in each stage of `startManager` so far, by stage name
+ 
+ "critical_path" is the time `startManager` blocked the calling thread.
+ */
+- (NSDictionary<NSString *, NSNumber *> *)launchStageDurations;
+
+/**
+ Hands the events of the SDK's background upload session to the SDK
+ 
+ Telemetry is uploaded with a background URL session while the app is suspended. When the
+ system relaunches the app for that session, forward the call from your app delegate:
+ 
+ ```
+ - (void)application:(UIApplication *)application handleEventsForBackgroundURLSession:(NSString *)identifier completionHandler:(void (^)(void))completionHandler {
+     if ([[PRESManager sharedPRESManager] handleEventsForBackgroundURLSession:identifier completionHandler:completionHandler]) return;
+     // handle your own sessions
+ }
+ ```
+ 
+ The SDK calls the completion handler on the main queue once the session delivered all events.
+ 
+ @param identifier The identifier of the URL session passed to the app delegate
+ @param completionHandler The completion handler passed to the app delegate
+ @return YES if the session belongs to the SDK and the completion handler is taken care of
+ */
+- (BOOL)handleEventsForBackgroundURLSession:(NSString *)identifier completionHandler:(void (^)(void))completionHandler;
+
 /**
  *  diagnose current network environment
  *
@@ -147,6 +180,24 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)diagnose:(NSString *)host
         complete:(PRESNetDiagCompleteHandler)complete;
 
+/**
+ *  diagnose current network environment against several end points at once
+ *
+ *  All hosts and probes run in parallel. Results of the last minute for the same host and network
+ *  type are reused instead of probing again.
+ *
+ *  @param hosts    the end points you want this diagnose action perform with
+ *  @param probes   the probes to run for every host
+ *  @param timeout  upper bound in seconds for every single probe, 0 uses the default timeout of each probe
+ *  @param progress called on an arbitrary queue whenever a probe finished, may be nil
+ *  @param complete called once every probe of every host finished, with one result per host
+ */
+- (void)diagnoseHosts:(NSArray<NSString *> *)hosts
+               probes:(PRESNetDiagProbe)probes
+              timeout:(NSTimeInterval)timeout
+             progress:(PRESNetDiagProgressHandler)progress
+             complete:(PRESNetDiagMultiCompleteHandler)complete;
+
 /**
  Set a custom block that handles all the log messages that are emitted from the SDK.
  
@@ -173,6 +224,19 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)setLogHandler:(PRESLogHandler)logHandler;
 
+///-----------------------------------------------------------------------------
+/// @name SDK statistics
+///-----------------------------------------------------------------------------
+
+/**
+ Returns the SDK's own counters and latency histograms since the app launched.
+
+ Keys are named "<module>.<metric>", e.g. "telemetry.dropped" or "upload.latency_ms.p90".
+ Histograms have ".count", ".sum", ".max", ".p50", ".p90" and ".p99" entries, the percentiles
+ are rounded up to the next power of two minus one. Durations are in the unit their name ends with.
+ */
+- (NSDictionary<NSString *, NSNumber *> *)statsSnapshot;
+
 ///-----------------------------------------------------------------------------
 /// @name SDK meta data
 ///-----------------------------------------------------------------------------
@@ -49,6 +49,18 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)trackEventWithName:(nonnull NSString *)eventName properties:(nullable NSDictionary<NSString *, NSString *> *)properties measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements;
 
+/**
+ *  This method allows to track an event with a given priority. High priority events skip the
+ *  batching, are not dropped when normal events are shed and get sent first. Use it sparingly
+ *  for events you can't afford to lose.
+ *
+ *  @param eventName the name of the event, which should be tracked.
+ *  @param properties key value pairs with additional info about the event.
+ *  @param measurements key value pairs, which contain custom metrics.
+ *  @param priority the priority of the event.
+ */
+- (void)trackEventWithName:(nonnull NSString *)eventName properties:(nullable NSDictionary<NSString *, NSString *> *)properties measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements priority:(PRESTelemetryPriority)priority;
+
 @end
 
 NS_ASSUME_NONNULL_END
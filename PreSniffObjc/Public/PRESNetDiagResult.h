@@ -12,7 +12,19 @@
 
 @interface PRESNetDiagResult : NSObject
 
-@property (nonatomic, assign) NSString *result_id;
+@property (nonatomic, copy) NSString *result_id;
+
+@property (nonatomic, copy, readonly) NSString *host;
+
+/**
+ *  Probes which finished, including the ones that timed out
+ */
+@property (atomic, assign, readonly) PRESNetDiagProbe completed_probes;
+
+/**
+ *  Probes which were stopped because they exceeded their timeout, their fields are not filled
+ */
+@property (atomic, assign, readonly) PRESNetDiagProbe timed_out_probes;
 
 @property (nonatomic, assign) NSInteger ping_code;
 @property (nonatomic, strong) NSString* ping_ip;
@@ -0,0 +1,99 @@
+//
+//  PRESBackoffPolicy.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 15/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, PRESCircuitState) {
+    /**
+     *  Requests are allowed, failures only add a backoff delay
+     */
+    PRESCircuitStateClosed = 0,
+    /**
+     *  Too many failures in a row, no requests until the open interval passed
+     */
+    PRESCircuitStateOpen = 1,
+    /**
+     *  The open interval passed, a single probe request decides whether to close or open again
+     */
+    PRESCircuitStateHalfOpen = 2
+};
+
+/**
+ *  Per endpoint retry state for the sender
+ *
+ *  Every failure in a row doubles the delay before the next attempt, starting at baseDelay and capped
+ *  at maxDelay. The actual delay is drawn uniformly from [0, delay] ("full jitter"), so devices that
+ *  failed at the same time spread their retries. After failuresToOpenCircuit failures in a row the
+ *  circuit opens for openInterval, which doubles on every failed probe up to maxOpenInterval. A
+ *  Retry-After from the server is honored as a lower bound, with up to 10 % jitter on top.
+ *
+ *  The state is written to filePath on every change, so a backend incident keeps the devices
+ *  backed off across launches instead of retrying all at once on the next app start. Thread safe.
+ */
+@interface PRESBackoffPolicy : NSObject
+
+@property (nonatomic, copy, readonly, nullable) NSString *filePath;
+
+@property (atomic, assign) NSTimeInterval baseDelay;
+@property (atomic, assign) NSTimeInterval maxDelay;
+@property (atomic, assign) NSUInteger failuresToOpenCircuit;
+@property (atomic, assign) NSTimeInterval openInterval;
+@property (atomic, assign) NSTimeInterval maxOpenInterval;
+
+/**
+ *  A half open probe without an outcome after this long is considered lost, e.g. because its
+ *  completion never arrived, and the next caller gets a new probe.
+ */
+@property (atomic, assign) NSTimeInterval probeTimeout;
+
+/**
+ *  Wall clock time in seconds since 1970, defaults to the system time (testing).
+ *  The wall clock is used because the state outlives the process.
+ */
+@property (nonatomic, copy, null_resettable) NSTimeInterval (^clock)(void);
+
+/**
+ *  @param filePath where the state is persisted, nil keeps it in memory only
+ */
+- (instancetype)initWithFilePath:(nullable NSString *)filePath;
+
+/**
+ *  Asks whether a request to the endpoint may start now. In the half open state only the first
+ *  caller gets the probe, everyone else has to wait for its outcome.
+ *
+ *  @return 0 if the request may start, otherwise the seconds to wait before asking again
+ */
+- (NSTimeInterval)acquireAttemptForEndpoint:(NSString *)endpoint;
+
+/**
+ *  Like acquireAttemptForEndpoint: without taking the half open probe, for cheap checks before preparing a request.
+ */
+- (NSTimeInterval)delayForEndpoint:(NSString *)endpoint;
+
+- (void)recordSuccessForEndpoint:(NSString *)endpoint;
+
+/**
+ *  @param retryAfter the seconds the server asked to wait, negative if it did not send Retry-After
+ */
+- (void)recordFailureForEndpoint:(NSString *)endpoint retryAfter:(NSTimeInterval)retryAfter;
+
+- (PRESCircuitState)circuitStateForEndpoint:(NSString *)endpoint;
+
+/**
+ *  Parses a Retry-After header, either delay seconds or an HTTP date.
+ *
+ *  @return the seconds to wait, -1 if the value is missing or invalid
+ */
++ (NSTimeInterval)retryAfterIntervalFromHeaderValue:(nullable NSString *)value now:(NSTimeInterval)now;
+
+@end
+
+NS_ASSUME_NONNULL_END
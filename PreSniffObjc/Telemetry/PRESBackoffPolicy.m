@@ -0,0 +1,312 @@
+//
+//  PRESBackoffPolicy.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 15/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESBackoffPolicy.h"
+#import "PRESBinaryRecord.h"
+#import "PRESPrivate.h"
+
+static uint8_t const PRESBackoffRecordVersion = 1;
+
+static NSTimeInterval const PRESBackoffDefaultBaseDelay = 5;
+static NSTimeInterval const PRESBackoffDefaultMaxDelay = 15 * 60;
+static NSUInteger const PRESBackoffDefaultFailuresToOpenCircuit = 6;
+static NSTimeInterval const PRESBackoffDefaultOpenInterval = 10 * 60;
+static NSTimeInterval const PRESBackoffDefaultMaxOpenInterval = 6 * 60 * 60;
+static NSTimeInterval const PRESBackoffDefaultProbeTimeout = 5 * 60;
+
+// Retry-After values beyond this are treated as a misconfiguration of the server
+static NSTimeInterval const PRESBackoffMaxRetryAfter = 24 * 60 * 60;
+
+// Record keys are "<endpoint> <field>"
+static NSString *const kPRESBackoffFailuresField = @"failures";
+static NSString *const kPRESBackoffStateField = @"state";
+static NSString *const kPRESBackoffNextAttemptField = @"next_attempt";
+static NSString *const kPRESBackoffOpenIntervalField = @"open_interval";
+
+/**
+ *  @returns a uniformly distributed value in [0, 1]
+ */
+static double pres_randomUnit(void) {
+    return arc4random_uniform(UINT32_MAX) / (double)(UINT32_MAX - 1);
+}
+
+@interface PRESEndpointBackoffState : NSObject
+
+@property (nonatomic, assign) NSUInteger failures;
+@property (nonatomic, assign) PRESCircuitState state;
+@property (nonatomic, assign) NSTimeInterval nextAttempt;
+@property (nonatomic, assign) NSTimeInterval openInterval;
+
+/**
+ *  Not persisted, a probe that was running when the app was killed simply did not happen.
+ */
+@property (nonatomic, assign) BOOL probeInFlight;
+@property (nonatomic, assign) NSTimeInterval probeStartTime;
+
+@end
+
+@implementation PRESEndpointBackoffState
+@end
+
+@interface PRESBackoffPolicy ()
+
+@property (nonatomic, strong) NSMutableDictionary<NSString *, PRESEndpointBackoffState *> *states;
+
+@end
+
+@implementation PRESBackoffPolicy
+
+- (instancetype)init {
+    return [self initWithFilePath:nil];
+}
+
+- (instancetype)initWithFilePath:(nullable NSString *)filePath {
+    if ((self = [super init])) {
+        _filePath = [filePath copy];
+        _baseDelay = PRESBackoffDefaultBaseDelay;
+        _maxDelay = PRESBackoffDefaultMaxDelay;
+        _failuresToOpenCircuit = PRESBackoffDefaultFailuresToOpenCircuit;
+        _openInterval = PRESBackoffDefaultOpenInterval;
+        _maxOpenInterval = PRESBackoffDefaultMaxOpenInterval;
+        _probeTimeout = PRESBackoffDefaultProbeTimeout;
+        _states = [NSMutableDictionary new];
+        [self load];
+    }
+    return self;
+}
+
+- (NSTimeInterval (^)(void))clock {
+    if (!_clock) {
+        return ^NSTimeInterval {
+            return [[NSDate date] timeIntervalSince1970];
+        };
+    }
+    return _clock;
+}
+
+#pragma mark - State machine
+
+- (NSTimeInterval)maxPlausibleDelay {
+    return MAX(MAX(self.maxDelay, self.maxOpenInterval), PRESBackoffMaxRetryAfter) * 1.1;
+}
+
+/**
+ *  @return YES if a half open probe is running and has not passed probeTimeout yet
+ */
+- (BOOL)isProbePendingForState:(PRESEndpointBackoffState *)state now:(NSTimeInterval)now {
+    if (state.state != PRESCircuitStateHalfOpen || !state.probeInFlight) return NO;
+    
+    // a probe started in the future means the clock was set back, don't wait for it either
+    NSTimeInterval elapsed = now - state.probeStartTime;
+    if (elapsed >= 0 && elapsed < self.probeTimeout) return YES;
+    
+    PRESLogDebug(@"INFO: Probe without an outcome, allowing a new one.");
+    state.probeInFlight = NO;
+    return NO;
+}
+
+- (PRESEndpointBackoffState *)stateForEndpoint:(NSString *)endpoint {
+    PRESEndpointBackoffState *state = self.states[endpoint];
+    if (!state) {
+        state = [PRESEndpointBackoffState new];
+        state.openInterval = self.openInterval;
+        self.states[endpoint] = state;
+    }
+    return state;
+}
+
+- (NSTimeInterval)acquireAttemptForEndpoint:(NSString *)endpoint {
+    NSTimeInterval now = self.clock();
+
+    @synchronized (self) {
+        PRESEndpointBackoffState *state = [self stateForEndpoint:endpoint];
+        if (now < state.nextAttempt) {
+            // a clock set back by more than the delay must not block sending for good
+            NSTimeInterval remaining = state.nextAttempt - now;
+            if (remaining <= [self maxPlausibleDelay]) {
+                return remaining;
+            }
+            state.nextAttempt = now;
+        }
+
+        switch (state.state) {
+            case PRESCircuitStateClosed:
+                return 0;
+            case PRESCircuitStateOpen:
+                state.state = PRESCircuitStateHalfOpen;
+                state.probeInFlight = YES;
+                state.probeStartTime = now;
+                [self save];
+                return 0;
+            case PRESCircuitStateHalfOpen:
+                if ([self isProbePendingForState:state now:now]) {
+                    return self.baseDelay;
+                }
+                state.probeInFlight = YES;
+                state.probeStartTime = now;
+                return 0;
+        }
+    }
+    return 0;
+}
+
+- (NSTimeInterval)delayForEndpoint:(NSString *)endpoint {
+    NSTimeInterval now = self.clock();
+
+    @synchronized (self) {
+        PRESEndpointBackoffState *state = self.states[endpoint];
+        if (!state) return 0;
+        if (now < state.nextAttempt && state.nextAttempt - now <= [self maxPlausibleDelay]) return state.nextAttempt - now;
+        if ([self isProbePendingForState:state now:now]) return self.baseDelay;
+        return 0;
+    }
+}
+
+- (void)recordSuccessForEndpoint:(NSString *)endpoint {
+    @synchronized (self) {
+        PRESEndpointBackoffState *state = [self stateForEndpoint:endpoint];
+        if (state.failures == 0 && state.state == PRESCircuitStateClosed) return;
+
+        if (state.state != PRESCircuitStateClosed) {
+            PRESLogDebug(@"INFO: Circuit for %@ closed after %lu failures.", endpoint, (unsigned long)state.failures);
+        }
+        state.failures = 0;
+        state.state = PRESCircuitStateClosed;
+        state.nextAttempt = 0;
+        state.openInterval = self.openInterval;
+        state.probeInFlight = NO;
+        [self save];
+    }
+}
+
+- (void)recordFailureForEndpoint:(NSString *)endpoint retryAfter:(NSTimeInterval)retryAfter {
+    NSTimeInterval now = self.clock();
+
+    @synchronized (self) {
+        PRESEndpointBackoffState *state = [self stateForEndpoint:endpoint];
+        state.failures += 1;
+        state.probeInFlight = NO;
+
+        NSTimeInterval delay;
+        if (state.state == PRESCircuitStateHalfOpen) {
+            // the probe failed, stay away twice as long
+            state.openInterval = MIN(state.openInterval * 2, self.maxOpenInterval);
+            state.state = PRESCircuitStateOpen;
+            delay = state.openInterval * (0.5 + 0.5 * pres_randomUnit());
+        } else if (state.failures >= self.failuresToOpenCircuit) {
+            state.state = PRESCircuitStateOpen;
+            delay = state.openInterval * (0.5 + 0.5 * pres_randomUnit());
+            PRESLogWarning(@"WARNING: Circuit for %@ opened after %lu failures.", endpoint, (unsigned long)state.failures);
+        } else {
+            double exponential = self.baseDelay * pow(2, state.failures - 1);
+            delay = MIN(exponential, self.maxDelay) * pres_randomUnit();
+        }
+
+        if (retryAfter >= 0) {
+            retryAfter = MIN(retryAfter, PRESBackoffMaxRetryAfter);
+            delay = MAX(delay, retryAfter * (1 + 0.1 * pres_randomUnit()));
+        }
+
+        state.nextAttempt = now + delay;
+        PRESLogDebug(@"INFO: Backing off %@ for %.1f seconds.", endpoint, delay);
+        [self save];
+    }
+}
+
+- (PRESCircuitState)circuitStateForEndpoint:(NSString *)endpoint {
+    @synchronized (self) {
+        return self.states[endpoint].state;
+    }
+}
+
+#pragma mark - Retry-After
+
++ (NSTimeInterval)retryAfterIntervalFromHeaderValue:(nullable NSString *)value now:(NSTimeInterval)now {
+    NSString *trimmed = [value stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    if (trimmed.length == 0) return -1;
+
+    NSScanner *scanner = [NSScanner scannerWithString:trimmed];
+    long long seconds = 0;
+    if ([scanner scanLongLong:&seconds] && scanner.isAtEnd) {
+        return seconds >= 0 ? (NSTimeInterval)seconds : -1;
+    }
+
+    static NSDateFormatter *httpDateFormatter;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        httpDateFormatter = [NSDateFormatter new];
+        httpDateFormatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+        httpDateFormatter.timeZone = [NSTimeZone timeZoneWithAbbreviation:@"GMT"];
+        httpDateFormatter.dateFormat = @"EEE',' dd MMM yyyy HH':'mm':'ss 'GMT'";
+    });
+
+    NSDate *date;
+    @synchronized (httpDateFormatter) {
+        date = [httpDateFormatter dateFromString:trimmed];
+    }
+    if (!date) return -1;
+    return MAX(date.timeIntervalSince1970 - now, 0);
+}
+
+#pragma mark - Persistence
+
+- (void)load {
+    if (!self.filePath) return;
+
+    NSData *data = [NSData dataWithContentsOfFile:self.filePath];
+    if (!data) return;
+    uint8_t version = 0;
+    NSDictionary<NSString *, NSString *> *record = pres_decodeBinaryRecord(data, &version);
+    if (!record || version != PRESBackoffRecordVersion) {
+        PRESLogWarning(@"WARNING: Ignoring invalid backoff state");
+        return;
+    }
+
+    [record enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSString *value, BOOL *stop) {
+        NSRange separator = [key rangeOfString:@" " options:NSBackwardsSearch];
+        if (separator.location == NSNotFound) return;
+        NSString *endpoint = [key substringToIndex:separator.location];
+        NSString *field = [key substringFromIndex:NSMaxRange(separator)];
+
+        PRESEndpointBackoffState *state = [self stateForEndpoint:endpoint];
+        if ([field isEqualToString:kPRESBackoffFailuresField]) {
+            state.failures = (NSUInteger)MAX(value.integerValue, 0);
+        } else if ([field isEqualToString:kPRESBackoffStateField]) {
+            NSInteger circuitState = value.integerValue;
+            state.state = (circuitState >= PRESCircuitStateClosed && circuitState <= PRESCircuitStateHalfOpen) ? circuitState : PRESCircuitStateClosed;
+        } else if ([field isEqualToString:kPRESBackoffNextAttemptField]) {
+            state.nextAttempt = value.doubleValue;
+        } else if ([field isEqualToString:kPRESBackoffOpenIntervalField]) {
+            state.openInterval = MAX(value.doubleValue, self.openInterval);
+        }
+    }];
+}
+
+- (void)save {
+    if (!self.filePath) return;
+
+    NSMutableDictionary<NSString *, NSString *> *record = [NSMutableDictionary dictionaryWithCapacity:self.states.count * 4];
+    [self.states enumerateKeysAndObjectsUsingBlock:^(NSString *endpoint, PRESEndpointBackoffState *state, BOOL *stop) {
+        if (state.failures == 0 && state.state == PRESCircuitStateClosed) return;
+
+        record[[NSString stringWithFormat:@"%@ %@", endpoint, kPRESBackoffFailuresField]] = [NSString stringWithFormat:@"%lu", (unsigned long)state.failures];
+        record[[NSString stringWithFormat:@"%@ %@", endpoint, kPRESBackoffStateField]] = [NSString stringWithFormat:@"%ld", (long)state.state];
+        record[[NSString stringWithFormat:@"%@ %@", endpoint, kPRESBackoffNextAttemptField]] = [NSString stringWithFormat:@"%.3f", state.nextAttempt];
+        record[[NSString stringWithFormat:@"%@ %@", endpoint, kPRESBackoffOpenIntervalField]] = [NSString stringWithFormat:@"%.3f", state.openInterval];
+    }];
+
+    if (record.count == 0) {
+        [[NSFileManager defaultManager] removeItemAtPath:self.filePath error:nil];
+        return;
+    }
+    if (![pres_encodeBinaryRecord(record, PRESBackoffRecordVersion) writeToFile:self.filePath atomically:YES]) {
+        PRESLogWarning(@"WARNING: Unable to persist the backoff state");
+    }
+}
+
+@end
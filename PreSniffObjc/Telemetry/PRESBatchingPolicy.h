@@ -0,0 +1,92 @@
+//
+//  PRESBatchingPolicy.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 14/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class PRESConfig;
+@class PRESReachability;
+
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Decides how many items the channel collects and how long it lingers before a bundle is persisted.
+ *
+ *  The policy keeps a moving average of the item arrival rate and the item size:
+ *
+ *  - the batch size aims for bundles of targetBundleBytes, but not for more items than are
+ *    expected to arrive within maxBatchInterval
+ *  - the linger time is the time needed to fill that batch at the observed rate. If not even
+ *    two items are expected within maxBatchInterval, waiting gains nothing and minBatchInterval is used
+ *  - while the network is unreachable or the persisted backlog is above half of its capacity,
+ *    bundles are made as large as allowed to save files and requests
+ *  - on cellular the linger time is doubled, so the radio wakes up less often
+ *
+ *  All results are clamped to the configured bounds. Not thread safe, the channel only uses it
+ *  on its serial queue, except for updateWithConfig: which replaces the bounds atomically.
+ */
+@interface PRESBatchingPolicy : NSObject
+
+/**
+ *  Reachability used to look up the network state, defaults to the shared instance (testing).
+ */
+@property (nonatomic, strong, nullable) PRESReachability *reachability;
+
+@property (atomic, assign, readonly) NSUInteger minBatchSize;
+@property (atomic, assign, readonly) NSUInteger maxBatchSize;
+@property (atomic, assign, readonly) NSTimeInterval minBatchInterval;
+@property (atomic, assign, readonly) NSTimeInterval maxBatchInterval;
+@property (atomic, assign, readonly) NSUInteger targetBundleBytes;
+
+/**
+ *  Number of persisted bundles waiting to be sent and the maximum number of bundles on disk.
+ */
+@property (nonatomic, assign) NSUInteger backlogCount;
+@property (nonatomic, assign) NSUInteger backlogCapacity;
+
+/**
+ *  Creates a policy with the bounds of the default config.
+ */
+- (instancetype)init;
+
+/**
+ *  Creates a policy which always uses the given batch size and interval.
+ */
+- (instancetype)initWithFixedBatchSize:(NSUInteger)batchSize batchInterval:(NSTimeInterval)batchInterval;
+
+/**
+ *  Replaces the bounds with the ones from the config.
+ */
+- (void)updateWithConfig:(PRESConfig *)config;
+
+/**
+ *  Feeds an enqueued item into the moving averages.
+ *
+ *  @param byteCount the serialized size of the item
+ *  @param timestamp monotonic time of the arrival in seconds
+ */
+- (void)recordItemWithByteCount:(NSUInteger)byteCount timestamp:(NSTimeInterval)timestamp;
+
+/**
+ *  Same as recordItemWithByteCount:timestamp: using the current monotonic time.
+ */
+- (void)recordItemWithByteCount:(NSUInteger)byteCount;
+
+/**
+ *  Number of items after which the current bundle is persisted.
+ */
+- (NSUInteger)batchSize;
+
+/**
+ *  Seconds to wait after the first item of a bundle before it is persisted.
+ */
+- (NSTimeInterval)batchInterval;
+
+@end
+
+NS_ASSUME_NONNULL_END
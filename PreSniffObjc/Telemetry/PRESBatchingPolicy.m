@@ -0,0 +1,136 @@
+//
+//  PRESBatchingPolicy.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 14/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESBatchingPolicy.h"
+#import "PRESConfig.h"
+#import "PRESReachability.h"
+#import "PRESTime.h"
+
+// Weight of the newest sample in the moving averages
+static double const PRESBatchingSmoothingFactor = 0.2;
+
+@interface PRESBatchingPolicy ()
+
+@property (atomic, assign, readwrite) NSUInteger minBatchSize;
+@property (atomic, assign, readwrite) NSUInteger maxBatchSize;
+@property (atomic, assign, readwrite) NSTimeInterval minBatchInterval;
+@property (atomic, assign, readwrite) NSTimeInterval maxBatchInterval;
+@property (atomic, assign, readwrite) NSUInteger targetBundleBytes;
+
+@end
+
+@implementation PRESBatchingPolicy {
+    NSTimeInterval _lastArrival;
+    double _averageGap;
+    double _averageItemBytes;
+}
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        [self updateWithConfig:[PRESConfig defaultConfig]];
+    }
+    return self;
+}
+
+- (instancetype)initWithFixedBatchSize:(NSUInteger)batchSize batchInterval:(NSTimeInterval)batchInterval {
+    if ((self = [super init])) {
+        _minBatchSize = _maxBatchSize = MAX(batchSize, 1U);
+        _minBatchInterval = _maxBatchInterval = batchInterval;
+        _targetBundleBytes = NSUIntegerMax;
+    }
+    return self;
+}
+
+- (void)updateWithConfig:(PRESConfig *)config {
+    @synchronized (self) {
+        self.minBatchSize = MAX(config.telemetryMinBatchSize, 1U);
+        self.maxBatchSize = MAX(config.telemetryMaxBatchSize, self.minBatchSize);
+        self.minBatchInterval = config.telemetryMinBatchInterval;
+        self.maxBatchInterval = MAX(config.telemetryMaxBatchInterval, self.minBatchInterval);
+        self.targetBundleBytes = config.telemetryTargetBundleBytes;
+    }
+}
+
+- (PRESReachability *)reachability {
+    return _reachability ?: [PRESReachability sharedInstance];
+}
+
+#pragma mark - Observations
+
+- (void)recordItemWithByteCount:(NSUInteger)byteCount {
+    [self recordItemWithByteCount:byteCount timestamp:pres_monotonic_ns() / (double)NSEC_PER_SEC];
+}
+
+- (void)recordItemWithByteCount:(NSUInteger)byteCount timestamp:(NSTimeInterval)timestamp {
+    if (_averageItemBytes <= 0) {
+        _averageItemBytes = byteCount;
+    } else {
+        _averageItemBytes += PRESBatchingSmoothingFactor * ((double)byteCount - _averageItemBytes);
+    }
+    
+    if (_lastArrival > 0) {
+        // cap the gap, a single long pause should not wipe out the history
+        double gap = MIN(MAX(timestamp - _lastArrival, 0), 4 * self.maxBatchInterval);
+        if (_averageGap <= 0) {
+            _averageGap = gap;
+        } else {
+            _averageGap += PRESBatchingSmoothingFactor * (gap - _averageGap);
+        }
+    }
+    _lastArrival = timestamp;
+}
+
+#pragma mark - Decisions
+
+- (double)arrivalRate {
+    if (_lastArrival <= 0) return 0;
+    return _averageGap > 0 ? 1.0 / _averageGap : INFINITY;
+}
+
+- (BOOL)prefersLargeBundles {
+    if (self.reachability.status == PRESReachabilityStatusNotReachable) return YES;
+    return self.backlogCapacity > 0 && self.backlogCount * 2 >= self.backlogCapacity;
+}
+
+- (NSUInteger)batchSize {
+    NSUInteger minBatchSize = self.minBatchSize;
+    NSUInteger maxBatchSize = self.maxBatchSize;
+    if (minBatchSize == maxBatchSize || [self prefersLargeBundles]) {
+        return maxBatchSize;
+    }
+    
+    double size = maxBatchSize;
+    if (_averageItemBytes > 0) {
+        size = MIN(size, self.targetBundleBytes / _averageItemBytes);
+    }
+    double expectedItems = [self arrivalRate] * self.maxBatchInterval;
+    size = MIN(size, expectedItems);
+    
+    return (NSUInteger)MIN(MAX(size, (double)minBatchSize), (double)maxBatchSize);
+}
+
+- (NSTimeInterval)batchInterval {
+    NSTimeInterval minBatchInterval = self.minBatchInterval;
+    NSTimeInterval maxBatchInterval = self.maxBatchInterval;
+    if (minBatchInterval >= maxBatchInterval || [self prefersLargeBundles]) {
+        return maxBatchInterval;
+    }
+    
+    double rate = [self arrivalRate];
+    if (rate * maxBatchInterval < 2) {
+        return minBatchInterval;
+    }
+    
+    NSTimeInterval interval = [self batchSize] / rate;
+    if (self.reachability.status == PRESReachabilityStatusViaWWAN) {
+        interval *= 2;
+    }
+    return MIN(MAX(interval, minBatchInterval), maxBatchInterval);
+}
+
+@end
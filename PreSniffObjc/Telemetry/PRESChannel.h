@@ -10,6 +10,50 @@ NS_ASSUME_NONNULL_BEGIN
 
 FOUNDATION_EXPORT char *PRESSafeJsonEventsString;
 
+/**
+ *  Outcome of enqueuing a telemetry item
+ */
+typedef NS_ENUM(NSInteger, PRESChannelEnqueueResult) {
+    /**
+     *  The item was added to the current batch or the priority lane
+     */
+    PRESChannelEnqueueResultAccepted = 0,
+    /**
+     *  The channel was blocked, the item was stored in the overflow spill
+     */
+    PRESChannelEnqueueResultSpilled = 1,
+    /**
+     *  The item was nil
+     */
+    PRESChannelEnqueueResultDroppedInvalidItem = 2,
+    /**
+     *  The channel was blocked and spilling is disabled
+     */
+    PRESChannelEnqueueResultDroppedChannelBlocked = 3,
+    /**
+     *  The channel was blocked and the overflow spill is full
+     */
+    PRESChannelEnqueueResultDroppedDiskQuota = 4,
+    /**
+     *  The item could not be converted to JSON
+     */
+    PRESChannelEnqueueResultDroppedSerializationFailure = 5
+};
+
+typedef void (^PRESChannelEnqueueCompletion)(PRESChannelEnqueueResult result);
+
+/**
+ *  Keys of the dictionary returned by -[PRESChannel statistics], all values are unsigned 64 bit counters
+ *  since the channel was created.
+ */
+FOUNDATION_EXPORT NSString *const kPRESChannelStatisticsEnqueued;
+FOUNDATION_EXPORT NSString *const kPRESChannelStatisticsAccepted;
+FOUNDATION_EXPORT NSString *const kPRESChannelStatisticsSpilled;
+FOUNDATION_EXPORT NSString *const kPRESChannelStatisticsDroppedInvalidItem;
+FOUNDATION_EXPORT NSString *const kPRESChannelStatisticsDroppedChannelBlocked;
+FOUNDATION_EXPORT NSString *const kPRESChannelStatisticsDroppedDiskQuota;
+FOUNDATION_EXPORT NSString *const kPRESChannelStatisticsDroppedSerializationFailure;
+
 /**
  *  Items get queued before they are persisted and sent out as a batch. This class managed the queue, and forwards the batch
  *  to the persistence layer once the max batch count has been reached.
@@ -28,11 +72,25 @@ FOUNDATION_EXPORT char *PRESSafeJsonEventsString;
 - (instancetype)initWithTelemetryContext:(PRESTelemetryContext *)telemetryContext persistence:(PRESPersistence *) persistence;
 
 /**
- *  Reset PRESSafeJsonEventsString so we can start appending JSON dictionaries.
+ *  Adds the item to the current batch, or to the priority lane for high priority items.
  *
  *  @param item The telemetry object, which should be processed
+ *
+ *  @return PRESChannelEnqueueResultDroppedInvalidItem for nil items, otherwise PRESChannelEnqueueResultAccepted
+ *          as the item is processed asynchronously. Use enqueueTelemetryItem:completion: for the final outcome.
+ */
+- (PRESChannelEnqueueResult)enqueueTelemetryItem:(nullable PRESTelemetryData *)item;
+
+/**
+ *  Same as enqueueTelemetryItem:, the completion is called on the channel's queue with the final outcome.
+ */
+- (PRESChannelEnqueueResult)enqueueTelemetryItem:(nullable PRESTelemetryData *)item completion:(nullable PRESChannelEnqueueCompletion)completion;
+
+/**
+ *  Snapshot of the enqueue counters, see kPRESChannelStatisticsEnqueued and the following keys.
+ *  Priority bundles evicted from a full priority lane are counted as disk quota drops.
  */
-- (void)enqueueTelemetryItem:(PRESTelemetryData *)item;
+- (NSDictionary<NSString *, NSNumber *> *)statistics;
 
 @end
 
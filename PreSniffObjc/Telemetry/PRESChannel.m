@@ -8,14 +8,31 @@
 #import "PRESData.h"
 #import "PRESDevice.h"
 #import "PRESPersistencePrivate.h"
+#import "PRESBatchingPolicy.h"
+#import "PRESOverflowSpill.h"
+#import "PRESConfig.h"
+#import <stdatomic.h>
+#import "PRESStats.h"
+#import "PRESTime.h"
 
 static char *const PRESDataItemsOperationsQueue = "net.hockeyapp.senderQueue";
 char *PRESSafeJsonEventsString;
 
 NSString *const PRESChannelBlockedNotification = @"PRESChannelBlockedNotification";
 
-static NSInteger const PRESDefaultMaxBatchSize  = 50;
-static NSInteger const PRESDefaultBatchInterval = 15;
+NSString *const kPRESChannelStatisticsEnqueued = @"enqueued";
+NSString *const kPRESChannelStatisticsAccepted = @"accepted";
+NSString *const kPRESChannelStatisticsSpilled = @"spilled";
+NSString *const kPRESChannelStatisticsDroppedInvalidItem = @"dropped_invalid_item";
+NSString *const kPRESChannelStatisticsDroppedChannelBlocked = @"dropped_channel_blocked";
+NSString *const kPRESChannelStatisticsDroppedDiskQuota = @"dropped_disk_quota";
+NSString *const kPRESChannelStatisticsDroppedSerializationFailure = @"dropped_serialization_failure";
+
+static NSString *const kPRESOverflowSpillDirectoryName = @"OverflowSpill";
+
+// One counter per PRESChannelEnqueueResult
+#define PRES_CHANNEL_RESULT_COUNT 6
+
 static NSInteger const PRESSchemaVersion = 2;
 
 static NSInteger const PRESDebugMaxBatchSize = 5;
@@ -23,7 +40,10 @@ static NSInteger const PRESDebugBatchInterval = 3;
 
 NS_ASSUME_NONNULL_BEGIN
 
-@implementation PRESChannel
+@implementation PRESChannel {
+    _Atomic uint64_t _enqueuedCount;
+    _Atomic uint64_t _resultCounts[PRES_CHANNEL_RESULT_COUNT];
+}
 
 @synthesize persistence = _persistence;
 @synthesize channelBlocked = _channelBlocked;
@@ -34,12 +54,11 @@ NS_ASSUME_NONNULL_BEGIN
     if (self = [super init]) {
         pres_resetSafeJsonStream(&PRESSafeJsonEventsString);
         _dataItemCount = 0;
+        _dataItemBytes = 0;
         if (pres_isDebuggerAttached()) {
-            _maxBatchSize = PRESDebugMaxBatchSize;
-            _batchInterval = PRESDebugBatchInterval;
+            _batchingPolicy = [[PRESBatchingPolicy alloc] initWithFixedBatchSize:PRESDebugMaxBatchSize batchInterval:PRESDebugBatchInterval];
         } else {
-            _maxBatchSize = PRESDefaultMaxBatchSize;
-            _batchInterval = PRESDefaultBatchInterval;
+            _batchingPolicy = [PRESBatchingPolicy new];
         }
         dispatch_queue_t serialQueue = dispatch_queue_create(PRESDataItemsOperationsQueue, DISPATCH_QUEUE_SERIAL);
         _dataItemsOperations = serialQueue;
@@ -75,8 +94,12 @@ NS_ASSUME_NONNULL_BEGIN
     }
     
     NSData *bundle = [NSData dataWithBytes:PRESSafeJsonEventsString length:strlen(PRESSafeJsonEventsString)];
+    pres_stats_record(PRESStatsHistogramTelemetryBundleBytes, bundle.length);
     [self.persistence persistBundle:bundle];
     
+    self.batchingPolicy.backlogCount = [self.persistence persistedBundleCount] + 1;
+    self.batchingPolicy.backlogCapacity = self.persistence.maxFileCount;
+    
     // Reset both, the async-signal-safe and item counter.
     [self resetQueue];
 }
@@ -84,46 +107,166 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)resetQueue {
     pres_resetSafeJsonStream(&PRESSafeJsonEventsString);
     _dataItemCount = 0;
+    _dataItemBytes = 0;
+}
+
+- (void)updateWithConfig:(PRESConfig *)config {
+    NSUInteger spillBytes = config.telemetryOverflowSpillBytes;
+    dispatch_async(self.dataItemsOperations, ^{
+        if (spillBytes > 0 && !self.overflowSpill) {
+            NSString *directoryPath = [self.persistence.appPreSniffSDKDirectoryPath stringByAppendingPathComponent:kPRESOverflowSpillDirectoryName];
+            self.overflowSpill = [[PRESOverflowSpill alloc] initWithDirectoryPath:directoryPath maxBytes:spillBytes];
+        } else if (spillBytes > 0) {
+            self.overflowSpill.maxBytes = spillBytes;
+        } else if (self.overflowSpill) {
+            // keep what has been spilled already, it is drained once the channel is unblocked
+            self.overflowSpill.maxBytes = 0;
+        }
+    });
+    
+    // keep the small fixed batches while debugging
+    if (pres_isDebuggerAttached()) return;
+    [self.batchingPolicy updateWithConfig:config];
 }
 
 #pragma mark - Adding to queue
 
-- (void)enqueueTelemetryItem:(PRESTelemetryData *)item {
+- (PRESChannelEnqueueResult)enqueueTelemetryItem:(nullable PRESTelemetryData *)item {
+    return [self enqueueTelemetryItem:item completion:nil];
+}
+
+- (PRESChannelEnqueueResult)enqueueTelemetryItem:(nullable PRESTelemetryData *)item completion:(nullable PRESChannelEnqueueCompletion)completion {
+    atomic_fetch_add_explicit(&_enqueuedCount, 1, memory_order_relaxed);
+    pres_stats_add(PRESStatsCounterTelemetryEnqueued, 1);
     
     if (!item) {
         // Case 1: Item is nil: Do not enqueue item and abort operation
         PRESLogWarning(@"WARNING: TelemetryItem was nil.");
-        return;
+        [self recordResult:PRESChannelEnqueueResultDroppedInvalidItem];
+        if (completion) {
+            dispatch_async(self.dataItemsOperations, ^{
+                completion(PRESChannelEnqueueResultDroppedInvalidItem);
+            });
+        }
+        return PRESChannelEnqueueResultDroppedInvalidItem;
     }
     
     __weak typeof(self) weakSelf = self;
     dispatch_async(self.dataItemsOperations, ^{
         typeof(self) strongSelf = weakSelf;
-        
-        if (strongSelf.isQueueBusy) {
-            // Case 2: Channel is in blocked state: Trigger sender, start timer to check after again after a while and abort operation.
-            PRESLogDebug(@"INFO: The channel is saturated. %@ was dropped.", item.debugDescription);
-            if (![strongSelf timerIsRunning]) {
-                [strongSelf startTimer];
-            }
-            return;
+        PRESChannelEnqueueResult result = [strongSelf processTelemetryItem:item];
+        [strongSelf recordResult:result];
+        if (completion) {
+            completion(result);
         }
+    });
+    return PRESChannelEnqueueResultAccepted;
+}
+
+- (PRESChannelEnqueueResult)processTelemetryItem:(PRESTelemetryData *)item {
+    BOOL isNormalPriority = item.priority != PRESTelemetryPriorityHigh;
+    BOOL canSpill = self.overflowSpill && self.overflowSpill.maxBytes > 0;
+    if (isNormalPriority && self.isQueueBusy && !canSpill) {
+        // Case 3a: Channel is in blocked state and there is nowhere to spill: Trigger sender, start timer and drop the item before serializing it.
+        if (![self timerIsRunning]) {
+            [self startTimer];
+        }
+        PRESLogDebug(@"INFO: The channel is saturated. %@ was dropped.", item.debugDescription);
+        return PRESChannelEnqueueResultDroppedChannelBlocked;
+    }
+    
+    uint64_t serializationStart = pres_monotonic_ns();
+    NSString *string = [self serializeDictionaryToJSONString:[self dictionaryForTelemetryData:item]];
+    pres_stats_record(PRESStatsHistogramTelemetrySerializationNs, pres_monotonic_ns() - serializationStart);
+    if (!string) {
+        return PRESChannelEnqueueResultDroppedSerializationFailure;
+    }
+    
+    if (item.priority == PRESTelemetryPriorityHigh) {
+        // Case 2: High priority items skip the batching and go to the reserved lane of the persistence right away.
+        NSData *bundle = [[string stringByAppendingString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding];
+        pres_stats_record(PRESStatsHistogramTelemetryBundleBytes, bundle.length);
+        [self.persistence persistBundle:bundle priority:PRESTelemetryPriorityHigh];
+        return PRESChannelEnqueueResultAccepted;
+    }
+    
+    if (self.isQueueBusy) {
+        // Case 3b: Channel is in blocked state: Trigger sender, start timer to check after again after a while and spill the item.
+        if (![self timerIsRunning]) {
+            [self startTimer];
+        }
+        if (!canSpill) {
+            // became busy while the item was serialized
+            return PRESChannelEnqueueResultDroppedChannelBlocked;
+        }
+        if (![self.overflowSpill appendLine:string]) {
+            PRESLogDebug(@"INFO: The channel is saturated and the overflow spill is full. %@ was dropped.", item.debugDescription);
+            return PRESChannelEnqueueResultDroppedDiskQuota;
+        }
+        return PRESChannelEnqueueResultSpilled;
+    }
+    
+    // Enqueue item
+    [self appendJSONStringToJsonStream:string];
+    
+    if (_dataItemCount >= self.maxBatchSize || _dataItemBytes >= self.batchingPolicy.targetBundleBytes) {
+        // Case 4: Max batch count or size has been reached, so write queue to disk and delete all items.
+        [self persistDataItemQueue];
         
-        // Enqueue item
-        NSDictionary *dict = [self dictionaryForTelemetryData:item];
-        [strongSelf appendDictionaryToJsonStream:dict];
-        
-        if (strongSelf->_dataItemCount >= self.maxBatchSize) {
-            // Case 3: Max batch count has been reached, so write queue to disk and delete all items.
-            [strongSelf persistDataItemQueue];
-            
-        } else if (strongSelf->_dataItemCount == 1) {
-            // Case 4: It is the first item, let's start the timer.
-            if (![strongSelf timerIsRunning]) {
-                [strongSelf startTimer];
-            }
+    } else if (_dataItemCount == 1) {
+        // Case 5: It is the first item, let's start the timer.
+        if (![self timerIsRunning]) {
+            [self startTimer];
         }
-    });
+    }
+    return PRESChannelEnqueueResultAccepted;
+}
+
+/**
+ * Moves spilled items back to the persistence, at most as many chunks as there are free slots.
+ * The slots are counted once, persistBundle: writes asynchronously, so the file count does not
+ * grow while the loop runs.
+ */
+- (void)drainOverflowSpill {
+    if (!self.overflowSpill) return;
+    
+    NSUInteger maxFileCount = self.persistence.maxFileCount;
+    NSUInteger persistedCount = [self.persistence persistedBundleCount];
+    NSUInteger freeSlots = persistedCount < maxFileCount ? maxFileCount - persistedCount : 0;
+    
+    for (NSUInteger i = 0; i < freeSlots; i++) {
+        NSData *chunk = [self.overflowSpill popChunk];
+        if (!chunk) break;
+        [self.persistence persistBundle:chunk];
+    }
+}
+
+#pragma mark - Statistics
+
+- (void)recordResult:(PRESChannelEnqueueResult)result {
+    if (result < 0 || result >= PRES_CHANNEL_RESULT_COUNT) return;
+    atomic_fetch_add_explicit(&_resultCounts[result], 1, memory_order_relaxed);
+    if (result != PRESChannelEnqueueResultAccepted && result != PRESChannelEnqueueResultSpilled) {
+        pres_stats_add(PRESStatsCounterTelemetryDropped, 1);
+    }
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)statistics {
+    uint64_t counts[PRES_CHANNEL_RESULT_COUNT];
+    for (NSUInteger i = 0; i < PRES_CHANNEL_RESULT_COUNT; i++) {
+        counts[i] = atomic_load_explicit(&_resultCounts[i], memory_order_relaxed);
+    }
+    uint64_t evictedPriorityBundles = self.persistence.evictedPriorityBundleCount;
+    
+    return @{
+             kPRESChannelStatisticsEnqueued: @(atomic_load_explicit(&_enqueuedCount, memory_order_relaxed)),
+             kPRESChannelStatisticsAccepted: @(counts[PRESChannelEnqueueResultAccepted]),
+             kPRESChannelStatisticsSpilled: @(counts[PRESChannelEnqueueResultSpilled]),
+             kPRESChannelStatisticsDroppedInvalidItem: @(counts[PRESChannelEnqueueResultDroppedInvalidItem]),
+             kPRESChannelStatisticsDroppedChannelBlocked: @(counts[PRESChannelEnqueueResultDroppedChannelBlocked]),
+             kPRESChannelStatisticsDroppedDiskQuota: @(counts[PRESChannelEnqueueResultDroppedDiskQuota] + evictedPriorityBundles),
+             kPRESChannelStatisticsDroppedSerializationFailure: @(counts[PRESChannelEnqueueResultDroppedSerializationFailure])
+             };
 }
 
 #pragma mark - Envelope telemerty items
@@ -143,7 +286,7 @@ NS_ASSUME_NONNULL_BEGIN
     data.baseType = telemetryData.dataTypeName;
     
     PRESEnvelope *envelope = [PRESEnvelope new];
-    envelope.time = pres_utcDateString([NSDate date]);
+    envelope.time = pres_utcDateStringNow();
     envelope.iKey = _telemetryContext.appIdentifier;
     
     envelope.tags = _telemetryContext.contextDictionary;
@@ -155,12 +298,17 @@ NS_ASSUME_NONNULL_BEGIN
 
 #pragma mark - Serialization Helper
 
-- (NSString *)serializeDictionaryToJSONString:(NSDictionary *)dictionary {
+- (nullable NSString *)serializeDictionaryToJSONString:(NSDictionary *)dictionary {
+    if (!dictionary || ![NSJSONSerialization isValidJSONObject:dictionary]) {
+        PRESLogError(@"ERROR: JSONSerialization error: %@ is not a valid JSON object", dictionary);
+        return nil;
+    }
+    
     NSError *error;
     NSData *data = [NSJSONSerialization dataWithJSONObject:dictionary options:(NSJSONWritingOptions)0 error:&error];
     if (!data) {
         PRESLogError(@"ERROR: JSONSerialization error: %@", error.localizedDescription);
-        return @"{}";
+        return nil;
     } else {
         return [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
     }
@@ -171,14 +319,22 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)appendDictionaryToJsonStream:(NSDictionary *)dictionary {
     if (dictionary) {
         NSString *string = [self serializeDictionaryToJSONString:dictionary];
-        
-        // Since we can't persist every event right away, we write it to a simple C string.
-        // This can then be written to disk by a signal handler in case of a crash.
-        pres_appendStringToSafeJsonStream(string, &(PRESSafeJsonEventsString));
-        _dataItemCount += 1;
+        if (string) {
+            [self appendJSONStringToJsonStream:string];
+        }
     }
 }
 
+- (void)appendJSONStringToJsonStream:(NSString *)string {
+    // Since we can't persist every event right away, we write it to a simple C string.
+    // This can then be written to disk by a signal handler in case of a crash.
+    pres_appendStringToSafeJsonStream(string, &(PRESSafeJsonEventsString));
+    NSUInteger byteCount = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    [self.batchingPolicy recordItemWithByteCount:byteCount];
+    _dataItemCount += 1;
+    _dataItemBytes += byteCount;
+}
+
 void pres_appendStringToSafeJsonStream(NSString *string, char **jsonString) {
     if (jsonString == NULL) { return; }
     
@@ -206,10 +362,11 @@ void pres_resetSafeJsonStream(char **string) {
 #pragma mark - Batching
 
 - (NSUInteger)maxBatchSize {
-    if(_maxBatchSize <= 0){
-        return PRESDefaultMaxBatchSize;
-    }
-    return _maxBatchSize;
+    return [self.batchingPolicy batchSize];
+}
+
+- (NSTimeInterval)batchInterval {
+    return [self.batchingPolicy batchInterval];
 }
 
 - (void)invalidateTimer {
@@ -230,17 +387,19 @@ void pres_resetSafeJsonStream(char **string) {
     }
     
     self.timerSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.dataItemsOperations);
-    dispatch_source_set_timer(self.timerSource, dispatch_walltime(NULL, NSEC_PER_SEC * self.batchInterval), 1ull * NSEC_PER_SEC, 1ull * NSEC_PER_SEC);
+    dispatch_source_set_timer(self.timerSource, dispatch_walltime(NULL, (int64_t)(NSEC_PER_SEC * self.batchInterval)), 1ull * NSEC_PER_SEC, 1ull * NSEC_PER_SEC);
     
     __weak typeof(self) weakSelf = self;
     dispatch_source_set_event_handler(self.timerSource, ^{
         typeof(self) strongSelf = weakSelf;
         
         if(strongSelf) {
+            [strongSelf.overflowSpill flush];
             if (strongSelf->_dataItemCount > 0) {
                 [strongSelf persistDataItemQueue];
             } else {
                 strongSelf.channelBlocked = NO;
+                [strongSelf drainOverflowSpill];
             }
             [strongSelf invalidateTimer];
         }
@@ -3,6 +3,9 @@
 @class PRESTelemetryData;
 @class PRESTelemetryContext;
 @class PRESPersistence;
+@class PRESBatchingPolicy;
+@class PRESConfig;
+@class PRESOverflowSpill;
 
 #import "PRESChannel.h"
 
@@ -27,22 +30,22 @@ FOUNDATION_EXPORT NSString *const PRESChannelBlockedNotification;
  */
 @property (nonatomic, strong) PRESPersistence *persistence;
 
+/**
+ *  Adapts batch size and linger time to the observed traffic. Uses fixed small batches
+ *  while a debugger is attached.
+ */
+@property (nonatomic, strong) PRESBatchingPolicy *batchingPolicy;
+
 /*
- * Threshold for sending data to the server. Default batch size for debugging is 150, for release
- * configuration, the batch size is 5.
- *
- * Default: 50
- *
- * @warning: We advice to not set the batch size below 5 events.
+ * Threshold for persisting the queue, as decided by the batching policy for the current bundle.
  */
-@property (nonatomic) NSUInteger maxBatchSize;
+@property (nonatomic, readonly) NSUInteger maxBatchSize;
 
 /*
- * Interval for sending data to the server in seconds.
- *
- * Default: 15
+ * Interval for persisting the queue in seconds, as decided by the batching policy when the
+ * first item of a bundle is enqueued.
  */
-@property (nonatomic, assign) NSInteger batchInterval;
+@property (nonatomic, readonly) NSTimeInterval batchInterval;
 
 /**
  *  A timer source which is used to flush the queue after a cretain time.
@@ -59,11 +62,28 @@ FOUNDATION_EXPORT NSString *const PRESChannelBlockedNotification;
  */
 @property (nonatomic, assign) NSUInteger dataItemCount;
 
+/**
+ *  The number of UTF-8 bytes in the JSON Stream string.
+ */
+@property (nonatomic, assign) NSUInteger dataItemBytes;
+
+/**
+ *  Side file for items arriving while the channel is blocked, nil unless enabled by the config.
+ *  Only accessed on dataItemsOperations.
+ */
+@property (nonatomic, strong, nullable) PRESOverflowSpill *overflowSpill;
+
 /**
  *  Indicates that channel is currently in a blocked state.
  */
 @property BOOL channelBlocked;
 
+/**
+ *  Applies the overflow spill size and the batching bounds of the config. The batching bounds
+ *  are ignored while a debugger is attached.
+ */
+- (void)updateWithConfig:(PRESConfig *)config;
+
 /**
  *  Manually trigger the PRESChannel to persist all items currently in its data item queue.
  */
@@ -93,7 +113,7 @@ void pres_resetSafeJsonStream(char *__nonnull*__nonnull jsonStream);
 
 /**
  *  A method which indicates whether the telemetry pipeline is busy and no new data should be enqueued.
- *  Currently, we drop telemetry data if this returns YES.
+ *  Currently, we drop normal priority telemetry data if this returns YES, high priority data has its own lane.
  *  This depends on defaultMaxBatchCount and defaultBatchInterval.
  *
  *  @return Returns yes if currently no new data should be enqueued on the channel.
@@ -12,6 +12,11 @@
 #import "PRESPersistence.h"
 #import "PRESBaseManagerPrivate.h"
 #import "PRESSender.h"
+#import "PRESReachability.h"
+#import "PRESConfig.h"
+#import "PRESChannelPrivate.h"
+#import "PRESPersistencePrivate.h"
+#import "PRESStats.h"
 
 NSString *const kPRESApplicationWasLaunched = @"PRESApplicationWasLaunched";
 
@@ -23,10 +28,18 @@ static NSString *const kPRESApplicationDidEnterBackgroundTime = @"PRESApplicatio
 static NSString *const PRESMetricsBaseURLString = @"https://gate.hockeyapp.net/";
 static NSString *const PRESMetricsURLPathString = @"v2/track";
 
+static NSString *const kPRESSDKHealthEventName = @"PRESSDKHealth";
+static const NSTimeInterval kPRESSDKHealthReportInterval = 60 * 60;
+static NSString *const kPRESSDKStatsEventName = @"PRESSDKStats";
+
 @interface PRESMetricsManager ()
 
 @property (nonatomic, strong) id<NSObject> appWillEnterForegroundObserver;
 @property (nonatomic, strong) id<NSObject> appDidEnterBackgroundObserver;
+@property (nonatomic, strong) dispatch_source_t healthReportTimer;
+@property (nonatomic, copy) NSDictionary<NSString *, NSNumber *> *lastReportedStatistics;
+@property (atomic, strong) PRESConfig *config;
+@property (atomic, assign) BOOL sessionSampledOut;
 
 @end
 
@@ -61,14 +74,28 @@ static NSString *const PRESMetricsURLPathString = @"v2/track";
 }
 
 - (void)startManager {
+    [[PRESReachability sharedInstance] startMonitoring];
     self.sender = [[PRESSender alloc] initWithPersistence:self.persistence serverURL:[NSURL URLWithString:self.serverURL]];
+    if (self.config) {
+        [self.sender updateWithConfig:self.config];
+    }
+    [self.persistence deleteBundlesExceedingMaxFileCount];
     [self.sender sendSavedDataAsync];
     [self startNewSessionWithId:pres_UUID()];
     [self registerObservers];
+    [self startHealthReportTimer];
 }
 
 #pragma mark - Configuration
 
+- (void)updateWithConfig:(PRESConfig *)config {
+    self.config = config;
+    [self.channel updateWithConfig:config];
+    self.persistence.maxFileCount = MAX(config.telemetryMaxFileCount, 1U);
+    [self.persistence deleteBundlesExceedingMaxFileCount];
+    [self.sender updateWithConfig:config];
+}
+
 - (void)setDisabled:(BOOL)disabled {
     if (_disabled == disabled) { return; }
     
@@ -139,11 +166,14 @@ static NSString *const PRESMetricsURLPathString = @"v2/track";
 }
 
 - (void)startNewSessionWithId:(NSString *)sessionId {
+    double sampleRate = self.config ? self.config.telemetrySampleRate : 1;
+    self.sessionSampledOut = arc4random_uniform(1000000) >= sampleRate * 1000000;
     PRESSession *newSession = [self createNewSessionWithId:sessionId];
     [self.telemetryContext setSessionId:newSession.sessionId];
     [self.telemetryContext setIsFirstSession:newSession.isFirst];
     [self.telemetryContext setIsNewSession:newSession.isNew];
     [self trackSessionWithState:PRESSessionState_start];
+    [self trackSDKHealth];
 }
 
 - (PRESSession *)createNewSessionWithId:(NSString *)sessionId {
@@ -197,6 +227,10 @@ static NSString *const PRESMetricsURLPathString = @"v2/track";
 }
 
 - (void)trackEventWithName:(nonnull NSString *)eventName properties:(nullable NSDictionary<NSString *, NSString *> *)properties measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements {
+    [self trackEventWithName:eventName properties:properties measurements:measurements priority:PRESTelemetryPriorityNormal];
+}
+
+- (void)trackEventWithName:(nonnull NSString *)eventName properties:(nullable NSDictionary<NSString *, NSString *> *)properties measurements:(nullable NSDictionary<NSString *, NSNumber *> *)measurements priority:(PRESTelemetryPriority)priority {
     if (!eventName) { return; }
     if (self.disabled) {
         PRESLogDebug(@"INFO: PRESMetricsManager is disabled, therefore this tracking call was ignored.");
@@ -210,42 +244,122 @@ static NSString *const PRESMetricsURLPathString = @"v2/track";
         [eventData setName:eventName];
         [eventData setProperties:properties];
         [eventData setMeasurements:measurements];
+        [eventData setPriority:priority];
         [strongSelf trackDataItem:eventData];
     });
 }
 
+#pragma mark SDK health
+
+- (void)startHealthReportTimer {
+    if (self.healthReportTimer) return;
+    
+    self.healthReportTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.metricsEventQueue);
+    uint64_t interval = (uint64_t)(kPRESSDKHealthReportInterval * NSEC_PER_SEC);
+    dispatch_source_set_timer(self.healthReportTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), interval, 60ull * NSEC_PER_SEC);
+    
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(self.healthReportTimer, ^{
+        typeof(self) strongSelf = weakSelf;
+        [strongSelf trackSDKHealth];
+        [strongSelf trackSDKStats];
+    });
+    dispatch_resume(self.healthReportTimer);
+}
+
+- (void)trackSDKHealth {
+    // checked before the baseline moves, a dropped report would lose its deltas for good
+    if (self.disabled) return;
+    
+    NSDictionary<NSString *, NSNumber *> *statistics = [self.channel statistics];
+    NSMutableDictionary<NSString *, NSNumber *> *measurements = [NSMutableDictionary dictionaryWithCapacity:statistics.count];
+    BOOL hasChanges = NO;
+    
+    @synchronized (self) {
+        for (NSString *key in statistics) {
+            uint64_t current = statistics[key].unsignedLongLongValue;
+            uint64_t last = self.lastReportedStatistics[key].unsignedLongLongValue;
+            uint64_t delta = current >= last ? current - last : current;
+            measurements[key] = @(delta);
+            // the health event itself is enqueued and accepted, only report when something went wrong
+            BOOL isTrafficCounter = [key isEqualToString:kPRESChannelStatisticsEnqueued] || [key isEqualToString:kPRESChannelStatisticsAccepted];
+            if (delta > 0 && !isTrafficCounter) {
+                hasChanges = YES;
+            }
+        }
+        if (!hasChanges) return;
+        self.lastReportedStatistics = statistics;
+    }
+    
+    PRESEventData *eventData = [PRESEventData new];
+    [eventData setName:kPRESSDKHealthEventName];
+    [eventData setMeasurements:measurements];
+    [self trackDataItem:eventData sampled:NO];
+}
+
+/**
+ *  Sends the cumulative PRESStats snapshot of this launch, if the config asks for it
+ */
+- (void)trackSDKStats {
+    if (!self.config.telemetrySelfStatsEnabled) return;
+    
+    PRESEventData *eventData = [PRESEventData new];
+    [eventData setName:kPRESSDKStatsEventName];
+    [eventData setMeasurements:pres_stats_snapshot()];
+    [self trackDataItem:eventData sampled:NO];
+}
+
 #pragma mark Track DataItem
 
 - (void)trackDataItem:(PRESTelemetryData *)dataItem {
+    [self trackDataItem:dataItem sampled:YES];
+}
+
+/**
+ *  @param sampled NO for the SDK's own telemetry, it reports deltas and has to reach the server from every session
+ */
+- (void)trackDataItem:(PRESTelemetryData *)dataItem sampled:(BOOL)sampled {
     if (self.disabled) {
         PRESLogDebug(@"INFO: PRESMetricsManager is disabled, therefore this tracking call was ignored.");
         return;
     }
+    if (sampled && self.sessionSampledOut && dataItem.priority != PRESTelemetryPriorityHigh) {
+        return;
+    }
     
     [self.channel enqueueTelemetryItem:dataItem];
 }
 
 #pragma mark - Custom getter
 
+// startManager and updateWithConfig: run on the launch queue while track calls run on metricsEventQueue,
+// the lazy getters are synchronized so both sides end up with the same instances
+
 - (PRESChannel *)channel {
-    if (!_channel) {
-        _channel = [[PRESChannel alloc] initWithTelemetryContext:self.telemetryContext persistence:self.persistence];
+    @synchronized (self) {
+        if (!_channel) {
+            _channel = [[PRESChannel alloc] initWithTelemetryContext:self.telemetryContext persistence:self.persistence];
+        }
+        return _channel;
     }
-    return _channel;
 }
 
 - (PRESTelemetryContext *)telemetryContext {
-    if (!_telemetryContext) {
-        _telemetryContext = [[PRESTelemetryContext alloc] initWithAppIdentifier:self.appIdentifier persistence:self.persistence];
+    @synchronized (self) {
+        if (!_telemetryContext) {
+            _telemetryContext = [[PRESTelemetryContext alloc] initWithAppIdentifier:self.appIdentifier persistence:self.persistence];
+        }
+        return _telemetryContext;
     }
-    return _telemetryContext;
 }
 
 - (PRESPersistence *)persistence {
-    if (!_persistence) {
-        _persistence = [PRESPersistence new];
+    @synchronized (self) {
+        if (!_persistence) {
+            _persistence = [PRESPersistence new];
+        }
+        return _persistence;
     }
-    return _persistence;
 }
 
 - (NSUserDefaults *)userDefaults {
@@ -6,6 +6,7 @@
 @class PRESSession;
 @class PRESPersistence;
 @class PRESSender;
+@class PRESConfig;
 
 #import "PRESNullability.h"
 NS_ASSUME_NONNULL_BEGIN
@@ -114,6 +115,18 @@ FOUNDATION_EXPORT NSString *const kPRESApplicationWasLaunched;
  */
 - (void)trackSessionWithState:(PRESSessionState)state;
 
+/**
+ *  Applies the telemetry part of the config to the channel, persistence and sender while they run.
+ *  The sample rate takes effect with the next session.
+ */
+- (void)updateWithConfig:(PRESConfig *)config;
+
+/**
+ *  Enqueues an event with the channel statistics accumulated since the last report, if items were spilled or dropped.
+ *  Called on every session start and once per hour.
+ */
+- (void)trackSDKHealth;
+
 @end
 
 NS_ASSUME_NONNULL_END
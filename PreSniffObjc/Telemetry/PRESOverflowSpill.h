@@ -0,0 +1,58 @@
+//
+//  PRESOverflowSpill.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 15/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ *  Bounded, compressed side directory for telemetry that arrives while the channel is blocked.
+ *
+ *  Every accepted line is appended to an open segment on disk before appendLine: returns, so
+ *  spilled items survive the app being killed. Once the open segment holds a full chunk it is
+ *  gzip compressed into its own numbered segment file. Popping removes the oldest segment file,
+ *  which keeps draining linear and never hands out the same chunk twice. Admission is decided
+ *  with the worst case compressed size of the open segment, so the directory never grows
+ *  beyond maxBytes. Not thread safe, the channel only uses it on its serial queue.
+ */
+@interface PRESOverflowSpill : NSObject
+
+@property (nonatomic, copy, readonly) NSString *directoryPath;
+@property (nonatomic, assign) NSUInteger maxBytes;
+
+/**
+ *  Bytes of the compressed segments plus the worst case compressed size of the open segment.
+ */
+@property (nonatomic, assign, readonly) NSUInteger usedBytes;
+
+- (instancetype)initWithDirectoryPath:(NSString *)directoryPath maxBytes:(NSUInteger)maxBytes;
+
+/**
+ *  Adds one JSON line and writes it to the open segment.
+ *
+ *  @return NO if the line does not fit into maxBytes anymore or could not be written, it is not
+ *          stored then
+ */
+- (BOOL)appendLine:(NSString *)line;
+
+/**
+ *  Compresses the open segment.
+ */
+- (void)flush;
+
+/**
+ *  Removes the oldest segment from the spill.
+ *
+ *  @return the uncompressed lines of the segment, nil if the spill is empty
+ */
+- (nullable NSData *)popChunk;
+
+@end
+
+NS_ASSUME_NONNULL_END
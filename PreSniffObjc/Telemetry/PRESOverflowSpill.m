@@ -0,0 +1,186 @@
+//
+//  PRESOverflowSpill.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 15/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import "PRESOverflowSpill.h"
+#import "PRESPrivate.h"
+#import "PRESGZIP.h"
+
+// Uncompressed bytes collected in the open segment before it gets compressed
+static NSUInteger const PRESOverflowSpillChunkSize = 16 * 1024;
+
+static NSString *const kPRESOverflowSpillOpenSegment = @"open";
+static NSString *const kPRESOverflowSpillSegmentExtension = @"gz";
+
+/**
+ * Upper bound of a compressed segment on disk: gzip wrapper and the worst case deflate
+ * expansion as in zlib's deflateBound
+ */
+static NSUInteger pres_spillChunkBound(NSUInteger rawLength) {
+    return 18 + rawLength + (rawLength >> 12) + (rawLength >> 14) + (rawLength >> 25) + 13;
+}
+
+@implementation PRESOverflowSpill {
+    // names of the compressed segments, oldest first
+    NSMutableArray<NSString *> *_segments;
+    NSUInteger _segmentBytes;
+    NSUInteger _openBytes;
+    unsigned long long _nextSequence;
+    NSFileHandle *_openHandle;
+}
+
+- (instancetype)initWithDirectoryPath:(NSString *)directoryPath maxBytes:(NSUInteger)maxBytes {
+    if ((self = [super init])) {
+        _directoryPath = [directoryPath copy];
+        _maxBytes = maxBytes;
+        _segments = [NSMutableArray array];
+        [self loadSegments];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_openHandle closeFile];
+}
+
+- (void)loadSegments {
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSError *error = nil;
+    if (![fileManager createDirectoryAtPath:self.directoryPath withIntermediateDirectories:YES attributes:nil error:&error]) {
+        PRESLogError(@"ERROR: Unable to create overflow spill directory: %@", error.localizedDescription);
+        return;
+    }
+    
+    NSArray<NSString *> *names = [[fileManager contentsOfDirectoryAtPath:self.directoryPath error:nil] sortedArrayUsingSelector:@selector(compare:)];
+    for (NSString *name in names) {
+        NSString *path = [self.directoryPath stringByAppendingPathComponent:name];
+        NSUInteger size = (NSUInteger)[[fileManager attributesOfItemAtPath:path error:nil] fileSize];
+        if ([name isEqualToString:kPRESOverflowSpillOpenSegment]) {
+            _openBytes = size;
+        } else if ([name.pathExtension isEqualToString:kPRESOverflowSpillSegmentExtension]) {
+            [_segments addObject:name];
+            _segmentBytes += size;
+            _nextSequence = MAX(_nextSequence, strtoull(name.UTF8String, NULL, 10) + 1);
+        }
+    }
+}
+
+- (NSString *)openSegmentPath {
+    return [self.directoryPath stringByAppendingPathComponent:kPRESOverflowSpillOpenSegment];
+}
+
+- (NSUInteger)usedBytes {
+    return _segmentBytes + (_openBytes > 0 ? pres_spillChunkBound(_openBytes) : 0);
+}
+
+- (BOOL)appendLine:(NSString *)line {
+    NSData *lineData = [[line stringByAppendingString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding];
+    if (!lineData || _segmentBytes + pres_spillChunkBound(_openBytes + lineData.length) > self.maxBytes) {
+        return NO;
+    }
+    
+    if (!_openHandle) {
+        NSString *path = [self openSegmentPath];
+        if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+            [[NSFileManager defaultManager] createFileAtPath:path contents:nil attributes:nil];
+        }
+        _openHandle = [NSFileHandle fileHandleForWritingAtPath:path];
+        if (!_openHandle) {
+            PRESLogError(@"ERROR: Unable to open overflow spill segment %@", path);
+            return NO;
+        }
+    }
+    
+    @try {
+        // truncate a partially written line of an earlier failure
+        [_openHandle truncateFileAtOffset:_openBytes];
+        [_openHandle writeData:lineData];
+    } @catch (NSException *exception) {
+        PRESLogError(@"ERROR: Unable to append to overflow spill segment: %@", exception.reason);
+        [_openHandle closeFile];
+        _openHandle = nil;
+        return NO;
+    }
+    
+    _openBytes += lineData.length;
+    if (_openBytes >= PRESOverflowSpillChunkSize) {
+        [self flush];
+    }
+    return YES;
+}
+
+- (void)flush {
+    if (_openBytes == 0) return;
+    
+    NSData *data = [NSData dataWithContentsOfFile:[self openSegmentPath]];
+    if (data.length == 0) {
+        [self removeOpenSegment];
+        return;
+    }
+    NSData *compressed = [data pres_gzippedData];
+    if (!compressed) {
+        PRESLogError(@"ERROR: Unable to compress %lu spilled bytes", (unsigned long)_openBytes);
+        return;
+    }
+    
+    NSString *name = [NSString stringWithFormat:@"%020llu.%@", _nextSequence, kPRESOverflowSpillSegmentExtension];
+    if (![compressed writeToFile:[self.directoryPath stringByAppendingPathComponent:name] atomically:YES]) {
+        PRESLogError(@"ERROR: Unable to write overflow spill segment %@", name);
+        return;
+    }
+    
+    [self removeOpenSegment];
+    _nextSequence++;
+    [_segments addObject:name];
+    _segmentBytes += compressed.length;
+}
+
+- (NSData *)popChunk {
+    while (_segments.count > 0) {
+        NSString *name = _segments.firstObject;
+        NSString *path = [self.directoryPath stringByAppendingPathComponent:name];
+        NSUInteger size = (NSUInteger)[[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileSize];
+        NSData *chunk = [[NSData dataWithContentsOfFile:path] pres_gunzippedData];
+        
+        // only hand out a segment once it is gone from disk, so it can not be sent twice
+        NSError *error = nil;
+        if (![[NSFileManager defaultManager] removeItemAtPath:path error:&error] && [[NSFileManager defaultManager] fileExistsAtPath:path]) {
+            PRESLogError(@"ERROR: Unable to remove overflow spill segment %@: %@", name, error.localizedDescription);
+            return nil;
+        }
+        [_segments removeObjectAtIndex:0];
+        _segmentBytes = _segmentBytes > size ? _segmentBytes - size : 0;
+        
+        if (chunk) {
+            return chunk;
+        }
+        PRESLogError(@"ERROR: Overflow spill segment %@ is corrupted, discarding it", name);
+    }
+    
+    if (_openBytes == 0) return nil;
+    
+    // not worth compressing, hand the open segment out directly
+    NSData *data = [NSData dataWithContentsOfFile:[self openSegmentPath]];
+    if (![self removeOpenSegment]) return nil;
+    return data.length > 0 ? data : nil;
+}
+
+- (BOOL)removeOpenSegment {
+    [_openHandle closeFile];
+    _openHandle = nil;
+    
+    NSString *path = [self openSegmentPath];
+    NSError *error = nil;
+    if (![[NSFileManager defaultManager] removeItemAtPath:path error:&error] && [[NSFileManager defaultManager] fileExistsAtPath:path]) {
+        PRESLogError(@"ERROR: Unable to remove overflow spill segment: %@", error.localizedDescription);
+        return NO;
+    }
+    _openBytes = 0;
+    return YES;
+}
+
+@end
@@ -3,6 +3,8 @@
 #import "PRESPersistencePrivate.h"
 #import "PRESPrivate.h"
 #import "PRESHelper.h"
+#import "PRESBinaryRecord.h"
+#import <stdatomic.h>
 
 NSString *const PRESPersistenceSuccessNotification = @"PRESPersistenceSuccessNotification";
 
@@ -10,16 +12,40 @@ static NSString *const kPRESTelemetry = @"Telemetry";
 static NSString *const kPRESMetaData = @"MetaData";
 static NSString *const kPRESFileBaseString = @"hockey-app-bundle-";
 static NSString *const kPRESFileBaseStringMeta = @"metadata";
+static NSString *const kPRESSequenceFileName = @"telemetry.sequence";
+static uint8_t const PRESMetaDataRecordVersion = 1;
 
 static NSString *const kPRESDirectory = @"com.microsoft.PreSniff";
 static NSString *const kPRESTelemetryDirectory = @"Telemetry";
+static NSString *const kPRESPriorityTelemetryDirectory = @"PriorityTelemetry";
 static NSString *const kPRESMetaDataDirectory = @"MetaData";
 
 static char const *kPRESPersistenceQueueString = "com.microsoft.PreSniff.persistenceQueue";
 static NSUInteger const PRESDefaultFileCount = 50;
+static NSUInteger const PRESDefaultPriorityFileCount = 20;
+
+// Number of sequence numbers reserved on disk at once, so allocating a file name rarely touches the disk
+static uint64_t const PRESSequenceReservationSize = 64;
+
+/**
+ * @returns the sequence number encoded in a bundle file name, 0 for legacy UUID based names so they are sent first
+ */
+static uint64_t pres_sequenceForBundleFileName(NSString *fileName) {
+    if (![fileName hasPrefix:kPRESFileBaseString]) return 0;
+    
+    const char *digits = [fileName substringFromIndex:kPRESFileBaseString.length].UTF8String;
+    uint64_t sequence = 0;
+    for (const char *c = digits; c && *c; c++) {
+        if (*c < '0' || *c > '9') return 0;
+        sequence = sequence * 10 + (uint64_t)(*c - '0');
+    }
+    return sequence;
+}
 
 @implementation PRESPersistence {
     BOOL _directorySetupComplete;
+    _Atomic uint64_t _nextSequence;
+    uint64_t _reservedSequence;
 }
 
 #pragma mark - Public
@@ -30,11 +56,13 @@ static NSUInteger const PRESDefaultFileCount = 50;
         _persistenceQueue = dispatch_queue_create(kPRESPersistenceQueueString, DISPATCH_QUEUE_SERIAL); //TODO several queues?
         _requestedBundlePaths = [NSMutableArray new];
         _maxFileCount = PRESDefaultFileCount;
+        _maxPriorityFileCount = PRESDefaultPriorityFileCount;
         
         // Evantually, there will be old files on disk, the flag will be updated before the first event gets created
         _directorySetupComplete = NO; //will be set to true in createDirectoryStructureIfNeeded
         
         [self createDirectoryStructureIfNeeded];
+        [self loadSequence];
     }
     return self;
 }
@@ -44,13 +72,21 @@ static NSUInteger const PRESDefaultFileCount = 50;
  * Sends out a PRESPersistenceSuccessNotification in case of success
  */
 - (void)persistBundle:(NSData *)bundle {
+    [self persistBundle:bundle priority:PRESTelemetryPriorityNormal];
+}
+
+- (void)persistBundle:(NSData *)bundle priority:(PRESTelemetryPriority)priority {
     //TODO send out a fail notification?
-    NSString *fileURL = [self fileURLForType:PRESPersistenceTypeTelemetry];
+    PRESPersistenceType type = priority == PRESTelemetryPriorityHigh ? PRESPersistenceTypePriorityTelemetry : PRESPersistenceTypeTelemetry;
+    NSString *fileURL = [self fileURLForType:type];
     
     if (bundle) {
         __weak typeof(self) weakSelf = self;
         dispatch_async(self.persistenceQueue, ^{
             typeof(self) strongSelf = weakSelf;
+            if (type == PRESPersistenceTypePriorityTelemetry) {
+                [strongSelf makeRoomInPriorityLane];
+            }
             BOOL success = [bundle writeToFile:fileURL atomically:YES];
             if (success) {
                 PRESLogDebug(@"INFO: Wrote bundle to %@", fileURL);
@@ -66,17 +102,23 @@ static NSUInteger const PRESDefaultFileCount = 50;
     }
 }
 
-- (void)persistMetaData:(NSDictionary *)metaData {
+- (void)persistMetaData:(NSDictionary<NSString *, NSString *> *)metaData {
     NSString *fileURL = [self fileURLForType:PRESPersistenceTypeMetaData];
+    NSData *data = pres_encodeBinaryRecord(metaData, PRESMetaDataRecordVersion);
     //TODO send out a notification, too?!
     dispatch_async(self.persistenceQueue, ^{
-        [NSKeyedArchiver archiveRootObject:metaData toFile:fileURL];
+        if (![data writeToFile:fileURL atomically:YES]) {
+            PRESLogError(@"Error writing meta data to %@", fileURL);
+        }
     });
 }
 
 - (BOOL)isFreeSpaceAvailable {
-    NSArray *files = [self persistedFilesForType:PRESPersistenceTypeTelemetry];
-    return files.count < _maxFileCount;
+    return [self persistedBundleCount] < _maxFileCount;
+}
+
+- (NSUInteger)persistedBundleCount {
+    return [self persistedFilesForType:PRESPersistenceTypeTelemetry].count;
 }
 
 - (NSString *)requestNextFilePath {
@@ -85,7 +127,8 @@ static NSUInteger const PRESDefaultFileCount = 50;
     dispatch_sync(self.persistenceQueue, ^() {
         typeof(self) strongSelf = weakSelf;
         
-        path = [strongSelf nextURLOfType:PRESPersistenceTypeTelemetry];
+        // the priority lane is always drained first
+        path = [strongSelf nextURLOfType:PRESPersistenceTypePriorityTelemetry] ?: [strongSelf nextURLOfType:PRESPersistenceTypeTelemetry];
         
         if (path) {
             [self.requestedBundlePaths addObject:path];
@@ -96,7 +139,14 @@ static NSUInteger const PRESDefaultFileCount = 50;
 
 - (NSDictionary *)metaData {
     NSString *filePath = [self fileURLForType:PRESPersistenceTypeMetaData];
-    NSObject *bundle = [self bundleAtFilePath:filePath withFileBaseString:kPRESFileBaseStringMeta];
+    NSData *data = [NSData dataWithContentsOfFile:filePath];
+    NSDictionary *metaData = data ? pres_decodeBinaryRecord(data, NULL) : nil;
+    if (metaData) {
+        return metaData;
+    }
+    
+    // Files written by older SDK versions are keyed archives
+    NSObject *bundle = data ? [self bundleAtFilePath:filePath withFileBaseString:kPRESFileBaseStringMeta] : nil;
     if ([bundle isKindOfClass:NSDictionary.class]) {
         return (NSDictionary *) bundle;
     }
@@ -154,6 +204,17 @@ static NSUInteger const PRESDefaultFileCount = 50;
     });
 }
 
+- (void)markFilePathRequested:(NSString *)filePath {
+    __weak typeof(self) weakSelf = self;
+    dispatch_async(self.persistenceQueue, ^() {
+        typeof(self) strongSelf = weakSelf;
+        
+        if (![strongSelf.requestedBundlePaths containsObject:filePath]) {
+            [strongSelf.requestedBundlePaths addObject:filePath];
+        }
+    });
+}
+
 #pragma mark - Private
 
 - (nullable NSString *)fileURLForType:(PRESPersistenceType)type {
@@ -168,9 +229,9 @@ static NSUInteger const PRESDefaultFileCount = 50;
             break;
         };
         default: {
-            NSString *uuid = pres_UUID();
-            fileName = [NSString stringWithFormat:@"%@%@", kPRESFileBaseString, uuid];
-            filePath = [self.appPreSniffSDKDirectoryPath stringByAppendingPathComponent:kPRESTelemetryDirectory];
+            // Zero padded, so the names sort in the order the bundles were created
+            fileName = [NSString stringWithFormat:@"%@%020llu", kPRESFileBaseString, [self allocateSequence]];
+            filePath = [self folderPathForType:type];
             break;
         };
     }
@@ -180,6 +241,53 @@ static NSUInteger const PRESDefaultFileCount = 50;
     return filePath;
 }
 
+- (NSString *)sequenceFilePath {
+    return [self.appPreSniffSDKDirectoryPath stringByAppendingPathComponent:kPRESSequenceFileName];
+}
+
+/**
+ * Continues after the persisted reservation or the newest bundle on disk, whichever is higher
+ */
+- (void)loadSequence {
+    uint64_t nextSequence = 1;
+    
+    NSData *data = [NSData dataWithContentsOfFile:[self sequenceFilePath]];
+    if (data.length == sizeof(uint64_t)) {
+        uint64_t persistedSequence = 0;
+        [data getBytes:&persistedSequence length:sizeof(persistedSequence)];
+        nextSequence = MAX(nextSequence, CFSwapInt64LittleToHost(persistedSequence));
+    }
+    
+    NSMutableArray<NSURL *> *fileURLs = [NSMutableArray array];
+    [fileURLs addObjectsFromArray:[self persistedFilesForType:PRESPersistenceTypeTelemetry] ?: @[]];
+    [fileURLs addObjectsFromArray:[self persistedFilesForType:PRESPersistenceTypePriorityTelemetry] ?: @[]];
+    for (NSURL *fileURL in fileURLs) {
+        uint64_t sequence = pres_sequenceForBundleFileName(fileURL.lastPathComponent);
+        if (sequence >= nextSequence) {
+            nextSequence = sequence + 1;
+        }
+    }
+    
+    _reservedSequence = nextSequence;
+    atomic_store(&_nextSequence, nextSequence);
+}
+
+- (uint64_t)allocateSequence {
+    uint64_t sequence = atomic_fetch_add(&_nextSequence, 1);
+    
+    @synchronized (self) {
+        if (sequence >= _reservedSequence) {
+            _reservedSequence = sequence + PRESSequenceReservationSize;
+            uint64_t reservedSequence = CFSwapInt64HostToLittle(_reservedSequence);
+            NSData *data = [NSData dataWithBytes:&reservedSequence length:sizeof(reservedSequence)];
+            if (![data writeToFile:[self sequenceFilePath] atomically:YES]) {
+                PRESLogWarning(@"WARNING: Unable to persist the telemetry sequence number");
+            }
+        }
+    }
+    return sequence;
+}
+
 /**
  * Create directory structure if necessary and exclude it from iCloud backup
  */
@@ -215,6 +323,13 @@ static NSUInteger const PRESDefaultFileCount = 50;
             return;
         }
         
+        // Create priority telemetry subfolder
+        NSURL *priorityTelemetryURL = [appURL URLByAppendingPathComponent:kPRESPriorityTelemetryDirectory];
+        if (![fileManager createDirectoryAtURL:priorityTelemetryURL withIntermediateDirectories:YES attributes:nil error:&error]) {
+            PRESLogError(@"ERROR: %@", error.localizedDescription);
+            return;
+        }
+        
         //Exclude PreSniffSDK folder from backup
         if (![appURL setResourceValue:@YES
                                forKey:NSURLIsExcludedFromBackupKey
@@ -232,7 +347,7 @@ static NSUInteger const PRESDefaultFileCount = 50;
  * @returns the URL to the next file depending on the specified type. If there's no file, return nil.
  */
 - (NSString *)nextURLOfType:(PRESPersistenceType)type {
-    NSArray<NSURL *> *fileNames = [self persistedFilesForType:type];
+    NSArray<NSURL *> *fileNames = [self sortedPersistedFilesForType:type];
     if (fileNames && fileNames.count > 0) {
         for (NSURL *filename in fileNames) {
             NSString *absolutePath = filename.path;
@@ -254,6 +369,68 @@ static NSUInteger const PRESDefaultFileCount = 50;
     return fileNames;
 }
 
+/**
+ * @returns the persisted files ordered by sequence number, oldest first
+ */
+- (NSArray<NSURL *> *)sortedPersistedFilesForType:(PRESPersistenceType)type {
+    return [[self persistedFilesForType:type] sortedArrayUsingComparator:^NSComparisonResult(NSURL *url1, NSURL *url2) {
+        uint64_t sequence1 = pres_sequenceForBundleFileName(url1.lastPathComponent);
+        uint64_t sequence2 = pres_sequenceForBundleFileName(url2.lastPathComponent);
+        if (sequence1 < sequence2) return NSOrderedAscending;
+        if (sequence1 > sequence2) return NSOrderedDescending;
+        return NSOrderedSame;
+    }];
+}
+
+/**
+ * Deletes the oldest priority bundles which are not being sent until there is room for one more
+ */
+- (void)makeRoomInPriorityLane {
+    NSArray<NSURL *> *fileURLs = [self sortedPersistedFilesForType:PRESPersistenceTypePriorityTelemetry];
+    NSUInteger count = fileURLs.count;
+    for (NSURL *fileURL in fileURLs) {
+        if (count < self.maxPriorityFileCount) break;
+        if ([self.requestedBundlePaths containsObject:fileURL.path]) continue;
+        
+        if ([[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil]) {
+            count--;
+            self.evictedPriorityBundleCount += 1;
+            PRESLogWarning(@"WARNING: Priority lane is full, evicted %@", fileURL.lastPathComponent);
+        }
+    }
+}
+
+- (void)deleteBundlesBeforeSequence:(uint64_t)sequence {
+    __weak typeof(self) weakSelf = self;
+    dispatch_async(self.persistenceQueue, ^() {
+        typeof(self) strongSelf = weakSelf;
+        for (NSURL *fileURL in [strongSelf sortedPersistedFilesForType:PRESPersistenceTypeTelemetry]) {
+            if (pres_sequenceForBundleFileName(fileURL.lastPathComponent) >= sequence) break;
+            if ([strongSelf.requestedBundlePaths containsObject:fileURL.path]) continue;
+            
+            NSError *error = nil;
+            if (![[NSFileManager defaultManager] removeItemAtURL:fileURL error:&error]) {
+                PRESLogError(@"Error deleting file at path %@", fileURL.path);
+            }
+        }
+    });
+}
+
+- (void)deleteBundlesExceedingMaxFileCount {
+    __weak typeof(self) weakSelf = self;
+    dispatch_async(self.persistenceQueue, ^() {
+        typeof(self) strongSelf = weakSelf;
+        NSArray<NSURL *> *fileURLs = [strongSelf sortedPersistedFilesForType:PRESPersistenceTypeTelemetry];
+        NSUInteger maxFileCount = strongSelf.maxFileCount;
+        if (fileURLs.count <= maxFileCount) return;
+        
+        // the oldest bundle to keep, everything with a lower sequence number goes
+        uint64_t sequence = pres_sequenceForBundleFileName(fileURLs[fileURLs.count - maxFileCount].lastPathComponent);
+        PRESLogWarning(@"WARNING: %lu telemetry bundles on disk, deleting the oldest to keep %lu", (unsigned long)fileURLs.count, (unsigned long)maxFileCount);
+        [strongSelf deleteBundlesBeforeSequence:sequence];
+    });
+}
+
 - (NSString *)folderPathForType:(PRESPersistenceType)type {
     NSString *subFolder = @"";
     switch (type) {
@@ -265,6 +442,10 @@ static NSUInteger const PRESDefaultFileCount = 50;
             subFolder = kPRESMetaDataDirectory;
             break;
         }
+        case PRESPersistenceTypePriorityTelemetry: {
+            subFolder = kPRESPriorityTelemetryDirectory;
+            break;
+        }
     }
     return [self.appPreSniffSDKDirectoryPath stringByAppendingPathComponent:subFolder];
 }
@@ -1,4 +1,5 @@
 #import "PRESPersistence.h"
+#import "PRESEnums.h"
 
 #import "PRESNullability.h"
 NS_ASSUME_NONNULL_BEGIN
@@ -10,7 +11,8 @@ NS_ASSUME_NONNULL_BEGIN
  */
 typedef NS_ENUM(NSInteger, PRESPersistenceType) {
     PRESPersistenceTypeTelemetry = 0,
-    PRESPersistenceTypeMetaData = 1
+    PRESPersistenceTypeMetaData = 1,
+    PRESPersistenceTypePriorityTelemetry = 2
 };
 
 /**
@@ -31,7 +33,18 @@ FOUNDATION_EXPORT NSString *const PRESPersistenceSuccessNotification;
 /**
  *  Determines how many telemetry files can be on disk at a time.
  */
-@property (nonatomic, assign) NSUInteger maxFileCount;
+@property (atomic, assign) NSUInteger maxFileCount;
+
+/**
+ *  Determines how many high priority telemetry files can be on disk at a time. The priority lane
+ *  has its own quota, so bulk data can't take its space.
+ */
+@property (nonatomic, assign) NSUInteger maxPriorityFileCount;
+
+/**
+ *  Number of high priority bundles deleted unsent because the priority lane was full.
+ */
+@property (atomic, assign) NSUInteger evictedPriorityBundleCount;
 
 @property (nonatomic, strong) NSString *appPreSniffSDKDirectoryPath;
 
@@ -51,11 +64,20 @@ FOUNDATION_EXPORT NSString *const PRESPersistenceSuccessNotification;
 - (void)persistBundle:(NSData *)bundle;
 
 /**
- *  Saves the given dictionary to the session Ids file.
+ *  Saves the bundle to the lane of the given priority. When the priority lane is full, its
+ *  oldest bundle is deleted to make room.
  *
- *  @param metaData a dictionary consisting of unix timestamps and session ids
+ *  @param bundle            the bundle, which should be saved to disk
+ *  @param priority          the lane
  */
-- (void)persistMetaData:(NSDictionary *)metaData;
+- (void)persistBundle:(NSData *)bundle priority:(PRESTelemetryPriority)priority;
+
+/**
+ *  Saves the given dictionary to the meta data file as compact binary record.
+ *
+ *  @param metaData a flat dictionary of string keys and values
+ */
+- (void)persistMetaData:(NSDictionary<NSString *, NSString *> *)metaData;
 
 /**
  *  Deletes the file for the given path.
@@ -64,6 +86,20 @@ FOUNDATION_EXPORT NSString *const PRESPersistenceSuccessNotification;
  */
 - (void)deleteFileAtPath:(NSString *)path;
 
+/**
+ *  Deletes all telemetry bundles that were created before the bundle with the given sequence
+ *  number. Bundles currently requested by the sender are kept.
+ *
+ *  @param sequence the sequence number of the oldest bundle to keep
+ */
+- (void)deleteBundlesBeforeSequence:(uint64_t)sequence;
+
+/**
+ *  Retention: deletes the oldest telemetry bundles until no more than maxFileCount are left,
+ *  e.g. after the config lowered the limit or a previous SDK version left more files behind.
+ */
+- (void)deleteBundlesExceedingMaxFileCount;
+
 /**
  *  Determines whether the persistence layer is able to write more files to disk.
  *
@@ -71,13 +107,19 @@ FOUNDATION_EXPORT NSString *const PRESPersistenceSuccessNotification;
  */
 - (BOOL)isFreeSpaceAvailable;
 
+/**
+ *  Returns the number of normal priority telemetry bundles on disk, including bundles which are
+ *  currently being sent.
+ */
+- (NSUInteger)persistedBundleCount;
+
 ///-----------------------------------------------------------------------------
 /// @name Get a bundle of saved data
 ///-----------------------------------------------------------------------------
 
 /**
- *  Returns the path for the next item to send. The requested path is reserved as long
- *  as leaveUpRequestedPath: gets called.
+ *  Returns the path for the next item to send, bundles of the priority lane come first. The
+ *  requested path is reserved as long as leaveUpRequestedPath: gets called.
  *
  *  @see giveBackRequestedPath:
  *
@@ -92,6 +134,14 @@ FOUNDATION_EXPORT NSString *const PRESPersistenceSuccessNotification;
  */
 - (void)giveBackRequestedFilePath:(NSString *)filePath;
 
+/**
+ *  Marks a path as requested without handing it out, e.g. for uploads that a background URL session
+ *  still runs from a previous launch. Give it back or delete it like any requested path.
+ *
+ *  @param filePath the path that must not be sent again for now
+ */
+- (void)markFilePathRequested:(NSString *)filePath;
+
 /**
  *  Return the json data for a given path
  *
@@ -102,9 +152,10 @@ FOUNDATION_EXPORT NSString *const PRESPersistenceSuccessNotification;
 - (nullable NSData *)dataAtFilePath:(NSString *)filePath;
 
 /**
- *  Returns the content of the session Ids file.
+ *  Returns the content of the meta data file. Files written by older SDK versions
+ *  are keyed archives and may contain objects instead of strings.
  *
- *  @return return a dictionary containing all session Ids
+ *  @return return a dictionary containing the meta data
  */
 - (NSDictionary *)metaData;
 
@@ -125,7 +176,8 @@ FOUNDATION_EXPORT NSString *const PRESPersistenceSuccessNotification;
 
 /**
  * Creates the path for a file
- * The filename includes the timestamp.
+ * Telemetry file names include a monotonically increasing, zero padded sequence number,
+ * which is persisted across launches, so sorting by name gives the creation order.
  *
  * @param type that you want the fileURL for
  */
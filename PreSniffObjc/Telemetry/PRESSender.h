@@ -2,6 +2,9 @@
 #import "PreSniffObjc.h"
 
 @class PRESPersistence;
+@class PRESUploadScheduler;
+@class PRESBackoffPolicy;
+@class PRESConfig;
 
 #import "PRESNullability.h"
 NS_ASSUME_NONNULL_BEGIN
@@ -15,6 +18,17 @@ NS_ASSUME_NONNULL_BEGIN
 /// @name Initialize instance
 ///-----------------------------------------------------------------------------
 
+/**
+ *  Returns YES if the identifier belongs to the background URL session of the sender.
+ */
++ (BOOL)isBackgroundSessionIdentifier:(NSString *)identifier;
+
+/**
+ *  Keeps the completion handler the app delegate got for the background URL session. It is
+ *  called on the main queue once the session delivered all its events.
+ */
++ (void)setBackgroundSessionCompletionHandler:(nullable void (^)(void))completionHandler;
+
 /**
  *  Initializes a sender instance with a given persistence object.
  *
@@ -25,34 +39,39 @@ NS_ASSUME_NONNULL_BEGIN
 - (instancetype)initWithPersistence:(PRESPersistence *)persistence serverURL:(NSURL *)serverURL;
 
 /**
- * We use this queue to keep track of the number of currently running requests
+ *  A queue which is used to schedule sending and handle the responses.
  */
-@property (nonatomic, strong) dispatch_queue_t requestsCountQueue;
+@property (nonatomic, strong) dispatch_queue_t senderTasksQueue;
 
 /**
- *  A queue which is used to handle PRESHTTPOperation completion blocks.
+ *  The endpoint url of the telemetry server.
  */
-@property (nonatomic, strong) dispatch_queue_t senderTasksQueue;
+@property (nonatomic, copy) NSString *endpointPath;
 
 /**
- *  A queue for processing http operations (iOS < 7)
+ *  The max number of request that can run at a time.
  */
-@property (nonatomic, strong) NSOperationQueue *operationQueue;
+@property (atomic, assign) NSUInteger maxRequestCount;
 
 /**
- *  The endpoint url of the telemetry server.
+ *  The number of requests that are currently running.
  */
-@property (nonatomic, copy) NSString *endpointPath;
+@property (nonatomic, assign, readonly) NSUInteger runningRequestsCount;
 
 /**
- *  The max number of request that can run at a time.
+ *  Paths of the bundles which are currently being sent, one per running request or background upload.
  */
-@property (nonatomic, assign) NSUInteger maxRequestCount;
+- (NSArray<NSString *> *)inFlightFilePaths;
 
 /**
- *  The number of requests that are currently running.
+ *  Decides whether pending bundles are sent now, later or via the background URL session.
+ */
+@property (nonatomic, strong) PRESUploadScheduler *scheduler;
+
+/**
+ *  Retry state of the endpoint, persisted next to the telemetry bundles.
  */
-@property (nonatomic, assign) NSUInteger runningRequestsCount;
+@property (nonatomic, strong) PRESBackoffPolicy *backoffPolicy;
 
 /**
  *	BaseURL to which relative paths are appended.
@@ -81,19 +100,33 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)sendSavedDataAsync;
 
+/**
+ *  Applies the request limit of the config to the running sender.
+ */
+- (void)updateWithConfig:(PRESConfig *)config;
+
 /**
  *  Triggers sending the saved data.
  */
 - (void)sendSavedData;
 
 /**
- *  Creates a HTTP operation/session task and puts it to the queue.
+ *  Hands the request to the shared PRESTransport.
  *
  *  @param request a request for sending a data object to the telemetry server
  *  @param path path to the file which should be sent
  */
 - (void)sendRequest:(NSURLRequest *)request filePath:(NSString *)path;
 
+/**
+ *  Uploads the request body from a temporary file with the background URL session, so the
+ *  system can run the upload while the app is suspended and pick a good time for it.
+ *
+ *  @param request a request for sending a data object to the telemetry server
+ *  @param filePath path to the file which should be sent
+ */
+- (void)sendUsingBackgroundSessionWithRequest:(NSURLRequest *)request filePath:(NSString *)filePath;
+
 /**
  * Helper method that checks whether the current OS supports NSURLSession
  *
@@ -101,26 +134,27 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (BOOL)isURLSessionSupported;
 
-- (void)sendUsingURLSessionWithRequest:(NSURLRequest *)request filePath:(NSString *)filePath;
-
-- (void)sendUsingURLConnectionWithRequest:(NSURLRequest *)request filePath:(NSString *)filePath;
+- (void)sendUsingTransportWithRequest:(NSURLRequest *)request filePath:(NSString *)filePath;
 
 /**
- *  Resumes the given NSURLSessionDataTask instance.
+ *  Deletes or unblocks sent file according to the given response code.
  *
- *  @param sessionDataTask the task which should be resumed
+ *  @param statusCode the status code of the response
+ *  @param responseData the data of the response
+ *  @param filePath the path of the file which content has been sent to the server
+ *  @param error an error object sent from the server
  */
-- (void)resumeSessionDataTask:(NSURLSessionDataTask *)sessionDataTask;
+- (void)handleResponseWithStatusCode:(NSInteger)statusCode responseData:(NSData *)responseData filePath:(NSString *)filePath error:(NSError *)error;
 
 /**
- *  Deletes or unblocks sent file according to the given response code.
+ *  Same as handleResponseWithStatusCode:responseData:filePath:error:, honoring the Retry-After header of the response.
  *
- *  @param statusCode the status code of the response
+ *  @param response the response, nil if the request failed before a response arrived
  *  @param responseData the data of the response
  *  @param filePath the path of the file which content has been sent to the server
  *  @param error an error object sent from the server
  */
-- (void)handleResponseWithStatusCode:(NSInteger)statusCode responseData:(NSData *)responseData filePath:(NSString *)filePath error:(NSError *)error;
+- (void)handleResponse:(nullable NSHTTPURLResponse *)response responseData:(nullable NSData *)responseData filePath:(NSString *)filePath error:(nullable NSError *)error;
 
 ///-----------------------------------------------------------------------------
 /// @name Helper
@@ -1,40 +1,127 @@
 #import "PRESSender.h"
 #import "PRESPersistencePrivate.h"
 #import "PRESChannelPrivate.h"
-#import "PRESGZIP.h"
 #import "PRESPrivate.h"
-#import "PRESHTTPOperation.h"
+#import "PRESTransport.h"
+#import "PRESBatchUploader.h"
 #import "PRESHelper.h"
+#import "PRESUploadScheduler.h"
+#import "PRESBackoffPolicy.h"
+#import "PRESTime.h"
+#import "PRESConfig.h"
+#import "PRESStats.h"
+#import <stdatomic.h>
 
 static char const *kPRESSenderTasksQueueString = "net.hockeyapp.sender.tasksQueue";
-static char const *kPRESSenderRequestsCountQueueString = "net.hockeyapp.sender.requestsCount";
 static NSUInteger const PRESDefaultRequestLimit = 10;
+static NSString *const kPRESSenderBackgroundSessionIdentifier = @"net.hockeyapp.sender.background";
+static NSString *const kPRESSenderUploadFileExtension = @"upload";
+static NSString *const kPRESSenderBackoffFileName = @"sender.backoff";
 
-@interface PRESSender ()
+// Data task leases older than this lost their completion, background uploads may legitimately take longer
+static NSTimeInterval const PRESSenderStaleLeaseInterval = 5 * 60;
 
-@property (nonatomic, strong) NSURLSession *session;
+/**
+ *  Ties an in-flight slot to the bundle it carries. Background uploads are leased without a slot,
+ *  the system may hold them back for hours.
+ */
+@interface PRESUploadLease : NSObject
 
+@property (nonatomic, copy) NSString *filePath;
+// 0 while the data task still waits in the transport
+@property (nonatomic, assign) NSTimeInterval startTime;
+@property (nonatomic, assign) BOOL background;
+
+@end
+
+@implementation PRESUploadLease
 @end
 
-@implementation PRESSender
+@interface PRESSender () <NSURLSessionDataDelegate, PRESBatchChunkSource>
+
+@property (nonatomic, strong) NSURLSession *backgroundSession;
+
+/**
+ *  Response bodies of running background uploads, keyed by task identifier.
+ */
+@property (nonatomic, strong) NSMutableDictionary<NSNumber *, NSMutableData *> *backgroundResponseData;
+@property (nonatomic, assign) BOOL deferredSendScheduled;
+
+/**
+ *  Set until the uploads a background session still runs from a previous launch are leased again,
+ *  no bundle is handed out meanwhile so none of them is sent twice.
+ */
+@property (atomic, assign) BOOL restoringBackgroundUploads;
+@property (nonatomic, copy) NSString *endpointKey;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, PRESUploadLease *> *leases;
+
+@end
+
+@implementation PRESSender {
+    _Atomic(NSUInteger) _inFlightCount;
+}
 
-@synthesize runningRequestsCount = _runningRequestsCount;
 @synthesize persistence = _persistence;
 
+static void (^PRESSenderBackgroundSessionCompletionHandler)(void);
+
+static NSString *pres_backgroundSessionIdentifier(void) {
+    return [NSString stringWithFormat:@"%@.%@", kPRESSenderBackgroundSessionIdentifier, [NSBundle mainBundle].bundleIdentifier ?: @""];
+}
+
+#pragma mark - Background session events
+
++ (BOOL)isBackgroundSessionIdentifier:(NSString *)identifier {
+    return [identifier isEqualToString:pres_backgroundSessionIdentifier()];
+}
+
++ (void)setBackgroundSessionCompletionHandler:(void (^)(void))completionHandler {
+    @synchronized(self){
+        PRESSenderBackgroundSessionCompletionHandler = [completionHandler copy];
+    }
+}
+
 #pragma mark - Initialize instance
 
 - (instancetype)initWithPersistence:(nonnull PRESPersistence *)persistence serverURL:(nonnull NSURL *)serverURL {
     if ((self = [super init])) {
-        _requestsCountQueue = dispatch_queue_create(kPRESSenderRequestsCountQueueString, DISPATCH_QUEUE_CONCURRENT);
+        _leases = [NSMutableDictionary new];
         _senderTasksQueue = dispatch_queue_create(kPRESSenderTasksQueueString, DISPATCH_QUEUE_CONCURRENT);
         _maxRequestCount = PRESDefaultRequestLimit;
         _serverURL = serverURL;
         _persistence = persistence;
+        _scheduler = [PRESUploadScheduler new];
+        _scheduler.maxConcurrentRequests = PRESDefaultRequestLimit;
+        _backgroundResponseData = [NSMutableDictionary new];
+        _backoffPolicy = [[PRESBackoffPolicy alloc] initWithFilePath:[persistence.appPreSniffSDKDirectoryPath stringByAppendingPathComponent:kPRESSenderBackoffFileName]];
+        _endpointKey = [NSString stringWithFormat:@"%@%@", serverURL.host ?: @"", serverURL.path ?: @""];
         [self registerObservers];
+        [self restoreBackgroundUploads];
+        [[PRESBatchUploader sharedUploader] addSource:self];
     }
     return self;
 }
 
+- (void)restoreBackgroundUploads {
+    if (![self isURLSessionSupported]) return;
+    
+    // recreating the session with its identifier reconnects the uploads of a previous launch to this delegate
+    self.restoringBackgroundUploads = YES;
+    __weak typeof(self) weakSelf = self;
+    [self.backgroundSession getTasksWithCompletionHandler:^(NSArray *dataTasks, NSArray *uploadTasks, NSArray *downloadTasks) {
+        typeof(self) strongSelf = weakSelf;
+        for (NSURLSessionTask *task in uploadTasks) {
+            NSString *filePath = task.taskDescription;
+            if (!filePath || task.state == NSURLSessionTaskStateCompleted) continue;
+            
+            [strongSelf.persistence markFilePathRequested:filePath];
+            [strongSelf leaseSlotForFilePath:filePath background:YES];
+        }
+        strongSelf.restoringBackgroundUploads = NO;
+        [strongSelf sendSavedDataAsync];
+    }];
+}
+
 #pragma mark - Handle persistence events
 
 - (void)registerObservers {
@@ -56,10 +143,28 @@ static NSUInteger const PRESDefaultRequestLimit = 10;
                         typeof(self) strongSelf = weakSelf;
                         [strongSelf sendSavedDataAsync];
                     }];
+    
+    [center addObserverForName:PRESNetworkDidBecomeReachableNotification
+                        object:nil
+                         queue:nil
+                    usingBlock:^(NSNotification *notification) {
+                        typeof(self) strongSelf = weakSelf;
+                        [strongSelf sendSavedDataAsync];
+                    }];
 }
 
 #pragma mark - Sending
 
+- (void)updateWithConfig:(PRESConfig *)config {
+    NSUInteger requestLimit = MAX(config.telemetryRequestLimit, 1U);
+    if (requestLimit == self.maxRequestCount) return;
+    
+    self.maxRequestCount = requestLimit;
+    self.scheduler.maxConcurrentRequests = requestLimit;
+    // running uploads finish normally, a higher limit can start more right away
+    [self sendSavedDataAsync];
+}
+
 - (void)sendSavedDataAsync {
     dispatch_async(self.senderTasksQueue, ^{
         [self sendSavedData];
@@ -67,30 +172,263 @@ static NSUInteger const PRESDefaultRequestLimit = 10;
 }
 
 - (void)sendSavedData {
-    @synchronized(self){
-        if(_runningRequestsCount < _maxRequestCount){
-            _runningRequestsCount++;
-            PRESLogDebug(@"INFO: Create new sender thread. Current count is %ld", (long) _runningRequestsCount);
-        }else{
-            return;
-        }
+    if (self.restoringBackgroundUploads) return;
+    
+    if ([PRESBatchUploader sharedUploader].enabled) {
+        // the uploader pulls the bundles through takeBatchChunksWithMaxBytes:
+        [[PRESBatchUploader sharedUploader] flush];
+        return;
+    }
+    
+    NSTimeInterval backoffDelay = [self.backoffPolicy delayForEndpoint:self.endpointKey];
+    if (backoffDelay > 0) {
+        [self scheduleDeferredSendAfter:backoffDelay];
+        return;
+    }
+    
+    PRESUploadDecision decision = [self.scheduler decisionForBacklogCount:[self.persistence persistedBundleCount]];
+    if (decision.action == PRESUploadActionDefer) {
+        [self scheduleDeferredSendAfter:decision.delay];
+        return;
+    }
+    if (decision.action == PRESUploadActionSendInBackgroundSession && [self isURLSessionSupported]) {
+        [self sendSavedDataInBackgroundSession];
+        return;
+    }
+    
+    if (![self acquireSlotWithLimit:MIN(self.maxRequestCount, decision.maxConcurrentRequests)]) {
+        return;
     }
     
     NSString *filePath = [self.persistence requestNextFilePath];
+    if (!filePath) {
+        [self releaseSlot];
+        return;
+    }
+    [self leaseSlotForFilePath:filePath background:NO];
+    
+    // asked last, so an acquired half open probe is always sent
+    backoffDelay = [self.backoffPolicy acquireAttemptForEndpoint:self.endpointKey];
+    if (backoffDelay > 0) {
+        [self releaseLeaseForFilePath:filePath];
+        [self.persistence giveBackRequestedFilePath:filePath];
+        [self scheduleDeferredSendAfter:backoffDelay];
+        return;
+    }
+    
     NSData *data = [self.persistence dataAtFilePath:filePath];
-    [self sendData:data withFilePath:filePath];
+    [self sendData:data withFilePath:filePath inBackgroundSession:NO];
+    
+}
+
+/**
+ *  Hands the next bundle to the background session. These uploads don't hold a request slot, their
+ *  number is limited by maxRequestCount on its own.
+ */
+- (void)sendSavedDataInBackgroundSession {
+    if ([self backgroundUploadCount] >= self.maxRequestCount) return;
+    
+    NSString *filePath = [self.persistence requestNextFilePath];
+    if (!filePath) return;
+    [self leaseSlotForFilePath:filePath background:YES];
+    
+    NSTimeInterval backoffDelay = [self.backoffPolicy acquireAttemptForEndpoint:self.endpointKey];
+    if (backoffDelay > 0) {
+        [self releaseLeaseForFilePath:filePath];
+        [self.persistence giveBackRequestedFilePath:filePath];
+        [self scheduleDeferredSendAfter:backoffDelay];
+        return;
+    }
+    
+    NSData *data = [self.persistence dataAtFilePath:filePath];
+    [self sendData:data withFilePath:filePath inBackgroundSession:YES];
+    [self sendSavedDataAsync];
+}
+
+#pragma mark - PRESBatchChunkSource
+
+- (NSArray<PRESBatchChunk *> *)takeBatchChunksWithMaxBytes:(NSUInteger)maxBytes {
+    NSMutableArray<PRESBatchChunk *> *chunks = [NSMutableArray new];
+    if (self.restoringBackgroundUploads) return chunks;
+    
+    NSUInteger bytes = 0;
+    
+    while (bytes < maxBytes) {
+        NSString *filePath = [self.persistence requestNextFilePath];
+        if (!filePath) break;
+        
+        NSData *data = [self.persistence dataAtFilePath:filePath];
+        if (data.length == 0) {
+            [self.persistence deleteFileAtPath:filePath];
+            continue;
+        }
+        if (chunks.count > 0 && bytes + data.length > maxBytes) {
+            [self.persistence giveBackRequestedFilePath:filePath];
+            break;
+        }
+        
+        __weak typeof(self) weakSelf = self;
+        [chunks addObject:[PRESBatchChunk chunkWithType:PRESBatchChunkTypeTelemetry payload:data completion:^(PRESBatchChunk *chunk, BOOL acknowledged) {
+            typeof(self) strongSelf = weakSelf;
+            if (acknowledged) {
+                [strongSelf.persistence deleteFileAtPath:filePath];
+            } else {
+                pres_stats_add(PRESStatsCounterUploadRetries, 1);
+                [strongSelf.persistence giveBackRequestedFilePath:filePath];
+            }
+        }]];
+        bytes += data.length;
+    }
+    return chunks;
+}
+
+#pragma mark - In-flight slots
+
+- (BOOL)acquireSlotWithLimit:(NSUInteger)limit {
+    [self reclaimStaleLeases];
     
+    NSUInteger count = atomic_load_explicit(&_inFlightCount, memory_order_relaxed);
+    do {
+        if (count >= limit) return NO;
+    } while (!atomic_compare_exchange_weak_explicit(&_inFlightCount, &count, count + 1, memory_order_acq_rel, memory_order_relaxed));
+    
+    PRESLogDebug(@"INFO: Create new sender thread. Current count is %ld", (long) count + 1);
+    return YES;
+}
+
+/**
+ *  Gives back a slot that never got a lease.
+ */
+- (void)releaseSlot {
+    atomic_fetch_sub_explicit(&_inFlightCount, 1, memory_order_acq_rel);
+}
+
+- (void)leaseSlotForFilePath:(NSString *)filePath background:(BOOL)background {
+    PRESUploadLease *lease = [PRESUploadLease new];
+    lease.filePath = filePath;
+    // a data task only starts once the transport has a free slot for it, see markLeaseStartedForFilePath:
+    lease.startTime = background ? pres_monotonic_ns() / (double)NSEC_PER_SEC : 0;
+    lease.background = background;
+    @synchronized(self.leases){
+        PRESUploadLease *existingLease = self.leases[filePath];
+        if (existingLease && !existingLease.background) {
+            // the persistence hands out a path only once, keep the slot count consistent anyway
+            [self releaseSlot];
+        }
+        self.leases[filePath] = lease;
+    }
+}
+
+- (void)markLeaseStartedForFilePath:(NSString *)filePath {
+    @synchronized(self.leases){
+        self.leases[filePath].startTime = pres_monotonic_ns() / (double)NSEC_PER_SEC;
+    }
+}
+
+- (NSUInteger)backgroundUploadCount {
+    NSUInteger count = 0;
+    @synchronized(self.leases){
+        for (PRESUploadLease *lease in self.leases.allValues) {
+            if (lease.background) count++;
+        }
+    }
+    return count;
+}
+
+/**
+ *  Ends the lease of the bundle and frees its slot. Completions that arrive twice or for a
+ *  reclaimed lease find no lease and leave the count untouched.
+ *
+ *  @return NO if there was no lease for the path
+ */
+- (BOOL)releaseLeaseForFilePath:(NSString *)filePath {
+    return [self takeLeaseForFilePath:filePath] != nil;
+}
+
+/**
+ *  Like releaseLeaseForFilePath: but hands out the lease, e.g. for its start time
+ */
+- (PRESUploadLease *)takeLeaseForFilePath:(NSString *)filePath {
+    if (!filePath) return nil;
+    
+    @synchronized(self.leases){
+        PRESUploadLease *lease = self.leases[filePath];
+        if (!lease) return nil;
+        [self.leases removeObjectForKey:filePath];
+        if (!lease.background) {
+            [self releaseSlot];
+        }
+        return lease;
+    }
+}
+
+- (void)reclaimStaleLeases {
+    NSTimeInterval now = pres_monotonic_ns() / (double)NSEC_PER_SEC;
+    NSMutableArray<NSString *> *stalePaths;
+    
+    @synchronized(self.leases){
+        for (PRESUploadLease *lease in self.leases.allValues) {
+            // requests still waiting in the transport are not stale, they have not started yet
+            if (!lease.background && lease.startTime > 0 && now - lease.startTime > PRESSenderStaleLeaseInterval) {
+                if (!stalePaths) stalePaths = [NSMutableArray new];
+                [stalePaths addObject:lease.filePath];
+            }
+        }
+    }
+    
+    for (NSString *filePath in stalePaths) {
+        if ([self releaseLeaseForFilePath:filePath]) {
+            PRESLogWarning(@"WARNING: Reclaimed the upload slot of %@ which did not complete.", filePath.lastPathComponent);
+            [self.persistence giveBackRequestedFilePath:filePath];
+        }
+    }
+}
+
+- (NSArray<NSString *> *)inFlightFilePaths {
+    @synchronized(self.leases){
+        return self.leases.allKeys;
+    }
+}
+
+- (NSUInteger)runningRequestsCount {
+    return atomic_load_explicit(&_inFlightCount, memory_order_relaxed);
+}
+
+- (void)scheduleDeferredSendAfter:(NSTimeInterval)delay {
+    @synchronized(self){
+        if (self.deferredSendScheduled) return;
+        self.deferredSendScheduled = YES;
+    }
+    PRESLogVerbose(@"VERBOSE: Deferring telemetry upload for %.1f seconds.", delay);
+    
+    __weak typeof(self) weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.senderTasksQueue, ^{
+        typeof(self) strongSelf = weakSelf;
+        @synchronized(strongSelf){
+            strongSelf.deferredSendScheduled = NO;
+        }
+        [strongSelf sendSavedData];
+    });
 }
 
 - (void)sendData:(nonnull NSData *)data withFilePath:(nonnull NSString *)filePath {
+    [self sendData:data withFilePath:filePath inBackgroundSession:NO];
+}
+
+- (void)sendData:(NSData *)data withFilePath:(NSString *)filePath inBackgroundSession:(BOOL)inBackgroundSession {
     if (data && data.length > 0) {
-        NSData *gzippedData = [data pres_gzippedData];
+        // compressed here since the background session uploads the body from a file
+        NSData *gzippedData = [PRESTransport gzippedData:data];
         NSURLRequest *request = [self requestForData:gzippedData];
         
-        [self sendRequest:request filePath:filePath];
+        if (inBackgroundSession && filePath) {
+            [self sendUsingBackgroundSessionWithRequest:request filePath:filePath];
+        } else {
+            [self sendRequest:request filePath:filePath];
+        }
     } else {
-        self.runningRequestsCount -= 1;
-        PRESLogDebug(@"INFO: Close sender thread due empty package. Current count is %ld", (long) _runningRequestsCount);
+        [self releaseLeaseForFilePath:filePath];
+        PRESLogDebug(@"INFO: Close sender thread due empty package. Current count is %ld", (long) self.runningRequestsCount);
         // TODO: Delete data and send next file
     }
 }
@@ -98,11 +436,7 @@ static NSUInteger const PRESDefaultRequestLimit = 10;
 - (void)sendRequest:(nonnull NSURLRequest *) request filePath:(nonnull NSString *) path {
     if (!path || !request) {return;}
     
-    if ([self isURLSessionSupported]) {
-        [self sendUsingURLSessionWithRequest:request filePath:path];
-    } else {
-        [self sendUsingURLConnectionWithRequest:request filePath:path];
-    }
+    [self sendUsingTransportWithRequest:request filePath:path];
 }
 
 - (BOOL)isURLSessionSupported {
@@ -111,34 +445,123 @@ static NSUInteger const PRESDefaultRequestLimit = 10;
     return isUrlSessionSupported;
 }
 
-- (void)sendUsingURLConnectionWithRequest:(nonnull NSURLRequest *)request filePath:(nonnull NSString *)filePath {
-    PRESHTTPOperation *operation = [PRESHTTPOperation operationWithRequest:request];
-    [operation setCompletion:^(PRESHTTPOperation *operation, NSData *responseData, NSError *error) {
-        NSInteger statusCode = [operation.response statusCode];
-        [self handleResponseWithStatusCode:statusCode responseData:responseData filePath:filePath error:error];
-    }];
+- (void)sendUsingTransportWithRequest:(nonnull NSURLRequest *)request filePath:(nonnull NSString *)filePath {
+    // no transport retries, the backoff policy decides when the bundle is sent again
+    [[PRESTransport sharedTransport] sendRequest:request
+                                         options:PRESTransportOptionNone
+                                         started:^{
+                                             [self markLeaseStartedForFilePath:filePath];
+                                         }
+                                      completion:^(NSData *data, NSHTTPURLResponse *response, NSError *error) {
+                                          [self handleResponse:response responseData:data filePath:filePath error:error];
+                                      }];
+}
+
+- (void)sendUsingBackgroundSessionWithRequest:(nonnull NSURLRequest *)request filePath:(nonnull NSString *)filePath {
+    // background sessions only upload from files
+    NSString *uploadPath = [self uploadFilePathForFilePath:filePath];
+    if (![request.HTTPBody writeToFile:uploadPath atomically:YES]) {
+        PRESLogWarning(@"WARNING: Could not write upload file, sending with a data task instead.");
+        [self sendUsingTransportWithRequest:request filePath:filePath];
+        return;
+    }
     
-    [self.operationQueue addOperation:operation];
+    NSMutableURLRequest *uploadRequest = [request mutableCopy];
+    uploadRequest.HTTPBody = nil;
+    NSURLSessionUploadTask *task = [self.backgroundSession uploadTaskWithRequest:uploadRequest fromFile:[NSURL fileURLWithPath:uploadPath]];
+    // survives a relaunch, unlike a completion handler
+    task.taskDescription = filePath;
+    @synchronized(self.backgroundResponseData){
+        self.backgroundResponseData[@(task.taskIdentifier)] = [NSMutableData data];
+    }
+    [task resume];
+}
+
+- (NSString *)uploadFilePathForFilePath:(NSString *)filePath {
+    NSString *fileName = [filePath.lastPathComponent stringByAppendingPathExtension:kPRESSenderUploadFileExtension];
+    return [NSTemporaryDirectory() stringByAppendingPathComponent:fileName];
 }
 
-- (void)sendUsingURLSessionWithRequest:(nonnull NSURLRequest *)request filePath:(nonnull NSString *)filePath {
-    NSURLSession *session = self.session;
-    NSURLSessionDataTask *task = [session dataTaskWithRequest:request
-                                            completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
-                                                NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *) response;
-                                                NSInteger statusCode = httpResponse.statusCode;
-                                                [self handleResponseWithStatusCode:statusCode responseData:data filePath:filePath error:error];
-                                            }];
-    [self resumeSessionDataTask:task];
+#pragma mark - NSURLSessionDataDelegate
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data {
+    @synchronized(self.backgroundResponseData){
+        [self.backgroundResponseData[@(dataTask.taskIdentifier)] appendData:data];
+    }
 }
 
-- (void)resumeSessionDataTask:(nonnull NSURLSessionDataTask *)sessionDataTask {
-    [sessionDataTask resume];
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error {
+    NSData *responseData;
+    @synchronized(self.backgroundResponseData){
+        responseData = self.backgroundResponseData[@(task.taskIdentifier)];
+        [self.backgroundResponseData removeObjectForKey:@(task.taskIdentifier)];
+    }
+    
+    NSString *filePath = task.taskDescription;
+    if (!filePath) return;
+    [[NSFileManager defaultManager] removeItemAtPath:[self uploadFilePathForFilePath:filePath] error:nil];
+    
+    NSInteger statusCode = [(NSHTTPURLResponse *)task.response statusCode];
+    if (!responseData) {
+        // started before a relaunch, the response body went away with the old process
+        [self releaseLeaseForFilePath:filePath];
+        if (!error && statusCode > 0 && [self shouldDeleteDataWithStatusCode:statusCode]) {
+            [self.persistence deleteFileAtPath:filePath];
+        } else {
+            [self.persistence giveBackRequestedFilePath:filePath];
+        }
+        return;
+    }
+    [self handleResponse:(NSHTTPURLResponse *)task.response responseData:responseData filePath:filePath error:error];
+}
+
+- (void)URLSessionDidFinishEventsForBackgroundURLSession:(NSURLSession *)session {
+    void (^completionHandler)(void);
+    @synchronized([PRESSender class]){
+        completionHandler = PRESSenderBackgroundSessionCompletionHandler;
+        PRESSenderBackgroundSessionCompletionHandler = nil;
+    }
+    if (!completionHandler) return;
+    
+    // UIKit expects the handler on the main thread, it takes the new app snapshot there
+    dispatch_async(dispatch_get_main_queue(), ^{
+        completionHandler();
+    });
+}
+
+- (void)handleResponse:(NSHTTPURLResponse *)response responseData:(NSData *)responseData filePath:(NSString *)filePath error:(NSError *)error {
+    NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? response.statusCode : 0;
+    NSTimeInterval retryAfter = -1;
+    if (statusCode == 429 || statusCode == 503) {
+        NSString *retryAfterValue = response.allHeaderFields[@"Retry-After"];
+        retryAfter = [PRESBackoffPolicy retryAfterIntervalFromHeaderValue:retryAfterValue now:[[NSDate date] timeIntervalSince1970]];
+    }
+    [self handleResponseWithStatusCode:statusCode responseData:responseData filePath:filePath error:error retryAfter:retryAfter];
 }
 
 - (void)handleResponseWithStatusCode:(NSInteger)statusCode responseData:(nonnull NSData *)responseData filePath:(nonnull NSString *)filePath error:(nonnull NSError *)error {
-    self.runningRequestsCount -= 1;
-    PRESLogDebug(@"INFO: Close sender thread due incoming response. Current count is %ld", (long) _runningRequestsCount);
+    [self handleResponseWithStatusCode:statusCode responseData:responseData filePath:filePath error:error retryAfter:-1];
+}
+
+- (void)handleResponseWithStatusCode:(NSInteger)statusCode responseData:(NSData *)responseData filePath:(NSString *)filePath error:(NSError *)error retryAfter:(NSTimeInterval)retryAfter {
+    PRESUploadLease *lease = [self takeLeaseForFilePath:filePath];
+    if (!lease) {
+        PRESLogDebug(@"INFO: Response for %@ without a lease, the slot was already released.", filePath.lastPathComponent);
+    } else if (lease.startTime > 0) {
+        NSTimeInterval latency = pres_monotonic_ns() / (double)NSEC_PER_SEC - lease.startTime;
+        pres_stats_record(PRESStatsHistogramUploadLatencyMs, (uint64_t)MAX(latency * 1000, 0));
+    }
+    [self.scheduler recordTransfer];
+    PRESLogDebug(@"INFO: Close sender thread due incoming response. Current count is %ld", (long) self.runningRequestsCount);
+    
+    // the server answered with something final, even if it rejected the payload it is healthy
+    BOOL failed = statusCode == 0 || ![self shouldDeleteDataWithStatusCode:statusCode];
+    if (failed) {
+        pres_stats_add(PRESStatsCounterUploadRetries, 1);
+        [self.backoffPolicy recordFailureForEndpoint:self.endpointKey retryAfter:retryAfter];
+    } else {
+        [self.backoffPolicy recordSuccessForEndpoint:self.endpointKey];
+    }
     
     if (responseData && (responseData.length > 0) && [self shouldDeleteDataWithStatusCode:statusCode]) {
         //we delete data that was either sent successfully or if we have a non-recoverable error
@@ -150,6 +573,10 @@ static NSUInteger const PRESDefaultRequestLimit = 10;
         PRESLogError(@"ERROR: Sending telemetry data failed");
         PRESLogError(@"Error description: %@", error.localizedDescription);
         [self.persistence giveBackRequestedFilePath:filePath];
+        if (failed) {
+            // retried once the backoff delay passed, new persistence notifications won't send earlier
+            [self sendSavedDataAsync];
+        }
     }
 }
 
@@ -179,41 +606,39 @@ static NSUInteger const PRESDefaultRequestLimit = 10;
 //some status codes represent recoverable error codes
 //we try sending again some point later
 - (BOOL)shouldDeleteDataWithStatusCode:(NSInteger)statusCode {
-    NSArray<NSNumber *> *recoverableStatusCodes = @[@429, @408, @500, @503, @511];
-    
-    return ![recoverableStatusCodes containsObject:@(statusCode)];
+    switch (statusCode) {
+        case 408:
+        case 429:
+        case 500:
+        case 503:
+        case 511:
+            return NO;
+        default:
+            return YES;
+    }
 }
 
 #pragma mark - Getter/Setter
 
-- (NSURLSession *)session {
-    if (!_session) {
-        NSURLSessionConfiguration *sessionConfiguration = [NSURLSessionConfiguration defaultSessionConfiguration];
-        _session = [NSURLSession sessionWithConfiguration:sessionConfiguration];
-    }
-    return _session;
-}
-
-- (NSOperationQueue *)operationQueue {
-    if (nil == _operationQueue) {
-        _operationQueue = [[NSOperationQueue alloc] init];
-        _operationQueue.maxConcurrentOperationCount = PRESDefaultRequestLimit;
+- (NSURLSession *)backgroundSession {
+    @synchronized(self){
+        if (!_backgroundSession) {
+            NSString *identifier = pres_backgroundSessionIdentifier();
+            NSURLSessionConfiguration *sessionConfiguration;
+            if ([NSURLSessionConfiguration respondsToSelector:@selector(backgroundSessionConfigurationWithIdentifier:)]) {
+                sessionConfiguration = [NSURLSessionConfiguration backgroundSessionConfigurationWithIdentifier:identifier];
+            } else {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+                sessionConfiguration = [NSURLSessionConfiguration backgroundSessionConfiguration:identifier];
+#pragma clang diagnostic pop
+            }
+            // telemetry is never urgent, let the system wait for Wi-Fi and power
+            sessionConfiguration.discretionary = YES;
+            _backgroundSession = [NSURLSession sessionWithConfiguration:sessionConfiguration delegate:self delegateQueue:nil];
+        }
+        return _backgroundSession;
     }
-    return _operationQueue;
-}
-
-- (NSUInteger)runningRequestsCount {
-    __block NSUInteger count;
-    dispatch_sync(_requestsCountQueue, ^{
-        count = _runningRequestsCount;
-    });
-    return count;
-}
-
-- (void)setRunningRequestsCount:(NSUInteger)runningRequestsCount {
-    dispatch_sync(_requestsCountQueue, ^{
-        _runningRequestsCount = runningRequestsCount;
-    });
 }
 
 @end
@@ -13,6 +13,7 @@
         _dataTypeName = @"SessionStateData";
         _version = @2;
         _state = PRESSessionState_start;
+        self.priority = PRESTelemetryPriorityHigh;
     }
     return self;
 }
@@ -30,12 +30,7 @@ NS_ASSUME_NONNULL_BEGIN
 @property(nonatomic, copy) NSString *appIdentifier;
 
 /**
- *  A queue which makes array operations thread safe.
- */
-@property (nonatomic, strong) dispatch_queue_t operationsQueue;
-
-/**
- *  The application context.
+ *  The application context. Change values with the setters, so a new snapshot gets published.
  */
 @property(nonatomic, strong, readonly) PRESApplication *application;
 
@@ -74,13 +69,16 @@ NS_ASSUME_NONNULL_BEGIN
 ///-----------------------------------------------------------------------------
 
 /**
- *  A dictionary which holds static tag fields for the purpose of caching
+ *  A dictionary which holds the application, internal and device fields of the current snapshot
  */
-@property (nonatomic, strong) NSDictionary *tags;
+@property (nonatomic, strong, readonly) NSDictionary *tags;
 
 /**
  *  Returns context objects as dictionary.
  *
+ *  The dictionary is built when a context value changes, calling this method only reads
+ *  the current immutable snapshot.
+ *
  *  @return a dictionary containing all context fields
  */
 - (NSDictionary *)contextDictionary;
@@ -7,7 +7,41 @@
 
 NSString *const kPRESUserMetaData = @"PRESUserMetaData";
 
-static char *const PRESContextOperationsQueue = "net.hockeyapp.telemetryContextQueue";
+/**
+ *  Immutable state of the context at one point in time
+ */
+@interface PRESTelemetryContextSnapshot : NSObject
+
+@property (nonatomic, copy, readonly) NSString *appIdentifier;
+@property (nonatomic, copy, readonly) NSDictionary *tags;
+@property (nonatomic, copy, readonly) NSDictionary *contextDictionary;
+
+- (instancetype)initWithAppIdentifier:(NSString *)appIdentifier tags:(NSDictionary *)tags contextDictionary:(NSDictionary *)contextDictionary;
+
+@end
+
+@implementation PRESTelemetryContextSnapshot
+
+- (instancetype)initWithAppIdentifier:(NSString *)appIdentifier tags:(NSDictionary *)tags contextDictionary:(NSDictionary *)contextDictionary {
+    if ((self = [super init])) {
+        _appIdentifier = [appIdentifier copy];
+        _tags = [tags copy];
+        _contextDictionary = [contextDictionary copy];
+    }
+    return self;
+}
+
+@end
+
+@interface PRESTelemetryContext ()
+
+/**
+ *  The current snapshot. Published with an atomic store, so getters never wait for writers
+ *  and never hop onto a queue.
+ */
+@property (atomic, strong) PRESTelemetryContextSnapshot *snapshot;
+
+@end
 
 @implementation PRESTelemetryContext
 
@@ -19,7 +53,7 @@ static char *const PRESContextOperationsQueue = "net.hockeyapp.telemetryContextQ
 -(instancetype)init {
     
     if(self = [super init]) {
-        _operationsQueue = dispatch_queue_create(PRESContextOperationsQueue, DISPATCH_QUEUE_CONCURRENT);
+        _snapshot = [PRESTelemetryContextSnapshot new];
     }
     return self;
 }
@@ -59,7 +93,7 @@ static char *const PRESContextOperationsQueue = "net.hockeyapp.telemetryContextQ
         _user = userContext;
         _internal = internalContext;
         _session = sessionContext;
-        _tags = [self tags];
+        [self updateContext:nil];
     }
     return self;
 }
@@ -79,14 +113,20 @@ static char *const PRESContextOperationsQueue = "net.hockeyapp.telemetryContextQ
 }
 
 - (void)saveUser:(PRESUser *)user{
-    NSDictionary *userMetaData = @{kPRESUserMetaData : user};
-    [self.persistence persistMetaData:userMetaData];
+    [self.persistence persistMetaData:[user serializeToDictionary]];
 }
 
 - (nullable PRESUser *)loadUser{
     NSDictionary *metaData =[self.persistence metaData];
-    PRESUser *user = [metaData objectForKey:kPRESUserMetaData];
-    return user;
+    
+    // Migrate the keyed archive written by older SDK versions
+    id legacyUser = [metaData objectForKey:kPRESUserMetaData];
+    if ([legacyUser isKindOfClass:[PRESUser class]]) {
+        [self saveUser:legacyUser];
+        return legacyUser;
+    }
+    
+    return [PRESUser userWithDictionary:metaData];
 }
 
 #pragma mark - Network
@@ -94,281 +134,225 @@ static char *const PRESContextOperationsQueue = "net.hockeyapp.telemetryContextQ
 #pragma mark - Getter/Setter properties
 
 - (NSString *)appIdentifier {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _appIdentifier;
-    });
-    return tmp;
+    return self.snapshot.appIdentifier;
 }
 
 - (void)setAppIdentifier:(NSString *)appIdentifier {
     NSString* tmp = [appIdentifier copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _appIdentifier = tmp;
-    });
+    }];
 }
 
 - (NSString *)screenResolution {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _device.screenResolution;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.device.screenResolution"];
 }
 
 - (void)setScreenResolution:(NSString *)screenResolution {
     NSString* tmp = [screenResolution copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _device.screenResolution = tmp;
-    });
+    }];
 }
 
 - (NSString *)appVersion {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _application.version;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.application.ver"];
 }
 
 - (void)setAppVersion:(NSString *)appVersion {
     NSString* tmp = [appVersion copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _application.version = tmp;
-    });
+    }];
 }
 
 - (NSString *)anonymousUserId {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _user.userId;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.user.id"];
 }
 
 - (void)setAnonymousUserId:(NSString *)userId {
     NSString* tmp = [userId copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _user.userId = tmp;
-    });
+    }];
 }
 
 - (NSString *)anonymousUserAquisitionDate {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _user.anonUserAcquisitionDate;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.user.anonUserAcquisitionDate"];
 }
 
 - (void)setAnonymousUserAquisitionDate:(NSString *)anonymousUserAquisitionDate {
     NSString* tmp = [anonymousUserAquisitionDate copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _user.anonUserAcquisitionDate = tmp;
-    });
+    }];
 }
 
 - (NSString *)sdkVersion {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _internal.sdkVersion;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.internal.sdkVersion"];
 }
 
 - (void)setSdkVersion:(NSString *)sdkVersion {
     NSString* tmp = [sdkVersion copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _internal.sdkVersion = tmp;
-    });
+    }];
 }
 
 - (NSString *)sessionId {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _session.sessionId;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.session.id"];
 }
 
 - (void)setSessionId:(NSString *)sessionId {
     NSString* tmp = [sessionId copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _session.sessionId = tmp;
-    });
+    }];
 }
 
 - (NSString *)isFirstSession {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _session.isFirst;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.session.isFirst"];
 }
 
 - (void)setIsFirstSession:(NSString *)isFirstSession {
     NSString* tmp = [isFirstSession copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _session.isFirst = tmp;
-    });
+    }];
 }
 
 - (NSString *)isNewSession {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _session.isNew;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.session.isNew"];
 }
 
 - (void)setIsNewSession:(NSString *)isNewSession {
     NSString* tmp = [isNewSession copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _session.isNew = tmp;
-    });
+    }];
 }
 
 - (NSString *)osVersion {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _device.osVersion;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.device.osVersion"];
 }
 
 - (void)setOsVersion:(NSString *)osVersion {
     NSString* tmp = [osVersion copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _device.osVersion = tmp;
-    });
+    }];
 }
 
 - (NSString *)osName {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _device.os;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.device.os"];
 }
 
 - (void)setOsName:(NSString *)osName {
     NSString* tmp = [osName copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _device.os = tmp;
-    });
+    }];
 }
 
 - (NSString *)deviceModel {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _device.model;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.device.model"];
 }
 
 - (void)setDeviceModel:(NSString *)deviceModel {
     NSString* tmp = [deviceModel copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _device.model = tmp;
-    });
+    }];
 }
 
 - (NSString *)deviceOemName {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _device.oemName;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.device.oemName"];
 }
 
 - (void)setDeviceOemName:(NSString *)oemName {
     NSString* tmp = [oemName copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _device.oemName = tmp;
-    });
+    }];
 }
 
 - (NSString *)osLocale {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _device.locale;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.device.locale"];
 }
 
 - (void)setOsLocale:(NSString *)osLocale {
     NSString* tmp = [osLocale copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _device.locale = tmp;
-    });
+    }];
 }
 
 - (NSString *)osLanguage {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _device.language;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.device.language"];
 }
 
 - (void)setOsLanguage:(NSString *)osLanguage {
     NSString* tmp = [osLanguage copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _device.language = tmp;
-    });
+    }];
 }
 
 - (NSString *)deviceId {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _device.deviceId;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.device.id"];
 }
 
 - (void)setDeviceId:(NSString *)deviceId {
     NSString* tmp = [deviceId copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _device.deviceId = tmp;
-    });
+    }];
 }
 
 - (NSString *)deviceType {
-    __block NSString *tmp;
-    dispatch_sync(_operationsQueue, ^{
-        tmp = _device.type;
-    });
-    return tmp;
+    return self.snapshot.contextDictionary[@"ai.device.type"];
 }
 
 - (void)setDeviceType:(NSString *)deviceType {
     NSString* tmp = [deviceType copy];
-    dispatch_barrier_async(_operationsQueue, ^{
+    [self updateContext:^{
         _device.type = tmp;
-    });
+    }];
 }
 
 #pragma mark - Custom getter
 #pragma mark - Helper
 
 - (NSDictionary *)contextDictionary {
-    NSMutableDictionary *contextDictionary = [NSMutableDictionary new];
-    [contextDictionary addEntriesFromDictionary:self.tags];
-    [contextDictionary addEntriesFromDictionary:[self.session serializeToDictionary]];
-    [contextDictionary addEntriesFromDictionary:[self.user serializeToDictionary]];
-    
-    return contextDictionary;
+    return self.snapshot.contextDictionary;
 }
 
 - (NSDictionary *)tags {
-    if(!_tags){
+    return self.snapshot.tags;
+}
+
+/**
+ * Applies the changes to the context objects and publishes a new snapshot. Writers are
+ * serialized, readers keep using the snapshot they already hold.
+ */
+- (void)updateContext:(void (^)(void))changes {
+    @synchronized (self) {
+        if (changes) {
+            changes();
+        }
+        
         NSMutableDictionary *tags = [self.application serializeToDictionary].mutableCopy;
-        [tags addEntriesFromDictionary:[self.application serializeToDictionary]];
         [tags addEntriesFromDictionary:[self.internal serializeToDictionary]];
         [tags addEntriesFromDictionary:[self.device serializeToDictionary]];
-        _tags = tags;
+        
+        NSMutableDictionary *contextDictionary = tags.mutableCopy;
+        [contextDictionary addEntriesFromDictionary:[self.session serializeToDictionary]];
+        [contextDictionary addEntriesFromDictionary:[self.user serializeToDictionary]];
+        
+        self.snapshot = [[PRESTelemetryContextSnapshot alloc] initWithAppIdentifier:_appIdentifier
+                                                                                 tags:tags
+                                                                    contextDictionary:contextDictionary];
     }
-    return _tags;
 }
 
 @end
@@ -1,4 +1,5 @@
 #import "PRESTelemetryObject.h"
+#import "PRESEnums.h"
 
 #import "PRESNullability.h"
 NS_ASSUME_NONNULL_BEGIN
@@ -13,6 +14,11 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, copy) NSString *name;
 @property (nonatomic, strong) NSDictionary *properties;
 
+/**
+ *  Lane of the item in the channel, not part of the payload. Default: PRESTelemetryPriorityNormal
+ */
+@property (nonatomic, assign) PRESTelemetryPriority priority;
+
 @end
 
 NS_ASSUME_NONNULL_END
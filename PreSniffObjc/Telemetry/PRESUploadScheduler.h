@@ -0,0 +1,96 @@
+//
+//  PRESUploadScheduler.h
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 15/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class PRESReachability;
+
+#import "PRESNullability.h"
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, PRESUploadAction) {
+    /**
+     *  Send with a regular data task right away
+     */
+    PRESUploadActionSend = 0,
+    /**
+     *  Hand the upload to the background URL session, the system picks the time
+     */
+    PRESUploadActionSendInBackgroundSession = 1,
+    /**
+     *  Do not send now, ask again after the delay
+     */
+    PRESUploadActionDefer = 2
+};
+
+typedef struct {
+    PRESUploadAction action;
+    NSUInteger maxConcurrentRequests;
+    NSTimeInterval delay;
+} PRESUploadDecision;
+
+/**
+ *  Decides when the sender uploads persisted bundles, so that sends are coalesced into few radio wake ups.
+ *
+ *  - offline nothing is sent, the sender retries once the network becomes reachable
+ *  - on Wi-Fi bundles are sent right away
+ *  - on cellular bundles are sent while the radio is still active from the last transfer or once
+ *    cellularBurstBacklog bundles are waiting, otherwise the first waiting bundle is held back for at
+ *    most cellularCoalescingInterval so the following ones go out in the same window
+ *  - in low power mode the coalescing interval is quadrupled and only one request runs at a time
+ *  - while the app is in the background the uploads are handed to the background URL session, in the
+ *    foreground a discretionary upload could wait for hours
+ *
+ *  Thread safe.
+ */
+@interface PRESUploadScheduler : NSObject
+
+/**
+ *  Reachability used to look up the network state, defaults to the shared instance (testing).
+ */
+@property (nonatomic, strong, null_resettable) PRESReachability *reachability;
+
+/**
+ *  Monotonic time in seconds, defaults to mach_absolute_time (testing).
+ */
+@property (nonatomic, copy, null_resettable) NSTimeInterval (^clock)(void);
+
+/**
+ *  Kept up to date from UIApplication and NSProcessInfo notifications, can be set directly (testing).
+ */
+@property (atomic, assign, getter=isApplicationInBackground) BOOL applicationInBackground;
+@property (atomic, assign, getter=isLowPowerModeEnabled) BOOL lowPowerModeEnabled;
+
+@property (atomic, assign) NSUInteger maxConcurrentRequests;
+@property (atomic, assign) NSTimeInterval radioTailInterval;
+@property (atomic, assign) NSTimeInterval cellularCoalescingInterval;
+@property (atomic, assign) NSUInteger cellularBurstBacklog;
+
+/**
+ *  Delay before trying again while the network is unreachable.
+ */
+@property (atomic, assign) NSTimeInterval offlineRetryInterval;
+
+/**
+ *  Creates a scheduler which also observes app state and low power mode changes.
+ */
+- (instancetype)init;
+
+/**
+ *  @param backlogCount number of persisted bundles waiting to be sent
+ */
+- (PRESUploadDecision)decisionForBacklogCount:(NSUInteger)backlogCount;
+
+/**
+ *  Call whenever a request finished, the radio stays active for radioTailInterval afterwards.
+ */
+- (void)recordTransfer;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,171 @@
+//
+//  PRESUploadScheduler.m
+//  PreSniffSDK
+//
+//  Created by WangSiyu on 15/06/2017.
+//  Copyright © 2017 pre-engineering. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#import "PRESUploadScheduler.h"
+#import "PRESReachability.h"
+#import "PRESTime.h"
+
+static NSUInteger const PRESUploadDefaultMaxConcurrentRequests = 10;
+static NSUInteger const PRESUploadCellularMaxConcurrentRequests = 2;
+
+// Cellular radios stay in the high power state for several seconds after the last packet
+static NSTimeInterval const PRESUploadDefaultRadioTailInterval = 8;
+static NSTimeInterval const PRESUploadDefaultCellularCoalescingInterval = 60;
+static NSTimeInterval const PRESUploadDefaultOfflineRetryInterval = 300;
+static NSUInteger const PRESUploadDefaultCellularBurstBacklog = 4;
+static double const PRESUploadLowPowerIntervalFactor = 4;
+
+@interface PRESUploadScheduler ()
+
+@property (nonatomic, strong) id<NSObject> appDidEnterBackgroundObserver;
+@property (nonatomic, strong) id<NSObject> appWillEnterForegroundObserver;
+@property (nonatomic, strong) id<NSObject> powerStateObserver;
+
+@end
+
+@implementation PRESUploadScheduler {
+    NSTimeInterval _lastTransfer;
+    NSTimeInterval _firstDeferral;
+}
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _maxConcurrentRequests = PRESUploadDefaultMaxConcurrentRequests;
+        _radioTailInterval = PRESUploadDefaultRadioTailInterval;
+        _cellularCoalescingInterval = PRESUploadDefaultCellularCoalescingInterval;
+        _cellularBurstBacklog = PRESUploadDefaultCellularBurstBacklog;
+        _offlineRetryInterval = PRESUploadDefaultOfflineRetryInterval;
+        _lastTransfer = -DBL_MAX;
+        _firstDeferral = -1;
+        [self registerObservers];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+    if (self.appDidEnterBackgroundObserver) [center removeObserver:self.appDidEnterBackgroundObserver];
+    if (self.appWillEnterForegroundObserver) [center removeObserver:self.appWillEnterForegroundObserver];
+    if (self.powerStateObserver) [center removeObserver:self.powerStateObserver];
+}
+
+- (void)registerObservers {
+    NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+    __weak typeof(self) weakSelf = self;
+
+    self.appDidEnterBackgroundObserver = [center addObserverForName:UIApplicationDidEnterBackgroundNotification
+                                                             object:nil
+                                                              queue:nil
+                                                         usingBlock:^(NSNotification *note) {
+                                                             typeof(self) strongSelf = weakSelf;
+                                                             strongSelf.applicationInBackground = YES;
+                                                         }];
+    self.appWillEnterForegroundObserver = [center addObserverForName:UIApplicationWillEnterForegroundNotification
+                                                              object:nil
+                                                               queue:nil
+                                                          usingBlock:^(NSNotification *note) {
+                                                              typeof(self) strongSelf = weakSelf;
+                                                              strongSelf.applicationInBackground = NO;
+                                                          }];
+
+    NSProcessInfo *processInfo = [NSProcessInfo processInfo];
+    if ([processInfo respondsToSelector:@selector(isLowPowerModeEnabled)]) {
+        _lowPowerModeEnabled = processInfo.lowPowerModeEnabled;
+        self.powerStateObserver = [center addObserverForName:NSProcessInfoPowerStateDidChangeNotification
+                                                      object:nil
+                                                       queue:nil
+                                                  usingBlock:^(NSNotification *note) {
+                                                      typeof(self) strongSelf = weakSelf;
+                                                      strongSelf.lowPowerModeEnabled = [NSProcessInfo processInfo].lowPowerModeEnabled;
+                                                  }];
+    }
+}
+
+#pragma mark - Dependencies
+
+- (PRESReachability *)reachability {
+    return _reachability ?: [PRESReachability sharedInstance];
+}
+
+- (NSTimeInterval (^)(void))clock {
+    if (!_clock) {
+        return ^NSTimeInterval {
+            return pres_monotonic_ns() / (double)NSEC_PER_SEC;
+        };
+    }
+    return _clock;
+}
+
+#pragma mark - Policy
+
+- (void)recordTransfer {
+    NSTimeInterval now = self.clock();
+    @synchronized (self) {
+        _lastTransfer = now;
+    }
+}
+
+- (PRESUploadDecision)decisionForBacklogCount:(NSUInteger)backlogCount {
+    PRESUploadDecision decision;
+    decision.action = PRESUploadActionSend;
+    decision.maxConcurrentRequests = self.lowPowerModeEnabled ? 1 : self.maxConcurrentRequests;
+    decision.delay = 0;
+
+    PRESReachabilityStatus status = self.reachability.status;
+    if (status == PRESReachabilityStatusNotReachable) {
+        decision.action = PRESUploadActionDefer;
+        decision.delay = self.offlineRetryInterval;
+        return decision;
+    }
+
+    if (self.applicationInBackground) {
+        [self resetDeferral];
+        decision.action = PRESUploadActionSendInBackgroundSession;
+        return decision;
+    }
+
+    // Wi-Fi and an unknown state (monitoring not started yet) do not need coalescing
+    if (status != PRESReachabilityStatusViaWWAN) {
+        [self resetDeferral];
+        return decision;
+    }
+
+    decision.maxConcurrentRequests = MIN(decision.maxConcurrentRequests, PRESUploadCellularMaxConcurrentRequests);
+    NSTimeInterval now = self.clock();
+    NSTimeInterval coalescingInterval = self.cellularCoalescingInterval * (self.lowPowerModeEnabled ? PRESUploadLowPowerIntervalFactor : 1);
+
+    @synchronized (self) {
+        BOOL radioActive = now - _lastTransfer < self.radioTailInterval;
+        if (radioActive || backlogCount >= self.cellularBurstBacklog) {
+            _firstDeferral = -1;
+            return decision;
+        }
+
+        if (_firstDeferral < 0) {
+            _firstDeferral = now;
+        }
+        NSTimeInterval remaining = _firstDeferral + coalescingInterval - now;
+        if (remaining <= 0) {
+            _firstDeferral = -1;
+            return decision;
+        }
+
+        decision.action = PRESUploadActionDefer;
+        decision.delay = remaining;
+        return decision;
+    }
+}
+
+- (void)resetDeferral {
+    @synchronized (self) {
+        _firstDeferral = -1;
+    }
+}
+
+@end
@@ -11,6 +11,13 @@
 @property (nonatomic, copy) NSString *anonUserAcquisitionDate;
 @property (nonatomic, copy) NSString *authUserAcquisitionDate;
 
+/**
+ *  Creates a user from the dictionary returned by serializeToDictionary
+ *
+ *  @return the user or nil if the dictionary does not contain a user id
+ */
++ (instancetype)userWithDictionary:(NSDictionary *)dictionary;
+
 - (BOOL)isEqualToUser:(PRESUser *)aUser;
 
 @end
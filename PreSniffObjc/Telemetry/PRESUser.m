@@ -36,6 +36,28 @@
     return dict;
 }
 
++ (instancetype)userWithDictionary:(NSDictionary *)dictionary {
+    NSString *(^stringForKey)(NSString *) = ^NSString *(NSString *key) {
+        id value = dictionary[key];
+        return [value isKindOfClass:[NSString class]] ? value : nil;
+    };
+    
+    if (!stringForKey(@"ai.user.id")) {
+        return nil;
+    }
+    
+    PRESUser *user = [self new];
+    user.accountAcquisitionDate = stringForKey(@"ai.user.accountAcquisitionDate");
+    user.accountId = stringForKey(@"ai.user.accountId");
+    user.userAgent = stringForKey(@"ai.user.userAgent");
+    user.userId = stringForKey(@"ai.user.id");
+    user.storeRegion = stringForKey(@"ai.user.storeRegion");
+    user.authUserId = stringForKey(@"ai.user.authUserId");
+    user.anonUserAcquisitionDate = stringForKey(@"ai.user.anonUserAcquisitionDate");
+    user.authUserAcquisitionDate = stringForKey(@"ai.user.authUserAcquisitionDate");
+    return user;
+}
+
 #pragma mark - NSCoding
 
 - (instancetype)initWithCoder:(NSCoder *)coder {